@@ -103,7 +103,12 @@ int feedback_send(struct ouvr_ctx *ctx)
     register ssize_t r;
     // tells sending side to ignore any feedback we send for the next [to_send] frames
     // which prevents sending too much bandwidth with several iframes in a row
-    int to_send = ctx->flag_send_iframe;
+    ouvr_feedback_msg to_send = {
+        .send_iframe = ctx->flag_send_iframe,
+        .max_width = ctx->display_width,
+        .max_height = ctx->display_height,
+        .max_fps = ctx->display_fps,
+    };
     c->iov[0].iov_len = sizeof(to_send);
     c->iov[0].iov_base = &to_send;
 
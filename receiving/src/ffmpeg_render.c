@@ -0,0 +1,360 @@
+/*
+    The MIT License (MIT)
+
+    Copyright (c) 2020 OpenUVR
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+
+    Authors:
+    Alec Rohloff
+    Zackary Allen
+    Kung-Min Lin
+    Chengyi Nie
+    Hung-Wei Tseng
+*/
+/**
+ * H.264 decoding on the cpu with libavcodec, for receivers without a VideoCore and for running the whole chain on one
+ * machine. The packets of a frame sent in slices are gathered and decoded as one access unit once the frame ends.
+ * Decoded frames go to the sink chosen in openuvr_software_decoder_config: nowhere, a raw file, or a shared memory
+ * region laid out like the one the sender reads frames from, so that a viewer can show them.
+ */
+#include "ouvr_packet.h"
+#include "openuvr.h"
+#include "ffmpeg_render.h"
+#include "ouvr_shm_producer.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include <libavcodec/avcodec.h>
+#include <libavutil/imgutils.h>
+#include <libswscale/swscale.h>
+
+typedef struct ffmpeg_render_priv
+{
+    AVCodecContext *dec_ctx;
+    AVPacket *av_pkt;
+    AVFrame *frame;
+    // the slices of the frame being received, with AV_INPUT_BUFFER_PADDING_SIZE zeroes after them
+    uint8_t *au;
+    int au_size;
+    int au_capacity;
+    uint32_t au_frame_id;
+
+    enum OPENUVR_SINK_TYPE sink;
+    char *sink_path;
+    FILE *file;
+    // OPENUVR_SINK_FILE: a frame packed without the decoder's row padding
+    uint8_t *file_buf;
+    int file_buf_size;
+    // OPENUVR_SINK_SHM: recreated whenever the stream changes size
+    struct ouvr_shm_producer *shm;
+    int shm_width;
+    int shm_height;
+    struct SwsContext *sws;
+
+    // stats is read from other threads
+    pthread_mutex_t stats_lock;
+    struct openuvr_decoder_stats stats;
+    float avg_decode_usec;
+    // spent in the decoder since the last frame came out of it. With frame threading that is an older frame than the
+    // one just sent, so a frame is counted with what the decoder took since the one before it
+    long pending_usec;
+} ffmpeg_render_priv;
+
+static long usec_between(const struct timespec *start, const struct timespec *end)
+{
+    return (end->tv_sec - start->tv_sec) * 1000000 + (end->tv_nsec - start->tv_nsec) / 1000;
+}
+
+static void ffmpeg_render_deinitialize(struct ouvr_ctx *ctx)
+{
+    ffmpeg_render_priv *p = ctx->dec_priv;
+    if (p == NULL)
+    {
+        return;
+    }
+    avcodec_free_context(&p->dec_ctx);
+    av_packet_free(&p->av_pkt);
+    av_frame_free(&p->frame);
+    free(p->au);
+    if (p->file != NULL)
+    {
+        fclose(p->file);
+    }
+    free(p->file_buf);
+    ouvr_shm_producer_destroy(p->shm);
+    sws_freeContext(p->sws);
+    free(p->sink_path);
+    pthread_mutex_destroy(&p->stats_lock);
+    free(p);
+    ctx->dec_priv = NULL;
+}
+
+static int ffmpeg_render_initialize(struct ouvr_ctx *ctx)
+{
+    const struct openuvr_software_decoder_config defaults = {.threads = 0, .frame_threading = 0, .sink = OPENUVR_SINK_NULL};
+    const struct openuvr_software_decoder_config *config = ctx->dec_config != NULL ? ctx->dec_config : &defaults;
+    ffmpeg_render_priv *p = calloc(1, sizeof(ffmpeg_render_priv));
+    if (p == NULL)
+    {
+        return -1;
+    }
+    ctx->dec_priv = p;
+    pthread_mutex_init(&p->stats_lock, NULL);
+    p->sink = config->sink;
+
+    if (p->sink != OPENUVR_SINK_NULL)
+    {
+        if (config->sink_path == NULL)
+        {
+            printf("the software decoder's sink needs a path\n");
+            goto err;
+        }
+        p->sink_path = strdup(config->sink_path);
+    }
+    if (p->sink == OPENUVR_SINK_FILE && (p->file = fopen(p->sink_path, "wb")) == NULL)
+    {
+        printf("couldn't open %s for the decoded frames\n", p->sink_path);
+        goto err;
+    }
+
+#if LIBAVCODEC_VERSION_INT < AV_VERSION_INT(58, 9, 100)
+    avcodec_register_all();
+#endif
+    const AVCodec *codec = avcodec_find_decoder(AV_CODEC_ID_H264);
+    if (codec == NULL)
+    {
+        printf("libavcodec has no H.264 decoder\n");
+        goto err;
+    }
+    p->dec_ctx = avcodec_alloc_context3(codec);
+    p->av_pkt = av_packet_alloc();
+    p->frame = av_frame_alloc();
+    if (p->dec_ctx == NULL || p->av_pkt == NULL || p->frame == NULL)
+    {
+        goto err;
+    }
+    p->dec_ctx->thread_count = config->threads;
+    if (config->frame_threading)
+    {
+        p->dec_ctx->thread_type = FF_THREAD_FRAME;
+    }
+    else
+    {
+        // libavcodec turns frame threading off for low delay anyway
+        p->dec_ctx->thread_type = FF_THREAD_SLICE;
+        p->dec_ctx->flags |= AV_CODEC_FLAG_LOW_DELAY;
+    }
+    if (avcodec_open2(p->dec_ctx, codec, NULL) < 0)
+    {
+        printf("avcodec_open2 failed\n");
+        goto err;
+    }
+    printf("software H.264 decoder on %d threads with %s threading\n", p->dec_ctx->thread_count,
+           p->dec_ctx->active_thread_type == FF_THREAD_FRAME ? "frame" : "slice");
+    return 0;
+
+err:
+    ffmpeg_render_deinitialize(ctx);
+    return -1;
+}
+
+static int write_file(ffmpeg_render_priv *p, const AVFrame *frame)
+{
+    int size = av_image_get_buffer_size(frame->format, frame->width, frame->height, 1);
+    if (size < 0)
+    {
+        return -1;
+    }
+    if (size > p->file_buf_size)
+    {
+        uint8_t *buf = realloc(p->file_buf, size);
+        if (buf == NULL)
+        {
+            return -1;
+        }
+        p->file_buf = buf;
+        p->file_buf_size = size;
+    }
+    av_image_copy_to_buffer(p->file_buf, size, (const uint8_t *const *)frame->data, frame->linesize, frame->format, frame->width, frame->height, 1);
+    if (fwrite(p->file_buf, 1, size, p->file) != (size_t)size)
+    {
+        printf("couldn't write a decoded frame to %s\n", p->sink_path);
+        return -1;
+    }
+    return 0;
+}
+
+static int write_shm(ffmpeg_render_priv *p, const AVFrame *frame)
+{
+    if (p->shm == NULL || frame->width != p->shm_width || frame->height != p->shm_height)
+    {
+        ouvr_shm_producer_destroy(p->shm);
+        p->shm = ouvr_shm_producer_create(p->sink_path, frame->width, frame->height);
+        if (p->shm == NULL)
+        {
+            return -1;
+        }
+        p->shm_width = frame->width;
+        p->shm_height = frame->height;
+    }
+    p->sws = sws_getCachedContext(p->sws, frame->width, frame->height, frame->format, frame->width, frame->height, AV_PIX_FMT_RGBA, SWS_FAST_BILINEAR, NULL, NULL, NULL);
+    if (p->sws == NULL)
+    {
+        printf("sws_getCachedContext failed\n");
+        return -1;
+    }
+    uint8_t *dst[1] = {ouvr_shm_producer_begin_frame(p->shm)};
+    int dst_stride[1] = {frame->width * 4};
+    sws_scale(p->sws, (const uint8_t *const *)frame->data, frame->linesize, 0, frame->height, dst, dst_stride);
+    return ouvr_shm_producer_end_frame(p->shm, 0);
+}
+
+static int write_sink(ffmpeg_render_priv *p, const AVFrame *frame)
+{
+    switch (p->sink)
+    {
+    case OPENUVR_SINK_FILE:
+        return write_file(p, frame);
+    case OPENUVR_SINK_SHM:
+        return write_shm(p, frame);
+    case OPENUVR_SINK_NULL:
+    default:
+        return 0;
+    }
+}
+
+static void count_frame(ffmpeg_render_priv *p, const AVFrame *frame, long usec)
+{
+    pthread_mutex_lock(&p->stats_lock);
+    p->avg_decode_usec = p->stats.frames_decoded == 0 ? usec : 0.95 * p->avg_decode_usec + 0.05 * usec;
+    p->stats.frames_decoded++;
+    p->stats.last_decode_usec = usec;
+    p->stats.avg_decode_usec = p->avg_decode_usec;
+    if (usec > p->stats.max_decode_usec)
+    {
+        p->stats.max_decode_usec = usec;
+    }
+    p->stats.width = frame->width;
+    p->stats.height = frame->height;
+    pthread_mutex_unlock(&p->stats_lock);
+#ifdef TIME_DECODING
+    printf("\r\033[60Cdec avg: %f, actual: %ld", p->avg_decode_usec, usec);
+#endif
+}
+
+static void count_error(struct ouvr_ctx *ctx, ffmpeg_render_priv *p)
+{
+    pthread_mutex_lock(&p->stats_lock);
+    p->stats.decode_errors++;
+    pthread_mutex_unlock(&p->stats_lock);
+    // the frames after it are missing their reference until the next keyframe
+    ctx->flag_send_iframe = 1;
+}
+
+static int ffmpeg_render_process_packet(struct ouvr_ctx *ctx, struct ouvr_packet *pkt)
+{
+    ffmpeg_render_priv *p = ctx->dec_priv;
+    // the end of the frame before was lost, what there is of it can't be decoded on its own
+    if (p->au_size > 0 && pkt->frame_id != p->au_frame_id)
+    {
+        p->au_size = 0;
+        count_error(ctx, p);
+    }
+    p->au_frame_id = pkt->frame_id;
+    if (p->au_size + pkt->size + AV_INPUT_BUFFER_PADDING_SIZE > p->au_capacity)
+    {
+        int capacity = p->au_size + pkt->size + AV_INPUT_BUFFER_PADDING_SIZE;
+        uint8_t *au = realloc(p->au, capacity);
+        if (au == NULL)
+        {
+            return -1;
+        }
+        p->au = au;
+        p->au_capacity = capacity;
+    }
+    memcpy(p->au + p->au_size, pkt->data, pkt->size);
+    p->au_size += pkt->size;
+    if (!(pkt->flags & OUVR_PACKET_FLAG_END_OF_FRAME) || p->au_size == 0)
+    {
+        return 0;
+    }
+    memset(p->au + p->au_size, 0, AV_INPUT_BUFFER_PADDING_SIZE);
+    p->av_pkt->data = p->au;
+    p->av_pkt->size = p->au_size;
+    p->av_pkt->flags = pkt->flags & OUVR_PACKET_FLAG_KEYFRAME ? AV_PKT_FLAG_KEY : 0;
+    p->au_size = 0;
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int ret = avcodec_send_packet(p->dec_ctx, p->av_pkt);
+    if (ret < 0)
+    {
+        count_error(ctx, p);
+        return 0;
+    }
+    while (1)
+    {
+        ret = avcodec_receive_frame(p->dec_ctx, p->frame);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        p->pending_usec += usec_between(&start, &end);
+        if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF)
+        {
+            break;
+        }
+        if (ret < 0)
+        {
+            count_error(ctx, p);
+            break;
+        }
+        count_frame(p, p->frame, p->pending_usec);
+        p->pending_usec = 0;
+        if (p->frame->key_frame)
+        {
+            ctx->flag_send_iframe = 0;
+        }
+        ret = write_sink(p, p->frame);
+        av_frame_unref(p->frame);
+        if (ret != 0)
+        {
+            return -1;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &start);
+    }
+    return 0;
+}
+
+static int ffmpeg_render_get_stats(struct ouvr_ctx *ctx, struct openuvr_decoder_stats *stats)
+{
+    ffmpeg_render_priv *p = ctx->dec_priv;
+    pthread_mutex_lock(&p->stats_lock);
+    *stats = p->stats;
+    pthread_mutex_unlock(&p->stats_lock);
+    return 0;
+}
+
+struct ouvr_decoder ffmpeg_render = {
+    .init = ffmpeg_render_initialize,
+    .process_frame = ffmpeg_render_process_packet,
+    .deinit = ffmpeg_render_deinitialize,
+    .get_stats = ffmpeg_render_get_stats,
+};
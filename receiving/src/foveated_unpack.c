@@ -0,0 +1,88 @@
+/*
+    The MIT License (MIT)
+
+    Copyright (c) 2020 OpenUVR
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+
+    Authors:
+    Alec Rohloff
+    Zackary Allen
+    Kung-Min Lin
+    Chengyi Nie
+    Hung-Wei Tseng
+*/
+#include <string.h>
+
+#include "foveated_unpack.h"
+
+// doubles a row of n RGB24 pixels into dst, each output pixel weighs 3/4 its nearest source pixel and 1/4 the next nearest
+static void upsample_row(const uint8_t *src, uint8_t *dst, int n)
+{
+    for (int x = 0; x < n; x++)
+    {
+        const uint8_t *prev = src + (x > 0 ? x - 1 : x) * 3;
+        const uint8_t *cur = src + x * 3;
+        const uint8_t *next = src + (x < n - 1 ? x + 1 : x) * 3;
+        for (int c = 0; c < 3; c++)
+        {
+            dst[x * 6 + c] = (3 * cur[c] + prev[c] + 2) >> 2;
+            dst[x * 6 + 3 + c] = (3 * cur[c] + next[c] + 2) >> 2;
+        }
+    }
+}
+
+void ouvr_foveated_unpack(const uint8_t *src, uint8_t *dst, int width, int height, const ouvr_fovea_position *pos)
+{
+    int stride = width * 3;
+    int src_stride = OUVR_FOVEATED_PACKED_WIDTH(width) * 3;
+    int num_eyes = pos->num_eyes == 2 ? 2 : 1;
+    int eye_width = width / num_eyes;
+    int packed_width = eye_width / 2;
+    int fovea_height = height / 2;
+    uint8_t blended[packed_width * 3];
+
+    for (int eye = 0; eye < num_eyes; eye++)
+    {
+        const uint8_t *periphery = src + fovea_height * src_stride + eye * packed_width * 3;
+        uint8_t *eye_dst = dst + eye * eye_width * 3;
+
+        // same 3/4, 1/4 weights as upsample_row, vertically
+        for (int y = 0; y < height; y++)
+        {
+            int sy = y / 2;
+            int other = y & 1 ? (sy < height / 2 - 1 ? sy + 1 : sy) : (sy > 0 ? sy - 1 : sy);
+            const uint8_t *near_row = periphery + sy * src_stride;
+            const uint8_t *far_row = periphery + other * src_stride;
+            for (int i = 0; i < packed_width * 3; i++)
+            {
+                blended[i] = (3 * near_row[i] + far_row[i] + 2) >> 2;
+            }
+            upsample_row(blended, eye_dst + y * stride, packed_width);
+        }
+
+        int left = pos->left[eye] > eye_width - packed_width ? eye_width - packed_width : pos->left[eye];
+        int top = pos->top[eye] > height - fovea_height ? height - fovea_height : pos->top[eye];
+        const uint8_t *fovea = src + eye * packed_width * 3;
+        for (int y = 0; y < fovea_height; y++)
+        {
+            memcpy(eye_dst + (top + y) * stride + left * 3, fovea + y * src_stride, packed_width * 3);
+        }
+    }
+}
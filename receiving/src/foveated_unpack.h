@@ -0,0 +1,46 @@
+/*
+    The MIT License (MIT)
+
+    Copyright (c) 2020 OpenUVR
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+
+    Authors:
+    Alec Rohloff
+    Zackary Allen
+    Kung-Min Lin
+    Chengyi Nie
+    Hung-Wei Tseng
+*/
+
+#ifndef OUVR_FOVEATED_UNPACK_H
+#define OUVR_FOVEATED_UNPACK_H
+
+#include <stdint.h>
+
+#include "ouvr_packet.h"
+
+/**
+ * Undoes the sender's foveated_pack on an RGB24 picture: each eye's half resolution periphery is upsampled back
+ * to the whole view and the full resolution fovea is put back at pos. dst is width x height, src the packed picture
+ * OUVR_FOVEATED_PACKED_WIDTH(width) wide.
+ */
+void ouvr_foveated_unpack(const uint8_t *src, uint8_t *dst, int width, int height, const ouvr_fovea_position *pos);
+
+#endif
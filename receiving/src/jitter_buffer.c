@@ -0,0 +1,113 @@
+/*
+    The MIT License (MIT)
+
+    Copyright (c) 2020 OpenUVR
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+
+    Authors:
+    Alec Rohloff
+    Zackary Allen
+    Kung-Min Lin
+    Chengyi Nie
+    Hung-Wei Tseng
+*/
+/**
+ * Receiver jitter buffer. The sender stamps every packet with the time it sent it, and the receive pipeline records
+ * when each packet came off the network. The two clocks aren't synchronised, but their offset is the same for every
+ * frame, so the difference between a frame's transit and the smallest recent transit is how long the network held
+ * it up. Frames are presented at the smallest transit plus a target delay of a few times the mean jitter, which keeps
+ * the spacing the sender gave them when the network bunches them up, and costs nothing once the jitter is gone.
+ */
+#include <stdlib.h>
+
+#include "jitter_buffer.h"
+
+// the smallest transit is looked for over windows this long, a base older than two windows is forgotten
+#define WINDOW_USEC 2000000
+// the target covers this many times the mean jitter, which leaves out all but the rarest late frames
+#define JITTER_MULTIPLE 3
+// holding a frame for less than this isn't worth a sleep
+#define MIN_HOLD_USEC 500
+
+static int64_t to_usec(const struct timespec *t)
+{
+    return t->tv_sec * 1000000LL + t->tv_nsec / 1000;
+}
+
+struct ouvr_jitter_buffer *ouvr_jitter_alloc(long max_delay_usec)
+{
+    ouvr_jitter_buffer *j = calloc(1, sizeof(ouvr_jitter_buffer));
+    if (j == NULL)
+    {
+        return NULL;
+    }
+    j->max_delay_usec = max_delay_usec;
+    return j;
+}
+
+void ouvr_jitter_free(struct ouvr_jitter_buffer *j)
+{
+    free(j);
+}
+
+int ouvr_jitter_schedule(struct ouvr_jitter_buffer *j, int64_t send_usec, const struct timespec *arrival, long interval_usec, struct timespec *deadline)
+{
+    int64_t now = to_usec(arrival);
+    int64_t transit = now - send_usec;
+    if (j->frames == 0 || now - j->window_start_usec >= WINDOW_USEC)
+    {
+        j->prev_window_min_usec = j->frames == 0 ? transit : j->window_min_usec;
+        j->window_min_usec = transit;
+        j->window_start_usec = now;
+    }
+    else if (transit < j->window_min_usec)
+    {
+        j->window_min_usec = transit;
+    }
+    if (j->frames > 0)
+    {
+        int64_t d = transit - j->last_transit_usec;
+        j->jitter_usec += ((d < 0 ? -d : d) - j->jitter_usec) / 16;
+    }
+    j->last_transit_usec = transit;
+    j->frames++;
+
+    int64_t base = j->window_min_usec < j->prev_window_min_usec ? j->window_min_usec : j->prev_window_min_usec;
+    long target = JITTER_MULTIPLE * j->jitter_usec;
+    if (target < MIN_HOLD_USEC)
+    {
+        target = 0;
+    }
+    if (target > j->max_delay_usec)
+    {
+        target = j->max_delay_usec;
+    }
+    j->target_usec = target;
+
+    int64_t due = now - (transit - base) + target;
+    deadline->tv_sec = due / 1000000;
+    deadline->tv_nsec = due % 1000000 * 1000;
+    if (now > due + interval_usec)
+    {
+        j->frames_late++;
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,65 @@
+/*
+    The MIT License (MIT)
+
+    Copyright (c) 2020 OpenUVR
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+
+    Authors:
+    Alec Rohloff
+    Zackary Allen
+    Kung-Min Lin
+    Chengyi Nie
+    Hung-Wei Tseng
+*/
+
+#ifndef OUVR_JITTER_BUFFER_H
+#define OUVR_JITTER_BUFFER_H
+
+#include <stdint.h>
+#include <time.h>
+
+// holds frames back until a presentation deadline worked out from when the sender sent them. A frame's transit is its
+// arrival minus its send time, which also holds the unknown offset between the two clocks. The smallest recent
+// transit is taken as the path's own delay and anything above it as jitter, and frames are presented target_usec
+// after the smallest transit would have brought them. target_usec follows the jitter, down to 0 on a clean network
+typedef struct ouvr_jitter_buffer
+{
+    long max_delay_usec;
+    // smallest transit of the current and the previous window, so that the base can rise again when the path changes
+    int64_t window_min_usec;
+    int64_t prev_window_min_usec;
+    int64_t window_start_usec;
+    int64_t last_transit_usec;
+    int frames;
+    // mean deviation of the transit from one frame to the next, as in RFC 3550
+    float jitter_usec;
+    long target_usec;
+    uint64_t frames_late;
+} ouvr_jitter_buffer;
+
+// frames are never held for more than max_delay_usec
+struct ouvr_jitter_buffer *ouvr_jitter_alloc(long max_delay_usec);
+void ouvr_jitter_free(struct ouvr_jitter_buffer *j);
+// learns from a frame sent at send_usec by the sender's clock and complete at arrival (CLOCK_MONOTONIC), and puts
+// the time it is to be presented in *deadline. Returns -1 if the frame arrived more than interval_usec after it,
+// when it is to be dropped
+int ouvr_jitter_schedule(struct ouvr_jitter_buffer *j, int64_t send_usec, const struct timespec *arrival, long interval_usec, struct timespec *deadline);
+
+#endif
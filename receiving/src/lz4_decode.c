@@ -0,0 +1,225 @@
+/*
+    The MIT License (MIT)
+
+    Copyright (c) 2020 OpenUVR
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+
+    Authors:
+    Alec Rohloff
+    Zackary Allen
+    Kung-Min Lin
+    Chengyi Nie
+    Hung-Wei Tseng
+*/
+/**
+ * Decompresses the chunks sent by lz4_encode with a pool of worker threads, so that a frame's chunks are
+ * decompressed in parallel and while the rest of the frame is still being received.
+ * The compressed data is copied out of the packet since the packet is reused for the next one.
+ */
+#include <lz4.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lz4_decode.h"
+#include "lz4_chunk.h"
+#include "thread_sched.h"
+
+#define NUM_WORKERS 4
+#define MAX_JOBS 64
+
+typedef struct lz4_job
+{
+    uint8_t *src;
+    int src_capacity;
+    int src_size;
+    uint8_t *dst;
+    int dst_size;
+} lz4_job;
+
+static pthread_t workers[NUM_WORKERS];
+static int num_workers;
+static struct ouvr_threads *worker_threads;
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t job_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t done_cond = PTHREAD_COND_INITIALIZER;
+static lz4_job jobs[MAX_JOBS];
+static int num_jobs;
+static int next_job;
+static int jobs_done;
+static int rows_done;
+static int should_exit;
+
+static uint8_t *frame;
+static int frame_width;
+static int frame_height;
+
+static void *lz4_worker(void *arg)
+{
+    (void)arg;
+    pthread_mutex_lock(&lock);
+    while (1)
+    {
+        while (next_job == num_jobs && !should_exit)
+        {
+            pthread_cond_wait(&job_cond, &lock);
+        }
+        if (should_exit)
+        {
+            break;
+        }
+        lz4_job *job = &jobs[next_job++];
+        pthread_mutex_unlock(&lock);
+
+        int r = LZ4_decompress_safe((const char *)job->src, (char *)job->dst, job->src_size, job->dst_size);
+
+        pthread_mutex_lock(&lock);
+        if (r == job->dst_size)
+        {
+            rows_done += job->dst_size / (frame_width * 3);
+        }
+        else
+        {
+            printf("LZ4_decompress_safe returned %d, expected %d\n", r, job->dst_size);
+        }
+        if (++jobs_done == num_jobs)
+        {
+            pthread_cond_signal(&done_cond);
+        }
+    }
+    pthread_mutex_unlock(&lock);
+    return NULL;
+}
+
+int lz4_decode_init(uint8_t *framebuffer, int width, int height, struct ouvr_threads *threads)
+{
+    worker_threads = threads;
+    frame = framebuffer;
+    frame_width = width;
+    frame_height = height;
+    should_exit = 0;
+    for (int i = 0; i < NUM_WORKERS; i++)
+    {
+        if (pthread_create(&workers[i], NULL, lz4_worker, NULL) != 0)
+        {
+            printf("could not start lz4 worker thread\n");
+            return num_workers > 0 ? 0 : -1;
+        }
+        char name[16];
+        snprintf(name, sizeof(name), "lz4-%d", i);
+        ouvr_threads_add(threads, workers[i], OPENUVR_THREAD_WORKERS, name);
+        num_workers++;
+    }
+    return 0;
+}
+
+void lz4_decode_set_frame(uint8_t *framebuffer, int width, int height)
+{
+    pthread_mutex_lock(&lock);
+    frame = framebuffer;
+    frame_width = width;
+    frame_height = height;
+    pthread_mutex_unlock(&lock);
+}
+
+int lz4_decode_submit(const uint8_t *data, int size)
+{
+    if (size < (int)sizeof(lz4_chunk_header))
+    {
+        return -1;
+    }
+    const lz4_chunk_header *hdr = (const lz4_chunk_header *)data;
+    if (hdr->magic != LZ4_CHUNK_MAGIC || hdr->frame_width != frame_width || hdr->frame_height != frame_height
+        || hdr->first_row + hdr->num_rows > frame_height || hdr->compressed_size != size - sizeof(lz4_chunk_header))
+    {
+        printf("unexpected lz4 chunk header\n");
+        return -1;
+    }
+
+    pthread_mutex_lock(&lock);
+    if (num_jobs == MAX_JOBS)
+    {
+        pthread_mutex_unlock(&lock);
+        printf("too many lz4 chunks in one frame\n");
+        return -1;
+    }
+    // only this thread adds jobs, and the workers never look past num_jobs, so the slot can be filled unlocked
+    lz4_job *job = &jobs[num_jobs];
+    pthread_mutex_unlock(&lock);
+
+    if (job->src_capacity < (int)hdr->compressed_size)
+    {
+        uint8_t *src = realloc(job->src, hdr->compressed_size);
+        if (src == NULL)
+        {
+            return -1;
+        }
+        job->src = src;
+        job->src_capacity = hdr->compressed_size;
+    }
+    memcpy(job->src, hdr + 1, hdr->compressed_size);
+    job->src_size = hdr->compressed_size;
+    job->dst = frame + hdr->first_row * frame_width * 3;
+    job->dst_size = hdr->num_rows * frame_width * 3;
+
+    pthread_mutex_lock(&lock);
+    num_jobs++;
+    pthread_cond_signal(&job_cond);
+    pthread_mutex_unlock(&lock);
+    return 0;
+}
+
+int lz4_decode_wait(void)
+{
+    pthread_mutex_lock(&lock);
+    while (jobs_done < num_jobs)
+    {
+        pthread_cond_wait(&done_cond, &lock);
+    }
+    int rows = rows_done;
+    num_jobs = 0;
+    next_job = 0;
+    jobs_done = 0;
+    rows_done = 0;
+    pthread_mutex_unlock(&lock);
+    return rows;
+}
+
+void lz4_decode_deinit(void)
+{
+    pthread_mutex_lock(&lock);
+    should_exit = 1;
+    pthread_cond_broadcast(&job_cond);
+    pthread_mutex_unlock(&lock);
+    for (int i = 0; i < num_workers; i++)
+    {
+        ouvr_threads_remove(worker_threads, workers[i]);
+        pthread_join(workers[i], NULL);
+    }
+    num_workers = 0;
+    for (int i = 0; i < MAX_JOBS; i++)
+    {
+        free(jobs[i].src);
+        jobs[i].src = NULL;
+        jobs[i].src_capacity = 0;
+    }
+}
@@ -0,0 +1,50 @@
+/*
+    The MIT License (MIT)
+
+    Copyright (c) 2020 OpenUVR
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+
+    Authors:
+    Alec Rohloff
+    Zackary Allen
+    Kung-Min Lin
+    Chengyi Nie
+    Hung-Wei Tseng
+*/
+
+#ifndef LZ4_DECODE_H
+#define LZ4_DECODE_H
+
+#include <stdint.h>
+
+struct ouvr_threads;
+
+// chunks are decompressed straight into framebuffer, which holds width x height RGB24 pixels. The worker threads are
+// placed as the workers stage of threads is configured
+int lz4_decode_init(uint8_t *framebuffer, int width, int height, struct ouvr_threads *threads);
+// switches to another framebuffer when the frame size changes, no chunk may be queued
+void lz4_decode_set_frame(uint8_t *framebuffer, int width, int height);
+// queues a packet from the sender's lz4_encode for decompression, returns -1 if it is malformed
+int lz4_decode_submit(const uint8_t *data, int size);
+// waits for every queued chunk, returns how many rows of framebuffer they filled
+int lz4_decode_wait(void);
+void lz4_decode_deinit(void);
+
+#endif
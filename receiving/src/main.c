@@ -32,27 +32,58 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <sys/time.h>
 
 void usage()
 {
-    printf("Usage: sudo ./openuvr [h264 | rgb] [udp | udp-compat | raw]\n");
+    printf("Usage: sudo ./openuvr [h264 | stereo | rgb | rgb-tile | lz4] [tcp | udp | udp-compat | raw | webrtc]\n");
+    printf("       ./openuvr software [tcp | udp | udp-compat | raw | webrtc] [null | file <path> | shm <name>] [threads] [slice | frame]\n");
+    printf("software decodes on the cpu, into nothing, a raw I420 file or /dev/shm/<name>, on one thread per core with slice threading by default\n");
+    printf("OPENUVR_THREADS places the threads, e.g. OPENUVR_THREADS=\"decode=2,fifo,50;workers=3;mlock\" (see openuvr_configure_threads())\n");
 }
 
 int main(int argc, char **argv) {
     struct openuvr_context *context;
     enum OPENUVR_NETWORK_TYPE net_choice = -1;
     enum OPENUVR_DECODER_TYPE enc_choice = -1;
+    struct openuvr_software_decoder_config software = {.threads = 0, .frame_threading = 0, .sink = OPENUVR_SINK_NULL};
 
-    if(argc > 3) {
+    if(argc < 3 || (argc > 3 && strcmp("software", argv[1]))) {
         usage();
         return 1;
     }
 
-    if(!strcmp("h264", argv[1])) {
+    if(!strcmp("software", argv[1])) {
+        enc_choice = OPENUVR_DECODER_H264_SOFTWARE;
+        int arg = 3;
+        if(arg < argc && !strcmp("null", argv[arg])) {
+            arg++;
+        }
+        else if(arg + 1 < argc && (!strcmp("file", argv[arg]) || !strcmp("shm", argv[arg]))) {
+            software.sink = !strcmp("file", argv[arg]) ? OPENUVR_SINK_FILE : OPENUVR_SINK_SHM;
+            software.sink_path = argv[arg + 1];
+            arg += 2;
+        }
+        if(arg < argc && strcmp("slice", argv[arg]) && strcmp("frame", argv[arg])) {
+            software.threads = atoi(argv[arg++]);
+        }
+        if(arg < argc && (!strcmp("slice", argv[arg]) || !strcmp("frame", argv[arg]))) {
+            software.frame_threading = !strcmp("frame", argv[arg++]);
+        }
+        if(arg != argc) {
+            usage();
+            return 1;
+        }
+    }
+    else if(!strcmp("h264", argv[1])) {
         enc_choice = OPENUVR_DECODER_H264;
     }
-    else if(!strcmp("rgb", argv[1])) {
+    else if(!strcmp("stereo", argv[1])) {
+        enc_choice = OPENUVR_DECODER_H264_STEREO;
+    }
+    // the rgb renderer understands every payload of the sender's rgb, rgb-tile and lz4 encoders
+    else if(!strcmp("rgb", argv[1]) || !strcmp("rgb-tile", argv[1]) || !strcmp("lz4", argv[1])) {
         enc_choice = OPENUVR_DECODER_RGB;
     }
 
@@ -77,7 +108,12 @@ int main(int argc, char **argv) {
         return 1;
     }
 
-    context = openuvr_alloc_context(enc_choice, net_choice);
+    if(enc_choice == OPENUVR_DECODER_H264_SOFTWARE) {
+        context = openuvr_alloc_context_software(net_choice, &software);
+    }
+    else {
+        context = openuvr_alloc_context(enc_choice, net_choice);
+    }
 
 #ifdef UE4DEBUG
     printf("context returned\n");
@@ -89,6 +125,10 @@ int main(int argc, char **argv) {
         usage();
         return 1;
     }
+    const char *threads = getenv("OPENUVR_THREADS");
+    if(threads != NULL) {
+        openuvr_configure_threads(context, threads);
+    }
 
     int frames_recvd = 0;
     int curr_sec = 0;
@@ -108,6 +148,12 @@ int main(int argc, char **argv) {
         if(tv.tv_sec != curr_sec)
         {
            // printf("%d fps\n", frames_recvd);
+            // the decoders that can tell report every second, for measuring the receiver on its own
+            struct openuvr_decoder_stats st;
+            if(curr_sec != 0 && openuvr_get_decoder_stats(context, &st) == 0) {
+                printf("%llu frames %dx%d, decode avg %ld us, last %ld us, max %ld us, %llu errors\n", (unsigned long long)st.frames_decoded,
+                       st.width, st.height, st.avg_decode_usec, st.last_decode_usec, st.max_decode_usec, (unsigned long long)st.decode_errors);
+            }
             curr_sec = tv.tv_sec;
             frames_recvd = 0;
         }
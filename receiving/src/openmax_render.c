@@ -31,6 +31,7 @@
 #include "ouvr_packet.h"
 #include "openmax_render.h"
 #include <stdio.h>
+#include <stdlib.h>
 #include <time.h>
 #include <sys/time.h>
 #include <pthread.h>
@@ -46,7 +47,8 @@
 #include <IL/OMX_Video.h>
 #include <IL/OMX_Broadcom.h>
 
-static int allocate_decoder_input_buffers();
+typedef struct omxr_instance omxr_instance;
+static int allocate_decoder_input_buffers(omxr_instance *o);
 
 #define OMX_INIT_STRUCTURE(a) \
   memset(&(a), 0, sizeof(a)); \
@@ -64,21 +66,43 @@ static OMX_ERRORTYPE fill_buffer_done_callback(OMX_HANDLETYPE hComponent, OMX_PT
 // static pthread_mutex_t decode_lock = PTHREAD_MUTEX_INITIALIZER;
 // static pthread_cond_t decode_cond = PTHREAD_COND_INITIALIZER;
 // int buffer_is_free = 1;
-static sem_t decode_sem;
+// one decoder tunnelled into one renderer. openmax_render uses a single one for the whole frame,
+// openmax_stereo_render one per eye
+struct omxr_instance
+{
+    sem_t decode_sem;
+    OMX_HANDLETYPE video_decoder;
+    OMX_HANDLETYPE video_render;
+    OMX_BUFFERHEADERTYPE *omx_buffer[NUM_BUFS];
+    int start_times[NUM_BUFS];
+    int buf_idx;
+    // set from the event handler when the decoder's output changes size. The first event comes with the first
+    // picture and needs nothing done, the tunnel already being up
+    int port_settings_events;
+    volatile int port_settings_changed;
+};
+
+static omxr_instance instances[2];
+
+// one eye's part of a frame for openmax_stereo_render, put together until the other eye's part is complete too
+typedef struct omxr_eye_frame
+{
+    unsigned char *data;
+    int size;
+    int capacity;
+    uint32_t frame_id;
+    uint32_t flags;
+    int started;
+    int complete;
+} omxr_eye_frame;
 
-static OMX_HANDLETYPE video_decoder;
-static OMX_HANDLETYPE video_render;
-static OMX_BUFFERHEADERTYPE *omx_buffer[NUM_BUFS] = {0};
-static int start_times[NUM_BUFS] = {0};
+static omxr_eye_frame eye_frames[2];
 
 static struct timespec sleep_time = {.tv_sec = 0, .tv_nsec = 100000000};
 
-static int omxr_initialize(struct ouvr_ctx *ctx)
+// must be called once before any instance is set up
+static int omxr_global_init()
 {
-    // pthread_mutex_init(&decode_lock, NULL);
-    // pthread_cond_init(&decode_cond, NULL);
-    sem_init(&decode_sem, 0, NUM_BUFS - 1);
-
     // must be called on raspberry pi before making GPU calls
     bcm_host_init();
 
@@ -88,6 +112,17 @@ static int omxr_initialize(struct ouvr_ctx *ctx)
         printf("OMX_Init() returned %x\n", err);
         return -1;
     }
+    return 0;
+}
+
+// dest is the part of the screen to render to, or NULL for the whole screen
+static int omxr_instance_init(omxr_instance *o, int width, int height, const OMX_DISPLAYRECTTYPE *dest)
+{
+    OMX_ERRORTYPE err;
+    // pthread_mutex_init(&decode_lock, NULL);
+    // pthread_cond_init(&decode_cond, NULL);
+    sem_init(&o->decode_sem, 0, NUM_BUFS - 1);
+    o->buf_idx = 0;
 
     //define callbacks
     OMX_CALLBACKTYPE callbacks;
@@ -96,25 +131,26 @@ static int omxr_initialize(struct ouvr_ctx *ctx)
     callbacks.FillBufferDone = fill_buffer_done_callback;
 
     // Get handle to video decoding component
-    err = OMX_GetHandle(&video_decoder, "OMX.broadcom.video_decode", NULL, &callbacks);
+    // the callbacks get o back as their app data
+    err = OMX_GetHandle(&o->video_decoder, "OMX.broadcom.video_decode", o, &callbacks);
     if(err != OMX_ErrorNone) {
         printf("OMX_GetHandle() returned %x for video_decode\n", err);
         return -1;
     }
-    OMX_SendCommand(video_decoder, OMX_CommandPortDisable, 130, NULL);
-    OMX_SendCommand(video_decoder, OMX_CommandPortDisable, 131, NULL);
+    OMX_SendCommand(o->video_decoder, OMX_CommandPortDisable, 130, NULL);
+    OMX_SendCommand(o->video_decoder, OMX_CommandPortDisable, 131, NULL);
     nanosleep(&sleep_time, NULL);
-    OMX_SendCommand(video_decoder, OMX_CommandStateSet, OMX_StateIdle, NULL);
+    OMX_SendCommand(o->video_decoder, OMX_CommandStateSet, OMX_StateIdle, NULL);
     nanosleep(&sleep_time, NULL);
 
-    //things to set up video_decoder
+    //things to set up o->video_decoder
     {
         OMX_VIDEO_PARAM_PORTFORMATTYPE formatType;
         OMX_INIT_STRUCTURE(formatType);
         formatType.nPortIndex = 130;
         formatType.eCompressionFormat = OMX_VIDEO_CodingAVC;
         formatType.xFramerate = 1966080;
-        err = OMX_SetParameter(video_decoder, OMX_IndexParamVideoPortFormat, &formatType);
+        err = OMX_SetParameter(o->video_decoder, OMX_IndexParamVideoPortFormat, &formatType);
         if(err != OMX_ErrorNone) {
             printf("OMX_SetParameter() returned %x for OMX_IndexParamVideoPortFormat\n", err);
             return -1;
@@ -123,20 +159,20 @@ static int omxr_initialize(struct ouvr_ctx *ctx)
         OMX_PARAM_PORTDEFINITIONTYPE portParam;
         OMX_INIT_STRUCTURE(portParam);
         portParam.nPortIndex = 130;
-        err = OMX_GetParameter(video_decoder, OMX_IndexParamPortDefinition, &portParam);
+        err = OMX_GetParameter(o->video_decoder, OMX_IndexParamPortDefinition, &portParam);
         if(err != OMX_ErrorNone)
         {
-            printf("OMX_GetParameter() returned %x for video_decoder\n", err);
+            printf("OMX_GetParameter() returned %x for o->video_decoder\n", err);
             return -1;
         }
         portParam.nPortIndex = 130;
         portParam.nBufferCountActual = 60;
-        portParam.format.video.nFrameWidth  = 1920;
-        portParam.format.video.nFrameHeight = 1080;
-        err = OMX_SetParameter(video_decoder, OMX_IndexParamPortDefinition, &portParam);
+        portParam.format.video.nFrameWidth  = width;
+        portParam.format.video.nFrameHeight = height;
+        err = OMX_SetParameter(o->video_decoder, OMX_IndexParamPortDefinition, &portParam);
         if(err != OMX_ErrorNone)
         {
-            printf("OMX_SetParameter() returned %x for video_decoder\n", err);
+            printf("OMX_SetParameter() returned %x for o->video_decoder\n", err);
             return -1;
         }
 
@@ -144,7 +180,7 @@ static int omxr_initialize(struct ouvr_ctx *ctx)
         OMX_PARAM_BRCMVIDEODECODEERRORCONCEALMENTTYPE concanParam;
         OMX_INIT_STRUCTURE(concanParam);
         concanParam.bStartWithValidFrame = OMX_TRUE;
-        err = OMX_SetParameter(video_decoder, OMX_IndexParamBrcmVideoDecodeErrorConcealment, &concanParam);
+        err = OMX_SetParameter(o->video_decoder, OMX_IndexParamBrcmVideoDecodeErrorConcealment, &concanParam);
         if(err != OMX_ErrorNone)
         {
             printf("OMX_SetParameter() returned %x for OMX_IndexParamBrcmVideoDecodeErrorConcealment\n", err);
@@ -155,7 +191,7 @@ static int omxr_initialize(struct ouvr_ctx *ctx)
         OMX_INIT_STRUCTURE(nalStreamFormat);
         nalStreamFormat.nPortIndex = 130;
         nalStreamFormat.eNaluFormat = OMX_NaluFormatStartCodes;
-        err = OMX_SetParameter(video_decoder, (OMX_INDEXTYPE)OMX_IndexParamNalStreamFormatSelect, &nalStreamFormat);
+        err = OMX_SetParameter(o->video_decoder, (OMX_INDEXTYPE)OMX_IndexParamNalStreamFormatSelect, &nalStreamFormat);
         if (err != OMX_ErrorNone)
         {
             printf("OMX_SetParameter() returned %x for OMX_IndexParamNalStreamFormatSelect\n", err);
@@ -163,10 +199,10 @@ static int omxr_initialize(struct ouvr_ctx *ctx)
         }
     }
 
-    OMX_SendCommand(video_decoder, OMX_CommandStateSet, OMX_StateExecuting, NULL);
+    OMX_SendCommand(o->video_decoder, OMX_CommandStateSet, OMX_StateExecuting, NULL);
     nanosleep(&sleep_time, NULL);
 
-    if(allocate_decoder_input_buffers() != 0) {
+    if(allocate_decoder_input_buffers(o) != 0) {
         return -1;
     }
 
@@ -176,14 +212,14 @@ static int omxr_initialize(struct ouvr_ctx *ctx)
         //these are the first 53 bytes of a given packet
         unsigned char extradata[53] = {0x0, 0x0, 0x0, 0x1, 0x67, 0x4d, 0x40, 0x32, 0x95, 0xa0, 0x1e, 0x0, 0x89, 0xf9, 0x70, 0x11, 0x0, 0x0, 0x3, 0x3, 0xe8, 0x0, 0x0, 0xea, 0x60, 0xe0, 0x0, 0x0, 0x3, 0x1, 0x31, 0x2d, 0x0, 0x0, 0x3, 0x0, 0x13, 0x12, 0xd0, 0x1b, 0xbc, 0xb8, 0x3e, 0x95, 0x40, 0x0, 0x0, 0x0, 0x1, 0x68, 0xee, 0x3c, 0x80};
 
-        omx_buffer[0]->nOffset = 0;
-        omx_buffer[0]->nFilledLen = (OMX_U32)53;
+        o->omx_buffer[0]->nOffset = 0;
+        o->omx_buffer[0]->nFilledLen = (OMX_U32)53;
 
-        memset((unsigned char *)omx_buffer[0]->pBuffer, 0x0, omx_buffer[0]->nAllocLen);
-        memcpy((unsigned char *)omx_buffer[0]->pBuffer, extradata, omx_buffer[0]->nFilledLen);
-        omx_buffer[0]->nFlags = OMX_BUFFERFLAG_CODECCONFIG | OMX_BUFFERFLAG_ENDOFFRAME;
+        memset((unsigned char *)o->omx_buffer[0]->pBuffer, 0x0, o->omx_buffer[0]->nAllocLen);
+        memcpy((unsigned char *)o->omx_buffer[0]->pBuffer, extradata, o->omx_buffer[0]->nFilledLen);
+        o->omx_buffer[0]->nFlags = OMX_BUFFERFLAG_CODECCONFIG | OMX_BUFFERFLAG_ENDOFFRAME;
 
-        err = OMX_EmptyThisBuffer(video_decoder, omx_buffer[0]);
+        err = OMX_EmptyThisBuffer(o->video_decoder, o->omx_buffer[0]);
         if (err != OMX_ErrorNone)
         {
             printf("OMX_EmptyThisBuffer() returned %x for senddecoderconfig\n", err);
@@ -193,13 +229,13 @@ static int omxr_initialize(struct ouvr_ctx *ctx)
     }
 
     // Get handle to video decoding component
-    err = OMX_GetHandle(&video_render, "OMX.broadcom.video_render", NULL, &callbacks);
+    err = OMX_GetHandle(&o->video_render, "OMX.broadcom.video_render", o, &callbacks);
     if(err != OMX_ErrorNone) {
         printf("OMX_GetHandle() returned %x for video_render\n", err);
         return -1;
     }
 
-    OMX_SendCommand(video_render, OMX_CommandPortDisable, 90, NULL);
+    OMX_SendCommand(o->video_render, OMX_CommandPortDisable, 90, NULL);
     nanosleep(&sleep_time, NULL);
 
     OMX_CONFIG_DISPLAYREGIONTYPE configDisplay;
@@ -210,7 +246,7 @@ static int omxr_initialize(struct ouvr_ctx *ctx)
     configDisplay.num = 0;
     configDisplay.layer = 0;
     configDisplay.transform = OMX_DISPLAY_ROT0;
-    err = OMX_SetConfig(video_render, OMX_IndexConfigDisplayRegion, &configDisplay);
+    err = OMX_SetConfig(o->video_render, OMX_IndexConfigDisplayRegion, &configDisplay);
     if(err != OMX_ErrorNone)
     {
         printf("OMX_SetConfig() returned %x for OMX_IndexConfigDisplayRegion\n", err);
@@ -238,67 +274,71 @@ static int omxr_initialize(struct ouvr_ctx *ctx)
         configDisplay.dest_rect.height     = 540;
 
         configDisplay.fullscreen = OMX_TRUE;
+        if(dest != NULL) {
+            configDisplay.dest_rect = *dest;
+            configDisplay.fullscreen = OMX_FALSE;
+        }
 
         configDisplay.pixel_x = 1;
         configDisplay.pixel_y = 1;
 
-        OMX_SetConfig(video_render, OMX_IndexConfigDisplayRegion, &configDisplay);
+        OMX_SetConfig(o->video_render, OMX_IndexConfigDisplayRegion, &configDisplay);
         if(err != OMX_ErrorNone) {
             printf("OMX_SetConfig() returned %x for second OMX_IndexConfigDisplayRegion\n", err);
             return -1;
         }
     }
 
-    OMX_SendCommand(video_render, OMX_CommandStateSet, OMX_StateIdle, NULL);
+    OMX_SendCommand(o->video_render, OMX_CommandStateSet, OMX_StateIdle, NULL);
     nanosleep(&sleep_time, NULL);
 
     // for decoder->render
     // sets src component to StateIdle only if it is StateLoaded, OMX_SetupTunnel(), enables src and dst ports, sets dst component to StateIdle if it's StateLoaded
-    err = OMX_SetupTunnel(video_decoder, 131, video_render, 90);
+    err = OMX_SetupTunnel(o->video_decoder, 131, o->video_render, 90);
     if(err != OMX_ErrorNone) {
         printf("OMX_SetupTunnel() returned %x for decoder=>render\n", err);
         return -1;
     }
-    OMX_SendCommand(video_decoder, OMX_CommandPortEnable, 130, NULL);
-    OMX_SendCommand(video_decoder, OMX_CommandPortEnable, 131, NULL);
-    OMX_SendCommand(video_render, OMX_CommandPortEnable, 90, NULL);
+    OMX_SendCommand(o->video_decoder, OMX_CommandPortEnable, 130, NULL);
+    OMX_SendCommand(o->video_decoder, OMX_CommandPortEnable, 131, NULL);
+    OMX_SendCommand(o->video_render, OMX_CommandPortEnable, 90, NULL);
     nanosleep(&sleep_time, NULL);
 
-    OMX_SendCommand(video_render, OMX_CommandStateSet, OMX_StateExecuting, NULL);
+    OMX_SendCommand(o->video_render, OMX_CommandStateSet, OMX_StateExecuting, NULL);
     nanosleep(&sleep_time, NULL);
 
     return 0;
 }
 
-static int allocate_decoder_input_buffers()
+static int allocate_decoder_input_buffers(omxr_instance *o)
 {
     OMX_ERRORTYPE err;
     OMX_PARAM_PORTDEFINITIONTYPE portFormat;
     OMX_INIT_STRUCTURE(portFormat);
     portFormat.nPortIndex = 130;
 
-    err = OMX_GetParameter(video_decoder, OMX_IndexParamPortDefinition, &portFormat);
+    err = OMX_GetParameter(o->video_decoder, OMX_IndexParamPortDefinition, &portFormat);
     if(err != OMX_ErrorNone) {
         printf("OMX_GetParameter() returned %x for decoder portdefinition\n", err);
         return -1;
     }
 
     //enable input port
-    OMX_SendCommand(video_decoder, OMX_CommandPortEnable, 130, NULL);
+    OMX_SendCommand(o->video_decoder, OMX_CommandPortEnable, 130, NULL);
     nanosleep(&sleep_time, NULL);
     
     for(int i = 0; i < NUM_BUFS; i++) {
         //nAllocLen is 81920
-        err = OMX_AllocateBuffer(video_decoder, &omx_buffer[i], 130, NULL, portFormat.nBufferSize);
+        err = OMX_AllocateBuffer(o->video_decoder, &o->omx_buffer[i], 130, NULL, portFormat.nBufferSize);
         if(err != OMX_ErrorNone)
         {
             printf("OMX_AllocateBuffer() returned %x\n", err);
             return -1;
         }
-        omx_buffer[i]->nInputPortIndex = 130;
-        omx_buffer[i]->nFilledLen      = 0;
-        omx_buffer[i]->nOffset         = 0;
-        omx_buffer[i]->pAppPrivate     = (void *)i; //(void*)i;
+        o->omx_buffer[i]->nInputPortIndex = 130;
+        o->omx_buffer[i]->nFilledLen      = 0;
+        o->omx_buffer[i]->nOffset         = 0;
+        o->omx_buffer[i]->pAppPrivate     = (void *)i; //(void*)i;
     }
     return 0;
 }
@@ -308,8 +348,37 @@ static int allocate_decoder_input_buffers()
 // OMX_SendCommand(m_handle, OMX_CommandPortEnable, portNum, NULL);
 // OMX_SetupTunnel(handleOutput, nPortOutput, handleInput, nPortInput);
 
-static int buf_idx = 0;
-static int omxr_process_packet(struct ouvr_ctx *ctx, struct ouvr_packet *pkt)
+static int omxr_initialize(struct ouvr_ctx *ctx)
+{
+    if(omxr_global_init() != 0) {
+        return -1;
+    }
+    return omxr_instance_init(&instances[0], 1920, 1080, NULL);
+}
+
+/**
+ * The decoder found a new picture size in the stream, which happens when the sender's dynamic resolution steps
+ * along its ladder. The tunnel has to be taken down and brought up again for the renderer to pick the size up,
+ * and the renderer keeps scaling whatever it gets to the display.
+ */
+static void omxr_reconfigure_tunnel(omxr_instance *o)
+{
+    o->port_settings_changed = 0;
+    OMX_PARAM_PORTDEFINITIONTYPE portParam;
+    OMX_INIT_STRUCTURE(portParam);
+    portParam.nPortIndex = 131;
+    if(OMX_GetParameter(o->video_decoder, OMX_IndexParamPortDefinition, &portParam) == OMX_ErrorNone) {
+        printf("decoded picture size changed to %dx%d\n", (int)portParam.format.video.nFrameWidth, (int)portParam.format.video.nFrameHeight);
+    }
+    OMX_SendCommand(o->video_decoder, OMX_CommandPortDisable, 131, NULL);
+    OMX_SendCommand(o->video_render, OMX_CommandPortDisable, 90, NULL);
+    nanosleep(&sleep_time, NULL);
+    OMX_SendCommand(o->video_decoder, OMX_CommandPortEnable, 131, NULL);
+    OMX_SendCommand(o->video_render, OMX_CommandPortEnable, 90, NULL);
+    nanosleep(&sleep_time, NULL);
+}
+
+static int omxr_instance_decode(omxr_instance *o, struct ouvr_ctx *ctx, struct ouvr_packet *pkt)
 {
     OMX_ERRORTYPE err;
     unsigned int remaining_bytes = (unsigned int)pkt->size;
@@ -320,18 +389,24 @@ static int omxr_process_packet(struct ouvr_ctx *ctx, struct ouvr_packet *pkt)
     gettimeofday(&start_time, NULL);
 #endif
 
-    // I'll take this to mean that it's an i-frame
-    if(pkt->data[4] != 0x6) {
+    if(o->port_settings_changed) {
+        omxr_reconfigure_tunnel(o);
+    }
+
+    // only a keyframe makes up for a loss, the other slices of a broken frame must not cancel the request
+    if(pkt->flags & OUVR_PACKET_FLAG_KEYFRAME) {
         ctx->flag_send_iframe = 0;
     }
 
-    while(remaining_bytes) {
+    // a packet can be a single slice of a frame, only the one that ends the frame gets OMX_BUFFERFLAG_ENDOFFRAME.
+    // it may also carry no data at all when the sender just marks the end of the frame
+    do {
         // pthread_mutex_lock(&decode_lock);
         // while(!buffer_is_free)
         //     pthread_cond_wait(&decode_cond, &decode_lock);
-        sem_wait(&decode_sem);
+        sem_wait(&o->decode_sem);
         //buffer_is_free = 0;
-        OMX_BUFFERHEADERTYPE *buf = omx_buffer[buf_idx];
+        OMX_BUFFERHEADERTYPE *buf = o->omx_buffer[o->buf_idx];
         buf->nFlags = OMX_BUFFERFLAG_TIME_UNKNOWN;
         buf->nOffset = 0;
         buf->nFilledLen = ((OMX_U32)remaining_bytes < buf->nAllocLen ? (OMX_U32)remaining_bytes : buf->nAllocLen);
@@ -340,25 +415,201 @@ static int omxr_process_packet(struct ouvr_ctx *ctx, struct ouvr_packet *pkt)
         remaining_bytes -= buf->nFilledLen;
         pos += buf->nFilledLen;
 
-        if(remaining_bytes == 0) {
+        if(remaining_bytes == 0 && (pkt->flags & OUVR_PACKET_FLAG_END_OF_FRAME)) {
             buf->nFlags |= OMX_BUFFERFLAG_ENDOFFRAME;
 #ifdef TIME_DECODING
-            start_times[buf_idx] = start_time.tv_usec;
+            o->start_times[o->buf_idx] = start_time.tv_usec;
 #endif
         }
 
-        err = OMX_EmptyThisBuffer(video_decoder, buf);
+        err = OMX_EmptyThisBuffer(o->video_decoder, buf);
         if (err != OMX_ErrorNone)
         {
             printf("OMX_EmptyThisBuffer() returned %x\n", err);
             return -1;
         }
-        buf_idx = (buf_idx + 1) % NUM_BUFS;
+        o->buf_idx = (o->buf_idx + 1) % NUM_BUFS;
         // pthread_mutex_unlock(&decode_lock);
+    } while(remaining_bytes);
+    return 0;
+}
+
+static int omxr_process_packet(struct ouvr_ctx *ctx, struct ouvr_packet *pkt)
+{
+    return omxr_instance_decode(&instances[0], ctx, pkt);
+}
+
+// the transports receive straight into the decoder's input buffers, taken in ring order as omxr_instance_decode() does
+static int omxr_lend_buffer(struct ouvr_ctx *ctx, struct ouvr_packet *pkt, int room, ouvr_lent_buffer *lent)
+{
+    omxr_instance *o = &instances[0];
+    // the ones already lent to pkt only come back once it is submitted
+    if(pkt->num_lent >= NUM_BUFS - 1 || (int)o->omx_buffer[0]->nAllocLen < room) {
+        return -1;
     }
+    sem_wait(&o->decode_sem);
+    OMX_BUFFERHEADERTYPE *buf = o->omx_buffer[o->buf_idx];
+    o->buf_idx = (o->buf_idx + 1) % NUM_BUFS;
+    lent->data = buf->pBuffer;
+    lent->capacity = buf->nAllocLen;
+    lent->priv = buf;
     return 0;
 }
 
+static int omxr_submit_buffers(struct ouvr_ctx *ctx, struct ouvr_packet *pkt)
+{
+    omxr_instance *o = &instances[0];
+#ifdef TIME_DECODING
+    struct timeval start_time;
+    gettimeofday(&start_time, NULL);
+#endif
+    if(o->port_settings_changed) {
+        omxr_reconfigure_tunnel(o);
+    }
+    // see omxr_instance_decode()
+    if(pkt->flags & OUVR_PACKET_FLAG_KEYFRAME) {
+        ctx->flag_send_iframe = 0;
+    }
+    for(int i = 0; i < pkt->num_lent; i++) {
+        OMX_BUFFERHEADERTYPE *buf = pkt->lent[i].priv;
+        buf->nFlags = OMX_BUFFERFLAG_TIME_UNKNOWN;
+        buf->nOffset = 0;
+        buf->nFilledLen = pkt->lent[i].size;
+        if(i == pkt->num_lent - 1 && (pkt->flags & OUVR_PACKET_FLAG_END_OF_FRAME)) {
+            buf->nFlags |= OMX_BUFFERFLAG_ENDOFFRAME;
+#ifdef TIME_DECODING
+            // nothing was lent since, the last one is just behind buf_idx
+            o->start_times[(o->buf_idx + NUM_BUFS - 1) % NUM_BUFS] = start_time.tv_usec;
+#endif
+        }
+        OMX_ERRORTYPE err = OMX_EmptyThisBuffer(o->video_decoder, buf);
+        if (err != OMX_ErrorNone)
+        {
+            printf("OMX_EmptyThisBuffer() returned %x\n", err);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static void omxr_return_buffers(struct ouvr_ctx *ctx, struct ouvr_packet *pkt)
+{
+    omxr_instance *o = &instances[0];
+    // they are the last ones taken from the ring, so it is turned back over them
+    o->buf_idx = (o->buf_idx + NUM_BUFS - pkt->num_lent) % NUM_BUFS;
+    for(int i = 0; i < pkt->num_lent; i++) {
+        sem_post(&o->decode_sem);
+    }
+}
+
+// the sender's stereo encoder sends each eye as its own stream, each goes to a decoder rendering to its half of the screen
+static int omxr_stereo_initialize(struct ouvr_ctx *ctx)
+{
+    if(omxr_global_init() != 0) {
+        return -1;
+    }
+
+    uint32_t screen_width, screen_height;
+    if(graphics_get_display_size(0, &screen_width, &screen_height) < 0) {
+        printf("graphics_get_display_size() failed\n");
+        return -1;
+    }
+    for(int eye = 0; eye < 2; eye++) {
+        OMX_DISPLAYRECTTYPE dest = {
+            .x_offset = eye * (screen_width / 2),
+            .y_offset = 0,
+            .width = screen_width / 2,
+            .height = screen_height,
+        };
+        if(omxr_instance_init(&instances[eye], 960, 1080, &dest) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// throws away what an eye had of a frame. The decoders reference the frame, so the pair starts again from a keyframe
+static void omxr_drop_eye_frame(struct ouvr_ctx *ctx, omxr_eye_frame *f)
+{
+    if(f->started) {
+        printf("dropped eye of frame %u without its other half\n", f->frame_id);
+        ctx->flag_send_iframe = 5;
+    }
+    f->size = 0;
+    f->started = 0;
+    f->complete = 0;
+}
+
+static int omxr_decode_eye_frame(struct ouvr_ctx *ctx, int eye)
+{
+    omxr_eye_frame *f = &eye_frames[eye];
+    struct ouvr_packet frame = {
+        .data = f->data,
+        .size = f->size,
+        .flags = f->flags,
+        .frame_id = f->frame_id,
+    };
+    int ret = omxr_instance_decode(&instances[eye], ctx, &frame);
+    f->size = 0;
+    f->started = 0;
+    f->complete = 0;
+    return ret;
+}
+
+/**
+ * Each decoder renders its picture as soon as it has decoded it, so an eye's frame is held back until the other
+ * eye's frame with the same id is complete, and then both are decoded together. An eye that moves on to another
+ * frame first takes the pair down with it.
+ */
+static int omxr_stereo_process_packet(struct ouvr_ctx *ctx, struct ouvr_packet *pkt)
+{
+    int eye = pkt->flags & OUVR_PACKET_FLAG_RIGHT_EYE ? 1 : 0;
+    omxr_eye_frame *f = &eye_frames[eye];
+    omxr_eye_frame *other = &eye_frames[!eye];
+
+    if(f->started && f->frame_id != pkt->frame_id) {
+        if(other->started && other->frame_id == f->frame_id) {
+            omxr_drop_eye_frame(ctx, other);
+        }
+        omxr_drop_eye_frame(ctx, f);
+    }
+    if(!f->started) {
+        f->started = 1;
+        f->frame_id = pkt->frame_id;
+        f->flags = 0;
+    }
+    // the keyframe flag of any of its packets
+    f->flags |= pkt->flags;
+    if(f->size + pkt->size > f->capacity) {
+        unsigned char *data = realloc(f->data, f->size + pkt->size);
+        if(data == NULL) {
+            printf("could not hold a %d byte eye frame\n", f->size + pkt->size);
+            omxr_drop_eye_frame(ctx, f);
+            return -1;
+        }
+        f->data = data;
+        f->capacity = f->size + pkt->size;
+    }
+    memcpy(f->data + f->size, pkt->data, pkt->size);
+    f->size += pkt->size;
+    if(!(pkt->flags & OUVR_PACKET_FLAG_END_OF_FRAME)) {
+        return 0;
+    }
+    f->complete = 1;
+
+    if(!other->complete) {
+        return 0;
+    }
+    if(other->frame_id != f->frame_id) {
+        // the older of the two never gets its other half
+        omxr_drop_eye_frame(ctx, (int32_t)(other->frame_id - f->frame_id) < 0 ? other : f);
+        return 0;
+    }
+    int left = omxr_decode_eye_frame(ctx, 0);
+    int right = omxr_decode_eye_frame(ctx, 1);
+    return left != 0 || right != 0 ? -1 : 0;
+}
+
 
 static OMX_ERRORTYPE event_handler_callback(
   OMX_HANDLETYPE hComponent,
@@ -369,6 +620,10 @@ static OMX_ERRORTYPE event_handler_callback(
   OMX_PTR pEventData)
 {
     //printf("Event handler callback %x %d\n", nData1, nData2);
+    omxr_instance *o = pAppData;
+    if(eEvent == OMX_EventPortSettingsChanged && hComponent == o->video_decoder && nData1 == 131 && o->port_settings_events++ > 0) {
+        o->port_settings_changed = 1;
+    }
     return OMX_ErrorNone;
 }
 #ifdef TIME_DECODING
@@ -377,18 +632,19 @@ float avg_dec_time = 0;
 
 static OMX_ERRORTYPE empty_buffer_done_callback(OMX_HANDLETYPE hComponent, OMX_PTR nAppData, OMX_BUFFERHEADERTYPE *pBuffer)
 {
+    omxr_instance *o = nAppData;
     //printf("empty buffer done callback\n");
 
 #ifdef TIME_DECODING
     struct timeval end_time;
     int idx = pBuffer->pAppPrivate;
-    if(start_times[idx] > 0){
+    if(o->start_times[idx] > 0){
         gettimeofday(&end_time, NULL);
-        int elapsed = end_time.tv_usec - start_times[idx];
+        int elapsed = end_time.tv_usec - o->start_times[idx];
         if(elapsed < 0) elapsed += 1000000;
             avg_dec_time = 0.998 * avg_dec_time + 0.002 * elapsed;
         printf("\r\033[60Cdec avg: %f, actual: %d", avg_dec_time, elapsed);
-        start_times[idx] = 0;
+        o->start_times[idx] = 0;
     }
 #endif
 
@@ -396,7 +652,7 @@ static OMX_ERRORTYPE empty_buffer_done_callback(OMX_HANDLETYPE hComponent, OMX_P
     // buffer_is_free = 1;
     // pthread_cond_broadcast(&decode_cond);
     // pthread_mutex_unlock(&decode_lock);
-    sem_post(&decode_sem);
+    sem_post(&o->decode_sem);
 
     return OMX_ErrorNone;
 }
@@ -409,6 +665,11 @@ static OMX_ERRORTYPE fill_buffer_done_callback(OMX_HANDLETYPE hComponent, OMX_PT
 
 static void omxr_deinitialize()
 {
+    for(int eye = 0; eye < 2; eye++) {
+        free(eye_frames[eye].data);
+        eye_frames[eye].data = NULL;
+        eye_frames[eye].capacity = 0;
+    }
     OMX_Deinit();
     bcm_host_deinit();
 }
@@ -417,40 +678,13 @@ struct ouvr_decoder openmax_render = {
     .init = omxr_initialize,
     .process_frame = omxr_process_packet,
     .deinit = omxr_deinitialize,
+    .lend_buffer = omxr_lend_buffer,
+    .submit_buffers = omxr_submit_buffers,
+    .return_buffers = omxr_return_buffers,
 };
 
-int omxr_get_available_buffers(OMX_BUFFERHEADERTYPE **pointers, int num)
-{
-    for(int i = 0; i < num; i++) {
-        OMX_BUFFERHEADERTYPE *buf = omx_buffer[buf_idx];
-        buf->nFlags = OMX_BUFFERFLAG_TIME_UNKNOWN;
-        buf->nOffset = 0;
-        buf->nFilledLen = 0;
-        pointers[i] = buf;
-        buf_idx = (buf_idx + 1) % NUM_BUFS;
-    }
-    return num;
-}
-
-int omxr_empty_buffers(OMX_BUFFERHEADERTYPE **pointers, int num)
-{
-    OMX_ERRORTYPE err;
-    for(int i = 0; i < num - 1; i++) {
-        err = OMX_EmptyThisBuffer(video_decoder, pointers[i]);
-        if (err != OMX_ErrorNone)
-        {
-            printf("OMX_EmptyThisBuffer() returned %x\n", err);
-            exit(1);
-        }
-    }
-
-    pointers[num - 1]->nFlags |= OMX_BUFFERFLAG_ENDOFFRAME;
-    err = OMX_EmptyThisBuffer(video_decoder, pointers[num - 1]);
-    if (err != OMX_ErrorNone)
-    {
-        printf("OMX_EmptyThisBuffer() returned %x\n", err);
-        exit(1);
-    }
-
-    return num;    
-}
+struct ouvr_decoder openmax_stereo_render = {
+    .init = omxr_stereo_initialize,
+    .process_frame = omxr_stereo_process_packet,
+    .deinit = omxr_deinitialize,
+};
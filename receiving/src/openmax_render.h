@@ -41,7 +41,6 @@
 }
 
 struct ouvr_decoder openmax_render;
-int omxr_get_available_buffers(OMX_BUFFERHEADERTYPE **pointers, int num);
-int omxr_empty_buffers(OMX_BUFFERHEADERTYPE **pointers, int num);
+struct ouvr_decoder openmax_stereo_render;
 
 #endif
\ No newline at end of file
@@ -35,25 +35,124 @@
 #include "raw.h"
 #include "udp_compat.h"
 #include "webrtc.h"
+#include "ffmpeg_render.h"
+#ifndef OUVR_NO_VIDEOCORE
 #include "openmax_render.h"
 #include "rgb_render.h"
 #include "openmax_audio.h"
 #include "ffmpeg_audio.h"
+#endif
 #include "feedback_net.h"
 #include "input_send.h"
+#include "thread_sched.h"
+#include "packet_pool.h"
+#include "spsc_queue.h"
+#include "jitter_buffer.h"
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <pthread.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+#include <time.h>
+#ifndef OUVR_NO_VIDEOCORE
+#include <bcm_host.h>
+#endif
 
 #define NUM_PACKETS 10
+// what the packets' buffers may take. Packets only grow as large as the frames they receive, so this holds three of
+// the largest ones where ten fixed packets used to take 100 MB
+#define PACKET_POOL_CAP (32 << 20)
+
+// packets in flight between the stages of openuvr_receive_loop(), the network stage waits when they are all in use
+#define PIPELINE_PACKETS 24
+// one frame being put together, one being decoded and the others waiting for the decoder or held by the jitter buffer
+#define PIPELINE_FRAMES 8
+// most packets a frame can come in, e.g. the slices of both eyes. Fewer than PIPELINE_PACKETS, so that a frame
+// being put together can always be completed
+#define FRAME_MAX_PACKETS 16
+// what openuvr_receive_loop() holds frames back by at most unless openuvr_set_jitter_buffer() says otherwise
+#define JITTER_MAX_DELAY_USEC 50000
+
+#define FRAME_EYE_LEFT 1
+#define FRAME_EYE_RIGHT 2
+
+typedef struct ouvr_frame_slot
+{
+    struct ouvr_packet *packets[FRAME_MAX_PACKETS];
+    int num_packets;
+    int keyframe;
+    // eyes with packets in the frame and eyes whose part of it has ended, FRAME_EYE_* bits
+    int eyes_seen;
+    int eyes_ended;
+    // when the frame was complete and queued for the decoder
+    struct timespec queued;
+} ouvr_frame_slot;
+
+/**
+ * State of openuvr_receive_loop(). The network stage receives into free packets and passes them to the reassembly
+ * stage, which groups them into frames and queues those for the decode stage on the caller's thread. Each queue has
+ * exactly one producer and one consumer thread, so packets and frame slots go back the way they came.
+ * When the decoder falls so far behind that every frame slot is taken, it drops the oldest frame instead of decoding
+ * it. The frames after it depend on it, so it then asks for a keyframe and skips frames until one arrives.
+ * With a jitter buffer the decode stage holds each frame until its deadline, and drops frames that missed theirs the
+ * same way, except for keyframes, which are what it would be waiting for.
+ */
+struct ouvr_receive_pipeline
+{
+    volatile int should_exit;
+    pthread_t network_thread;
+    pthread_t reassembly_thread;
+
+    struct ouvr_packet *packets[PIPELINE_PACKETS];
+    // network -> reassembly
+    ouvr_spsc_queue received;
+    sem_t packets_ready;
+    // decode -> network
+    ouvr_spsc_queue free_packets;
+    sem_t packets_free;
+
+    ouvr_frame_slot frames[PIPELINE_FRAMES];
+    // reassembly -> decode
+    ouvr_spsc_queue frame_queue;
+    sem_t frames_ready;
+    // decode -> reassembly
+    ouvr_spsc_queue free_frames;
+    sem_t frames_free;
+
+    // the stereo encoder ends each eye's half of a frame on its own, a frame is complete once both have ended. Set
+    // by the reassembly stage while right eye packets come in
+    int stream_is_stereo;
+    // streams whose encoder doesn't flag keyframes can't be waited on for one
+    int stream_has_keyframes;
+    int waiting_for_keyframe;
+    // NULL when frames are decoded as soon as they are complete
+    struct ouvr_jitter_buffer *jitter;
+
+    // each average is only updated by the stage that measures it
+    float avg_reassembly_usec;
+    float avg_queue_usec;
+    float avg_decode_usec;
+    atomic_ullong frames_received;
+    atomic_ullong frames_decoded;
+    atomic_ullong frames_dropped;
+    atomic_long reassembly_usec;
+    atomic_long queue_usec;
+    atomic_long decode_usec;
+    atomic_long max_total_usec;
+    atomic_long jitter_usec;
+    atomic_long jitter_delay_usec;
+    atomic_ullong frames_late;
+};
 
 // tests round-trip time of large blank packet
 void test_rtt(){
     struct ouvr_ctx *ctx = calloc(1, sizeof(struct ouvr_ctx));
     ctx->net=&raw_handler;
     ctx->flag_send_iframe = 1;
-    struct ouvr_packet *pkt=ouvr_packet_alloc();
+    ctx->pool = ouvr_packet_pool_alloc(PACKET_POOL_CAP);
+    struct ouvr_packet *pkt=ouvr_packet_alloc(ctx->pool);
     feedback_initialize(ctx);
     ctx->net->init(ctx);
     while(1){
@@ -64,10 +163,35 @@ void test_rtt(){
     exit(1);
 }
 
-struct openuvr_context *openuvr_alloc_context(enum OPENUVR_DECODER_TYPE dec_type, enum OPENUVR_NETWORK_TYPE net_type)
+// fills in what gets reported to the sender, the decoders have already called bcm_host_init(). Without a VideoCore
+// nothing is known about the display and 0 leaves the choice to the sender
+static void query_display(struct ouvr_ctx *ctx)
+{
+#ifndef OUVR_NO_VIDEOCORE
+    uint32_t width = 0, height = 0;
+    if (graphics_get_display_size(0, &width, &height) >= 0)
+    {
+        ctx->display_width = width;
+        ctx->display_height = height;
+    }
+    TV_DISPLAY_STATE_T state;
+    memset(&state, 0, sizeof(state));
+    if (vc_tv_get_display_state(&state) == 0 && (state.state & (VC_HDMI_HDMI | VC_HDMI_DVI)))
+    {
+        ctx->display_fps = state.display.hdmi.frame_rate;
+    }
+#endif
+    printf("display is %dx%d@%d\n", ctx->display_width, ctx->display_height, ctx->display_fps);
+}
+
+static struct openuvr_context *alloc_context(enum OPENUVR_DECODER_TYPE dec_type, enum OPENUVR_NETWORK_TYPE net_type, const struct openuvr_software_decoder_config *dec_config)
 {
     struct openuvr_context *ret = calloc(1, sizeof(struct openuvr_context));
     struct ouvr_ctx *ctx = calloc(1, sizeof(struct ouvr_ctx));
+    ctx->dec_config = dec_config;
+    ctx->threads = ouvr_threads_alloc();
+    ctx->pool = ouvr_packet_pool_alloc(PACKET_POOL_CAP);
+    ctx->jitter_max_delay_usec = JITTER_MAX_DELAY_USEC;
 
     //test_rtt();
 
@@ -96,12 +220,24 @@ struct openuvr_context *openuvr_alloc_context(enum OPENUVR_DECODER_TYPE dec_type
     
     switch (dec_type)
     {
+    case OPENUVR_DECODER_H264_SOFTWARE:
+        ctx->dec = &ffmpeg_render;
+        break;
+#ifndef OUVR_NO_VIDEOCORE
     case OPENUVR_DECODER_RGB:
         ctx->dec = &rgb_render;
         break;
+    case OPENUVR_DECODER_H264_STEREO:
+        ctx->dec = &openmax_stereo_render;
+        break;
     case OPENUVR_DECODER_H264:
     default:
         ctx->dec = &openmax_render;
+#else
+    default:
+        printf("only the software decoder is built without a VideoCore\n");
+        goto err;
+#endif
     }
     if (ctx->dec->init(ctx) != 0)
     {
@@ -110,9 +246,14 @@ struct openuvr_context *openuvr_alloc_context(enum OPENUVR_DECODER_TYPE dec_type
 #endif
         goto err;
     }
+    ctx->dec_config = NULL;
+    query_display(ctx);
 
+    // audio is played through the VideoCore too, without it the audio packets are dropped
+#ifndef OUVR_NO_VIDEOCORE
     ctx->aud = &openmax_audio;
-    if (ctx->aud->init(ctx) != 0)
+#endif
+    if (ctx->aud != NULL && ctx->aud->init(ctx) != 0)
     {
 #ifdef UE4DEBUG
     printf("audio init failed\n");
@@ -127,7 +268,11 @@ struct openuvr_context *openuvr_alloc_context(enum OPENUVR_DECODER_TYPE dec_type
     ctx->packets = calloc(sizeof(struct ouvr_packet *), NUM_PACKETS);
     for(int i = 0; i < NUM_PACKETS; i++)
     {
-        ctx->packets[i] = ouvr_packet_alloc();
+        ctx->packets[i] = ouvr_packet_alloc(ctx->pool);
+        if (ctx->packets[i] == NULL)
+        {
+            goto err;
+        }
     }
 
 //    send_input_loop_start();
@@ -144,35 +289,86 @@ struct openuvr_context *openuvr_alloc_context(enum OPENUVR_DECODER_TYPE dec_type
 #ifdef UE4DEBUG
     printf("feedback inited\n");
 #endif
+    // flag_send_iframe is set, so this asks for a keyframe and announces the receiver. A fan-out sender only sends
+    // to receivers it has heard from
+    feedback_send(ctx);
     ret->priv = ctx;
     return ret;
 
 err:
+    if (ctx->packets != NULL)
+    {
+        for (int i = 0; i < NUM_PACKETS; i++)
+        {
+            ouvr_packet_free(ctx->packets[i]);
+        }
+        free(ctx->packets);
+    }
+    ouvr_packet_pool_free(ctx->pool);
+    ouvr_threads_free(ctx->threads);
     free(ctx);
     free(ret);
     return NULL;
 }
 
+struct openuvr_context *openuvr_alloc_context(enum OPENUVR_DECODER_TYPE dec_type, enum OPENUVR_NETWORK_TYPE net_type)
+{
+    return alloc_context(dec_type, net_type, NULL);
+}
+
+struct openuvr_context *openuvr_alloc_context_software(enum OPENUVR_NETWORK_TYPE net_type, const struct openuvr_software_decoder_config *config)
+{
+    return alloc_context(OPENUVR_DECODER_H264_SOFTWARE, net_type, config);
+}
+
 #include <sys/time.h>
 
 int openuvr_receive_frame_raw_h264(struct openuvr_context *context)
 {
-    struct ouvr_ctx *ctx = context->priv;
-    raw_receive_and_decode(ctx);
-    feedback_send(ctx);
-    return 0;
+    // every transport that can receives into the decoder's buffers through openuvr_receive_frame() now
+    return openuvr_receive_frame(context);
 }
 
-int openuvr_receive_frame(struct openuvr_context *context)
+// the caller's thread decodes. It is tracked the first time it gets here, so that configuring the decode stage
+// places it, but keeps its name and, until then, wherever the application put it
+static void add_decode_thread(struct ouvr_ctx *ctx)
 {
-    struct ouvr_ctx *ctx = context->priv;
-    struct ouvr_packet *pkt = ctx->packets[0];
-    if (ctx->net->recv_packet(ctx, pkt) != 0)
+    if (!ctx->decode_thread_added)
     {
-        printf("recv_packet failed\n");
-        return -1;
+        ouvr_threads_add_caller(ctx->threads, OPENUVR_THREAD_DECODE, "decode");
+        ctx->decode_thread_added = 1;
     }
-    if (pkt->size == 4096)
+}
+
+// passes pkt to the audio or the video decoder, and tells the sender at the end of every frame
+static int process_packet(struct ouvr_ctx *ctx, struct ouvr_packet *pkt)
+{
+    if (pkt->num_lent > 0)
+    {
+        // the data is already in the decoder's buffers, unless it is for someone else or the decoder wants it whole
+        int ret = 1;
+        if (!(pkt->flags & OUVR_PACKET_FLAG_REPEAT) && !(pkt->size == 4096 && ctx->aud != NULL))
+        {
+            ret = ctx->dec->submit_buffers(ctx, pkt);
+        }
+        if (ret <= 0)
+        {
+            // the decoder has them back either way
+            pkt->num_lent = 0;
+            if (ret < 0)
+            {
+                return -1;
+            }
+            if (pkt->flags & OUVR_PACKET_FLAG_END_OF_FRAME || pkt->size == 0)
+                feedback_send(ctx);
+            return 0;
+        }
+        if (ouvr_packet_gather(pkt) != 0)
+        {
+            return -1;
+        }
+    }
+    if (pkt->size == 4096 && ctx->aud != NULL)
     {
 #ifdef UE4DEBUG
     // printf("received packet size = 4096, entering audio->process_frame\n");
@@ -188,14 +384,45 @@ int openuvr_receive_frame(struct openuvr_context *context)
 #ifdef UE4DEBUG
     printf("received packet size != 4096, entering decoder->process_frame\n");
 #endif
-        if (pkt->size && ctx->dec->process_frame(ctx, pkt) != 0)
+        // packets without data still matter when they mark the end of a frame that was sent in slices,
+        // but a repeated frame leaves the decoder with nothing to do
+        if (!(pkt->flags & OUVR_PACKET_FLAG_REPEAT) && (pkt->size || (pkt->flags & OUVR_PACKET_FLAG_END_OF_FRAME)) && ctx->dec->process_frame(ctx, pkt) != 0)
         {
 #ifdef UE4DEBUG
     printf("decoder->process_frame failed\n");
 #endif
             return -1;
         }
-        feedback_send(ctx);
+        if (pkt->flags & OUVR_PACKET_FLAG_END_OF_FRAME || pkt->size == 0)
+            feedback_send(ctx);
+    }
+    return 0;
+}
+
+int openuvr_receive_frame(struct openuvr_context *context)
+{
+    struct ouvr_ctx *ctx = context->priv;
+    add_decode_thread(ctx);
+    struct ouvr_packet *pkt = ctx->packets[0];
+    // only this path lends, the pipeline's packets wait in queues for longer than the decoder can spare its buffers
+    if (ctx->net->zero_copy && ctx->dec->lend_buffer != NULL)
+    {
+        ouvr_packet_lend(pkt, ctx);
+    }
+    int ret = ctx->net->recv_packet(ctx, pkt);
+    if (ret != 0)
+    {
+        printf("recv_packet failed\n");
+        ouvr_packet_drop(pkt);
+    }
+    else
+    {
+        ret = process_packet(ctx, pkt);
+    }
+    pkt->lender = NULL;
+    if (ret != 0)
+    {
+        return -1;
     }
 #if defined (TIME_NETWORK) || defined (TIME_DECODING)
     fflush(stdout);
@@ -203,38 +430,389 @@ int openuvr_receive_frame(struct openuvr_context *context)
     return 0;
 }
 
-int idx;
-pthread_mutex_t mut = PTHREAD_MUTEX_INITIALIZER;
-pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
+static long usec_between(const struct timespec *start, const struct timespec *end)
+{
+    return (end->tv_sec - start->tv_sec) * 1000000 + (end->tv_nsec - start->tv_nsec) / 1000;
+}
 
-static void *receive_loop(void *arg){
+static void *network_loop(void *arg)
+{
     struct ouvr_ctx *ctx = arg;
-    while(1){
-        int new_idx = (idx + 1) % NUM_PACKETS;
-        ctx->net->recv_packet(ctx,ctx->packets[new_idx]);
-        pthread_mutex_lock(&mut);
-        idx = new_idx;
-        pthread_cond_signal(&cond);
-        pthread_mutex_unlock(&mut);
+    struct ouvr_receive_pipeline *p = ctx->pipeline;
+
+    while (1)
+    {
+        sem_wait(&p->packets_free);
+        if (p->should_exit)
+        {
+            break;
+        }
+        struct ouvr_packet *pkt = ouvr_spsc_pop(&p->free_packets);
+        if (ctx->net->recv_packet(ctx, pkt) != 0)
+        {
+            printf("recv_packet failed\n");
+            p->should_exit = 1;
+            // wakes the other stages up so that they see it
+            sem_post(&p->packets_ready);
+            break;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &pkt->received);
+        ouvr_spsc_push(&p->received, pkt);
+        sem_post(&p->packets_ready);
+    }
+    return NULL;
+}
+
+static void queue_frame(struct ouvr_receive_pipeline *p, ouvr_frame_slot *frame)
+{
+    clock_gettime(CLOCK_MONOTONIC, &frame->queued);
+    long usec = usec_between(&frame->packets[0]->received, &frame->packets[frame->num_packets - 1]->received);
+    p->avg_reassembly_usec = 0.95 * p->avg_reassembly_usec + 0.05 * usec;
+    atomic_store(&p->reassembly_usec, p->avg_reassembly_usec);
+    atomic_fetch_add(&p->frames_received, 1);
+    ouvr_spsc_push(&p->frame_queue, frame);
+    sem_post(&p->frames_ready);
+}
+
+static void *reassembly_loop(void *arg)
+{
+    struct ouvr_ctx *ctx = arg;
+    struct ouvr_receive_pipeline *p = ctx->pipeline;
+    // the frame the packets are added to, taken from free_frames when its first packet arrives
+    ouvr_frame_slot *frame = NULL;
+
+    while (1)
+    {
+        sem_wait(&p->packets_ready);
+        // posted without a packet when the pipeline stops
+        if (p->should_exit)
+        {
+            break;
+        }
+        struct ouvr_packet *pkt = ouvr_spsc_pop(&p->received);
+        // a frame whose last packet was lost ends when the next one starts
+        if (frame != NULL && frame->packets[0]->frame_id != pkt->frame_id)
+        {
+            // a whole frame without the right eye, the sender is no longer sending stereo
+            if (!(frame->eyes_seen & FRAME_EYE_RIGHT))
+            {
+                p->stream_is_stereo = 0;
+            }
+            queue_frame(p, frame);
+            frame = NULL;
+        }
+        if (frame == NULL)
+        {
+            sem_wait(&p->frames_free);
+            if (p->should_exit)
+            {
+                break;
+            }
+            frame = ouvr_spsc_pop(&p->free_frames);
+            frame->num_packets = 0;
+            frame->keyframe = 0;
+            frame->eyes_seen = 0;
+            frame->eyes_ended = 0;
+        }
+        frame->packets[frame->num_packets++] = pkt;
+        frame->keyframe |= (pkt->flags & OUVR_PACKET_FLAG_KEYFRAME) != 0;
+        int eye = FRAME_EYE_LEFT;
+        if (pkt->flags & OUVR_PACKET_FLAG_RIGHT_EYE)
+        {
+            eye = FRAME_EYE_RIGHT;
+            p->stream_is_stereo = 1;
+        }
+        frame->eyes_seen |= eye;
+        // packets without data are the end of a sliced frame or what is left of a lost one
+        if ((pkt->flags & OUVR_PACKET_FLAG_END_OF_FRAME) || pkt->size == 0)
+        {
+            frame->eyes_ended |= eye;
+        }
+        // the other eye's packets may not have started to arrive when the first one ends
+        int eyes = frame->eyes_seen | (p->stream_is_stereo ? FRAME_EYE_LEFT | FRAME_EYE_RIGHT : FRAME_EYE_LEFT);
+        if ((frame->eyes_ended & eyes) == eyes || frame->num_packets == FRAME_MAX_PACKETS)
+        {
+            queue_frame(p, frame);
+            frame = NULL;
+        }
     }
+    sem_post(&p->frames_ready);
     return NULL;
 }
 
+// returns 0 when the frame was decoded or dropped, -1 when the decoder failed
+static int decode_frame(struct ouvr_ctx *ctx, struct ouvr_receive_pipeline *p, ouvr_frame_slot *frame)
+{
+    // scheduled before anything can drop it, so that the jitter buffer learns from every frame
+    int late = 0;
+    struct timespec deadline;
+    struct ouvr_packet *first = frame->packets[0];
+    // transit is timed on the last packet, sent and received, so that how long the frame took to send doesn't count
+    struct ouvr_packet *last = frame->packets[frame->num_packets - 1];
+    if (p->jitter != NULL && last->send_time.sec != 0)
+    {
+        int64_t send_usec = (int64_t)last->send_time.sec * 1000000 + last->send_time.usec;
+        long interval_usec = 1000000 / (first->frame_rate != 0 ? first->frame_rate : 60);
+        late = ouvr_jitter_schedule(p->jitter, send_usec, &last->received, interval_usec, &deadline) != 0;
+        atomic_store(&p->jitter_usec, (long)p->jitter->jitter_usec);
+        atomic_store(&p->jitter_delay_usec, p->jitter->target_usec);
+    }
+    else
+    {
+        clock_gettime(CLOCK_MONOTONIC, &deadline);
+    }
+    // every other slot is taken, the reassembly stage is about to wait for this one
+    if (ouvr_spsc_depth(&p->frame_queue) >= PIPELINE_FRAMES - 2)
+    {
+        atomic_fetch_add(&p->frames_dropped, 1);
+        p->waiting_for_keyframe = p->stream_has_keyframes;
+        ctx->flag_send_iframe = 5;
+        feedback_send(ctx);
+        return 0;
+    }
+    if (frame->keyframe)
+    {
+        p->stream_has_keyframes = 1;
+        p->waiting_for_keyframe = 0;
+    }
+    else if (p->waiting_for_keyframe)
+    {
+        atomic_fetch_add(&p->frames_dropped, 1);
+        feedback_send(ctx);
+        return 0;
+    }
+    else if (late)
+    {
+        atomic_fetch_add(&p->frames_late, 1);
+        atomic_fetch_add(&p->frames_dropped, 1);
+        p->waiting_for_keyframe = p->stream_has_keyframes;
+        ctx->flag_send_iframe = 5;
+        feedback_send(ctx);
+        return 0;
+    }
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL);
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < frame->num_packets; i++)
+    {
+        if (process_packet(ctx, frame->packets[i]) != 0)
+        {
+            return -1;
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    p->avg_queue_usec = 0.95 * p->avg_queue_usec + 0.05 * usec_between(&frame->queued, &start);
+    p->avg_decode_usec = 0.95 * p->avg_decode_usec + 0.05 * usec_between(&start, &end);
+    atomic_store(&p->queue_usec, p->avg_queue_usec);
+    atomic_store(&p->decode_usec, p->avg_decode_usec);
+    long total = usec_between(&frame->packets[0]->received, &end);
+    if (total > atomic_load(&p->max_total_usec))
+    {
+        atomic_store(&p->max_total_usec, total);
+    }
+    atomic_fetch_add(&p->frames_decoded, 1);
+    return 0;
+}
+
+static void free_pipeline(struct ouvr_receive_pipeline *p)
+{
+    for (int i = 0; i < PIPELINE_PACKETS; i++)
+    {
+        ouvr_packet_free(p->packets[i]);
+    }
+    ouvr_jitter_free(p->jitter);
+    ouvr_spsc_destroy(&p->received);
+    ouvr_spsc_destroy(&p->free_packets);
+    ouvr_spsc_destroy(&p->frame_queue);
+    ouvr_spsc_destroy(&p->free_frames);
+    sem_destroy(&p->packets_ready);
+    sem_destroy(&p->packets_free);
+    sem_destroy(&p->frames_ready);
+    sem_destroy(&p->frames_free);
+    free(p);
+}
+
+static struct ouvr_receive_pipeline *alloc_pipeline(struct ouvr_ctx *ctx)
+{
+    struct ouvr_receive_pipeline *p = calloc(1, sizeof(struct ouvr_receive_pipeline));
+    if (p == NULL)
+    {
+        return NULL;
+    }
+    atomic_init(&p->frames_received, 0);
+    atomic_init(&p->frames_decoded, 0);
+    atomic_init(&p->frames_dropped, 0);
+    atomic_init(&p->reassembly_usec, 0);
+    atomic_init(&p->queue_usec, 0);
+    atomic_init(&p->decode_usec, 0);
+    atomic_init(&p->max_total_usec, 0);
+    atomic_init(&p->jitter_usec, 0);
+    atomic_init(&p->jitter_delay_usec, 0);
+    atomic_init(&p->frames_late, 0);
+    sem_init(&p->packets_ready, 0, 0);
+    sem_init(&p->packets_free, 0, PIPELINE_PACKETS);
+    sem_init(&p->frames_ready, 0, 0);
+    sem_init(&p->frames_free, 0, PIPELINE_FRAMES);
+    if (ouvr_spsc_init(&p->received, PIPELINE_PACKETS) != 0 || ouvr_spsc_init(&p->free_packets, PIPELINE_PACKETS) != 0 ||
+        ouvr_spsc_init(&p->frame_queue, PIPELINE_FRAMES) != 0 || ouvr_spsc_init(&p->free_frames, PIPELINE_FRAMES) != 0)
+    {
+        free_pipeline(p);
+        return NULL;
+    }
+    if (ctx->jitter_max_delay_usec > 0 && (p->jitter = ouvr_jitter_alloc(ctx->jitter_max_delay_usec)) == NULL)
+    {
+        free_pipeline(p);
+        return NULL;
+    }
+    for (int i = 0; i < PIPELINE_PACKETS; i++)
+    {
+        p->packets[i] = ouvr_packet_alloc(ctx->pool);
+        if (p->packets[i] == NULL)
+        {
+            free_pipeline(p);
+            return NULL;
+        }
+        ouvr_spsc_push(&p->free_packets, p->packets[i]);
+    }
+    for (int i = 0; i < PIPELINE_FRAMES; i++)
+    {
+        ouvr_spsc_push(&p->free_frames, &p->frames[i]);
+    }
+    return p;
+}
+
+static void stop_pipeline(struct ouvr_ctx *ctx, struct ouvr_receive_pipeline *p)
+{
+    p->should_exit = 1;
+    sem_post(&p->packets_ready);
+    sem_post(&p->frames_free);
+    ouvr_threads_remove(ctx->threads, p->reassembly_thread);
+    pthread_join(p->reassembly_thread, NULL);
+    // the network stage only sees it once the packet it is receiving is complete
+    sem_post(&p->packets_free);
+    ouvr_threads_remove(ctx->threads, p->network_thread);
+    pthread_join(p->network_thread, NULL);
+    ctx->pipeline = NULL;
+    free_pipeline(p);
+}
+
 int openuvr_receive_loop(struct openuvr_context *context)
 {
     struct ouvr_ctx *ctx = context->priv;
-    pthread_t recv_thread;
-    pthread_create(&recv_thread, NULL, receive_loop, ctx);
+    struct ouvr_receive_pipeline *p = alloc_pipeline(ctx);
+    if (p == NULL)
+    {
+        printf("couldn't allocate the receive pipeline\n");
+        return 1;
+    }
+    ctx->pipeline = p;
+    pthread_create(&p->network_thread, NULL, network_loop, ctx);
+    ouvr_threads_add(ctx->threads, p->network_thread, OPENUVR_THREAD_RECEIVE, "receive");
+    pthread_create(&p->reassembly_thread, NULL, reassembly_loop, ctx);
+    ouvr_threads_add(ctx->threads, p->reassembly_thread, OPENUVR_THREAD_REASSEMBLE, "reassemble");
+    add_decode_thread(ctx);
 
-    while(1){
-        pthread_mutex_lock(&mut);
-        pthread_cond_wait(&cond, &mut);
-        int i = idx;
-        pthread_mutex_unlock(&mut);
-        if (ctx->dec->process_frame(ctx, ctx->packets[i]) != 0)
+    while (1)
+    {
+        sem_wait(&p->frames_ready);
+        ouvr_frame_slot *frame = ouvr_spsc_pop(&p->frame_queue);
+        if (frame == NULL)
+        {
+            // only posted without a frame when the network stage failed
+            break;
+        }
+        int ret = decode_frame(ctx, p, frame);
+        for (int i = 0; i < frame->num_packets; i++)
         {
-            return 1;
+            ouvr_packet_shrink(frame->packets[i]);
+            ouvr_spsc_push(&p->free_packets, frame->packets[i]);
+            sem_post(&p->packets_free);
         }
+        ouvr_spsc_push(&p->free_frames, frame);
+        sem_post(&p->frames_free);
+        if (ret != 0)
+        {
+            break;
+        }
+#if defined (TIME_NETWORK) || defined (TIME_DECODING)
+        fflush(stdout);
+#endif
+    }
+    stop_pipeline(ctx, p);
+    return 1;
+}
+
+int openuvr_get_receive_stats(struct openuvr_context *context, struct openuvr_receive_stats *stats)
+{
+    if (context == NULL || context->priv == NULL)
+    {
+        return -1;
+    }
+    struct ouvr_ctx *ctx = context->priv;
+    struct ouvr_receive_pipeline *p = ctx->pipeline;
+    memset(stats, 0, sizeof(*stats));
+    if (p != NULL)
+    {
+        stats->frames_received = atomic_load(&p->frames_received);
+        stats->frames_decoded = atomic_load(&p->frames_decoded);
+        stats->frames_dropped = atomic_load(&p->frames_dropped);
+        stats->frame_queue_depth = ouvr_spsc_depth(&p->frame_queue);
+        stats->reassembly_usec = atomic_load(&p->reassembly_usec);
+        stats->queue_usec = atomic_load(&p->queue_usec);
+        stats->decode_usec = atomic_load(&p->decode_usec);
+        stats->max_total_usec = atomic_load(&p->max_total_usec);
+        stats->jitter_usec = atomic_load(&p->jitter_usec);
+        stats->jitter_delay_usec = atomic_load(&p->jitter_delay_usec);
+        stats->frames_late = atomic_load(&p->frames_late);
     }
     return 0;
 }
+
+void openuvr_set_jitter_buffer(struct openuvr_context *context, long max_delay_usec)
+{
+    struct ouvr_ctx *ctx = context->priv;
+    ctx->jitter_max_delay_usec = max_delay_usec;
+}
+
+int openuvr_get_packet_pool_stats(struct openuvr_context *context, struct openuvr_pool_stats *stats)
+{
+    if (context == NULL || context->priv == NULL)
+    {
+        return -1;
+    }
+    struct ouvr_ctx *ctx = context->priv;
+    ouvr_packet_pool_stats(ctx->pool, stats);
+    return 0;
+}
+
+int openuvr_get_decoder_stats(struct openuvr_context *context, struct openuvr_decoder_stats *stats)
+{
+    if (context == NULL || context->priv == NULL)
+    {
+        return -1;
+    }
+    struct ouvr_ctx *ctx = context->priv;
+    if (ctx->dec->get_stats == NULL)
+    {
+        return -1;
+    }
+    return ctx->dec->get_stats(ctx, stats);
+}
+
+int openuvr_set_thread_config(struct openuvr_context *context, enum OPENUVR_THREAD_STAGE stage, const struct openuvr_thread_config *config)
+{
+    struct ouvr_ctx *ctx = context->priv;
+    return ouvr_threads_configure(ctx->threads, stage, config);
+}
+
+int openuvr_configure_threads(struct openuvr_context *context, const char *desc)
+{
+    struct ouvr_ctx *ctx = context->priv;
+    return ouvr_threads_parse(ctx->threads, desc);
+}
+
+int openuvr_lock_memory(void)
+{
+    return ouvr_lock_memory();
+}
@@ -31,6 +31,8 @@
 #ifndef OPENUVR_MAIN_H
 #define OPENUVR_MAIN_H
 
+#include <stdint.h>
+
 enum OPENUVR_NETWORK_TYPE
 {
     OPENUVR_NETWORK_TCP,
@@ -44,6 +46,32 @@ enum OPENUVR_DECODER_TYPE
 {
     OPENUVR_DECODER_H264,
     OPENUVR_DECODER_RGB,
+    OPENUVR_DECODER_H264_STEREO,
+    // libavcodec on the cpu, for receivers without a VideoCore. See openuvr_alloc_context_software()
+    OPENUVR_DECODER_H264_SOFTWARE,
+};
+
+// where the software decoder puts the decoded frames
+enum OPENUVR_SINK_TYPE
+{
+    // nowhere, for measuring the decoder alone
+    OPENUVR_SINK_NULL,
+    // appended to a file as raw I420, e.g. for ffplay -f rawvideo -pixel_format yuv420p -video_size WxH
+    OPENUVR_SINK_FILE,
+    // published as RGBA in /dev/shm/<name>, laid out as in ouvr_shm_frames.h for a viewer to pick up
+    OPENUVR_SINK_SHM,
+};
+
+struct openuvr_software_decoder_config
+{
+    // decoding threads, 0 for one per core
+    int threads;
+    // decodes several frames at once, which holds back a frame per extra thread. Slice threading otherwise, which
+    // only helps streams encoded in several slices
+    int frame_threading;
+    enum OPENUVR_SINK_TYPE sink;
+    // the file or the shared memory name
+    const char *sink_path;
 };
 
 struct openuvr_context
@@ -51,9 +79,115 @@ struct openuvr_context
     void *priv;
 };
 
+// the threads of a session, each named ouvr-<stage> or after what it does. receive and reassemble are the threads
+// openuvr_receive_loop() starts, decode the one calling openuvr_receive_frame() or openuvr_receive_loop(), and
+// workers the lz4 decompression threads
+enum OPENUVR_THREAD_STAGE
+{
+    OPENUVR_THREAD_RECEIVE,
+    OPENUVR_THREAD_DECODE,
+    OPENUVR_THREAD_WORKERS,
+    OPENUVR_THREAD_REASSEMBLE,
+};
+#define OPENUVR_THREAD_STAGES 4
+
+enum OPENUVR_SCHED_POLICY
+{
+    OPENUVR_SCHED_OTHER,
+    OPENUVR_SCHED_FIFO,
+    OPENUVR_SCHED_RR,
+};
+
+struct openuvr_thread_config
+{
+    // bit n lets the threads run on cpu n, 0 lets them run on any
+    uint64_t cpus;
+    enum OPENUVR_SCHED_POLICY policy;
+    // 1 to 99 for fifo and rr, which need CAP_SYS_NICE or an rtprio limit
+    int priority;
+};
+
+// the data buffers of the received packets
+struct openuvr_pool_stats
+{
+    // the most the pool maps, and what it has mapped now and at most. huge_page_bytes is the part backed by reserved
+    // huge pages, the rest is left to transparent huge pages
+    uint64_t cap;
+    uint64_t bytes_mapped;
+    uint64_t bytes_mapped_high_water;
+    uint64_t huge_page_bytes;
+    // held by packets, now and at most
+    uint64_t bytes_in_use;
+    uint64_t bytes_in_use_high_water;
+    int buffers_in_use;
+    int buffers_high_water;
+    // slabs mapped so far, and buffers refused because the cap was reached, each one a frame that was dropped
+    uint64_t slabs_mapped;
+    uint64_t failures;
+};
+
+// openuvr_receive_loop() only, 0 otherwise
+struct openuvr_receive_stats
+{
+    // frames put together from their packets, decoded, and dropped oldest first because the decoder fell behind
+    uint64_t frames_received;
+    uint64_t frames_decoded;
+    uint64_t frames_dropped;
+    // frames waiting for the decoder
+    int frame_queue_depth;
+    // averaged over the last frames: from the first to the last packet of a frame coming off the network, from then
+    // until the decoder took the frame, and how long decoding it took
+    long reassembly_usec;
+    long queue_usec;
+    long decode_usec;
+    // the slowest frame so far, from its first packet to decoded
+    long max_total_usec;
+    // the jitter buffer's estimate of the network jitter, how long it currently holds frames for, and the frames it
+    // dropped for arriving too late to be presented (part of frames_dropped). queue_usec includes the hold
+    long jitter_usec;
+    long jitter_delay_usec;
+    uint64_t frames_late;
+};
+
+// decoders that run on the cpu only
+struct openuvr_decoder_stats
+{
+    uint64_t frames_decoded;
+    // frames the decoder rejected, each one followed by a keyframe request
+    uint64_t decode_errors;
+    // time spent in the decoder for the last frame, on average and at most
+    long last_decode_usec;
+    long avg_decode_usec;
+    long max_decode_usec;
+    // the size of the last frame
+    int width;
+    int height;
+};
+
 struct openuvr_context *openuvr_alloc_context(enum OPENUVR_DECODER_TYPE dec_type, enum OPENUVR_NETWORK_TYPE net_type);
+// for OPENUVR_DECODER_H264_SOFTWARE, NULL config decodes on a thread per core into OPENUVR_SINK_NULL
+struct openuvr_context *openuvr_alloc_context_software(enum OPENUVR_NETWORK_TYPE net_type, const struct openuvr_software_decoder_config *config);
 int openuvr_receive_frame(struct openuvr_context *context);
+// receives, puts frames together and decodes on three threads, the caller's one decoding. Returns when decoding fails
 int openuvr_receive_loop(struct openuvr_context *context);
+int openuvr_get_receive_stats(struct openuvr_context *context, struct openuvr_receive_stats *stats);
+// openuvr_receive_loop() holds frames back by up to max_delay_usec to present them as evenly as the sender sent them.
+// 50 ms unless set before the loop starts, 0 decodes every frame as soon as it is complete
+void openuvr_set_jitter_buffer(struct openuvr_context *context, long max_delay_usec);
+// the same as openuvr_receive_frame(), which receives straight into the decoder's buffers where it can
 int openuvr_receive_frame_raw_h264(struct openuvr_context *context);
+int openuvr_get_packet_pool_stats(struct openuvr_context *context, struct openuvr_pool_stats *stats);
+// returns -1 for the decoders that don't keep them
+int openuvr_get_decoder_stats(struct openuvr_context *context, struct openuvr_decoder_stats *stats);
+// places the stage's threads, those running already and those started later, and prints where each one ended up.
+// Stages never configured are left with what the threads inherit from the process, e.g. from taskset or chrt.
+// Returns -1 if the configuration is invalid or a thread couldn't be placed, which then keeps running as it was
+int openuvr_set_thread_config(struct openuvr_context *context, enum OPENUVR_THREAD_STAGE stage, const struct openuvr_thread_config *config);
+// the same from a description of "stage=cpus[,policy[,priority]]" entries separated by ';', e.g.
+// "receive=1,fifo,60;decode=2-3,fifo,50". Stages are receive, reassemble, decode and workers, cpus a list like
+// 0+2-3 or "any", policy other, fifo or rr. An entry "mlock" calls openuvr_lock_memory()
+int openuvr_configure_threads(struct openuvr_context *context, const char *desc);
+// locks the process's memory, present and future, so that real-time threads don't stall on page faults
+int openuvr_lock_memory(void);
 
 #endif
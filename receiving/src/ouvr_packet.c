@@ -29,16 +29,178 @@
     Hung-Wei Tseng
 */
 #include "ouvr_packet.h"
+#include "packet_pool.h"
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
-struct ouvr_packet *ouvr_packet_alloc() {
+struct ouvr_packet *ouvr_packet_alloc(struct ouvr_packet_pool *pool) {
     struct ouvr_packet *pkt = malloc(sizeof(struct ouvr_packet));
-    pkt->data = malloc(10000000);
+    if (pkt == NULL)
+    {
+        return NULL;
+    }
+    pkt->data = ouvr_packet_pool_get(pool, 0, &pkt->capacity);
+    if (pkt->data == NULL)
+    {
+        printf("Packet pool exhausted\n");
+        free(pkt);
+        return NULL;
+    }
+    pkt->pool = pool;
+    atomic_init(&pkt->refs, 1);
     pkt->size = 0;
+    pkt->flags = 0;
+    pkt->frame_id = 0;
+    pkt->frame_width = 0;
+    pkt->frame_height = 0;
+    pkt->frame_rate = 0;
+    pkt->send_time.sec = 0;
+    pkt->send_time.usec = 0;
+    pkt->lender = NULL;
+    pkt->num_lent = 0;
+    return pkt;
+}
+
+struct ouvr_packet *ouvr_packet_ref(struct ouvr_packet *pkt) {
+    atomic_fetch_add_explicit(&pkt->refs, 1, memory_order_relaxed);
     return pkt;
 }
 
 void ouvr_packet_free(struct ouvr_packet *pkt) {
-    free(pkt->data);
+    if (pkt == NULL || atomic_fetch_sub_explicit(&pkt->refs, 1, memory_order_acq_rel) != 1)
+    {
+        return;
+    }
+    ouvr_packet_pool_put(pkt->pool, pkt->data);
     free(pkt);
-}
\ No newline at end of file
+}
+
+int ouvr_packet_reserve(struct ouvr_packet *pkt, int size) {
+    if (size <= pkt->capacity)
+    {
+        return 0;
+    }
+    int capacity;
+    unsigned char *data = ouvr_packet_pool_get(pkt->pool, size, &capacity);
+    if (data == NULL)
+    {
+        printf("No buffer for a %d byte packet\n", size);
+        return -1;
+    }
+    memcpy(data, pkt->data, pkt->size);
+    ouvr_packet_pool_put(pkt->pool, pkt->data);
+    pkt->data = data;
+    pkt->capacity = capacity;
+    return 0;
+}
+
+void ouvr_packet_shrink(struct ouvr_packet *pkt) {
+    if (pkt->capacity <= OUVR_PACKET_KEEP_CAPACITY)
+    {
+        return;
+    }
+    int capacity;
+    unsigned char *data = ouvr_packet_pool_get(pkt->pool, 0, &capacity);
+    if (data == NULL)
+    {
+        return;
+    }
+    ouvr_packet_pool_put(pkt->pool, pkt->data);
+    pkt->data = data;
+    pkt->capacity = capacity;
+    pkt->size = 0;
+}
+
+void ouvr_packet_read_header(struct ouvr_packet *pkt, const ouvr_packet_header *hdr) {
+    pkt->flags = hdr->flags;
+    pkt->frame_id = hdr->frame_id;
+    pkt->fovea = hdr->fovea;
+    pkt->frame_width = hdr->frame_width;
+    pkt->frame_height = hdr->frame_height;
+    pkt->frame_rate = hdr->frame_rate;
+    pkt->send_time = hdr->send_time;
+}
+void ouvr_packet_lend(struct ouvr_packet *pkt, struct ouvr_ctx *ctx) {
+    pkt->lender = ctx->dec->lend_buffer != NULL ? ctx : NULL;
+    pkt->num_lent = 0;
+}
+
+static void return_lent(struct ouvr_packet *pkt) {
+    if (pkt->num_lent > 0)
+    {
+        pkt->lender->dec->return_buffers(pkt->lender, pkt);
+        pkt->num_lent = 0;
+    }
+}
+
+int ouvr_packet_tail(struct ouvr_packet *pkt, int room, int expected, unsigned char **tail) {
+    if (pkt->lender != NULL)
+    {
+        ouvr_lent_buffer *buf;
+        if (pkt->num_lent > 0)
+        {
+            buf = &pkt->lent[pkt->num_lent - 1];
+            if (buf->capacity - buf->size >= room)
+            {
+                *tail = buf->data + buf->size;
+                return buf->capacity - buf->size;
+            }
+        }
+        buf = &pkt->lent[pkt->num_lent];
+        if (pkt->num_lent < OUVR_PACKET_MAX_LENT && pkt->lender->dec->lend_buffer(pkt->lender, pkt, room, buf) == 0)
+        {
+            buf->size = 0;
+            pkt->num_lent++;
+            *tail = buf->data;
+            return buf->capacity;
+        }
+        // the decoder has nothing left to lend, what came so far joins the rest in data
+        if (ouvr_packet_gather(pkt) != 0)
+        {
+            return -1;
+        }
+        pkt->lender = NULL;
+    }
+    if (pkt->size + room > pkt->capacity && ouvr_packet_reserve(pkt, (expected > pkt->size ? expected : pkt->size) + room) != 0)
+    {
+        return -1;
+    }
+    *tail = pkt->data + pkt->size;
+    return pkt->capacity - pkt->size;
+}
+
+void ouvr_packet_commit(struct ouvr_packet *pkt, int n) {
+    pkt->size += n;
+    if (pkt->num_lent > 0)
+    {
+        pkt->lent[pkt->num_lent - 1].size += n;
+    }
+}
+
+int ouvr_packet_gather(struct ouvr_packet *pkt) {
+    if (pkt->num_lent == 0)
+    {
+        return 0;
+    }
+    int size = pkt->size;
+    // nothing in data is worth keeping
+    pkt->size = 0;
+    if (ouvr_packet_reserve(pkt, size) != 0)
+    {
+        return_lent(pkt);
+        return -1;
+    }
+    for (int i = 0; i < pkt->num_lent; i++)
+    {
+        memcpy(pkt->data + pkt->size, pkt->lent[i].data, pkt->lent[i].size);
+        pkt->size += pkt->lent[i].size;
+    }
+    return_lent(pkt);
+    return 0;
+}
+
+void ouvr_packet_drop(struct ouvr_packet *pkt) {
+    return_lent(pkt);
+    pkt->size = 0;
+}
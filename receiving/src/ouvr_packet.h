@@ -34,14 +34,26 @@ struct ouvr_packet;
 struct ouvr_network;
 struct ouvr_encoder;
 struct ouvr_ctx;
+struct ouvr_threads;
+struct ouvr_packet_pool;
+struct ouvr_receive_pipeline;
+struct openuvr_software_decoder_config;
+struct openuvr_decoder_stats;
 
 // #define SERVER_IP "172.16.38.214"
 // #define CLIENT_IP "172.16.44.23"
 
+// both can be given to make, LOOPBACK=1 runs the sender and the receiver on one machine
+#ifndef SERVER_IP
 #define SERVER_IP "192.168.1.2"
+#endif
+#ifndef CLIENT_IP
 #define CLIENT_IP "192.168.1.3"
+#endif
 
 #include <stdint.h>
+#include <stdatomic.h>
+#include <time.h>
 
 typedef struct timevalue
 {
@@ -49,19 +61,130 @@ typedef struct timevalue
     int32_t usec;
 } timevalue;
 
+// set on the last packet of a frame; encoders that stream slices send several packets per frame
+#define OUVR_PACKET_FLAG_END_OF_FRAME 0x1
+// the frame is identical to the previous one, the packet carries no data and the receiver keeps showing what it has
+#define OUVR_PACKET_FLAG_REPEAT 0x2
+// the picture is packed by the sender's foveated_pack, with the foveae taken from the positions in the header.
+// It is OUVR_FOVEATED_PACKED_WIDTH() of the frame_width in the header wide
+#define OUVR_PACKET_FLAG_FOVEATED 0x4
+#define OUVR_FOVEATED_PACKED_WIDTH(width) ((width) / 2)
+// the packet belongs to the right eye's stream of a frame sent by the stereo encoder, which encodes each eye separately
+#define OUVR_PACKET_FLAG_RIGHT_EYE 0x8
+// the packet belongs to a frame the decoder can start from
+#define OUVR_PACKET_FLAG_KEYFRAME 0x10
+
+// top left corner of each eye's full resolution fovea, relative to the eye's view
+typedef struct ouvr_fovea_position
+{
+    uint16_t num_eyes;
+    uint16_t left[2];
+    uint16_t top[2];
+} ouvr_fovea_position;
+
+// received in front of every datagram (udp, raw) or every packet (tcp)
+typedef struct ouvr_packet_header
+{
+    int32_t size;
+    uint32_t flags;
+    uint32_t frame_id;
+    timevalue send_time;
+    ouvr_fovea_position fovea;
+    // geometry and frame rate of the session, so the receiver can follow changes without being restarted
+    uint16_t frame_width;
+    uint16_t frame_height;
+    uint16_t frame_rate;
+} ouvr_packet_header;
+
+// sent by the receiver on the feedback socket. Besides asking for an i-frame, it tells the sender the largest
+// picture and the highest frame rate the receiver's display can show, 0 when it doesn't know
+typedef struct ouvr_feedback_msg
+{
+    int32_t send_iframe;
+    uint16_t max_width;
+    uint16_t max_height;
+    uint16_t max_fps;
+} ouvr_feedback_msg;
+
+// most decoder buffers one packet is received into, the rest of a larger one goes into data after all
+#define OUVR_PACKET_MAX_LENT 16
+
+// an input buffer a decoder lends to the transport to receive straight into
+typedef struct ouvr_lent_buffer
+{
+    unsigned char *data;
+    int capacity;
+    // what was received into it
+    int size;
+    // the decoder's own handle for it
+    void *priv;
+} ouvr_lent_buffer;
+
 struct ouvr_packet
 {
     unsigned char *data;
     int size;
+    uint32_t flags;
+    uint32_t frame_id;
+    ouvr_fovea_position fovea;
+    // geometry the sender is using, 0 for transports that don't carry a header
+    uint16_t frame_width;
+    uint16_t frame_height;
+    uint16_t frame_rate;
+    // when the sender sent it by its own clock, 0 for transports that don't carry a header
+    timevalue send_time;
+    // what data can hold, the handlers call ouvr_packet_reserve() once they know how large the packet is
+    int capacity;
+    struct ouvr_packet_pool *pool;
+    atomic_int refs;
+    // when the packet came off the network, set by openuvr_receive_loop()
+    struct timespec received;
+    // set through ouvr_packet_lend() for one receive: the session whose decoder lends buffers for the payload, which
+    // then lands in lent rather than data. size still counts all of it
+    struct ouvr_ctx *lender;
+    ouvr_lent_buffer lent[OUVR_PACKET_MAX_LENT];
+    int num_lent;
 };
 
-struct ouvr_packet *ouvr_packet_alloc();
+// the largest packet there can be
+#define OUVR_PACKET_CAPACITY 10000000
+
+// a packet with a small buffer from pool, NULL if the pool is exhausted
+struct ouvr_packet *ouvr_packet_alloc(struct ouvr_packet_pool *pool);
+// another reference to pkt for a stage that holds on to it, each one is dropped by ouvr_packet_free()
+struct ouvr_packet *ouvr_packet_ref(struct ouvr_packet *pkt);
 void ouvr_packet_free(struct ouvr_packet *pkt);
+// makes room for size bytes of data, moving the first pkt->size bytes to a larger buffer if needed. Returns -1 when
+// size is above OUVR_PACKET_CAPACITY or the pool is at its cap, pkt keeps the buffer it had
+int ouvr_packet_reserve(struct ouvr_packet *pkt, int size);
+// swaps a buffer larger than OUVR_PACKET_KEEP_CAPACITY for a small one, so that packets waiting to be reused don't
+// hold on to what a keyframe took
+void ouvr_packet_shrink(struct ouvr_packet *pkt);
+#define OUVR_PACKET_KEEP_CAPACITY (1 << 20)
+// copies what the packet needs from the header that came with it
+void ouvr_packet_read_header(struct ouvr_packet *pkt, const ouvr_packet_header *hdr);
+
+// the next payload received into pkt goes into buffers lent by ctx's decoder, when it lends any. Only for transports
+// with zero_copy set
+void ouvr_packet_lend(struct ouvr_packet *pkt, struct ouvr_ctx *ctx);
+// where a transport puts the next bytes of the payload, at least room of them in a row. expected is how large the
+// packet will be as far as the transport knows, for growing data once rather than datagram by datagram. Returns how
+// many bytes there are at *tail, -1 when there is no room left and the rest of the packet has to be dropped
+int ouvr_packet_tail(struct ouvr_packet *pkt, int room, int expected, unsigned char **tail);
+// n bytes were written at the tail
+void ouvr_packet_commit(struct ouvr_packet *pkt, int n);
+// moves a payload received into lent buffers into data and gives them back, for decoders that can't take it as it
+// is. Returns -1 if data can't hold it, the packet is then empty
+int ouvr_packet_gather(struct ouvr_packet *pkt);
+// empties the packet, giving back any lent buffers unused
+void ouvr_packet_drop(struct ouvr_packet *pkt);
 
 struct ouvr_network
 {
     int (*init)(struct ouvr_ctx *ctx);
     int (*recv_packet)(struct ouvr_ctx *ctx, struct ouvr_packet *pkt);
+    // recv_packet writes the payload through ouvr_packet_tail(), so it can go straight into the decoder's buffers
+    int zero_copy;
 };
 
 struct ouvr_decoder
@@ -69,6 +192,16 @@ struct ouvr_decoder
     int (*init)(struct ouvr_ctx *ctx);
     int (*process_frame)(struct ouvr_ctx *ctx, struct ouvr_packet *pkt);
     void (*deinit)(struct ouvr_ctx *ctx);
+    // NULL for decoders that don't keep any
+    int (*get_stats)(struct ouvr_ctx *ctx, struct openuvr_decoder_stats *stats);
+    // NULL for decoders that only take packets through process_frame. lend_buffer hands out the next free input
+    // buffer with at least room bytes, or returns -1 to have the rest of the packet received into its data. It may
+    // wait for the decoder to finish with a buffer, but not for one lent to pkt. submit_buffers decodes the packet
+    // from the buffers it was received into, or returns 1 to have it gathered into data and given to process_frame.
+    // return_buffers takes back buffers that were lent to pkt and never submitted
+    int (*lend_buffer)(struct ouvr_ctx *ctx, struct ouvr_packet *pkt, int room, ouvr_lent_buffer *buf);
+    int (*submit_buffers)(struct ouvr_ctx *ctx, struct ouvr_packet *pkt);
+    void (*return_buffers)(struct ouvr_ctx *ctx, struct ouvr_packet *pkt);
 };
 
 struct ouvr_audio
@@ -84,11 +217,27 @@ struct ouvr_ctx
     void *net_priv;
     struct ouvr_decoder *dec;
     void *dec_priv;
+    // what openuvr_alloc_context_software() was given, only valid during dec->init()
+    const struct openuvr_software_decoder_config *dec_config;
     struct ouvr_audio *aud;
     void *aud_priv;
     int num_packets;
     struct ouvr_packet **packets;
+    // where the packets get their buffers
+    struct ouvr_packet_pool *pool;
     int flag_send_iframe;
+    // what the display can show, reported to the sender with every feedback message
+    uint16_t display_width;
+    uint16_t display_height;
+    uint16_t display_fps;
+    // every thread of the session by stage, placed as configured through openuvr_set_thread_config()
+    struct ouvr_threads *threads;
+    // the thread decoding frames has been added to threads
+    int decode_thread_added;
+    // the threads of openuvr_receive_loop() while it runs
+    struct ouvr_receive_pipeline *pipeline;
+    // most the loop's jitter buffer holds a frame for, 0 without one
+    long jitter_max_delay_usec;
 };
 
 #endif
@@ -0,0 +1,299 @@
+/*
+    The MIT License (MIT)
+
+    Copyright (c) 2020 OpenUVR
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+
+    Authors:
+    Alec Rohloff
+    Zackary Allen
+    Kung-Min Lin
+    Chengyi Nie
+    Hung-Wei Tseng
+*/
+/**
+ * Packet buffer pool. Buffers come in a few size classes, each carved out of slabs of at least one 2 MB huge page.
+ * Slabs are mapped with MAP_HUGETLB when huge pages have been reserved, and otherwise aligned to 2 MB and offered to
+ * transparent huge pages, so that walking a 10 MB frame doesn't take thousands of TLB misses. Free buffers are kept
+ * on a list per class, linked through their first bytes. When the cap is reached, slabs with no buffer handed out
+ * are unmapped to make room for the class that needs it, so a pool that once held large keyframes doesn't keep them.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#include "packet_pool.h"
+#include "ouvr_packet.h"
+
+#define HUGE_PAGE_SIZE (2 << 20)
+#define ROUND_UP(x, to) (((x) + (to)-1) / (to) * (to))
+
+// 64 kB for audio and tiny frames up to the largest packet, a class is picked for each new packet and grows from there
+#define NUM_CLASSES 5
+static const size_t class_sizes[NUM_CLASSES] = {1 << 16, 1 << 18, 1 << 20, 1 << 22, ROUND_UP(OUVR_PACKET_CAPACITY, HUGE_PAGE_SIZE)};
+
+typedef struct pool_slab
+{
+    struct pool_slab *next;
+    uint8_t *mem;
+    size_t size;
+    int huge;
+    // buffers handed out
+    int used;
+} pool_slab;
+
+typedef struct pool_class
+{
+    pool_slab *slabs;
+    void *free_list;
+} pool_class;
+
+struct ouvr_packet_pool
+{
+    pthread_mutex_t lock;
+    pool_class classes[NUM_CLASSES];
+    struct openuvr_pool_stats stats;
+};
+
+static size_t slab_size(int cls)
+{
+    return class_sizes[cls] < HUGE_PAGE_SIZE ? HUGE_PAGE_SIZE : class_sizes[cls];
+}
+
+static uint8_t *map_slab(size_t size, int *huge)
+{
+    void *mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (mem != MAP_FAILED)
+    {
+        *huge = 1;
+        return mem;
+    }
+    *huge = 0;
+    // map a huge page more than needed and trim it, transparent huge pages only back aligned ranges
+    uint8_t *raw = mmap(NULL, size + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (raw == MAP_FAILED)
+    {
+        return NULL;
+    }
+    uint8_t *aligned = (uint8_t *)ROUND_UP((uintptr_t)raw, HUGE_PAGE_SIZE);
+    if (aligned > raw)
+    {
+        munmap(raw, aligned - raw);
+    }
+    munmap(aligned + size, raw + HUGE_PAGE_SIZE - aligned);
+#ifdef MADV_HUGEPAGE
+    madvise(aligned, size, MADV_HUGEPAGE);
+#endif
+    return aligned;
+}
+
+static int add_slab(struct ouvr_packet_pool *pool, int cls)
+{
+    size_t size = slab_size(cls);
+    if (pool->stats.bytes_mapped + size > pool->stats.cap)
+    {
+        return -1;
+    }
+    pool_slab *slab = calloc(1, sizeof(pool_slab));
+    if (slab == NULL)
+    {
+        return -1;
+    }
+    slab->mem = map_slab(size, &slab->huge);
+    if (slab->mem == NULL)
+    {
+        free(slab);
+        return -1;
+    }
+    slab->size = size;
+    pool_class *c = &pool->classes[cls];
+    slab->next = c->slabs;
+    c->slabs = slab;
+    // pushed back to front so that buffers are handed out in address order
+    for (size_t i = size / class_sizes[cls]; i-- > 0;)
+    {
+        uint8_t *buf = slab->mem + i * class_sizes[cls];
+        *(void **)buf = c->free_list;
+        c->free_list = buf;
+    }
+    pool->stats.bytes_mapped += size;
+    if (slab->huge)
+    {
+        pool->stats.huge_page_bytes += size;
+    }
+    if (pool->stats.bytes_mapped > pool->stats.bytes_mapped_high_water)
+    {
+        pool->stats.bytes_mapped_high_water = pool->stats.bytes_mapped;
+    }
+    pool->stats.slabs_mapped++;
+    return 0;
+}
+
+static void unmap_slab(struct ouvr_packet_pool *pool, pool_slab *slab)
+{
+    pool->stats.bytes_mapped -= slab->size;
+    if (slab->huge)
+    {
+        pool->stats.huge_page_bytes -= slab->size;
+    }
+    munmap(slab->mem, slab->size);
+    free(slab);
+}
+
+// unmaps the slabs none of whose buffers are handed out
+static void trim(struct ouvr_packet_pool *pool)
+{
+    for (int cls = 0; cls < NUM_CLASSES; cls++)
+    {
+        pool_class *c = &pool->classes[cls];
+        pool_slab **sp = &c->slabs;
+        while (*sp != NULL)
+        {
+            pool_slab *slab = *sp;
+            if (slab->used > 0)
+            {
+                sp = &slab->next;
+                continue;
+            }
+            void **bp = &c->free_list;
+            while (*bp != NULL)
+            {
+                if ((uint8_t *)*bp >= slab->mem && (uint8_t *)*bp < slab->mem + slab->size)
+                {
+                    *bp = *(void **)*bp;
+                }
+                else
+                {
+                    bp = (void **)*bp;
+                }
+            }
+            *sp = slab->next;
+            unmap_slab(pool, slab);
+        }
+    }
+}
+
+struct ouvr_packet_pool *ouvr_packet_pool_alloc(size_t cap)
+{
+    struct ouvr_packet_pool *pool = calloc(1, sizeof(struct ouvr_packet_pool));
+    if (pool == NULL)
+    {
+        return NULL;
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+    pool->stats.cap = cap;
+    return pool;
+}
+
+void ouvr_packet_pool_free(struct ouvr_packet_pool *pool)
+{
+    if (pool == NULL)
+    {
+        return;
+    }
+    for (int cls = 0; cls < NUM_CLASSES; cls++)
+    {
+        while (pool->classes[cls].slabs != NULL)
+        {
+            pool_slab *slab = pool->classes[cls].slabs;
+            pool->classes[cls].slabs = slab->next;
+            unmap_slab(pool, slab);
+        }
+    }
+    pthread_mutex_destroy(&pool->lock);
+    free(pool);
+}
+
+uint8_t *ouvr_packet_pool_get(struct ouvr_packet_pool *pool, size_t size, int *capacity)
+{
+    int cls = 0;
+    while (cls < NUM_CLASSES && class_sizes[cls] < size)
+    {
+        cls++;
+    }
+    if (cls == NUM_CLASSES || size > OUVR_PACKET_CAPACITY)
+    {
+        return NULL;
+    }
+    pthread_mutex_lock(&pool->lock);
+    pool_class *c = &pool->classes[cls];
+    if (c->free_list == NULL && add_slab(pool, cls) != 0)
+    {
+        trim(pool);
+        if (add_slab(pool, cls) != 0)
+        {
+            pool->stats.failures++;
+            pthread_mutex_unlock(&pool->lock);
+            return NULL;
+        }
+    }
+    uint8_t *buf = c->free_list;
+    c->free_list = *(void **)buf;
+    for (pool_slab *slab = c->slabs; slab != NULL; slab = slab->next)
+    {
+        if (buf >= slab->mem && buf < slab->mem + slab->size)
+        {
+            slab->used++;
+            break;
+        }
+    }
+    pool->stats.bytes_in_use += class_sizes[cls];
+    if (pool->stats.bytes_in_use > pool->stats.bytes_in_use_high_water)
+    {
+        pool->stats.bytes_in_use_high_water = pool->stats.bytes_in_use;
+    }
+    if (++pool->stats.buffers_in_use > pool->stats.buffers_high_water)
+    {
+        pool->stats.buffers_high_water = pool->stats.buffers_in_use;
+    }
+    pthread_mutex_unlock(&pool->lock);
+    *capacity = class_sizes[cls];
+    return buf;
+}
+
+void ouvr_packet_pool_put(struct ouvr_packet_pool *pool, uint8_t *buf)
+{
+    pthread_mutex_lock(&pool->lock);
+    for (int cls = 0; cls < NUM_CLASSES; cls++)
+    {
+        for (pool_slab *slab = pool->classes[cls].slabs; slab != NULL; slab = slab->next)
+        {
+            if (buf >= slab->mem && buf < slab->mem + slab->size)
+            {
+                slab->used--;
+                *(void **)buf = pool->classes[cls].free_list;
+                pool->classes[cls].free_list = buf;
+                pool->stats.bytes_in_use -= class_sizes[cls];
+                pool->stats.buffers_in_use--;
+                pthread_mutex_unlock(&pool->lock);
+                return;
+            }
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void ouvr_packet_pool_stats(struct ouvr_packet_pool *pool, struct openuvr_pool_stats *stats)
+{
+    pthread_mutex_lock(&pool->lock);
+    *stats = pool->stats;
+    pthread_mutex_unlock(&pool->lock);
+}
@@ -0,0 +1,53 @@
+/*
+    The MIT License (MIT)
+
+    Copyright (c) 2020 OpenUVR
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+
+    Authors:
+    Alec Rohloff
+    Zackary Allen
+    Kung-Min Lin
+    Chengyi Nie
+    Hung-Wei Tseng
+*/
+
+#ifndef OUVR_PACKET_POOL_H
+#define OUVR_PACKET_POOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "openuvr.h"
+
+struct ouvr_packet_pool;
+
+// data buffers for the packets of one session, in size classes carved out of slabs that are mapped when a class runs
+// out. No more than cap bytes are ever mapped
+struct ouvr_packet_pool *ouvr_packet_pool_alloc(size_t cap);
+// every buffer has to be back in the pool
+void ouvr_packet_pool_free(struct ouvr_packet_pool *pool);
+// a buffer of at least size bytes starting on a cache line, its actual size is put in *capacity. Returns NULL when
+// size is above OUVR_PACKET_CAPACITY or the pool would have to map more than its cap
+uint8_t *ouvr_packet_pool_get(struct ouvr_packet_pool *pool, size_t size, int *capacity);
+void ouvr_packet_pool_put(struct ouvr_packet_pool *pool, uint8_t *buf);
+void ouvr_packet_pool_stats(struct ouvr_packet_pool *pool, struct openuvr_pool_stats *stats);
+
+#endif
@@ -53,7 +53,9 @@ typedef struct raw_net_context
     unsigned char eth_header[14];
     int fd;
     struct msghdr msg;
-    struct iovec iov[4];
+    struct iovec iov[3];
+    // where the rest of a packet too large for the pool goes
+    unsigned char discard[RECV_SIZE];
 } raw_net_context;
 
 unsigned char const global_eth_header[14] = {0x9c, 0xda, 0x3e, 0xa3, 0xd8, 0x29, 0xb8, 0x27, 0xeb, 0xce, 0x97, 0x68, 0x88, 0xb5};
@@ -81,7 +83,7 @@ static int raw_initialize(struct ouvr_ctx *ctx)
     c->iov[0].iov_len = sizeof(c->eth_header);
     srand(17); 
     c->msg.msg_iov = c->iov;
-    c->msg.msg_iovlen = 4;
+    c->msg.msg_iovlen = 3;
     return 0;
 }
 
@@ -98,20 +100,24 @@ static int raw_receive_packet(struct ouvr_ctx *ctx, struct ouvr_packet *pkt)
 #endif
     raw_net_context *c = ctx->net_priv;
     register ssize_t r;
-    unsigned char *start_pos = pkt->data;
     int offset = 0;
-    int expected_size = 1;
+    int dropping = 0;
+    // size starts at 1 so that at least one datagram is read, a packet may have no payload at all
+    ouvr_packet_header hdr = {.size = 1};
     struct timespec time_of_last_receive = {.tv_sec = 0}, time_temp;
-    struct timevalue sending_tv;
+    unsigned char *tail;
     pkt->size = 0;
-    c->iov[1].iov_len = sizeof(expected_size);
-    c->iov[1].iov_base = &expected_size;
-    c->iov[2].iov_len = sizeof(sending_tv);
-    c->iov[2].iov_base = &sending_tv;
-    c->iov[3].iov_len = RECV_SIZE;
-    while (offset < expected_size)
+    c->iov[1].iov_len = sizeof(hdr);
+    c->iov[1].iov_base = &hdr;
+    c->iov[2].iov_len = RECV_SIZE;
+    while (offset < hdr.size)
     {
-        c->iov[3].iov_base = start_pos + offset;
+        // see udp.c
+        if (!dropping && ouvr_packet_tail(pkt, RECV_SIZE, hdr.size, &tail) < 0)
+        {
+            dropping = 1;
+        }
+        c->iov[2].iov_base = dropping ? c->discard : tail;
         r = recvmsg(c->fd, &c->msg, 0);
         if (r < -1)
         {
@@ -126,8 +132,11 @@ static int raw_receive_packet(struct ouvr_ctx *ctx, struct ouvr_packet *pkt)
                 has_received_first = 1;
             }
 #endif
-            offset += r - (sizeof(c->eth_header) + sizeof(expected_size) + sizeof(sending_tv));
-            pkt->size += r - (sizeof(c->eth_header) + sizeof(expected_size) + sizeof(sending_tv));
+            offset += r - (sizeof(c->eth_header) + sizeof(hdr));
+            if (!dropping)
+            {
+                ouvr_packet_commit(pkt, r - (sizeof(c->eth_header) + sizeof(hdr)));
+            }
             clock_gettime(CLOCK_MONOTONIC, &time_of_last_receive);
         }
         else
@@ -137,22 +146,30 @@ static int raw_receive_packet(struct ouvr_ctx *ctx, struct ouvr_packet *pkt)
             if(time_temp.tv_sec > time_of_last_receive.tv_sec)
                 elapsed += 1000000000;
             if(elapsed > 3000000 && time_of_last_receive.tv_sec > 0){
-                pkt->size = 0;
+                ouvr_packet_drop(pkt);
+                hdr.flags = 0;
                 //printf("dropped %ld\n", time_of_last_receive.tv_nsec);
                 ctx->flag_send_iframe = 5;
                 break;
             }
         }
     }
+    if (dropping)
+    {
+        ouvr_packet_drop(pkt);
+        hdr.flags = 0;
+        ctx->flag_send_iframe = 5;
+    }
+    ouvr_packet_read_header(pkt, &hdr);
 #ifdef TIME_NETWORK
     gettimeofday(&end_time, NULL);
     long elapsed = end_time.tv_usec - start_time.tv_usec + (end_time.tv_sec > start_time.tv_sec ? 1000000 : 0);
     avg_time = 0.998 * avg_time + 0.002 * elapsed;
     printf("\rnet avg: %f,  elapsed: %ld", avg_time, elapsed);
 
-    long transfered = end_time.tv_usec - sending_tv.usec + (end_time.tv_sec - sending_tv.sec) * 1000000;
+    long transfered = end_time.tv_usec - hdr.send_time.usec + (end_time.tv_sec - hdr.send_time.sec) * 1000000;
     avg_transfer_time = 0.998 * avg_transfer_time + 0.002 * transfered;
-    printf("sendtime: sec: %d, usec: %d, endtime: sec: %ld, usec: %ld\n", sending_tv.sec, sending_tv.usec, end_time.tv_sec, end_time.tv_usec);
+    printf("sendtime: sec: %d, usec: %d, endtime: sec: %ld, usec: %ld\n", hdr.send_time.sec, hdr.send_time.usec, end_time.tv_sec, end_time.tv_usec);
     printf("\rtotal transfer avg: %f, transfered: %ld\n", avg_transfer_time, transfered);
 #endif
 #if 0
@@ -168,71 +185,5 @@ static int raw_receive_packet(struct ouvr_ctx *ctx, struct ouvr_packet *pkt)
 struct ouvr_network raw_handler = {
     .init = raw_initialize,
     .recv_packet = raw_receive_packet,
+    .zero_copy = 1,
 };
-
-#include "openmax_render.h"
-int raw_receive_and_decode(struct ouvr_ctx *ctx)
-{
-    OMX_BUFFERHEADERTYPE *bufs[5];
-    omxr_get_available_buffers(bufs, 5);
-
-    raw_net_context *c = ctx->net_priv;
-    register ssize_t r;
-    int total_received = 0;
-    int expected_size = 1;
-    struct timespec time_of_last_receive = {.tv_sec = 0}, time_temp;
-    struct timevalue sending_tv;
-    c->iov[1].iov_len = sizeof(expected_size);
-    c->iov[1].iov_base = &expected_size;
-    c->iov[2].iov_len = sizeof(sending_tv);
-    c->iov[2].iov_base = &sending_tv;
-    c->iov[3].iov_len = RECV_SIZE;
-
-    int buf_idx = 0;
-    int buf_offset = 0;
-    int max_buf_size = bufs[buf_idx]->nAllocLen - RECV_SIZE;
-    while(total_received < expected_size) {
-        c->iov[3].iov_base = bufs[buf_idx]->pBuffer + buf_offset;
-        r = recvmsg(c->fd, &c->msg, 0);
-        if (r < -1)
-        {
-            printf("Reading error: %d\n", r);
-            return -1;
-        }
-        else if (r > 0)
-        {
-            int to_add = r - (sizeof(c->eth_header) + sizeof(expected_size) + sizeof(sending_tv));
-            buf_offset += to_add;
-            total_received += to_add;
-            clock_gettime(CLOCK_MONOTONIC, &time_of_last_receive);
-        }
-        else
-        {
-            clock_gettime(CLOCK_MONOTONIC, &time_temp);
-            long elapsed = time_temp.tv_nsec - time_of_last_receive.tv_nsec;
-            if(time_temp.tv_sec > time_of_last_receive.tv_sec)
-                elapsed += 1000000000;
-            if(elapsed > 3000000 && time_of_last_receive.tv_sec > 0){
-                ctx->flag_send_iframe = 5;
-                return -1;
-            }
-        }
-        if(buf_offset >= max_buf_size && total_received < expected_size) {
-            bufs[buf_idx]->nFilledLen = buf_offset;
-            buf_idx++;
-            buf_offset = 0;
-            max_buf_size = bufs[buf_idx]->nAllocLen - RECV_SIZE;
-        }
-    }
-    if(buf_idx >= 5){
-        printf("buf_idx: %d, exp_size: %d\n", buf_idx, expected_size);
-        exit(1);
-    }
-    if(bufs[0]->pBuffer[4] != 0x6) {
-        ctx->flag_send_iframe = 0;
-    }
-    bufs[buf_idx]->nFilledLen = buf_offset;
-    omxr_empty_buffers(bufs, buf_idx + 1);
-
-    return 0;
-}
@@ -34,7 +34,5 @@
 #include "ouvr_packet.h"
 
 struct ouvr_network raw_handler;
-//int raw_receive_and_decode();
-int raw_receive_and_decode(struct ouvr_ctx *ctx);
 
 #endif
\ No newline at end of file
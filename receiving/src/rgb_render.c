@@ -30,7 +30,12 @@
 */
 #include "ouvr_packet.h"
 #include "rgb_render.h"
+#include "rgb_tile.h"
+#include "lz4_chunk.h"
+#include "lz4_decode.h"
+#include "foveated_unpack.h"
 #include <stdio.h>
+#include <stdlib.h>
 #include <time.h>
 #include <pthread.h>
 #include <semaphore.h>
@@ -53,6 +58,7 @@
 
 
 static int allocate_decoder_input_buffers();
+static int configure_input_port();
 
 #define OMX_INIT_STRUCTURE(a) \
   memset(&(a), 0, sizeof(a)); \
@@ -63,6 +69,10 @@ static int allocate_decoder_input_buffers();
   (a).nVersion.s.nStep = OMX_VERSION_STEP
 #define NUM_BUFS 3
 
+// until a packet header says otherwise, and for the transports that don't send one
+#define DEFAULT_WIDTH 1920
+#define DEFAULT_HEIGHT 1080
+
 static OMX_ERRORTYPE event_handler_callback(OMX_HANDLETYPE hComponent, OMX_PTR pAppData, OMX_EVENTTYPE eEvent, OMX_U32 nData1, OMX_U32 nData2, OMX_PTR pEventData);
 static OMX_ERRORTYPE empty_buffer_done_callback(OMX_HANDLETYPE hComponent, OMX_PTR nAppData, OMX_BUFFERHEADERTYPE *pBuffer);
 static OMX_ERRORTYPE fill_buffer_done_callback(OMX_HANDLETYPE hComponent, OMX_PTR nAppData, OMX_BUFFERHEADERTYPE *pBuffer);
@@ -75,7 +85,26 @@ static sem_t decode_sem;
 static OMX_HANDLETYPE video_render;
 static OMX_BUFFERHEADERTYPE *omx_buffer[NUM_BUFS] = {0};
 
+// size of the pictures shown, which the render port is set up for
+static int frame_width;
+static int frame_height;
+static int frame_size;
+// last complete picture as it was sent, patched in place by the tiles of rgb_tile_encode packets. It is the size of
+// the frame, or the packed size while the sender packs its frames with foveated_pack
+static uint8_t *framebuffer;
+static int pic_width;
+static int pic_height;
+static int pic_size;
+static int packed;
+// what framebuffer or a full frame packet turn into when they are packed
+static uint8_t *unpacked;
+// lz4 chunks of the current frame handed to lz4_decode
+static int lz4_chunks_pending;
+
 static struct timespec sleep_time = {.tv_sec = 0, .tv_nsec = 100000000};
+static int buf_idx = 0;
+// the last packets were unpacked full frames, which are the only ones the render can take as they were received
+static int full_frames;
 
 static int rgb_initialize(struct ouvr_ctx *ctx)
 {
@@ -83,6 +112,23 @@ static int rgb_initialize(struct ouvr_ctx *ctx)
     // pthread_cond_init(&decode_cond, NULL);
     sem_init(&decode_sem, 0, NUM_BUFS - 1);
 
+    frame_width = DEFAULT_WIDTH;
+    frame_height = DEFAULT_HEIGHT;
+    frame_size = frame_width * frame_height * 3;
+    pic_width = frame_width;
+    pic_height = frame_height;
+    pic_size = frame_size;
+    framebuffer = calloc(1, pic_size);
+    if (framebuffer == NULL)
+    {
+        printf("could not allocate rgb framebuffer\n");
+        return -1;
+    }
+    if (lz4_decode_init(framebuffer, pic_width, pic_height, ctx->threads) != 0)
+    {
+        return -1;
+    }
+
     // must be called on raspberry pi before making GPU calls
     bcm_host_init();
 
@@ -166,7 +212,31 @@ static int rgb_initialize(struct ouvr_ctx *ctx)
 
 
 
-    /** Configure video options */
+    if(configure_input_port() != 0) {
+        return -1;
+    }
+
+
+    OMX_SendCommand(video_render, OMX_CommandStateSet, OMX_StateIdle, NULL);
+    nanosleep(&sleep_time, NULL);
+    
+    OMX_SendCommand(video_render, OMX_CommandStateSet, OMX_StateExecuting, NULL);
+    nanosleep(&sleep_time, NULL);
+    
+    OMX_SendCommand(video_render, OMX_CommandPortEnable, 90, NULL);
+    nanosleep(&sleep_time, NULL);
+    
+    if(allocate_decoder_input_buffers() != 0) {
+        return -1;
+    }
+
+    return 0;
+}
+
+/** Configure video options */
+static int configure_input_port()
+{
+    OMX_ERRORTYPE err;
     OMX_PARAM_PORTDEFINITIONTYPE configVideo;
     OMX_INIT_STRUCTURE(configVideo);
     configVideo.nPortIndex = 90;
@@ -175,9 +245,9 @@ static int rgb_initialize(struct ouvr_ctx *ctx)
         printf("OMX_GetParameter() returned %x for render portdefinition configVideo\n", err);
         return -1;
     }
-    configVideo.format.video.nFrameWidth = 1920;
-    configVideo.format.video.nFrameHeight = 1080;
-    configVideo.format.video.nStride = 1920*3;
+    configVideo.format.video.nFrameWidth = frame_width;
+    configVideo.format.video.nFrameHeight = frame_height;
+    configVideo.format.video.nStride = frame_width*3;
     configVideo.format.video.nSliceHeight = 0;
     err = OMX_SetParameter(video_render, OMX_IndexParamPortDefinition, &configVideo);
     if(err != OMX_ErrorNone)
@@ -185,21 +255,66 @@ static int rgb_initialize(struct ouvr_ctx *ctx)
         printf("OMX_SetParameter() returned %x for video_render configVideo\n", err);
         return -1;
     }
+    return 0;
+}
 
+/**
+ * Follows the sender to a new frame size, or to packing its frames or not: the framebuffer is replaced by a blank
+ * one of the size of the pictures sent. A new frame size also reconfigures the render port, which needs it disabled
+ * and its buffers freed first.
+ */
+static int set_geometry(int width, int height, int is_packed)
+{
+    int new_pic_width = is_packed ? OUVR_FOVEATED_PACKED_WIDTH(width) : width;
+    uint8_t *new_framebuffer = calloc(1, new_pic_width * height * 3);
+    if (new_framebuffer == NULL)
+    {
+        printf("could not allocate rgb framebuffer for %dx%d\n", new_pic_width, height);
+        return -1;
+    }
+    free(framebuffer);
+    framebuffer = new_framebuffer;
+    pic_width = new_pic_width;
+    pic_height = height;
+    pic_size = pic_width * pic_height * 3;
+    packed = is_packed;
+    lz4_decode_set_frame(framebuffer, pic_width, pic_height);
+    if (width == frame_width && height == frame_height)
+    {
+        printf("foveated packing %s\n", is_packed ? "started" : "stopped");
+        return 0;
+    }
+    printf("frame size changed from %dx%d to %dx%d\n", frame_width, frame_height, width, height);
 
-    OMX_SendCommand(video_render, OMX_CommandStateSet, OMX_StateIdle, NULL);
-    nanosleep(&sleep_time, NULL);
-    
-    OMX_SendCommand(video_render, OMX_CommandStateSet, OMX_StateExecuting, NULL);
+    // wait for the render to hand back every buffer
+    for(int i = 0; i < NUM_BUFS - 1; i++) {
+        sem_wait(&decode_sem);
+    }
+    OMX_SendCommand(video_render, OMX_CommandPortDisable, 90, NULL);
+    for(int i = 0; i < NUM_BUFS; i++) {
+        OMX_FreeBuffer(video_render, 90, omx_buffer[i]);
+        omx_buffer[i] = NULL;
+    }
     nanosleep(&sleep_time, NULL);
-    
+
+    free(unpacked);
+    unpacked = NULL;
+    frame_width = width;
+    frame_height = height;
+    frame_size = width * height * 3;
+
+    if(configure_input_port() != 0) {
+        return -1;
+    }
     OMX_SendCommand(video_render, OMX_CommandPortEnable, 90, NULL);
-    nanosleep(&sleep_time, NULL);
-    
     if(allocate_decoder_input_buffers() != 0) {
         return -1;
     }
-
+    nanosleep(&sleep_time, NULL);
+    buf_idx = 0;
+    for(int i = 0; i < NUM_BUFS - 1; i++) {
+        sem_post(&decode_sem);
+    }
     return 0;
 }
 
@@ -241,12 +356,9 @@ static int allocate_decoder_input_buffers()
 // OMX_SendCommand(m_handle, OMX_CommandPortEnable, portNum, NULL);
 // OMX_SetupTunnel(handleOutput, nPortOutput, handleInput, nPortInput);
 
-static int buf_idx = 0;
-static int rgb_process_packet(struct ouvr_ctx *ctx, struct ouvr_packet *pkt)
+static int render_picture(const unsigned char *pos, unsigned int remaining_bytes)
 {
     OMX_ERRORTYPE err;
-    unsigned int remaining_bytes = (unsigned int)pkt->size;
-    unsigned char *pos = pkt->data;
 
     while(remaining_bytes) {
         // pthread_mutex_lock(&decode_lock);
@@ -277,6 +389,212 @@ static int rgb_process_packet(struct ouvr_ctx *ctx, struct ouvr_packet *pkt)
     return 0;
 }
 
+// renders a whole picture, unpacking it first if the sender packed it
+static int show_picture(struct ouvr_packet *pkt, const unsigned char *picture)
+{
+    if (pkt->flags & OUVR_PACKET_FLAG_FOVEATED)
+    {
+        if (unpacked == NULL && (unpacked = malloc(frame_size)) == NULL)
+        {
+            printf("could not allocate the unpacking buffer\n");
+            return -1;
+        }
+        ouvr_foveated_unpack(picture, unpacked, frame_width, frame_height, &pkt->fovea);
+        picture = unpacked;
+    }
+    return render_picture(picture, frame_size);
+}
+
+/**
+ * Copies the tiles of an rgb_tile_encode packet into framebuffer.
+ * Returns the number of tiles applied, or -1 if the packet is malformed.
+ */
+static int apply_tiles(struct ouvr_ctx *ctx, const uint8_t *data, int size)
+{
+    if (size < (int)sizeof(rgb_tile_header))
+    {
+        return -1;
+    }
+    const rgb_tile_header *hdr = (const rgb_tile_header *)data;
+    if (hdr->magic != RGB_TILE_MAGIC || hdr->frame_width != pic_width || hdr->frame_height != pic_height || hdr->tile_size == 0)
+    {
+        printf("unexpected rgb tile header\n");
+        return -1;
+    }
+    int tile_size = hdr->tile_size;
+    int tiles_x = (pic_width + tile_size - 1) / tile_size;
+    int tiles_y = (pic_height + tile_size - 1) / tile_size;
+    const uint16_t *indices = (const uint16_t *)(data + sizeof(rgb_tile_header));
+    const uint8_t *src = (const uint8_t *)(indices + hdr->num_tiles);
+    const uint8_t *end = data + size;
+    if (src > end)
+    {
+        return -1;
+    }
+
+    for (int i = 0; i < hdr->num_tiles; i++)
+    {
+        int t = indices[i];
+        if (t >= tiles_x * tiles_y)
+        {
+            return -1;
+        }
+        int x = (t % tiles_x) * tile_size;
+        int y = (t / tiles_x) * tile_size;
+        int w = pic_width - x < tile_size ? pic_width - x : tile_size;
+        int h = pic_height - y < tile_size ? pic_height - y : tile_size;
+        if (end - src < w * h * 3)
+        {
+            return -1;
+        }
+        for (int row = 0; row < h; row++)
+        {
+            memcpy(framebuffer + ((y + row) * pic_width + x) * 3, src, w * 3);
+            src += w * 3;
+        }
+    }
+    // every tile was sent again, which is this encoder's equivalent of an i-frame
+    if (hdr->num_tiles == tiles_x * tiles_y)
+    {
+        ctx->flag_send_iframe = 0;
+    }
+    return hdr->num_tiles;
+}
+
+static int rgb_process_packet(struct ouvr_ctx *ctx, struct ouvr_packet *pkt)
+{
+    // the size and the packing only change between frames, and nothing from before is worth keeping
+    int pkt_packed = (pkt->flags & OUVR_PACKET_FLAG_FOVEATED) != 0;
+    if (pkt->frame_width && pkt->frame_height && (pkt->frame_width != frame_width || pkt->frame_height != frame_height || pkt_packed != packed))
+    {
+        if (lz4_chunks_pending)
+        {
+            lz4_chunks_pending = 0;
+            lz4_decode_wait();
+        }
+        if (set_geometry(pkt->frame_width, pkt->frame_height, pkt_packed) != 0)
+        {
+            return -1;
+        }
+        // tiles and chunks patch the previous picture, which was just thrown away
+        ctx->flag_send_iframe = 5;
+    }
+
+    // a full frame from rgb_encode. A tile packet can never be exactly this size since its header comes on top of
+    // the pixels of at most every tile
+    if (pkt->size == pic_size)
+    {
+        full_frames = !pkt_packed;
+        return show_picture(pkt, pkt->data);
+    }
+    if (pkt->size > 0)
+    {
+        full_frames = 0;
+    }
+
+    // the other formats start with a magic number
+    uint32_t magic = pkt->size >= 4 ? *(uint32_t *)pkt->data : 0;
+    if (magic == LZ4_CHUNK_MAGIC)
+    {
+        // a frame comes as several chunks, they are decompressed in the background until the frame ends
+        if (lz4_decode_submit(pkt->data, pkt->size) == 0)
+        {
+            lz4_chunks_pending++;
+        }
+        if (!(pkt->flags & OUVR_PACKET_FLAG_END_OF_FRAME))
+        {
+            return 0;
+        }
+    }
+    if (lz4_chunks_pending)
+    {
+        if (!(pkt->flags & OUVR_PACKET_FLAG_END_OF_FRAME))
+        {
+            return 0;
+        }
+        lz4_chunks_pending = 0;
+        int rows = lz4_decode_wait();
+        // every frame is complete on its own, so there is no need to ask for another once one made it
+        if (rows == pic_height)
+        {
+            ctx->flag_send_iframe = 0;
+        }
+        // a lost chunk leaves its rows from the previous frame
+        return rows > 0 ? show_picture(pkt, framebuffer) : 0;
+    }
+    if (pkt->size == 0)
+    {
+        return 0;
+    }
+
+    int num_tiles = apply_tiles(ctx, pkt->data, pkt->size);
+    if (num_tiles < 0)
+    {
+        // ask for every tile again rather than show a picture we know is wrong
+        ctx->flag_send_iframe = 5;
+        return -1;
+    }
+    if (num_tiles == 0)
+    {
+        return 0;
+    }
+    return show_picture(pkt, framebuffer);
+}
+
+// lends the render's buffers while full frames are coming, as long as the ones free at once can hold a whole one
+static int rgb_lend_buffer(struct ouvr_ctx *ctx, struct ouvr_packet *pkt, int room, ouvr_lent_buffer *lent)
+{
+    int usable = (int)omx_buffer[0]->nAllocLen - room;
+    if (!full_frames || pkt->num_lent >= NUM_BUFS - 1 || usable <= 0 || (NUM_BUFS - 1) * usable < frame_size)
+    {
+        return -1;
+    }
+    sem_wait(&decode_sem);
+    OMX_BUFFERHEADERTYPE *buf = omx_buffer[buf_idx];
+    buf_idx = (buf_idx + 1) % NUM_BUFS;
+    lent->data = buf->pBuffer;
+    lent->capacity = buf->nAllocLen;
+    lent->priv = buf;
+    return 0;
+}
+
+static int rgb_submit_buffers(struct ouvr_ctx *ctx, struct ouvr_packet *pkt)
+{
+    // anything but a full frame of the current size goes through rgb_process_packet
+    if (pkt->size != frame_size || packed || (pkt->flags & OUVR_PACKET_FLAG_FOVEATED) ||
+        (pkt->frame_width && pkt->frame_height && (pkt->frame_width != frame_width || pkt->frame_height != frame_height)))
+    {
+        return 1;
+    }
+    for (int i = 0; i < pkt->num_lent; i++)
+    {
+        OMX_BUFFERHEADERTYPE *buf = pkt->lent[i].priv;
+        buf->nFlags = OMX_BUFFERFLAG_TIME_UNKNOWN;
+        buf->nOffset = 0;
+        buf->nFilledLen = pkt->lent[i].size;
+        if (i == pkt->num_lent - 1)
+        {
+            buf->nFlags |= OMX_BUFFERFLAG_ENDOFFRAME;
+        }
+        OMX_ERRORTYPE err = OMX_EmptyThisBuffer(video_render, buf);
+        if (err != OMX_ErrorNone)
+        {
+            printf("OMX_EmptyThisBuffer() returned %x\n", err);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static void rgb_return_buffers(struct ouvr_ctx *ctx, struct ouvr_packet *pkt)
+{
+    buf_idx = (buf_idx + NUM_BUFS - pkt->num_lent) % NUM_BUFS;
+    for (int i = 0; i < pkt->num_lent; i++)
+    {
+        sem_post(&decode_sem);
+    }
+}
+
 static OMX_ERRORTYPE event_handler_callback(
   OMX_HANDLETYPE hComponent,
   OMX_PTR pAppData,
@@ -310,6 +628,11 @@ static OMX_ERRORTYPE fill_buffer_done_callback(OMX_HANDLETYPE hComponent, OMX_PT
 
 static void rgb_deinitialize()
 {
+    lz4_decode_deinit();
+    free(framebuffer);
+    framebuffer = NULL;
+    free(unpacked);
+    unpacked = NULL;
     OMX_Deinit();
     bcm_host_deinit();
 }
@@ -318,4 +641,7 @@ struct ouvr_decoder rgb_render = {
     .init = rgb_initialize,
     .process_frame = rgb_process_packet,
     .deinit = rgb_deinitialize,
+    .lend_buffer = rgb_lend_buffer,
+    .submit_buffers = rgb_submit_buffers,
+    .return_buffers = rgb_return_buffers,
 };
\ No newline at end of file
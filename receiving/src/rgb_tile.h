@@ -0,0 +1,51 @@
+/*
+    The MIT License (MIT)
+
+    Copyright (c) 2020 OpenUVR
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+
+    Authors:
+    Alec Rohloff
+    Zackary Allen
+    Kung-Min Lin
+    Chengyi Nie
+    Hung-Wei Tseng
+*/
+
+#ifndef OUVR_RGB_TILE_H
+#define OUVR_RGB_TILE_H
+
+#include <stdint.h>
+
+#define RGB_TILE_MAGIC 0x4c495452
+
+// start of the payload of a packet produced by rgb_tile_encode. It is followed by num_tiles uint16_t tile indices,
+// then by the RGB24 pixels of each of those tiles, row by row. Tiles are tile_size x tile_size pixels numbered in
+// row-major order, the ones on the right and bottom edges are clipped to the frame.
+typedef struct rgb_tile_header
+{
+    uint32_t magic;
+    uint16_t frame_width;
+    uint16_t frame_height;
+    uint16_t tile_size;
+    uint16_t num_tiles;
+} rgb_tile_header;
+
+#endif
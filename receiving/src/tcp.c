@@ -106,20 +106,20 @@ static int tcp_receive_packet(struct ouvr_ctx *ctx, struct ouvr_packet *pkt)
 #endif
     tcp_net_context *c = ctx->net_priv;
 
-    struct timevalue sending_tv;
+    ouvr_packet_header hdr;
 
     register int r;
     unsigned char *pos;
     int nleft = 0;
     int size;
 
-    size = sizeof(nleft);
-    pos = &nleft;
+    size = sizeof(hdr);
+    pos = (unsigned char *)&hdr;
     while(size > 0)
     {
         r = read(c->fd, pos, size);
         if (r < 0){
-            printf("reading nleft error: %d, errno: %d\n", r, errno);
+            printf("reading packet header error: %d, errno: %d\n", r, errno);
             return -1;
         }
         else if (r > 0){
@@ -127,31 +127,37 @@ static int tcp_receive_packet(struct ouvr_ctx *ctx, struct ouvr_packet *pkt)
             size -= r;
         }
     }
-    pkt->size = nleft;
-
-    size = sizeof(sending_tv);
-    pos = &sending_tv;
-    while ((size > 0))
-    {
-        r = read(c->fd, pos, size);
-        if(r < 0){
-            printf("reading sending time error: %d, errno: %d\n", r, errno);
-            return -1;
-        }
-        else if(r > 0){
-            pos += r;
-            size -= r;
-        }
-    }
+    nleft = hdr.size;
+    pkt->size = 0;
+    ouvr_packet_read_header(pkt, &hdr);
 
 #ifdef TIME_NETWORK
     gettimeofday(&start_time, NULL);
 #endif
 
-    pos = pkt->data;
     while (nleft > 0)
     {
-        r = read(c->fd, pos, nleft);
+        int room = ouvr_packet_tail(pkt, 1, hdr.size, &pos);
+        if (room < 0)
+        {
+            // the packet is read past so that the stream stays in step, and the decoder starts again from a keyframe
+            unsigned char discard[4096];
+            while (nleft > 0)
+            {
+                r = read(c->fd, discard, nleft < (int)sizeof(discard) ? nleft : (int)sizeof(discard));
+                if (r <= 0)
+                {
+                    printf("Reading error: %d\n", r);
+                    return -1;
+                }
+                nleft -= r;
+            }
+            ouvr_packet_drop(pkt);
+            pkt->flags = 0;
+            ctx->flag_send_iframe = 5;
+            return 0;
+        }
+        r = read(c->fd, pos, nleft < room ? nleft : room);
         if (r < -1)
         {
             printf("Reading error: %d\n", r);
@@ -159,7 +165,7 @@ static int tcp_receive_packet(struct ouvr_ctx *ctx, struct ouvr_packet *pkt)
         }
         else if (r > 0)
         {
-            pos += r;
+            ouvr_packet_commit(pkt, r);
             nleft -= r;
         }
     }
@@ -170,9 +176,9 @@ static int tcp_receive_packet(struct ouvr_ctx *ctx, struct ouvr_packet *pkt)
     avg_recv_time = 0.998 * avg_recv_time + 0.002 * recved;
     printf("total recv avg: %f, recv elapsed: %ld\n", avg_recv_time, recved);
 
-    long transfered = end_time.tv_usec - sending_tv.usec + (end_time.tv_sec - sending_tv.sec) * 1000000;
+    long transfered = end_time.tv_usec - hdr.send_time.usec + (end_time.tv_sec - hdr.send_time.sec) * 1000000;
     avg_transfer_time = 0.998 * avg_transfer_time + 0.002 * transfered;
-    printf("sendtime: sec: %ld, usec: %ld, endtime: sec: %ld, usec: %ld\n", sending_tv.sec, sending_tv.usec, end_time.tv_sec, end_time.tv_usec);
+    printf("sendtime: sec: %d, usec: %d, endtime: sec: %ld, usec: %ld\n", hdr.send_time.sec, hdr.send_time.usec, end_time.tv_sec, end_time.tv_usec);
     printf("total transfer avg: %f, transfered: %ld\n", avg_transfer_time, transfered);
 #endif
 
@@ -182,4 +188,5 @@ static int tcp_receive_packet(struct ouvr_ctx *ctx, struct ouvr_packet *pkt)
 struct ouvr_network tcp_handler = {
     .init = tcp_initialize,
     .recv_packet = tcp_receive_packet,
+    .zero_copy = 1,
 };
@@ -0,0 +1,392 @@
+/*
+    The MIT License (MIT)
+
+    Copyright (c) 2020 OpenUVR
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+
+    Authors:
+    Alec Rohloff
+    Zackary Allen
+    Kung-Min Lin
+    Chengyi Nie
+    Hung-Wei Tseng
+*/
+/**
+ * Thread placement. Each stage's threads are pinned with pthread_setaffinity_np() and scheduled with
+ * pthread_setschedparam(), which both work on another thread's handle, so the threads a decoder starts before the
+ * session is configured are placed as well. Where a thread ended up is read back from the kernel and printed, since
+ * a policy the process isn't allowed to use leaves it where it was.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sched.h>
+#include <sys/mman.h>
+
+#include "thread_sched.h"
+
+const char *const ouvr_thread_stage_names[OPENUVR_THREAD_STAGES] = {"receive", "decode", "workers", "reassemble"};
+
+static int to_policy(enum OPENUVR_SCHED_POLICY policy)
+{
+    switch (policy)
+    {
+    case OPENUVR_SCHED_FIFO:
+        return SCHED_FIFO;
+    case OPENUVR_SCHED_RR:
+        return SCHED_RR;
+    default:
+        return SCHED_OTHER;
+    }
+}
+
+static const char *policy_name(int policy)
+{
+    switch (policy)
+    {
+    case SCHED_FIFO:
+        return "SCHED_FIFO";
+    case SCHED_RR:
+        return "SCHED_RR";
+    default:
+        return "SCHED_OTHER";
+    }
+}
+
+// cpus as a list of ranges, e.g. 0,2-3
+static void format_cpus(const cpu_set_t *set, char *buf, size_t size)
+{
+    size_t len = 0;
+    buf[0] = '\0';
+    for (int i = 0; i < CPU_SETSIZE && len < size; i++)
+    {
+        if (!CPU_ISSET(i, set))
+        {
+            continue;
+        }
+        int last = i;
+        while (last + 1 < CPU_SETSIZE && CPU_ISSET(last + 1, set))
+        {
+            last++;
+        }
+        if (last == i)
+        {
+            len += snprintf(buf + len, size - len, "%s%d", len ? "," : "", i);
+        }
+        else
+        {
+            len += snprintf(buf + len, size - len, "%s%d-%d", len ? "," : "", i, last);
+        }
+        i = last;
+    }
+}
+
+static void report_thread(pthread_t thread, const char *name)
+{
+    cpu_set_t set;
+    int policy;
+    struct sched_param param;
+    char cpus[128] = "?";
+    if (pthread_getaffinity_np(thread, sizeof(set), &set) == 0)
+    {
+        format_cpus(&set, cpus, sizeof(cpus));
+    }
+    if (pthread_getschedparam(thread, &policy, &param) != 0)
+    {
+        return;
+    }
+    printf("OpenUVR: thread ouvr-%s runs on cpus %s under %s, priority %d\n", name, cpus, policy_name(policy), param.sched_priority);
+}
+
+static int place_thread(pthread_t thread, const char *name, const struct openuvr_thread_config *config)
+{
+    int ret = 0;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int i = 0; i < CPU_SETSIZE; i++)
+    {
+        // no cpus given puts the thread back on all of them
+        if (config->cpus == 0 || (i < 64 && (config->cpus >> i) & 1))
+        {
+            CPU_SET(i, &set);
+        }
+    }
+    int err = pthread_setaffinity_np(thread, sizeof(set), &set);
+    if (err != 0)
+    {
+        printf("Couldn't set the cpus of ouvr-%s: %s\n", name, strerror(err));
+        ret = -1;
+    }
+
+    int policy = to_policy(config->policy);
+    struct sched_param param = {.sched_priority = policy == SCHED_OTHER ? 0 : config->priority};
+    err = pthread_setschedparam(thread, policy, &param);
+    if (err != 0)
+    {
+        printf("Couldn't schedule ouvr-%s under %s %d: %s\n", name, policy_name(policy), param.sched_priority, strerror(err));
+        ret = -1;
+    }
+    report_thread(thread, name);
+    return ret;
+}
+
+struct ouvr_threads *ouvr_threads_alloc(void)
+{
+    ouvr_threads *t = calloc(1, sizeof(ouvr_threads));
+    pthread_mutex_init(&t->lock, NULL);
+    return t;
+}
+
+void ouvr_threads_free(struct ouvr_threads *t)
+{
+    if (t == NULL)
+    {
+        return;
+    }
+    pthread_mutex_destroy(&t->lock);
+    free(t);
+}
+
+static void track_thread(struct ouvr_threads *t, pthread_t thread, int stage, const char *name)
+{
+    if (t == NULL)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&t->lock);
+    int i = 0;
+    while (i < OUVR_MAX_THREADS && t->threads[i].used)
+    {
+        i++;
+    }
+    if (i == OUVR_MAX_THREADS)
+    {
+        // still runs, just wherever the kernel puts it
+        printf("Too many threads to place ouvr-%s\n", name);
+    }
+    else
+    {
+        t->threads[i].used = 1;
+        t->threads[i].thread = thread;
+        t->threads[i].stage = stage;
+        snprintf(t->threads[i].name, sizeof(t->threads[i].name), "%s", name);
+        // without a configuration the thread stays where it was started, placing it anyway would undo taskset or chrt
+        if (t->configured[stage])
+        {
+            place_thread(thread, t->threads[i].name, &t->config[stage]);
+        }
+        else
+        {
+            report_thread(thread, t->threads[i].name);
+        }
+    }
+    pthread_mutex_unlock(&t->lock);
+}
+
+void ouvr_threads_add(struct ouvr_threads *t, pthread_t thread, int stage, const char *name)
+{
+    char full_name[16];
+    snprintf(full_name, sizeof(full_name), "ouvr-%s", name);
+    pthread_setname_np(thread, full_name);
+    track_thread(t, thread, stage, name);
+}
+
+void ouvr_threads_add_caller(struct ouvr_threads *t, int stage, const char *name)
+{
+    track_thread(t, pthread_self(), stage, name);
+}
+
+void ouvr_threads_remove(struct ouvr_threads *t, pthread_t thread)
+{
+    if (t == NULL)
+    {
+        return;
+    }
+    pthread_mutex_lock(&t->lock);
+    for (int i = 0; i < OUVR_MAX_THREADS; i++)
+    {
+        if (t->threads[i].used && pthread_equal(t->threads[i].thread, thread))
+        {
+            t->threads[i].used = 0;
+        }
+    }
+    pthread_mutex_unlock(&t->lock);
+}
+
+int ouvr_threads_configure(struct ouvr_threads *t, int stage, const struct openuvr_thread_config *config)
+{
+    if (stage < 0 || stage >= OPENUVR_THREAD_STAGES)
+    {
+        printf("Invalid thread stage %d\n", stage);
+        return -1;
+    }
+    int policy = to_policy(config->policy);
+    if (policy != SCHED_OTHER && (config->priority < sched_get_priority_min(policy) || config->priority > sched_get_priority_max(policy)))
+    {
+        printf("Invalid %s priority %d for the %s threads\n", policy_name(policy), config->priority, ouvr_thread_stage_names[stage]);
+        return -1;
+    }
+
+    int ret = 0;
+    pthread_mutex_lock(&t->lock);
+    t->config[stage] = *config;
+    t->configured[stage] = 1;
+    for (int i = 0; i < OUVR_MAX_THREADS; i++)
+    {
+        if (t->threads[i].used && t->threads[i].stage == stage && place_thread(t->threads[i].thread, t->threads[i].name, config) != 0)
+        {
+            ret = -1;
+        }
+    }
+    pthread_mutex_unlock(&t->lock);
+    return ret;
+}
+
+// "0+2-3" or "any"
+static int parse_cpus(const char *s, uint64_t *cpus)
+{
+    *cpus = 0;
+    if (!strcmp(s, "any"))
+    {
+        return 0;
+    }
+    while (*s)
+    {
+        char *end;
+        long first = strtol(s, &end, 10);
+        long last = first;
+        if (end == s)
+        {
+            return -1;
+        }
+        if (*end == '-')
+        {
+            s = end + 1;
+            last = strtol(s, &end, 10);
+            if (end == s)
+            {
+                return -1;
+            }
+        }
+        if (first < 0 || last < first || last > 63)
+        {
+            return -1;
+        }
+        for (long i = first; i <= last; i++)
+        {
+            *cpus |= 1ULL << i;
+        }
+        if (*end == '+')
+        {
+            end++;
+        }
+        else if (*end != '\0')
+        {
+            return -1;
+        }
+        s = end;
+    }
+    return 0;
+}
+
+static int parse_entry(struct ouvr_threads *t, char *entry)
+{
+    if (!strcmp(entry, "mlock"))
+    {
+        return ouvr_lock_memory();
+    }
+    char *value = strchr(entry, '=');
+    if (value == NULL)
+    {
+        return -1;
+    }
+    *value++ = '\0';
+    int stage = 0;
+    while (stage < OPENUVR_THREAD_STAGES && strcmp(entry, ouvr_thread_stage_names[stage]))
+    {
+        stage++;
+    }
+    if (stage == OPENUVR_THREAD_STAGES)
+    {
+        return -1;
+    }
+
+    struct openuvr_thread_config config = {0};
+    char *save;
+    char *field = strtok_r(value, ",", &save);
+    if (field == NULL || parse_cpus(field, &config.cpus) != 0)
+    {
+        return -1;
+    }
+    if ((field = strtok_r(NULL, ",", &save)) != NULL)
+    {
+        if (!strcmp(field, "fifo"))
+        {
+            config.policy = OPENUVR_SCHED_FIFO;
+        }
+        else if (!strcmp(field, "rr"))
+        {
+            config.policy = OPENUVR_SCHED_RR;
+        }
+        else if (strcmp(field, "other"))
+        {
+            return -1;
+        }
+        // real-time threads without a priority get the lowest one
+        config.priority = 1;
+    }
+    if ((field = strtok_r(NULL, ",", &save)) != NULL)
+    {
+        config.priority = atoi(field);
+    }
+    return ouvr_threads_configure(t, stage, &config);
+}
+
+int ouvr_threads_parse(struct ouvr_threads *t, const char *desc)
+{
+    char *copy = strdup(desc);
+    int ret = 0;
+    char *save;
+    for (char *entry = strtok_r(copy, ";", &save); entry != NULL; entry = strtok_r(NULL, ";", &save))
+    {
+        // parse_entry() cuts the entry up
+        char *parsed = strdup(entry);
+        if (parse_entry(t, parsed) != 0)
+        {
+            printf("Couldn't apply the thread configuration \"%s\"\n", entry);
+            ret = -1;
+        }
+        free(parsed);
+    }
+    free(copy);
+    return ret;
+}
+
+int ouvr_lock_memory(void)
+{
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0)
+    {
+        printf("Couldn't lock the process's memory, page faults can still stall the threads\n");
+        return -1;
+    }
+    printf("OpenUVR: memory locked\n");
+    return 0;
+}
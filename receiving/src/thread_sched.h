@@ -0,0 +1,78 @@
+/*
+    The MIT License (MIT)
+
+    Copyright (c) 2020 OpenUVR
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+
+    Authors:
+    Alec Rohloff
+    Zackary Allen
+    Kung-Min Lin
+    Chengyi Nie
+    Hung-Wei Tseng
+*/
+
+#ifndef OUVR_THREAD_SCHED_H
+#define OUVR_THREAD_SCHED_H
+
+#include <pthread.h>
+
+#include "openuvr.h"
+
+#define OUVR_MAX_THREADS 32
+
+// the threads of one session by stage, and where each stage is to run. A thread is placed when it is added if its
+// stage was configured, and again whenever its stage is configured, until it is removed. Until then it keeps what it
+// inherited from the process, e.g. from taskset or chrt
+typedef struct ouvr_threads
+{
+    pthread_mutex_t lock;
+    struct openuvr_thread_config config[OPENUVR_THREAD_STAGES];
+    int configured[OPENUVR_THREAD_STAGES];
+    struct
+    {
+        int used;
+        pthread_t thread;
+        int stage;
+        char name[16];
+    } threads[OUVR_MAX_THREADS];
+} ouvr_threads;
+
+// the tokens ouvr_threads_parse() takes for each stage, indexed by stage
+extern const char *const ouvr_thread_stage_names[OPENUVR_THREAD_STAGES];
+
+struct ouvr_threads *ouvr_threads_alloc(void);
+void ouvr_threads_free(struct ouvr_threads *t);
+// names thread "ouvr-<name>", places it if its stage was configured and reports where it ended up. t may be NULL,
+// the thread is then only named
+void ouvr_threads_add(struct ouvr_threads *t, pthread_t thread, int stage, const char *name);
+// the same for the calling thread, which belongs to the application and keeps its name
+void ouvr_threads_add_caller(struct ouvr_threads *t, int stage, const char *name);
+// must be called before the thread is joined
+void ouvr_threads_remove(struct ouvr_threads *t, pthread_t thread);
+// returns -1 if the configuration is invalid or some thread couldn't be placed, e.g. without CAP_SYS_NICE for
+// real-time priorities. The threads keep running where they were
+int ouvr_threads_configure(struct ouvr_threads *t, int stage, const struct openuvr_thread_config *config);
+// "stage=cpus[,policy[,priority]]" entries separated by ';', e.g. "receive=1,fifo,60;decode=2-3,fifo,50". cpus is a
+// list like 0+2-3 or "any", policy is other, fifo or rr. A "mlock" entry calls ouvr_lock_memory()
+int ouvr_threads_parse(struct ouvr_threads *t, const char *desc);
+int ouvr_lock_memory(void);
+
+#endif
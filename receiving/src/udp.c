@@ -58,7 +58,9 @@ typedef struct udp_net_context
     int fd;
     struct sockaddr_in serv_addr, cli_addr;
     struct msghdr msg;
-    struct iovec iov[3];
+    struct iovec iov[2];
+    // where the rest of a packet too large for the pool goes
+    unsigned char discard[RECV_SIZE];
 } udp_net_context;
 
 
@@ -97,7 +99,7 @@ static int udp_initialize(struct ouvr_ctx *ctx)
     fcntl(c->fd, F_SETFL, flags | (int)O_NONBLOCK);
     srand(17); 
     c->msg.msg_iov = c->iov;
-    c->msg.msg_iovlen = 3;
+    c->msg.msg_iovlen = 2;
     return 0;
 }
 
@@ -114,20 +116,24 @@ static int udp_receive_packet(struct ouvr_ctx *ctx, struct ouvr_packet *pkt)
 #endif
     udp_net_context *c = ctx->net_priv;
     register ssize_t r;
-    unsigned char *start_pos = pkt->data;
     int offset = 0;
-    int expected_size = 1;
+    int dropping = 0;
+    // size starts at 1 so that at least one datagram is read, a packet may have no payload at all
+    ouvr_packet_header hdr = {.size = 1};
     struct timespec time_of_last_receive = {.tv_sec = 0}, time_temp;
-    struct timevalue send_time;
+    unsigned char *tail;
     pkt->size = 0;
-    c->iov[0].iov_len = sizeof(expected_size);
-    c->iov[0].iov_base = &expected_size;
-    c->iov[1].iov_len = sizeof(send_time);
-    c->iov[1].iov_base = &send_time;
-    c->iov[2].iov_len = RECV_SIZE;
-    while (offset < expected_size)
+    c->iov[0].iov_len = sizeof(hdr);
+    c->iov[0].iov_base = &hdr;
+    c->iov[1].iov_len = RECV_SIZE;
+    while (offset < hdr.size)
     {
-        c->iov[2].iov_base = start_pos + offset;
+        // the header tells how large the whole packet is, each datagram has to fit behind the ones before it
+        if (!dropping && ouvr_packet_tail(pkt, RECV_SIZE, hdr.size, &tail) < 0)
+        {
+            dropping = 1;
+        }
+        c->iov[1].iov_base = dropping ? c->discard : tail;
         r = recvmsg(c->fd, &c->msg, 0);
 	if (r < -1)
         {
@@ -142,9 +148,12 @@ static int udp_receive_packet(struct ouvr_ctx *ctx, struct ouvr_packet *pkt)
                 has_received_first = 1;
             }
 #endif
-            // printf("%d, %d, %d, %d\n",r, sizeof(expected_size) ,sizeof(send_time), r - sizeof(expected_size) - sizeof(send_time));
-            offset += r - sizeof(expected_size) - sizeof(send_time);
-            pkt->size += r - sizeof(expected_size) - sizeof(send_time);
+            // printf("%d, %d, %d\n",r, sizeof(hdr), r - sizeof(hdr));
+            offset += r - sizeof(hdr);
+            if (!dropping)
+            {
+                ouvr_packet_commit(pkt, r - sizeof(hdr));
+            }
             clock_gettime(CLOCK_MONOTONIC, &time_of_last_receive);
         }
         else
@@ -154,25 +163,33 @@ static int udp_receive_packet(struct ouvr_ctx *ctx, struct ouvr_packet *pkt)
             if(time_temp.tv_sec > time_of_last_receive.tv_sec)
                 elapsed += 1000000000;
             if(elapsed > 3000000 && time_of_last_receive.tv_sec > 0) {
-                pkt->size = 0;
+                ouvr_packet_drop(pkt);
+                hdr.flags = 0;
                 ctx->flag_send_iframe = 5;
                 break;
             }
         }
     }
+    if (dropping)
+    {
+        ouvr_packet_drop(pkt);
+        hdr.flags = 0;
+        ctx->flag_send_iframe = 5;
+    }
+    ouvr_packet_read_header(pkt, &hdr);
 #ifdef TIME_NETWORK
     gettimeofday(&end_time, NULL);
     long elapsed = end_time.tv_usec - start_time.tv_usec + (end_time.tv_sec > start_time.tv_sec ? 1000000 : 0);
     avg_time = 0.998 * avg_time + 0.002 * elapsed;
     printf("\rnet avg: %f,  elapsed: %ld\n", avg_time, elapsed);
 
-    long transfered = end_time.tv_usec - send_time.usec + (end_time.tv_sec - send_time.sec) * 1000000;
+    long transfered = end_time.tv_usec - hdr.send_time.usec + (end_time.tv_sec - hdr.send_time.sec) * 1000000;
     avg_transfer_time = 0.998 * avg_transfer_time + 0.002 * transfered;
     printf("\rtotal transfer avg: %f, transfered: %ld\n", avg_transfer_time, transfered);
 #endif
     if(!(rand() % 60) && 0) {
 	    printf("dropped\n");
-	    pkt->size = 0;
+	    ouvr_packet_drop(pkt);
 	    ctx->flag_send_iframe = 5;
     }
    // printf("%d\n", pkt->size);
@@ -182,4 +199,5 @@ static int udp_receive_packet(struct ouvr_ctx *ctx, struct ouvr_packet *pkt)
 struct ouvr_network udp_handler = {
     .init = udp_initialize,
     .recv_packet = udp_receive_packet,
+    .zero_copy = 1,
 };
@@ -55,6 +55,8 @@ typedef struct udp_compat_net_context
     struct sockaddr_in serv_addr, cli_addr;
     struct msghdr msg;
     struct iovec iov[3];
+    // where the rest of a packet too large for the pool goes
+    unsigned char discard[RECV_SIZE];
 } udp_compat_net_context;
 
 static int udp_initialize(struct ouvr_ctx *ctx)
@@ -100,14 +102,19 @@ static int udp_receive_packet(struct ouvr_ctx *ctx, struct ouvr_packet *pkt)
 {
     udp_compat_net_context *c = ctx->net_priv;
     register ssize_t r;
-    unsigned char *start_pos = pkt->data;
     int offset = 0;
+    int dropping = 0;
     struct timespec time_of_last_receive = {.tv_sec = 0, .tv_nsec = 0}, time_temp;
     pkt->size = 0;
     c->iov[0].iov_len = RECV_SIZE;
     while (1)
     {
-        c->iov[0].iov_base = start_pos + offset;
+        // there's no header to tell the size, the packet grows a class at a time
+        if (!dropping && offset + RECV_SIZE > pkt->capacity && ouvr_packet_reserve(pkt, offset + RECV_SIZE) != 0)
+        {
+            dropping = 1;
+        }
+        c->iov[0].iov_base = dropping ? c->discard : pkt->data + offset;
         r = recvmsg(c->fd, &c->msg, 0);
         if (r < -1)
         {
@@ -131,6 +138,16 @@ static int udp_receive_packet(struct ouvr_ctx *ctx, struct ouvr_packet *pkt)
                 break;
         }
     }
+    // foreign senders don't send a packet header, so every packet is treated as a whole frame
+    pkt->flags = OUVR_PACKET_FLAG_END_OF_FRAME;
+    pkt->send_time.sec = 0;
+    pkt->send_time.usec = 0;
+    if (dropping)
+    {
+        pkt->size = 0;
+        pkt->flags = 0;
+        ctx->flag_send_iframe = 5;
+    }
     return 0;
 }
 
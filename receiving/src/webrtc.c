@@ -208,9 +208,16 @@ static void RTC_API trMessageCallback(int id, const char *message, int size, voi
 		sleep(1);
 	}
     struct ouvr_packet *pkt = ctx->packets[1];
-	// memcpy(pkt->data, message, size);
-	pkt->data = message;
+	// message belongs to libdatachannel and is gone once this returns, pointing pkt->data at it lost the pool's buffer
+	pkt->size = 0;
+	if (ouvr_packet_reserve(pkt, size) != 0)
+	{
+		ctx->flag_send_iframe = 5;
+		return;
+	}
+	memcpy(pkt->data, message, size);
 	pkt->size = size;
+	pkt->flags = OUVR_PACKET_FLAG_END_OF_FRAME;
 	if(pkt->size && ctx->dec->process_frame(ctx, pkt)!=0){
 		printf("trMessageCallback: decoder->process_frame failed!\n");
 	}
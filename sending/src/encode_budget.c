@@ -0,0 +1,131 @@
+/*
+    The MIT License (MIT)
+
+    Copyright (c) 2020 OpenUVR
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+
+    Authors:
+    Alec Rohloff
+    Zackary Allen
+    Kung-Min Lin
+    Chengyi Nie
+    Hung-Wei Tseng
+*/
+/**
+ * Encode-time budget: when complex scenes make the CPU encoder take longer than the deadline, the x264 analysis is
+ * cut down a step at a time (preset, then subpel refinement and reference count) until frames fit again, and
+ * brought back once they comfortably do. This costs much less quality than scaling the frame down, which
+ * openuvr_send_frame() only does once the fastest level here isn't enough.
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "encode_budget.h"
+#include "ouvr_packet.h"
+
+// 0 keeps the preset's own subme or refs. x264 won't use more refs than it was opened with, so the slower levels
+// only get their extra reference if the session started on one of them
+static const struct
+{
+    const char *preset;
+    int subme;
+    int refs;
+} speed_levels[] = {
+    {"faster", 0, 0},
+    {"faster", 0, 1},
+    {"veryfast", 0, 0},
+    {"veryfast", 1, 0},
+    {"superfast", 0, 0},
+};
+#define NUM_LEVELS (int)(sizeof(speed_levels) / sizeof(speed_levels[0]))
+// the encoders' default preset, which is where a session starts
+#define START_LEVEL 2
+
+#define OVER_FRAMES 4
+#define UNDER_FRAMES 120
+#define HOLD_FRAMES 30
+// a step slower needs frames to fit in this share of the deadline, since it may cost a lot more than the last one saved
+#define HEADROOM_PERCENT 60
+
+struct ouvr_encode_budget *ouvr_budget_alloc(void)
+{
+    ouvr_encode_budget *b = calloc(1, sizeof(ouvr_encode_budget));
+    if (b == NULL)
+    {
+        return NULL;
+    }
+    b->level = START_LEVEL;
+    return b;
+}
+
+void ouvr_budget_free(struct ouvr_encode_budget *b)
+{
+    free(b);
+}
+
+void ouvr_budget_set_deadline(struct ouvr_encode_budget *b, long deadline_usec)
+{
+    b->deadline_usec = deadline_usec;
+    b->over_frames = 0;
+    b->under_frames = 0;
+    b->hold_frames = 0;
+}
+
+static int change_level(struct ouvr_encode_budget *b, int level, struct ouvr_encoder_params *params)
+{
+    b->level = level;
+    b->over_frames = 0;
+    b->under_frames = 0;
+    b->hold_frames = HOLD_FRAMES;
+    strcpy(params->preset, speed_levels[level].preset);
+    params->subme = speed_levels[level].subme;
+    params->refs = speed_levels[level].refs;
+    return 1;
+}
+
+int ouvr_budget_update(struct ouvr_encode_budget *b, long encode_usec, struct ouvr_encoder_params *params)
+{
+    if (b->deadline_usec <= 0)
+    {
+        return 0;
+    }
+    if (b->hold_frames > 0)
+    {
+        b->hold_frames--;
+        return 0;
+    }
+    b->over_frames = encode_usec > b->deadline_usec ? b->over_frames + 1 : 0;
+    b->under_frames = encode_usec * 100 < b->deadline_usec * HEADROOM_PERCENT ? b->under_frames + 1 : 0;
+
+    if (b->over_frames >= OVER_FRAMES && b->level < NUM_LEVELS - 1)
+    {
+        return change_level(b, b->level + 1, params);
+    }
+    if (b->under_frames >= UNDER_FRAMES && b->level > 0)
+    {
+        return change_level(b, b->level - 1, params);
+    }
+    return 0;
+}
+
+int ouvr_budget_can_speed_up(struct ouvr_encode_budget *b)
+{
+    return b->deadline_usec > 0 && b->level < NUM_LEVELS - 1;
+}
@@ -0,0 +1,59 @@
+/*
+    The MIT License (MIT)
+
+    Copyright (c) 2020 OpenUVR
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+
+    Authors:
+    Alec Rohloff
+    Zackary Allen
+    Kung-Min Lin
+    Chengyi Nie
+    Hung-Wei Tseng
+*/
+
+#ifndef OUVR_ENCODE_BUDGET_H
+#define OUVR_ENCODE_BUDGET_H
+
+struct ouvr_encoder_params;
+
+// keeps the encode time of a frame under a deadline by moving along a fixed ladder of x264 speed settings, from
+// slower (better) to faster (worse) ones. A step faster needs OVER_FRAMES frames over the deadline in a row and a
+// step slower UNDER_FRAMES frames with plenty of room, after a change the level stays put for HOLD_FRAMES
+typedef struct ouvr_encode_budget
+{
+    long deadline_usec;
+    int level;
+    int over_frames;
+    int under_frames;
+    int hold_frames;
+} ouvr_encode_budget;
+
+struct ouvr_encode_budget *ouvr_budget_alloc(void);
+void ouvr_budget_free(struct ouvr_encode_budget *b);
+// 0 turns the controller off, the encoder keeps the settings it had reached
+void ouvr_budget_set_deadline(struct ouvr_encode_budget *b, long deadline_usec);
+// feeds how long the last frame took. Returns 1 and the settings of the new level in params when the level changes,
+// 0 otherwise
+int ouvr_budget_update(struct ouvr_encode_budget *b, long encode_usec, struct ouvr_encoder_params *params);
+// 1 while there is a faster level left to go to
+int ouvr_budget_can_speed_up(struct ouvr_encode_budget *b);
+
+#endif
@@ -0,0 +1,546 @@
+/*
+    The MIT License (MIT)
+
+    Copyright (c) 2020 OpenUVR
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+
+    Authors:
+    Alec Rohloff
+    Zackary Allen
+    Kung-Min Lin
+    Chengyi Nie
+    Hung-Wei Tseng
+*/
+/**
+ * One encode, many receivers. Each receiver gets its own connected socket, so a slow one fills only its own send
+ * buffer, and the datagrams of a packet go out to the receivers in turns of a few at a time so that nobody waits for
+ * a whole frame to be sent to the others. Packets from the last keyframe on are kept, so a receiver that joins late or
+ * loses data is caught up by replaying them to it alone. The replay takes its turns with the live datagrams, a limited
+ * number per frame, and is stamped with the time it is actually sent so that the receiver doesn't drop it as late.
+ * When the receiver's socket buffer fills up it stops where it is and goes on at the next packet, and once it has
+ * reached the packet being sent the receiver is live again. Only when that isn't possible is the encoder asked for a
+ * keyframe, and those requests are coalesced and rate-limited per receiver so that one lossy link cannot make
+ * everyone pay for keyframes.
+ */
+#include "fanout.h"
+#include "feedback_net.h"
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define CLIENT_PORT_BUFFER 21222
+// where receivers send their feedback to, the same as for a single receiver
+#define SERVER_PORT_FEEDBACK 21223
+
+#define SEND_SIZE 1450
+#define MAX_RECEIVERS 16
+// datagrams sent to one receiver before it is the next one's turn
+#define SEND_BURST 8
+#define RECEIVER_SNDBUF (4 * 1024 * 1024)
+
+// packets kept since the last keyframe. A GOP that outgrows them can only be joined at the next keyframe
+#define CACHE_BYTES (8 * 1024 * 1024)
+#define CACHE_PACKETS 4096
+// datagrams of the cache replayed to a receiver per frame on top of the live ones, so that it catches up in a few
+// frames without one frame's sends taking long enough to hold up the encoder
+#define REPLAY_FRAME_DATAGRAMS 512
+
+// frames between keyframes forced for receivers, and between two forced by the same receiver
+#define SHARED_KEYFRAME_INTERVAL 30
+#define RECEIVER_KEYFRAME_INTERVAL 300
+// requests still on their way when a receiver was caught up are ignored for this many frames
+#define REQUEST_HOLDOFF 5
+
+typedef struct fanout_receiver
+{
+    int fd;
+    struct sockaddr_in addr;
+    // nothing it could decode has reached it yet, it only gets a replay or the next keyframe
+    int needs_keyframe;
+    // replay the cache to it from the start of the next frame
+    int replay_pending;
+    // the replay has got as far as datagram replay_next of cached packet replay_packet, and can send
+    // replay_budget more datagrams this frame
+    int replaying;
+    int replay_packet;
+    int replay_next;
+    int replay_budget;
+    // the frame it last had a keyframe forced at, -1 if never
+    int64_t last_forced;
+    // the frame it last got a keyframe or a replay at
+    int64_t recovered_at;
+    // datagrams sent to it, and dropped because its socket buffer was full
+    uint64_t seq;
+    uint64_t drops;
+    ouvr_feedback_msg feedback;
+} fanout_receiver;
+
+typedef struct fanout_cached_packet
+{
+    ouvr_packet_header hdr;
+    size_t offset;
+} fanout_cached_packet;
+
+typedef struct fanout_net_context
+{
+    int feedback_fd;
+    fanout_receiver receivers[MAX_RECEIVERS];
+    int num_receivers;
+
+    uint8_t *cache;
+    size_t cache_used;
+    fanout_cached_packet cache_packets[CACHE_PACKETS];
+    int cache_count;
+    // 0 until a keyframe was seen, and once the packets since then no longer fit
+    int cache_valid;
+
+    uint32_t frame_id;
+    int64_t frames;
+    int64_t last_shared_keyframe;
+    uint64_t shared_keyframes;
+    uint64_t replays;
+} fanout_net_context;
+
+static int fanout_initialize(struct ouvr_ctx *ctx)
+{
+    fanout_net_context *c = calloc(1, sizeof(fanout_net_context));
+    ctx->net_priv = c;
+    c->cache = malloc(CACHE_BYTES);
+    c->last_shared_keyframe = -SHARED_KEYFRAME_INTERVAL;
+
+    c->feedback_fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (c->feedback_fd < 0)
+    {
+        PRINT_ERR("Couldn't create fan-out feedback socket\n");
+        return -1;
+    }
+    struct sockaddr_in serv_addr = {0};
+    serv_addr.sin_family = AF_INET;
+    inet_pton(AF_INET, SERVER_IP, &serv_addr.sin_addr.s_addr);
+    serv_addr.sin_port = htons(SERVER_PORT_FEEDBACK);
+    if (bind(c->feedback_fd, (struct sockaddr *)&serv_addr, sizeof(serv_addr)) < 0)
+    {
+        PRINT_ERR("Couldn't bind fan-out feedback\n");
+        return -1;
+    }
+    int flags = fcntl(c->feedback_fd, F_GETFL, 0);
+    fcntl(c->feedback_fd, F_SETFL, flags | (int)O_NONBLOCK);
+    return 0;
+}
+
+static void remove_receiver(fanout_net_context *c, fanout_receiver *r)
+{
+    printf("OpenUVR: receiver %s left\n", inet_ntoa(r->addr.sin_addr));
+    close(r->fd);
+    *r = c->receivers[--c->num_receivers];
+}
+
+static fanout_receiver *add_receiver(fanout_net_context *c, struct in_addr ip)
+{
+    if (c->num_receivers == MAX_RECEIVERS)
+    {
+        return NULL;
+    }
+    fanout_receiver *r = &c->receivers[c->num_receivers];
+    memset(r, 0, sizeof(*r));
+    r->fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (r->fd < 0)
+    {
+        PRINT_ERR("Couldn't create udp socket\n");
+        return NULL;
+    }
+    r->addr.sin_family = AF_INET;
+    r->addr.sin_addr = ip;
+    r->addr.sin_port = htons(CLIENT_PORT_BUFFER);
+    // connected, so that a receiver that went away shows up as ECONNREFUSED
+    if (connect(r->fd, (struct sockaddr *)&r->addr, sizeof(r->addr)) < 0)
+    {
+        PRINT_ERR("Couldn't connect udp\n");
+        close(r->fd);
+        return NULL;
+    }
+    int sndbuf = RECEIVER_SNDBUF;
+    setsockopt(r->fd, SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+    int flags = fcntl(r->fd, F_GETFL, 0);
+    fcntl(r->fd, F_SETFL, flags | (int)O_NONBLOCK);
+    r->needs_keyframe = 1;
+    r->replay_pending = 1;
+    r->last_forced = -1;
+    c->num_receivers++;
+    printf("OpenUVR: receiver %s joined\n", inet_ntoa(ip));
+    return r;
+}
+
+// sends datagrams [*next, ...) of a packet to r, at most max of them, and moves *next past what was sent. Returns -1
+// when r has to be dropped, 1 when its socket buffer is full and 0 otherwise
+static int send_datagrams(fanout_receiver *r, const ouvr_packet_header *hdr, const uint8_t *data, int *next, int max)
+{
+    struct iovec iov[2] = {{(void *)hdr, sizeof(*hdr)}, {NULL, 0}};
+    struct msghdr msg = {.msg_iov = iov, .msg_iovlen = 2};
+    // a packet without payload still takes one datagram
+    int count = hdr->size > 0 ? (hdr->size + SEND_SIZE - 1) / SEND_SIZE : 1;
+    for (int sent = 0; *next < count && sent < max; sent++)
+    {
+        int offset = *next * SEND_SIZE;
+        iov[1].iov_base = (void *)(data + offset);
+        iov[1].iov_len = hdr->size - offset < SEND_SIZE ? hdr->size - offset : SEND_SIZE;
+        if (sendmsg(r->fd, &msg, 0) < 0)
+        {
+            return errno == ECONNREFUSED ? -1 : 1;
+        }
+        r->seq++;
+        (*next)++;
+    }
+    return 0;
+}
+
+// a full socket buffer loses the rest of a live packet and r has to recover
+static int send_live(fanout_receiver *r, const ouvr_packet_header *hdr, const uint8_t *data, int *next, int max)
+{
+    int ret = send_datagrams(r, hdr, data, next, max);
+    if (ret == 1)
+    {
+        r->drops++;
+        r->needs_keyframe = 1;
+        r->replay_pending = 1;
+        *next = hdr->size > 0 ? (hdr->size + SEND_SIZE - 1) / SEND_SIZE : 1;
+        ret = 0;
+    }
+    return ret;
+}
+
+// sends r its next turn of the replay, at most max datagrams. Returns -1 when r has to be dropped, 1 when it can't take
+// more now and 0 otherwise. Once it has everything in the cache, the packet being sent included, it is live again
+static int send_replay(fanout_net_context *c, fanout_receiver *r, int max)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    if (max > r->replay_budget)
+    {
+        max = r->replay_budget;
+    }
+    while (max > 0 && r->replay_packet < c->cache_count)
+    {
+        const fanout_cached_packet *cp = &c->cache_packets[r->replay_packet];
+        ouvr_packet_header hdr = cp->hdr;
+        hdr.send_time.sec = tv.tv_sec;
+        hdr.send_time.usec = tv.tv_usec;
+        int count = hdr.size > 0 ? (hdr.size + SEND_SIZE - 1) / SEND_SIZE : 1;
+        int first = r->replay_next;
+        int ret = send_datagrams(r, &hdr, c->cache + cp->offset, &r->replay_next, max);
+        max -= r->replay_next - first;
+        r->replay_budget -= r->replay_next - first;
+        if (ret != 0)
+        {
+            return ret;
+        }
+        if (r->replay_next == count)
+        {
+            r->replay_packet++;
+            r->replay_next = 0;
+        }
+    }
+    if (r->replay_packet == c->cache_count)
+    {
+        r->replaying = 0;
+        r->needs_keyframe = 0;
+        // the requests it sent while it was behind are still coming in
+        r->recovered_at = c->frames;
+        return 0;
+    }
+    return r->replay_budget > 0 ? 0 : 1;
+}
+
+static void cache_packet(fanout_net_context *c, const ouvr_packet_header *hdr, const uint8_t *data)
+{
+    if (!c->cache_valid)
+    {
+        return;
+    }
+    if (c->cache_count == CACHE_PACKETS || c->cache_used + hdr->size > CACHE_BYTES)
+    {
+        c->cache_valid = 0;
+        // the replays can't reach the live stream any more, those receivers wait for a keyframe
+        for (int i = 0; i < c->num_receivers; i++)
+        {
+            c->receivers[i].replaying = 0;
+        }
+        return;
+    }
+    fanout_cached_packet *cp = &c->cache_packets[c->cache_count++];
+    cp->hdr = *hdr;
+    cp->offset = c->cache_used;
+    memcpy(c->cache + c->cache_used, data, hdr->size);
+    c->cache_used += hdr->size;
+}
+
+static int fanout_send_packet(struct ouvr_ctx *ctx, struct ouvr_packet *pkt)
+{
+    fanout_net_context *c = ctx->net_priv;
+    ouvr_packet_header hdr;
+    ouvr_packet_fill_header(pkt, &hdr);
+    int keyframe = pkt->flags & OUVR_PACKET_FLAG_KEYFRAME;
+
+    if (pkt->frame_id != c->frame_id || c->frames == 0)
+    {
+        c->frame_id = pkt->frame_id;
+        c->frames++;
+        if (keyframe)
+        {
+            c->cache_valid = 1;
+            c->cache_count = 0;
+            c->cache_used = 0;
+            for (int i = 0; i < c->num_receivers; i++)
+            {
+                fanout_receiver *r = &c->receivers[i];
+                if (r->needs_keyframe)
+                {
+                    r->needs_keyframe = 0;
+                    r->replay_pending = 0;
+                    r->replaying = 0;
+                    r->recovered_at = c->frames;
+                }
+            }
+        }
+        else if (c->cache_valid)
+        {
+            for (int i = 0; i < c->num_receivers; i++)
+            {
+                fanout_receiver *r = &c->receivers[i];
+                if (r->replay_pending)
+                {
+                    r->replay_pending = 0;
+                    r->replaying = 1;
+                    r->replay_packet = 0;
+                    r->replay_next = 0;
+                    r->recovered_at = c->frames;
+                    c->replays++;
+                }
+                r->replay_budget = REPLAY_FRAME_DATAGRAMS;
+            }
+        }
+    }
+    cache_packet(c, &hdr, pkt->data);
+
+    // receivers being replayed to get the packet from the cache once they reach it, and take their turns in the
+    // rounds until they do, can't take more, or have used up this frame's replay
+    int next[MAX_RECEIVERS] = {0};
+    int replay_done[MAX_RECEIVERS] = {0};
+    int count = hdr.size > 0 ? (hdr.size + SEND_SIZE - 1) / SEND_SIZE : 1;
+    int busy = 1;
+    while (busy)
+    {
+        busy = 0;
+        for (int i = 0; i < c->num_receivers; i++)
+        {
+            fanout_receiver *r = &c->receivers[i];
+            int ret = 0;
+            if (r->replaying && !replay_done[i])
+            {
+                ret = send_replay(c, r, SEND_BURST);
+                replay_done[i] = ret != 0;
+                // caught up, the packet was the last one replayed
+                next[i] = r->replaying ? 0 : count;
+                busy |= r->replaying && !replay_done[i];
+            }
+            else if (!r->needs_keyframe && next[i] < count)
+            {
+                ret = send_live(r, &hdr, pkt->data, &next[i], SEND_BURST);
+                busy |= next[i] < count;
+            }
+            if (ret < 0)
+            {
+                next[i] = next[c->num_receivers - 1];
+                replay_done[i] = replay_done[c->num_receivers - 1];
+                remove_receiver(c, r);
+                i--;
+            }
+        }
+    }
+    return 0;
+}
+
+static fanout_receiver *find_receiver(fanout_net_context *c, struct in_addr ip)
+{
+    for (int i = 0; i < c->num_receivers; i++)
+    {
+        if (c->receivers[i].addr.sin_addr.s_addr == ip.s_addr)
+        {
+            return &c->receivers[i];
+        }
+    }
+    return NULL;
+}
+
+// lowers the frame rate to what the slowest display can show
+static void apply_limits(struct ouvr_ctx *ctx, fanout_net_context *c)
+{
+    ouvr_feedback_msg limits = {0};
+    for (int i = 0; i < c->num_receivers; i++)
+    {
+        const ouvr_feedback_msg *f = &c->receivers[i].feedback;
+        if (f->max_width > 0 && (limits.max_width == 0 || f->max_width < limits.max_width))
+        {
+            limits.max_width = f->max_width;
+        }
+        if (f->max_height > 0 && (limits.max_height == 0 || f->max_height < limits.max_height))
+        {
+            limits.max_height = f->max_height;
+        }
+        if (f->max_fps > 0 && (limits.max_fps == 0 || f->max_fps < limits.max_fps))
+        {
+            limits.max_fps = f->max_fps;
+        }
+    }
+    feedback_apply_limits(ctx, &limits);
+}
+
+// receivers that can't be caught up from the cache need a keyframe. One is forced for all of them at once, no more
+// than every SHARED_KEYFRAME_INTERVAL frames, and each receiver can only force one every RECEIVER_KEYFRAME_INTERVAL.
+// The others wait for the next keyframe anyone gets
+static void request_keyframe(struct ouvr_ctx *ctx, fanout_net_context *c)
+{
+    if (c->cache_valid || c->frames - c->last_shared_keyframe < SHARED_KEYFRAME_INTERVAL)
+    {
+        return;
+    }
+    int force = 0;
+    for (int i = 0; i < c->num_receivers; i++)
+    {
+        fanout_receiver *r = &c->receivers[i];
+        if (r->needs_keyframe && (r->last_forced < 0 || c->frames - r->last_forced >= RECEIVER_KEYFRAME_INTERVAL))
+        {
+            r->last_forced = c->frames;
+            force = 1;
+        }
+    }
+    if (force)
+    {
+        c->last_shared_keyframe = c->frames;
+        c->shared_keyframes++;
+        pthread_mutex_lock(&ctx->params_lock);
+        ctx->keyframe_requested = 1;
+        pthread_mutex_unlock(&ctx->params_lock);
+    }
+}
+
+static void fanout_receive_feedback(struct ouvr_ctx *ctx)
+{
+    fanout_net_context *c = ctx->net_priv;
+    ouvr_feedback_msg msg;
+    struct sockaddr_in from;
+    socklen_t from_len;
+    int limits_changed = 0;
+
+    pthread_mutex_lock(&ctx->send_lock);
+    while (1)
+    {
+        memset(&msg, 0, sizeof(msg));
+        from_len = sizeof(from);
+        ssize_t r = recvfrom(c->feedback_fd, &msg, sizeof(msg), 0, (struct sockaddr *)&from, &from_len);
+        if (r < (ssize_t)sizeof(msg.send_iframe))
+        {
+            if (r < 0)
+            {
+                break;
+            }
+            continue;
+        }
+        fanout_receiver *rcv = find_receiver(c, from.sin_addr);
+        if (rcv == NULL)
+        {
+            rcv = add_receiver(c, from.sin_addr);
+            if (rcv == NULL)
+            {
+                continue;
+            }
+        }
+        // older receivers only send the i-frame request
+        if (r == sizeof(msg) && memcmp(&msg.max_width, &rcv->feedback.max_width, sizeof(msg) - sizeof(msg.send_iframe)))
+        {
+            rcv->feedback = msg;
+            limits_changed = 1;
+        }
+        // receivers keep asking until a keyframe reaches them, the first request is enough
+        if (msg.send_iframe > 0 && !rcv->needs_keyframe && c->frames - rcv->recovered_at >= REQUEST_HOLDOFF)
+        {
+            rcv->needs_keyframe = 1;
+            rcv->replay_pending = 1;
+        }
+    }
+    if (limits_changed)
+    {
+        apply_limits(ctx, c);
+    }
+    request_keyframe(ctx, c);
+    pthread_mutex_unlock(&ctx->send_lock);
+}
+
+static void fanout_deinitialize(struct ouvr_ctx *ctx)
+{
+    fanout_net_context *c = ctx->net_priv;
+    for (int i = 0; i < c->num_receivers; i++)
+    {
+        close(c->receivers[i].fd);
+    }
+    close(c->feedback_fd);
+    free(c->cache);
+    free(c);
+    ctx->net_priv = NULL;
+}
+
+int fanout_add_receiver(struct ouvr_ctx *ctx, const char *ip)
+{
+    fanout_net_context *c = ctx->net_priv;
+    struct in_addr addr;
+    if (ctx->net != &udp_fanout_handler || inet_pton(AF_INET, ip, &addr) != 1)
+    {
+        return -1;
+    }
+    pthread_mutex_lock(&ctx->send_lock);
+    int ret = find_receiver(c, addr) != NULL || add_receiver(c, addr) != NULL ? 0 : -1;
+    pthread_mutex_unlock(&ctx->send_lock);
+    return ret;
+}
+
+void fanout_get_counts(struct ouvr_ctx *ctx, int *receivers, uint64_t *shared_keyframes, uint64_t *replays)
+{
+    fanout_net_context *c = ctx->net_priv;
+    pthread_mutex_lock(&ctx->send_lock);
+    *receivers = c->num_receivers;
+    *shared_keyframes = c->shared_keyframes;
+    *replays = c->replays;
+    pthread_mutex_unlock(&ctx->send_lock);
+}
+
+struct ouvr_network udp_fanout_handler = {
+    .init = fanout_initialize,
+    .send_packet = fanout_send_packet,
+    .deinit = fanout_deinitialize,
+    .receive_feedback = fanout_receive_feedback,
+};
@@ -52,8 +52,6 @@
 //#define SERVER_PORT_FEEDBACK 21223
 //#define CLIENT_PORT_FEEDBACK 21224
 
-extern char CLIENT_IP[20];
-
 
 typedef struct feedback_net_context
 {
@@ -90,9 +88,12 @@ int feedback_initialize(struct ouvr_ctx *ctx)
     c->serv_addr.sin_port = htons(SERVER_PORT_FEEDBACK);
 
     c->cli_addr.sin_family = AF_INET;
-    inet_pton(AF_INET, CLIENT_IP, &c->cli_addr.sin_addr.s_addr);
+    inet_pton(AF_INET, ctx->client_ip, &c->cli_addr.sin_addr.s_addr);
     c->cli_addr.sin_port = htons(CLIENT_PORT_FEEDBACK);
 
+    // see udp.c
+    int reuse = 1;
+    setsockopt(c->fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
     if (bind(c->fd, (struct sockaddr *)&c->serv_addr, sizeof(c->serv_addr)) < 0)
     {
         PRINT_ERR("Couldn't bind feedback\n");
@@ -111,11 +112,35 @@ int feedback_initialize(struct ouvr_ctx *ctx)
     return 0;
 }
 
+// keeps what the receiver reported and lowers the frame rate to what it can show. The resolution is fixed for the
+// whole session, so a receiver with a smaller display only gets a warning
+void feedback_apply_limits(struct ouvr_ctx *ctx, const ouvr_feedback_msg *msg)
+{
+    if (msg->max_width == ctx->receiver_width && msg->max_height == ctx->receiver_height && msg->max_fps == ctx->receiver_fps)
+    {
+        return;
+    }
+    ctx->receiver_width = msg->max_width;
+    ctx->receiver_height = msg->max_height;
+    ctx->receiver_fps = msg->max_fps;
+
+    ctx->fps = ctx->requested_fps;
+    if (ctx->receiver_fps > 0 && ctx->receiver_fps < ctx->fps)
+    {
+        ctx->fps = ctx->receiver_fps;
+    }
+    printf("OpenUVR: receiver shows up to %dx%d@%d, sending %dx%d@%d\n", ctx->receiver_width, ctx->receiver_height, ctx->receiver_fps, ctx->width, ctx->height, ctx->fps);
+    if ((ctx->receiver_width > 0 && ctx->width > ctx->receiver_width) || (ctx->receiver_height > 0 && ctx->height > ctx->receiver_height))
+    {
+        PRINT_ERR("Frames are %dx%d but the receiver's display is %dx%d, they will be scaled down on the receiver\n", ctx->width, ctx->height, ctx->receiver_width, ctx->receiver_height);
+    }
+}
+
 int feedback_receive(struct ouvr_ctx *ctx)
 {
     feedback_net_context *c = ctx->fbn_priv;
     register ssize_t r;
-    int to_recv = 0;
+    ouvr_feedback_msg to_recv = {0};
     c->iov[0].iov_len = sizeof(to_recv);
     c->iov[0].iov_base = &to_recv;
 
@@ -125,9 +150,26 @@ int feedback_receive(struct ouvr_ctx *ctx)
         PRINT_ERR("sendmsg returned %ld\n", r);
         return -1;
     }
-    else if (r >= 0 && ctx->flag_send_iframe == 0)
+    // older receivers only send the i-frame request
+    if (r == sizeof(to_recv))
+    {
+        feedback_apply_limits(ctx, &to_recv);
+    }
+    if (r >= (ssize_t)sizeof(to_recv.send_iframe) && ctx->flag_send_iframe == 0)
     {
-        ctx->flag_send_iframe = to_recv;
+        ctx->flag_send_iframe = to_recv.send_iframe;
     }
     return 0;
 }
+
+void feedback_deinitialize(struct ouvr_ctx *ctx)
+{
+    feedback_net_context *c = ctx->fbn_priv;
+    if (c == NULL)
+    {
+        return;
+    }
+    close(c->fd);
+    free(c);
+    ctx->fbn_priv = NULL;
+}
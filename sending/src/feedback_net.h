@@ -36,5 +36,8 @@
 
 int feedback_initialize(struct ouvr_ctx *ctx);
 int feedback_receive(struct ouvr_ctx *ctx);
+void feedback_deinitialize(struct ouvr_ctx *ctx);
+// what the receivers' displays can show, for network handlers that receive the feedback themselves
+void feedback_apply_limits(struct ouvr_ctx *ctx, const ouvr_feedback_msg *msg);
 
 #endif
\ No newline at end of file
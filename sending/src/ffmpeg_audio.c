@@ -141,6 +141,11 @@ static int ffmpeg_process_frame(struct ouvr_ctx *ctx, struct ouvr_packet *pkt)
     ret = avcodec_receive_packet(a->enc_ctx, &packet);
     if (ret >= 0)
     {
+        pkt->size = 0;
+        if (ouvr_packet_reserve(pkt, packet.size) != 0)
+        {
+            return -1;
+        }
         memcpy(pkt->data, packet.data, packet.size);
         pkt->size = packet.size;
         printf("size %d\n", pkt->size);
@@ -170,6 +175,15 @@ static int ffmpeg_process_frame(struct ouvr_ctx *ctx, struct ouvr_packet *pkt)
         }
     }
 
+    int size = 0;
+    for (int i = 0; i < N; i++)
+    {
+        size += alsa_pkts[i].size;
+    }
+    if (ouvr_packet_reserve(pkt, size) != 0)
+    {
+        return -1;
+    }
     for (int i = 0; i < N; i++)
     {
         memcpy(pkt->data + pkt->size, alsa_pkts[i].data, alsa_pkts[i].size);
@@ -44,8 +44,11 @@
 #include "ffmpeg_cuda_encode.h"
 #include "ouvr_packet.h"
 
-#define WIDTH 1920
-#define HEIGHT 1080
+// the bitrate was tuned for 1080p at 60 fps, other geometries get the same number of bits per pixel
+#define REFERENCE_BITRATE 15000000
+#define REFERENCE_PIXEL_RATE (1920 * 1080 * 60)
+// used until openuvr_set_gop() says otherwise
+#define DEFAULT_GOP 480
 
 // #define USE_YUV
 
@@ -60,11 +63,23 @@ typedef struct ffmpeg_cuda_encode_context
     AVCodecContext *enc_ctx;
     AVFrame *frame;
     int idx;
+    // nvenc's GOP length is fixed once it is open, so keyframes are placed here instead
+    int gop;
+    int frames_since_idr;
     CUcontext *cuda_ctx;
     CUDA_MEMCPY2D memCpyStruct;
     CUgraphicsResource resource;
 } ffmpeg_cuda_encode_context;
 
+static int64_t target_bitrate(struct ouvr_ctx *ctx)
+{
+    if (ctx->enc_params.bitrate_kbps > 0)
+    {
+        return (int64_t)ctx->enc_params.bitrate_kbps * 1000;
+    }
+    return (int64_t)REFERENCE_BITRATE * ctx->width * ctx->height * ctx->fps / REFERENCE_PIXEL_RATE;
+}
+
 static int ffmpeg_initialize(struct ouvr_ctx *ctx)
 {
     int ret;
@@ -82,13 +97,15 @@ static int ffmpeg_initialize(struct ouvr_ctx *ctx)
         return -1;
     }
     e->enc_ctx = avcodec_alloc_context3(enc);
-    e->enc_ctx->width = WIDTH;
-    e->enc_ctx->height = HEIGHT;
+    e->enc_ctx->width = ctx->width;
+    e->enc_ctx->height = ctx->height;
     e->enc_ctx->codec_type = AVMEDIA_TYPE_VIDEO;
-    e->enc_ctx->framerate = (AVRational){60, 1};
-    e->enc_ctx->time_base = (AVRational){1, 60};
-    e->enc_ctx->bit_rate = 15000000;
-    e->enc_ctx->gop_size = 480;
+    e->enc_ctx->framerate = (AVRational){ctx->fps, 1};
+    e->enc_ctx->time_base = (AVRational){1, ctx->fps};
+    e->enc_ctx->bit_rate = target_bitrate(ctx);
+    // left to the preset, which never inserts keyframes by itself in the low latency modes
+    e->enc_ctx->gop_size = -1;
+    e->gop = ctx->enc_params.gop > 0 ? ctx->enc_params.gop : DEFAULT_GOP;
     e->enc_ctx->max_b_frames = 0;
     e->enc_ctx->pix_fmt = AV_PIX_FMT_CUDA;
     e->enc_ctx->sw_pix_fmt = PIX_FMT;
@@ -120,8 +137,8 @@ static int ffmpeg_initialize(struct ouvr_ctx *ctx)
     AVHWFramesContext *frames_ctx = (AVHWFramesContext *)e->enc_ctx->hw_frames_ctx->data;
     frames_ctx->format = AV_PIX_FMT_CUDA;
     frames_ctx->sw_format = PIX_FMT;
-    frames_ctx->width = WIDTH;
-    frames_ctx->height = HEIGHT;
+    frames_ctx->width = ctx->width;
+    frames_ctx->height = ctx->height;
     frames_ctx->device_ref = e->enc_ctx->hw_device_ctx;
     frames_ctx->device_ctx = (AVHWDeviceContext *)e->enc_ctx->hw_device_ctx->data;
     ret = av_hwframe_ctx_init(e->enc_ctx->hw_frames_ctx);
@@ -187,11 +204,18 @@ static int ffmpeg_process_frame(struct ouvr_ctx *ctx, struct ouvr_packet *pkt)
     ret = avcodec_receive_packet(e->enc_ctx, &packet);
     if (ret >= 0)
     {
-        // This takes ~5 microseconds, so nothing to worry about
-        // memcpy(pkt->data, packet.data, packet.size);
-        // This can be ~ 10 microseconds faster, but not memory safe probably:
-        pkt->data = packet.data;
+        // This takes ~5 microseconds, so nothing to worry about. Pointing pkt->data at packet.data saved that but left
+        // the packet's own buffer behind and the encoder's one to be freed with it
+        pkt->size = 0;
+        if (ouvr_packet_reserve(pkt, packet.size) != 0)
+        {
+            av_packet_unref(&packet);
+            return -1;
+        }
+        memcpy(pkt->data, packet.data, packet.size);
         pkt->size = packet.size;
+        pkt->flags = packet.flags & AV_PKT_FLAG_KEY ? OUVR_PACKET_FLAG_KEYFRAME : 0;
+        av_packet_unref(&packet);
         return 1;
     }
     else if (ret != -11)
@@ -207,9 +231,9 @@ static int ffmpeg_process_frame(struct ouvr_ctx *ctx, struct ouvr_packet *pkt)
 /* TODO: see if saturation can be fixed on NPPI conversion to YUV420 */
 #ifdef USE_YUV
     NppiSize fdsa;
-    fdsa.width = WIDTH;
-    fdsa.height = HEIGHT;
-    nppiRGBToYUV420_8u_C3P3R(e->memCpyStruct.srcDevice, WIDTH * 3, e->frame->data, e->frame->linesize, fdsa);
+    fdsa.width = ctx->width;
+    fdsa.height = ctx->height;
+    nppiRGBToYUV420_8u_C3P3R(e->memCpyStruct.srcDevice, ctx->width * 3, e->frame->data, e->frame->linesize, fdsa);
 #else
     err = cuMemcpy2D(&e->memCpyStruct);
     if (err != 0)
@@ -239,6 +263,14 @@ static int ffmpeg_process_frame(struct ouvr_ctx *ctx, struct ouvr_packet *pkt)
             ctx->flag_send_iframe++;
         }
     }
+    if (++e->frames_since_idr >= e->gop)
+    {
+        frame->pict_type = AV_PICTURE_TYPE_I;
+    }
+    if (frame->pict_type == AV_PICTURE_TYPE_I)
+    {
+        e->frames_since_idr = 0;
+    }
 
     ret = avcodec_send_frame(e->enc_ctx, frame);
     if (ret != 0 && ret != -11)
@@ -290,12 +322,27 @@ static void ffmpeg_cuda_copy(struct ouvr_ctx *ctx)
     e->memCpyStruct.srcDevice = srcDevPtr;
     e->memCpyStruct.dstDevice = (CUdeviceptr)e->frame->data[0];
     e->memCpyStruct.dstPitch = e->frame->linesize[0];
-    e->memCpyStruct.WidthInBytes = WIDTH * 4;
-    e->memCpyStruct.Height = HEIGHT;
+    e->memCpyStruct.WidthInBytes = ctx->width * 4;
+    e->memCpyStruct.Height = ctx->height;
 
     err = cuCtxPopCurrent(&oldctx);
 }
 
+// nvenc picks up a new bit_rate with the next frame it is sent, the preset can't change without reopening it
+static int ffmpeg_reconfigure(struct ouvr_ctx *ctx, unsigned int changed)
+{
+    ffmpeg_cuda_encode_context *e = ctx->enc_priv;
+    if (changed & OUVR_PARAM_BITRATE)
+    {
+        e->enc_ctx->bit_rate = target_bitrate(ctx);
+    }
+    if (changed & OUVR_PARAM_GOP)
+    {
+        e->gop = ctx->enc_params.gop > 0 ? ctx->enc_params.gop : DEFAULT_GOP;
+    }
+    return changed & (OUVR_PARAM_PRESET | OUVR_PARAM_ANALYSIS) ? -1 : 0;
+}
+
 static void ffmpeg_deinitialize(struct ouvr_ctx *ctx)
 {
     ffmpeg_cuda_encode_context *e = ctx->enc_priv;
@@ -315,4 +362,5 @@ struct ouvr_encoder ffmpeg_cuda_encode = {
     .process_frame = ffmpeg_process_frame,
     .cuda_copy = ffmpeg_cuda_copy,
     .deinit = ffmpeg_deinitialize,
+    .reconfigure = ffmpeg_reconfigure,
 };
\ No newline at end of file
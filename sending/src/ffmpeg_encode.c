@@ -33,13 +33,20 @@
 #include "include/libavutil/avutil.h"
 #include "include/libavutil/opt.h"
 #include "include/libavutil/imgutils.h"
+#include "include/libavutil/mem.h"
 #include "include/libswscale/swscale.h"
 
 #include "ffmpeg_encode.h"
 #include "ouvr_packet.h"
+#include "foveation.h"
 
-#define WIDTH 1920
-#define HEIGHT 1080
+// the bitrate was tuned for 1080p at 60 fps, other geometries get the same number of bits per pixel
+#define REFERENCE_BITRATE 15000000
+#define REFERENCE_PIXEL_RATE (1920 * 1080 * 60)
+// used until openuvr_set_gop() says otherwise
+#define DEFAULT_GOP 140
+
+#define MAX_FOVEA_RINGS 10
 
 /* output defaults to ABGR, but uncomment following line to output as YUV420p */
 // #define OUTPUT_YUV
@@ -51,6 +58,9 @@ typedef struct ffmpeg_encode_context
     AVCodecContext *enc_ctx;
     AVFrame *frame;
     int idx;
+    // nvenc's GOP length is fixed once it is open, so keyframes are placed here instead
+    int gop;
+    int frames_since_idr;
     struct SwsContext *rgb_to_yuv_ctx;
 } ffmpeg_encode_context;
 
@@ -62,12 +72,21 @@ typedef struct ffmpeg_encode_context
 
 #ifdef INPUT_RGB
 #define INPUT_PIX_FMT AV_PIX_FMT_RGB24
-static int const srcstride[1] = {WIDTH * 3};
+#define INPUT_BYTES_PER_PIXEL 3
 #else
 #define INPUT_PIX_FMT AV_PIX_FMT_RGB0
-static int const srcstride[1] = {WIDTH * 4};
+#define INPUT_BYTES_PER_PIXEL 4
 #endif
 
+static int64_t target_bitrate(struct ouvr_ctx *ctx)
+{
+    if (ctx->enc_params.bitrate_kbps > 0)
+    {
+        return (int64_t)ctx->enc_params.bitrate_kbps * 1000;
+    }
+    return (int64_t)REFERENCE_BITRATE * ctx->enc_width * ctx->enc_height * ctx->fps / REFERENCE_PIXEL_RATE;
+}
+
 static int ffmpeg_initialize(struct ouvr_ctx *ctx)
 {
     int ret;
@@ -84,13 +103,15 @@ static int ffmpeg_initialize(struct ouvr_ctx *ctx)
         return -1;
     }
     e->enc_ctx = avcodec_alloc_context3(enc);
-    e->enc_ctx->width = WIDTH;
-    e->enc_ctx->height = HEIGHT;
+    e->enc_ctx->width = ctx->enc_width;
+    e->enc_ctx->height = ctx->enc_height;
     e->enc_ctx->codec_type = AVMEDIA_TYPE_VIDEO;
-    e->enc_ctx->framerate = (AVRational){60, 1};
-    e->enc_ctx->time_base = (AVRational){1, 60};
-    e->enc_ctx->bit_rate = 15000000;
-    e->enc_ctx->gop_size = 140;
+    e->enc_ctx->framerate = (AVRational){ctx->fps, 1};
+    e->enc_ctx->time_base = (AVRational){1, ctx->fps};
+    e->enc_ctx->bit_rate = target_bitrate(ctx);
+    // left to the preset, which never inserts keyframes by itself in the low latency modes
+    e->enc_ctx->gop_size = -1;
+    e->gop = ctx->enc_params.gop > 0 ? ctx->enc_params.gop : DEFAULT_GOP;
     e->enc_ctx->max_b_frames = 0;
     e->enc_ctx->pix_fmt = OUTPUT_PIX_FMT;
     ret = av_opt_set(e->enc_ctx->priv_data, "preset", "llhq", 0);
@@ -122,10 +143,40 @@ static int ffmpeg_initialize(struct ouvr_ctx *ctx)
         PRINT_ERR("av_image_alloc() failed\n");
         return -1;
     }
-    e->rgb_to_yuv_ctx = sws_getContext(WIDTH, HEIGHT, INPUT_PIX_FMT, WIDTH, HEIGHT, OUTPUT_PIX_FMT, SWS_FAST_BILINEAR, NULL, NULL, NULL);
+    e->rgb_to_yuv_ctx = sws_getContext(ctx->enc_width, ctx->enc_height, INPUT_PIX_FMT, ctx->enc_width, ctx->enc_height, OUTPUT_PIX_FMT, SWS_FAST_BILINEAR, NULL, NULL, NULL);
     return 0;
 }
 
+// passes the foveation profile as regions of interest, encoders that do not support them just ignore it
+static void attach_fovea_regions(struct ouvr_ctx *ctx, AVFrame *frame)
+{
+    ouvr_fovea_ring rings[MAX_FOVEA_RINGS];
+
+    // the frame is reused, so last frame's regions have to go even if foveation was turned off since
+    av_frame_remove_side_data(frame, AV_FRAME_DATA_REGIONS_OF_INTEREST);
+    int n = ouvr_foveation_rings(ctx->fov, ctx->enc_width, ctx->enc_height, rings, MAX_FOVEA_RINGS);
+    if (n == 0)
+    {
+        return;
+    }
+    AVFrameSideData *sd = av_frame_new_side_data(frame, AV_FRAME_DATA_REGIONS_OF_INTEREST, n * sizeof(AVRegionOfInterest));
+    if (sd == NULL)
+    {
+        return;
+    }
+    AVRegionOfInterest *roi = (AVRegionOfInterest *)sd->data;
+    for (int i = 0; i < n; i++)
+    {
+        roi[i].self_size = sizeof(AVRegionOfInterest);
+        roi[i].left = rings[i].left;
+        roi[i].top = rings[i].top;
+        roi[i].right = rings[i].right;
+        roi[i].bottom = rings[i].bottom;
+        // qoffset goes from -1 to 1 over the whole quantizer range
+        roi[i].qoffset = av_make_q((int)(rings[i].qp_offset * 100), 51 * 100);
+    }
+}
+
 static int ffmpeg_process_frame(struct ouvr_ctx *ctx, struct ouvr_packet *pkt)
 {
     int ret;
@@ -140,8 +191,16 @@ static int ffmpeg_process_frame(struct ouvr_ctx *ctx, struct ouvr_packet *pkt)
     ret = avcodec_receive_packet(e->enc_ctx, &packet);
     if (ret >= 0)
     {
+        pkt->size = 0;
+        if (ouvr_packet_reserve(pkt, packet.size) != 0)
+        {
+            av_packet_unref(&packet);
+            return -1;
+        }
         memcpy(pkt->data, packet.data, packet.size);
         pkt->size = packet.size;
+        pkt->flags = packet.flags & AV_PKT_FLAG_KEY ? OUVR_PACKET_FLAG_KEYFRAME : 0;
+        av_packet_unref(&packet);
         return 1;
     }
     else if (ret != -11)
@@ -151,7 +210,8 @@ static int ffmpeg_process_frame(struct ouvr_ctx *ctx, struct ouvr_packet *pkt)
     }
 
     const uint8_t *const src = ctx->pix_buf;
-    sws_scale(e->rgb_to_yuv_ctx, &src, srcstride, 0, HEIGHT, frame->data, frame->linesize);
+    const int srcstride[1] = {ctx->enc_width * INPUT_BYTES_PER_PIXEL};
+    sws_scale(e->rgb_to_yuv_ctx, &src, srcstride, 0, ctx->enc_height, frame->data, frame->linesize);
 
     frame->pts = e->idx++;
     if (ctx->flag_send_iframe > 0)
@@ -167,6 +227,16 @@ static int ffmpeg_process_frame(struct ouvr_ctx *ctx, struct ouvr_packet *pkt)
             ctx->flag_send_iframe++;
         }
     }
+    if (++e->frames_since_idr >= e->gop)
+    {
+        frame->pict_type = AV_PICTURE_TYPE_I;
+    }
+    if (frame->pict_type == AV_PICTURE_TYPE_I)
+    {
+        e->frames_since_idr = 0;
+    }
+
+    attach_fovea_regions(ctx, frame);
 
     ret = avcodec_send_frame(enc_ctx, frame);
     if (ret != 0 && ret != -11)
@@ -177,9 +247,36 @@ static int ffmpeg_process_frame(struct ouvr_ctx *ctx, struct ouvr_packet *pkt)
 
     return 0;
 }
+// nvenc picks up a new bit_rate with the next frame it is sent, the preset can't change without reopening it
+static int ffmpeg_reconfigure(struct ouvr_ctx *ctx, unsigned int changed)
+{
+    ffmpeg_encode_context *e = ctx->enc_priv;
+    if (changed & OUVR_PARAM_BITRATE)
+    {
+        e->enc_ctx->bit_rate = target_bitrate(ctx);
+    }
+    if (changed & OUVR_PARAM_GOP)
+    {
+        e->gop = ctx->enc_params.gop > 0 ? ctx->enc_params.gop : DEFAULT_GOP;
+    }
+    return changed & (OUVR_PARAM_PRESET | OUVR_PARAM_ANALYSIS) ? -1 : 0;
+}
+
 static void ffmpeg_deinitialize(struct ouvr_ctx *ctx)
 {
     ffmpeg_encode_context *e = ctx->enc_priv;
+    if (e == NULL)
+    {
+        return;
+    }
+    // resize_encoder() comes through here on every step of the resolution ladder
+    sws_freeContext(e->rgb_to_yuv_ctx);
+    if (e->frame != NULL)
+    {
+        // the planes come from av_image_alloc(), which the frame doesn't own
+        av_freep(&e->frame->data[0]);
+        av_frame_free(&e->frame);
+    }
     avcodec_free_context(&e->enc_ctx);
     free(e);
     ctx->enc_priv = NULL;
@@ -189,4 +286,5 @@ struct ouvr_encoder ffmpeg_encode = {
     .init = ffmpeg_initialize,
     .process_frame = ffmpeg_process_frame,
     .deinit = ffmpeg_deinitialize,
+    .reconfigure = ffmpeg_reconfigure,
 };
\ No newline at end of file
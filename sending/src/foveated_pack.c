@@ -0,0 +1,99 @@
+/*
+    The MIT License (MIT)
+
+    Copyright (c) 2020 OpenUVR
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+
+    Authors:
+    Alec Rohloff
+    Zackary Allen
+    Kung-Min Lin
+    Chengyi Nie
+    Hung-Wei Tseng
+*/
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "foveated_pack.h"
+
+// averages each 2x2 block of the rows starting at row0 and row1 into dst, for width_out output pixels
+static void downsample_rows(const uint8_t *row0, const uint8_t *row1, uint8_t *dst, int width_out)
+{
+    int x = 0;
+#ifdef __SSE2__
+    for (; x + 4 <= width_out; x += 4)
+    {
+        __m128i a0 = _mm_loadu_si128((const __m128i *)(row0 + x * 8));
+        __m128i a1 = _mm_loadu_si128((const __m128i *)(row0 + x * 8 + 16));
+        __m128i b0 = _mm_loadu_si128((const __m128i *)(row1 + x * 8));
+        __m128i b1 = _mm_loadu_si128((const __m128i *)(row1 + x * 8 + 16));
+        __m128 v0 = _mm_castsi128_ps(_mm_avg_epu8(a0, b0));
+        __m128 v1 = _mm_castsi128_ps(_mm_avg_epu8(a1, b1));
+        __m128i even = _mm_castps_si128(_mm_shuffle_ps(v0, v1, _MM_SHUFFLE(2, 0, 2, 0)));
+        __m128i odd = _mm_castps_si128(_mm_shuffle_ps(v0, v1, _MM_SHUFFLE(3, 1, 3, 1)));
+        _mm_storeu_si128((__m128i *)(dst + x * 4), _mm_avg_epu8(even, odd));
+    }
+#endif
+    for (; x < width_out; x++)
+    {
+        for (int c = 0; c < 4; c++)
+        {
+            dst[x * 4 + c] = (row0[x * 8 + c] + row0[x * 8 + 4 + c] + row1[x * 8 + c] + row1[x * 8 + 4 + c] + 2) >> 2;
+        }
+    }
+}
+
+void ouvr_foveated_pack(const uint8_t *src, uint8_t *dst, int width, int height, int num_eyes, const float center_x[2], const float center_y[2], ouvr_fovea_position *pos)
+{
+    int stride = width * 4;
+    int dst_stride = OUVR_FOVEATED_PACKED_WIDTH(width) * 4;
+    int eye_width = width / num_eyes;
+    int packed_width = eye_width / 2;
+    int fovea_height = height / 2;
+
+    pos->num_eyes = num_eyes;
+    for (int eye = 0; eye < num_eyes; eye++)
+    {
+        const uint8_t *eye_src = src + eye * eye_width * 4;
+        uint8_t *eye_dst = dst + eye * packed_width * 4;
+
+        // fovea, kept inside the view and on even coordinates so chroma subsampling lines up on both sides
+        int left = center_x[eye] * eye_width - packed_width / 2;
+        int top = center_y[eye] * height - fovea_height / 2;
+        left = left < 0 ? 0 : left > eye_width - packed_width ? eye_width - packed_width : left;
+        top = top < 0 ? 0 : top > height - fovea_height ? height - fovea_height : top;
+        left &= ~1;
+        top &= ~1;
+        pos->left[eye] = left;
+        pos->top[eye] = top;
+        for (int y = 0; y < fovea_height; y++)
+        {
+            memcpy(eye_dst + y * dst_stride, eye_src + (top + y) * stride + left * 4, packed_width * 4);
+        }
+
+        // periphery: the whole view at half resolution under the fovea
+        for (int y = 0; y < height / 2; y++)
+        {
+            downsample_rows(eye_src + 2 * y * stride, eye_src + (2 * y + 1) * stride, eye_dst + (fovea_height + y) * dst_stride, packed_width);
+        }
+    }
+}
@@ -0,0 +1,47 @@
+/*
+    The MIT License (MIT)
+
+    Copyright (c) 2020 OpenUVR
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+
+    Authors:
+    Alec Rohloff
+    Zackary Allen
+    Kung-Min Lin
+    Chengyi Nie
+    Hung-Wei Tseng
+*/
+
+#ifndef OUVR_FOVEATED_PACK_H
+#define OUVR_FOVEATED_PACK_H
+
+#include <stdint.h>
+
+#include "ouvr_packet.h"
+
+/**
+ * Packs each eye view of the RGBA frame in src as its fovea at full resolution, a quarter of the view centred on
+ * center_x/center_y, stacked on top of the whole view at half resolution. The packed eye is half as wide as the
+ * view, so dst is OUVR_FOVEATED_PACKED_WIDTH(width) wide and as high as src, half its pixels. pos receives where
+ * the foveae were taken from.
+ */
+void ouvr_foveated_pack(const uint8_t *src, uint8_t *dst, int width, int height, int num_eyes, const float center_x[2], const float center_y[2], ouvr_fovea_position *pos);
+
+#endif
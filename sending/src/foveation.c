@@ -0,0 +1,197 @@
+/*
+    The MIT License (MIT)
+
+    Copyright (c) 2020 OpenUVR
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+
+    Authors:
+    Alec Rohloff
+    Zackary Allen
+    Kung-Min Lin
+    Chengyi Nie
+    Hung-Wei Tseng
+*/
+/**
+ * Keeps the foveation profile and the fovea centres set through the API, and turns them into the quantizer
+ * offsets the encoders want.
+ */
+#include <math.h>
+#include <stdlib.h>
+
+#include "foveation.h"
+#include "ouvr_packet.h"
+
+// number of rings per eye used to approximate the profile with regions of interest
+#define NUM_LEVELS 4
+
+struct ouvr_foveation *ouvr_foveation_alloc()
+{
+    struct ouvr_foveation *fov = calloc(1, sizeof(struct ouvr_foveation));
+    pthread_mutex_init(&fov->lock, NULL);
+    for (int eye = 0; eye < 2; eye++)
+    {
+        fov->center_x[eye] = 0.5f;
+        fov->center_y[eye] = 0.5f;
+    }
+    return fov;
+}
+
+void ouvr_foveation_free(struct ouvr_foveation *fov)
+{
+    if (fov == NULL)
+    {
+        return;
+    }
+    pthread_mutex_destroy(&fov->lock);
+    free(fov);
+}
+
+void ouvr_foveation_set_profile(struct ouvr_foveation *fov, const struct openuvr_foveation_profile *profile)
+{
+    pthread_mutex_lock(&fov->lock);
+    if (profile != NULL)
+    {
+        fov->profile = *profile;
+        if (fov->profile.outer_radius < fov->profile.inner_radius)
+        {
+            fov->profile.outer_radius = fov->profile.inner_radius;
+        }
+    }
+    fov->enabled = profile != NULL;
+    pthread_mutex_unlock(&fov->lock);
+}
+
+void ouvr_foveation_set_center(struct ouvr_foveation *fov, int eye, float x, float y)
+{
+    if (eye < 0 || eye > 1)
+    {
+        return;
+    }
+    pthread_mutex_lock(&fov->lock);
+    fov->center_x[eye] = x;
+    fov->center_y[eye] = y;
+    pthread_mutex_unlock(&fov->lock);
+}
+
+int ouvr_foveation_snapshot(struct ouvr_foveation *fov, struct openuvr_foveation_profile *profile, float center_x[2], float center_y[2])
+{
+    pthread_mutex_lock(&fov->lock);
+    *profile = fov->profile;
+    for (int eye = 0; eye < 2; eye++)
+    {
+        center_x[eye] = fov->center_x[eye];
+        center_y[eye] = fov->center_y[eye];
+    }
+    int enabled = fov->enabled;
+    pthread_mutex_unlock(&fov->lock);
+    return enabled;
+}
+
+static float offset_for_distance(const struct openuvr_foveation_profile *p, float d)
+{
+    if (d <= p->inner_radius)
+    {
+        return 0;
+    }
+    if (d >= p->outer_radius)
+    {
+        return p->max_qp_offset;
+    }
+    // smoothstep, so that there is no visible edge where the quality starts dropping
+    float t = (d - p->inner_radius) / (p->outer_radius - p->inner_radius);
+    return p->max_qp_offset * t * t * (3 - 2 * t);
+}
+
+int ouvr_foveation_qp_offsets(struct ouvr_foveation *fov, int frame_width, int x_offset, int width, int height, int mb_size, float *map)
+{
+    int mb_width = (width + mb_size - 1) / mb_size;
+    int mb_height = (height + mb_size - 1) / mb_size;
+
+    struct openuvr_foveation_profile p;
+    float center_x[2], center_y[2];
+    if (!ouvr_foveation_snapshot(fov, &p, center_x, center_y))
+    {
+        return 0;
+    }
+
+    int eye_width = p.stereo ? frame_width / 2 : frame_width;
+    for (int mby = 0; mby < mb_height; mby++)
+    {
+        float y = mby * mb_size + mb_size / 2.0f;
+        for (int mbx = 0; mbx < mb_width; mbx++)
+        {
+            float x = x_offset + mbx * mb_size + mb_size / 2.0f;
+            int eye = x >= eye_width ? 1 : 0;
+            float dx = x - (eye * eye_width + center_x[eye] * eye_width);
+            float dy = y - center_y[eye] * height;
+            map[mby * mb_width + mbx] = offset_for_distance(&p, sqrtf(dx * dx + dy * dy) / height);
+        }
+    }
+    return 1;
+}
+
+int ouvr_foveation_rings(struct ouvr_foveation *fov, int width, int height, ouvr_fovea_ring *rings, int max_rings)
+{
+    struct openuvr_foveation_profile p;
+    float center_x[2], center_y[2];
+    if (!ouvr_foveation_snapshot(fov, &p, center_x, center_y))
+    {
+        return 0;
+    }
+
+    int num_eyes = p.stereo ? 2 : 1;
+    int eye_width = width / num_eyes;
+    int n = 0;
+    // ring k covers everything up to the radius where the profile reaches level k + 1, and takes the offset of
+    // the middle of its band. The eyes' rectangles never overlap so their order does not matter
+    for (int k = 0; k <= NUM_LEVELS; k++)
+    {
+        for (int eye = 0; eye < num_eyes && n < max_rings; eye++)
+        {
+            int eye_left = eye * eye_width;
+            ouvr_fovea_ring *r = &rings[n];
+            if (k == NUM_LEVELS)
+            {
+                r->left = eye_left;
+                r->top = 0;
+                r->right = eye_left + eye_width;
+                r->bottom = height;
+                r->qp_offset = p.max_qp_offset;
+                n++;
+                continue;
+            }
+            float radius = (p.inner_radius + (p.outer_radius - p.inner_radius) * k / NUM_LEVELS) * height;
+            float band_middle = p.inner_radius + (p.outer_radius - p.inner_radius) * (k - 0.5f) / NUM_LEVELS;
+            int cx = eye_left + center_x[eye] * eye_width;
+            int cy = center_y[eye] * height;
+            r->left = cx - radius < eye_left ? eye_left : cx - radius;
+            r->right = cx + radius > eye_left + eye_width ? eye_left + eye_width : cx + radius;
+            r->top = cy - radius < 0 ? 0 : cy - radius;
+            r->bottom = cy + radius > height ? height : cy + radius;
+            r->qp_offset = k == 0 ? 0 : offset_for_distance(&p, band_middle);
+            // the fovea can be pointed outside of the view
+            if (r->right > r->left && r->bottom > r->top)
+            {
+                n++;
+            }
+        }
+    }
+    return n;
+}
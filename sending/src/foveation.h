@@ -0,0 +1,73 @@
+/*
+    The MIT License (MIT)
+
+    Copyright (c) 2020 OpenUVR
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+
+    Authors:
+    Alec Rohloff
+    Zackary Allen
+    Kung-Min Lin
+    Chengyi Nie
+    Hung-Wei Tseng
+*/
+
+#ifndef OUVR_FOVEATION_H
+#define OUVR_FOVEATION_H
+
+#include <pthread.h>
+
+#include "openuvr.h"
+
+// rectangle around one eye's fovea, in pixels, right and bottom excluded
+typedef struct ouvr_fovea_ring
+{
+    int left;
+    int top;
+    int right;
+    int bottom;
+    float qp_offset;
+} ouvr_fovea_ring;
+
+typedef struct ouvr_foveation
+{
+    // the setters are called from the application's threads while the encoder reads from its own
+    pthread_mutex_t lock;
+    int enabled;
+    struct openuvr_foveation_profile profile;
+    float center_x[2];
+    float center_y[2];
+} ouvr_foveation;
+
+struct ouvr_foveation *ouvr_foveation_alloc();
+void ouvr_foveation_free(struct ouvr_foveation *fov);
+void ouvr_foveation_set_profile(struct ouvr_foveation *fov, const struct openuvr_foveation_profile *profile);
+void ouvr_foveation_set_center(struct ouvr_foveation *fov, int eye, float x, float y);
+// copies the current profile and centres, returns whether the profile is enabled
+int ouvr_foveation_snapshot(struct ouvr_foveation *fov, struct openuvr_foveation_profile *profile, float center_x[2], float center_y[2]);
+
+// fills map with one quantizer offset per mb_size x mb_size macroblock, in raster order, for the width x height
+// area starting at column x_offset of a frame_width x height frame. Returns 0 without touching map when foveation is off
+int ouvr_foveation_qp_offsets(struct ouvr_foveation *fov, int frame_width, int x_offset, int width, int height, int mb_size, float *map);
+// approximates the profile with nested rectangles for encoders that only take regions of interest.
+// The innermost rings come first, returns how many were written or 0 when foveation is off
+int ouvr_foveation_rings(struct ouvr_foveation *fov, int width, int height, ouvr_fovea_ring *rings, int max_rings);
+
+#endif
@@ -0,0 +1,147 @@
+/*
+    The MIT License (MIT)
+
+    Copyright (c) 2020 OpenUVR
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+
+    Authors:
+    Alec Rohloff
+    Zackary Allen
+    Kung-Min Lin
+    Chengyi Nie
+    Hung-Wei Tseng
+*/
+/**
+ * Fast hashes of frame regions, used to find out which parts of a frame changed since it was last sent.
+ * The hashes are only ever compared with other hashes computed on the same machine, so the SSE4.2 and the
+ * portable versions don't need to agree with each other. The SSE4.2 one is only built for x86, and only used when the
+ * cpu has it.
+ */
+#include "frame_hash.h"
+
+#include <string.h>
+#if defined(__x86_64__) || defined(__i386__)
+#define HASH_HAS_SSE42 1
+#include <nmmintrin.h>
+#endif
+
+#define FNV_PRIME 0x100000001b3ULL
+
+#ifdef HASH_HAS_SSE42
+static uint32_t rotl32(uint32_t x, int n)
+{
+    return (x << n) | (x >> (32 - n));
+}
+
+// 32 bit x86 only has the crc32 of up to 4 bytes
+__attribute__((target("sse4.2"))) static inline uint64_t crc32_u64(uint64_t crc, uint64_t w)
+{
+#ifdef __x86_64__
+    return _mm_crc32_u64(crc, w);
+#else
+    uint32_t c = _mm_crc32_u32((uint32_t)crc, (uint32_t)w);
+    return _mm_crc32_u32(c, (uint32_t)(w >> 32));
+#endif
+}
+
+// crc32 has a latency of 3 cycles but a throughput of 1 per cycle, so 4 rows are hashed at once to keep it busy
+__attribute__((target("sse4.2"))) static uint32_t hash_block_sse42(const uint8_t *buf, int stride, int width_bytes, int height)
+{
+    uint64_t acc[4] = {0, 1, 2, 3};
+    int words = width_bytes / 8;
+    int y = 0;
+    for (; y + 4 <= height; y += 4)
+    {
+        const uint8_t *r0 = buf + y * stride;
+        const uint8_t *r1 = r0 + stride;
+        const uint8_t *r2 = r1 + stride;
+        const uint8_t *r3 = r2 + stride;
+        for (int i = 0; i < words; i++)
+        {
+            uint64_t w0, w1, w2, w3;
+            memcpy(&w0, r0 + i * 8, 8);
+            memcpy(&w1, r1 + i * 8, 8);
+            memcpy(&w2, r2 + i * 8, 8);
+            memcpy(&w3, r3 + i * 8, 8);
+            acc[0] = crc32_u64(acc[0], w0);
+            acc[1] = crc32_u64(acc[1], w1);
+            acc[2] = crc32_u64(acc[2], w2);
+            acc[3] = crc32_u64(acc[3], w3);
+        }
+    }
+    for (; y < height; y++)
+    {
+        const uint8_t *r = buf + y * stride;
+        for (int i = 0; i < words; i++)
+        {
+            uint64_t w;
+            memcpy(&w, r + i * 8, 8);
+            acc[0] = crc32_u64(acc[0], w);
+        }
+    }
+    // leftover bytes at the end of each row
+    for (y = 0; y < height && words * 8 < width_bytes; y++)
+    {
+        const uint8_t *r = buf + y * stride;
+        for (int i = words * 8; i < width_bytes; i++)
+        {
+            acc[1] = _mm_crc32_u8(acc[1], r[i]);
+        }
+    }
+    return (uint32_t)acc[0] ^ rotl32(acc[1], 8) ^ rotl32(acc[2], 16) ^ rotl32(acc[3], 24);
+}
+#endif
+
+static uint32_t hash_block_generic(const uint8_t *buf, int stride, int width_bytes, int height)
+{
+    uint64_t acc = 0xcbf29ce484222325ULL;
+    int words = width_bytes / 8;
+    for (int y = 0; y < height; y++)
+    {
+        const uint8_t *r = buf + y * stride;
+        for (int i = 0; i < words; i++)
+        {
+            uint64_t w;
+            memcpy(&w, r + i * 8, 8);
+            acc = (acc ^ w) * FNV_PRIME;
+        }
+        for (int i = words * 8; i < width_bytes; i++)
+        {
+            acc = (acc ^ r[i]) * FNV_PRIME;
+        }
+    }
+    return (uint32_t)(acc ^ (acc >> 32));
+}
+
+uint32_t ouvr_hash_block(const uint8_t *buf, int stride, int width_bytes, int height)
+{
+#ifdef HASH_HAS_SSE42
+    static int has_sse42 = -1;
+    if (has_sse42 < 0)
+    {
+        has_sse42 = __builtin_cpu_supports("sse4.2");
+    }
+    if (has_sse42)
+    {
+        return hash_block_sse42(buf, stride, width_bytes, height);
+    }
+#endif
+    return hash_block_generic(buf, stride, width_bytes, height);
+}
@@ -0,0 +1,137 @@
+/*
+    The MIT License (MIT)
+
+    Copyright (c) 2020 OpenUVR
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+
+    Authors:
+    Alec Rohloff
+    Zackary Allen
+    Kung-Min Lin
+    Chengyi Nie
+    Hung-Wei Tseng
+*/
+/**
+ * Frame pacing for the send loops. Every tick has an absolute deadline one interval after the previous one and the
+ * thread sleeps until it with clock_nanosleep(TIMER_ABSTIME), which wakes it once per frame and doesn't drift by the
+ * time spent encoding. When the game reports its presents, each tick is nudged by a fraction of its phase error
+ * against them, so that frames are picked up right after they are finished instead of up to an interval later.
+ */
+#include <stdlib.h>
+#include <errno.h>
+#include <time.h>
+
+#include "frame_pacer.h"
+
+#define NSEC_PER_SEC 1000000000LL
+// the share of the phase error corrected per tick, small enough that a single odd present doesn't jerk the schedule
+#define PHASE_GAIN 8
+
+const long ouvr_pacer_bucket_usec[OUVR_PACER_JITTER_BUCKETS] = {50, 100, 250, 500, 1000, 2000, 4000, 0};
+
+static int64_t now_ns(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * NSEC_PER_SEC + t.tv_nsec;
+}
+
+struct ouvr_frame_pacer *ouvr_pacer_alloc(void)
+{
+    ouvr_frame_pacer *p = calloc(1, sizeof(ouvr_frame_pacer));
+    if (p == NULL)
+    {
+        return NULL;
+    }
+    atomic_init(&p->present_ns, 0);
+    return p;
+}
+
+void ouvr_pacer_free(struct ouvr_frame_pacer *p)
+{
+    free(p);
+}
+
+void ouvr_pacer_report_present(struct ouvr_frame_pacer *p)
+{
+    atomic_store(&p->present_ns, now_ns());
+}
+
+void ouvr_pacer_set_phase(struct ouvr_frame_pacer *p, long offset_usec)
+{
+    p->phase_offset_ns = offset_usec * 1000;
+}
+
+// moves target towards offset after the last present, by a fraction of the distance to the nearest such point
+static int64_t lock_phase(struct ouvr_frame_pacer *p, int64_t target, long interval)
+{
+    int64_t present = atomic_load(&p->present_ns);
+    if (present == 0 || present == p->last_present_ns)
+    {
+        return target;
+    }
+    p->last_present_ns = present;
+    int64_t err = (target - present - p->phase_offset_ns) % interval;
+    if (err < 0)
+    {
+        err += interval;
+    }
+    if (err > interval / 2)
+    {
+        err -= interval;
+    }
+    return target - err / PHASE_GAIN;
+}
+
+static void record_jitter(struct ouvr_frame_pacer *p, int64_t late_ns)
+{
+    long late_usec = late_ns > 0 ? late_ns / 1000 : 0;
+    int b = 0;
+    while (b < OUVR_PACER_JITTER_BUCKETS - 1 && late_usec >= ouvr_pacer_bucket_usec[b])
+    {
+        b++;
+    }
+    p->jitter_hist[b]++;
+}
+
+int ouvr_pacer_wait(struct ouvr_frame_pacer *p, int fps)
+{
+    long interval = NSEC_PER_SEC / fps;
+    int64_t now = now_ns();
+    int skipped = 0;
+
+    int64_t target = p->last_tick_ns == 0 ? now : lock_phase(p, p->last_tick_ns + interval, interval);
+    if (now - target > interval / 2)
+    {
+        // too late for this tick to be worth sending, skip to the first one still ahead
+        skipped = (now - target + interval - 1) / interval;
+        target += skipped * interval;
+        p->skipped_ticks += skipped;
+    }
+
+    struct timespec deadline = {.tv_sec = target / NSEC_PER_SEC, .tv_nsec = target % NSEC_PER_SEC};
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR)
+    {
+    }
+    record_jitter(p, now_ns() - target);
+    p->last_tick_ns = target;
+    p->ticks++;
+    return skipped;
+}
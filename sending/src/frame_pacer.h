@@ -0,0 +1,69 @@
+/*
+    The MIT License (MIT)
+
+    Copyright (c) 2020 OpenUVR
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+
+    Authors:
+    Alec Rohloff
+    Zackary Allen
+    Kung-Min Lin
+    Chengyi Nie
+    Hung-Wei Tseng
+*/
+
+#ifndef OUVR_FRAME_PACER_H
+#define OUVR_FRAME_PACER_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+
+#define OUVR_PACER_JITTER_BUCKETS 8
+
+// wakes the send loop once per frame interval on absolute deadlines, so that sleeping late never pushes the
+// following frames back. The ticks can be phase-locked to the game's presents, and how late each wake-up was is
+// kept as a histogram
+typedef struct ouvr_frame_pacer
+{
+    // CLOCK_MONOTONIC nanoseconds of the last tick as scheduled, 0 before the first one
+    int64_t last_tick_ns;
+
+    // written by the game's thread, 0 until it reports a present
+    atomic_llong present_ns;
+    int64_t last_present_ns;
+    long phase_offset_ns;
+
+    uint64_t ticks;
+    uint64_t skipped_ticks;
+    uint64_t jitter_hist[OUVR_PACER_JITTER_BUCKETS];
+} ouvr_frame_pacer;
+
+struct ouvr_frame_pacer *ouvr_pacer_alloc(void);
+void ouvr_pacer_free(struct ouvr_frame_pacer *p);
+// sleeps until the next tick at fps. A tick missed by more than half an interval is dropped rather than sent late,
+// the schedule moves on to the next one that is still ahead. Returns how many ticks were dropped
+int ouvr_pacer_wait(struct ouvr_frame_pacer *p, int fps);
+// the game presented a frame now, ticks are pulled towards offset_usec after its presents from then on
+void ouvr_pacer_report_present(struct ouvr_frame_pacer *p);
+void ouvr_pacer_set_phase(struct ouvr_frame_pacer *p, long offset_usec);
+// upper bound of each jitter bucket in microseconds, the last bucket has no bound
+extern const long ouvr_pacer_bucket_usec[OUVR_PACER_JITTER_BUCKETS];
+
+#endif
@@ -1,22 +1,28 @@
 #include "gst_encode.h"
 #include "ouvr_packet.h"
+#include "thread_sched.h"
 #include <gst/gst.h>
 #include <pthread.h>
 
-#define WIDTH 1920
-#define HEIGHT 1080
-
-static const int BUFF_SIZE = WIDTH * HEIGHT * 4;
-
 typedef struct gst_encode_context
 {
     pthread_t main_thread;
+    // each pipeline's bus is watched from its own main context, so several encoders don't share the default one
+    GMainContext *main_context;
     GMainLoop * loop;
     GstElement *pipeline;
     GstElement * bin;
     GstElement * src;
     GstElement * sink;
+    GstElement * enc;
     GstBus *bus;
+    // set by gst_process_frame(), need_data() turns it into a force-key-unit event ahead of the next buffer
+    volatile int force_keyframe;
+    // 0 leaves keyframes to x264enc's key-int-max
+    int gop;
+    int frames_since_idr;
+    // buffers pushed into appsrc, which timestamps them
+    int num_frame;
 } gst_encode_context;
 
 
@@ -54,22 +60,28 @@ gboolean bus_call(GstBus *bus, GstMessage *msg, gpointer data) {
 static GstFlowReturn need_data (GstElement *elem, guint length, struct ouvr_ctx *ctx) {
     // usleep(30000);
     GstFlowReturn ret;
-    static int num_frame = 0;
-    num_frame++;
-
     const uint8_t *const src = ctx->pix_buf;
     gst_encode_context *e = ctx->enc_priv;
+    e->num_frame++;
 
+    const gsize buff_size = (gsize)ctx->enc_width * ctx->enc_height * 4;
     GstBuffer *buffer;
-    buffer = gst_buffer_new_allocate(NULL, BUFF_SIZE, NULL);
-    GST_BUFFER_TIMESTAMP(buffer) = (GstClockTime)((num_frame / 60.0) * 1e9);
+    buffer = gst_buffer_new_allocate(NULL, buff_size, NULL);
+    GST_BUFFER_TIMESTAMP(buffer) = (GstClockTime)(((double)e->num_frame / ctx->fps) * 1e9);
 
     GstMapInfo info;
     gst_buffer_map(buffer, &info, GST_MAP_WRITE | GST_MAP_READ);
     unsigned char *buf = info.data;
-    memmove(buf, src, BUFF_SIZE);
+    memmove(buf, src, buff_size);
     gst_buffer_unmap(buffer, &info);
 
+    if (e->force_keyframe) {
+        // what gst_video_event_new_downstream_force_key_unit() builds, x264enc answers it with an IDR
+        e->force_keyframe = 0;
+        gst_element_send_event (e->src, gst_event_new_custom (GST_EVENT_CUSTOM_DOWNSTREAM,
+            gst_structure_new ("GstForceKeyUnit", "all-headers", G_TYPE_BOOLEAN, TRUE, NULL)));
+    }
+
     g_signal_emit_by_name (e->src, "push-buffer", buffer, &ret);
 #ifdef UE4DEBUG
     printf("push-buffer emited\n");
@@ -144,15 +156,15 @@ static int gst_initialize(struct ouvr_ctx *ctx)
       g_strdup_printf
       (
       // "videotestsrc "
-      "appsrc name=src format=time block=true blocksize=8294400 max_bytes=8294400 caps=\"video/x-raw, width=1920, height=1080, format=RGBA, bpp=32, framerate=60/1, pixel-aspect-ratio=1/1\" "
+      "appsrc name=src format=time block=true blocksize=%d max_bytes=%d caps=\"video/x-raw, width=%d, height=%d, format=RGBA, bpp=32, framerate=%d/1, pixel-aspect-ratio=1/1\" "
       "! videoconvert "
-      "! video/x-raw, format=I420, height=1080, width=1920 "
-      "! x264enc bframes=0 key-int-max=0 "  //rc-lookahead=1 bitrate=1500 pass=quant tune=zerolatency
+      "! video/x-raw, format=I420, height=%d, width=%d "
+      "! x264enc name=enc bframes=0 key-int-max=%d "  //rc-lookahead=1 bitrate=1500 pass=quant tune=zerolatency
       "! video/x-h264 "// , stream-format=byte-stream, alignment=au 
       "! rtph264pay pt=96 mtu=1200 ssrc=42 config-interval=1 " //
       "! appsink name=sink "//sync=false
       // "! autovideosink"
-      );
+      , ctx->enc_width * ctx->enc_height * 4, ctx->enc_width * ctx->enc_height * 4, ctx->enc_width, ctx->enc_height, ctx->fps, ctx->enc_height, ctx->enc_width, ctx->enc_params.gop);
 
     e->bin = gst_parse_bin_from_description (video_desc, TRUE, &video_error);
     if (video_error) {
@@ -164,12 +176,21 @@ static int gst_initialize(struct ouvr_ctx *ctx)
     g_assert(e->src);
     e->sink = gst_bin_get_by_name (GST_BIN (e->bin), "sink");
     g_assert(e->sink);
+    e->enc = gst_bin_get_by_name (GST_BIN (e->bin), "enc");
+    g_assert(e->enc);
+    if (ctx->enc_params.bitrate_kbps > 0) {
+        g_object_set (e->enc, "bitrate", (guint)ctx->enc_params.bitrate_kbps, NULL);
+    }
+    e->gop = ctx->enc_params.gop;
 
     
     gst_bin_add_many(GST_BIN(e->pipeline), e->bin, NULL);
 
+    e->main_context = g_main_context_new ();
     e->bus = gst_pipeline_get_bus(GST_PIPELINE(e->pipeline));
+    g_main_context_push_thread_default (e->main_context);
     gst_bus_add_signal_watch (e->bus);
+    g_main_context_pop_thread_default (e->main_context);
     g_signal_connect (e->bus, "message", G_CALLBACK (bus_msg), GST_PIPELINE(e->pipeline));
 
     g_signal_connect (e->src, "need-data", G_CALLBACK (need_data), ctx);
@@ -184,8 +205,9 @@ static int gst_initialize(struct ouvr_ctx *ctx)
     //   printf("Pipeline is now in PLAYING state");
     // }
 
-    e->loop = g_main_loop_new (NULL, FALSE);
+    e->loop = g_main_loop_new (e->main_context, FALSE);
     pthread_create(&e->main_thread, NULL, g_main_loop_run, e->loop);
+    ouvr_threads_add(ctx->threads, e->main_thread, OPENUVR_THREAD_WORKERS, "gst");
     return 0;
 }
 
@@ -195,6 +217,24 @@ static int gst_process_frame(struct ouvr_ctx *ctx, struct ouvr_packet *pkt)
     GstFlowReturn ret;
     gst_encode_context *e = ctx->enc_priv;
 
+    if (ctx->flag_send_iframe > 0)
+    {
+        e->force_keyframe = 1;
+        ctx->flag_send_iframe = ~ctx->flag_send_iframe;
+    }
+    else if (ctx->flag_send_iframe < 0)
+    {
+        ctx->flag_send_iframe++;
+    }
+    if (e->gop > 0 && ++e->frames_since_idr >= e->gop)
+    {
+        e->force_keyframe = 1;
+    }
+    if (e->force_keyframe)
+    {
+        e->frames_since_idr = 0;
+    }
+
 #ifdef UE4DEBUG
     printf("before emit pull-sample\n");
 #endif
@@ -209,12 +249,17 @@ static int gst_process_frame(struct ouvr_ctx *ctx, struct ouvr_packet *pkt)
 #ifdef GST_LOG
       printf("send pkt %d \n", map.size);
 #endif
-      memmove(pkt->data, map.data, map.size);
-      pkt->size = map.size;
+      pkt->size = 0;
+      int ret = ouvr_packet_reserve(pkt, map.size);
+      if (ret == 0) {
+        memmove(pkt->data, map.data, map.size);
+        pkt->size = map.size;
+        pkt->flags = GST_BUFFER_FLAG_IS_SET(buffer, GST_BUFFER_FLAG_DELTA_UNIT) ? 0 : OUVR_PACKET_FLAG_KEYFRAME;
+      }
       gst_buffer_unmap(buffer, &map);
       gst_sample_unref(sample);
 
-      return 1;
+      return ret == 0 ? 1 : -1;
     } else {
         printf("return sample = nullptr\n");
         return -1;
@@ -223,13 +268,39 @@ static int gst_process_frame(struct ouvr_ctx *ctx, struct ouvr_packet *pkt)
     return 0;
 }
 
+// x264enc takes a new bitrate while playing, its speed-preset only applies from the READY state
+static int gst_reconfigure(struct ouvr_ctx *ctx, unsigned int changed)
+{
+    gst_encode_context *e = ctx->enc_priv;
+    if (changed & OUVR_PARAM_BITRATE)
+    {
+        g_object_set (e->enc, "bitrate", (guint)ctx->enc_params.bitrate_kbps, NULL);
+    }
+    if (changed & OUVR_PARAM_GOP)
+    {
+        e->gop = ctx->enc_params.gop;
+    }
+    return changed & (OUVR_PARAM_PRESET | OUVR_PARAM_ANALYSIS) ? -1 : 0;
+}
+
 static void gst_deinitialize(struct ouvr_ctx *ctx)
 {
     gst_encode_context *e = ctx->enc_priv;
 
+    // the encoder is set up again whenever the frame size changes, so the old pipeline has to actually stop.
+    // The bin belongs to the pipeline, src and sink were referenced by gst_bin_get_by_name()
+    gst_element_set_state (e->pipeline, GST_STATE_NULL);
+    g_main_loop_quit (e->loop);
+    ouvr_threads_remove(ctx->threads, e->main_thread);
+    pthread_join(e->main_thread, NULL);
+    g_main_loop_unref (e->loop);
+    gst_object_unref (e->src);
+    gst_object_unref (e->sink);
+    gst_object_unref (e->enc);
     gst_object_unref (e->pipeline);
-    gst_object_unref (e->bin);
+    gst_bus_remove_signal_watch (e->bus);
     gst_object_unref(e->bus);
+    g_main_context_unref (e->main_context);
 
     free(e);
     ctx->enc_priv = NULL;
@@ -239,4 +310,5 @@ struct ouvr_encoder gst_encode = {
     .init = gst_initialize,
     .process_frame = gst_process_frame,
     .deinit = gst_deinitialize,
+    .reconfigure = gst_reconfigure,
 };
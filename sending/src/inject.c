@@ -66,16 +66,16 @@ struct ieee80211_hdr
 #define WLAN_FC_SUBTYPE_DATA 0
 
 static const uint8_t u8aRadiotapHeader[] = {0x00, 0x00, 0x18, 0x00, 0x0f, 0x80, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, /*0x10 */ 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x08, 0x00};
-const uint8_t ipllc[8] = {0xaa, 0xaa, 0x03, 0x00, 0x00, 0x00, 0x88, 0xb5};
-static uint8_t *header_buf;
-static uint8_t *data;
-
-static long header_size;
+static const uint8_t ipllc[8] = {0xaa, 0xaa, 0x03, 0x00, 0x00, 0x00, 0x88, 0xb5};
 
 typedef struct inject_net_context
 {
     uint8_t eth_header[14];
     int fd;
+    // radiotap, 802.11 and llc headers followed by room for one datagram, data is where the datagram goes
+    uint8_t *header_buf;
+    uint8_t *data;
+    long header_size;
     struct sockaddr_ll inject_addr;
     struct msghdr msg;
     struct iovec iov[3];
@@ -130,14 +130,14 @@ static int inject_initialize(struct ouvr_ctx *ctx)
     /* Other useful bits */
     uint8_t fcchunk[2]; /* 802.11 header frame control */
 
-    header_size = sizeof(u8aRadiotapHeader) + sizeof(struct ieee80211_hdr) + sizeof(ipllc) + 4 + SEND_SIZE;
-    header_buf = (uint8_t *)malloc(header_size);
+    c->header_size = sizeof(u8aRadiotapHeader) + sizeof(struct ieee80211_hdr) + sizeof(ipllc) + sizeof(ouvr_packet_header) + SEND_SIZE;
+    c->header_buf = (uint8_t *)malloc(c->header_size);
 
     /* Put our pointers in the right place */
-    rt = (uint8_t *)header_buf;
+    rt = (uint8_t *)c->header_buf;
     hdr = (struct ieee80211_hdr *)(rt + sizeof(u8aRadiotapHeader));
     llc = (uint8_t *)(hdr + 1);
-    data = (uint8_t *)(llc + sizeof(llc));
+    c->data = (uint8_t *)(llc + sizeof(ipllc));
 
     /* The radiotap header has been explained already */
     memcpy(rt, u8aRadiotapHeader, sizeof(u8aRadiotapHeader));
@@ -156,8 +156,8 @@ static int inject_initialize(struct ouvr_ctx *ctx)
     hdr->seq_ctrl = 0;
     memcpy(llc, ipllc, 8 * sizeof(uint8_t));
 
-    c->iov[0].iov_base = header_buf;
-    c->iov[0].iov_len = header_size;
+    c->iov[0].iov_base = c->header_buf;
+    c->iov[0].iov_len = c->header_size;
 
     return 0;
 }
@@ -168,12 +168,14 @@ static int inject_send_packet(struct ouvr_ctx *ctx, struct ouvr_packet *pkt)
     register ssize_t r;
     uint8_t *start_pos = pkt->data;
     int offset = 0;
-    int data_size = SEND_SIZE;
-    memcpy(data, &pkt->size, 4);
-    while (offset < pkt->size)
+    int data_size = pkt->size < SEND_SIZE ? pkt->size : SEND_SIZE;
+    ouvr_packet_header hdr;
+    ouvr_packet_fill_header(pkt, &hdr);
+    memcpy(c->data, &hdr, sizeof(hdr));
+    do
     {
-        memcpy(data + 4, start_pos + offset, data_size);
-        r = send(c->fd, header_buf, header_size, 0);
+        memcpy(c->data + sizeof(hdr), start_pos + offset, data_size);
+        r = send(c->fd, c->header_buf, c->header_size - SEND_SIZE + data_size, 0);
         if (r < -1)
         {
             PRINT_ERR("sendmsg returned %ld\n", r);
@@ -187,7 +189,7 @@ static int inject_send_packet(struct ouvr_ctx *ctx, struct ouvr_packet *pkt)
                 data_size = pkt->size - offset;
             }
         }
-    }
+    } while (offset < pkt->size);
     return 0;
 }
 
@@ -195,6 +197,7 @@ static void inject_deinitialize(struct ouvr_ctx *ctx)
 {
     inject_net_context *c = ctx->net_priv;
     close(c->fd);
+    free(c->header_buf);
     free(ctx->net_priv);
 }
 
@@ -32,6 +32,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <unistd.h>
+#include <string.h>
 #include <linux/input.h>
 #include <linux/uinput.h>
 #include <fcntl.h>
@@ -43,7 +44,9 @@
 #include <pthread.h>
 #include <sys/time.h>
 
+#include "input_recv.h"
 #include "ouvr_packet.h"
+#include "thread_sched.h"
 
 #define SERVER_PORT 9000
 #define CLIENT_PORT 9001
@@ -58,12 +61,18 @@ struct SensorData
     float gyro_z;
 };
 
-int sensor_recv_fd, input_fd;
-
-static struct pollfd sensor_poll;
-static struct SensorData sensor_data;
-static struct msghdr sensor_msg = {0};
-static struct iovec sensor_iov;
+// one per context, set up by input_recv_start()
+typedef struct input_recv_context
+{
+    int sensor_recv_fd;
+    int input_fd;
+    struct pollfd sensor_poll;
+    struct SensorData sensor_data;
+    struct msghdr sensor_msg;
+    struct iovec sensor_iov;
+    pthread_t thread;
+    volatile int should_exit;
+} input_recv_context;
 
 static void input_control(int fd, int type, int code, int val)
 {
@@ -81,9 +90,9 @@ static void input_control(int fd, int type, int code, int val)
 	}
 }
 
-static void setup_file_descriptors()
+static void setup_file_descriptors(struct ouvr_ctx *ctx, input_recv_context *in)
 {
-    sensor_recv_fd = socket(AF_INET, SOCK_DGRAM, 0);
+    in->sensor_recv_fd = socket(AF_INET, SOCK_DGRAM, 0);
 
     struct sockaddr_in serv_addr = {0};
     serv_addr.sin_family = AF_INET;
@@ -92,28 +101,32 @@ static void setup_file_descriptors()
 
     struct sockaddr_in cli_addr = {0};
     cli_addr.sin_family = AF_INET;
-    inet_pton(AF_INET, CLIENT_IP, &cli_addr.sin_addr.s_addr);
+    inet_pton(AF_INET, ctx->client_ip, &cli_addr.sin_addr.s_addr);
     cli_addr.sin_port = htons(CLIENT_PORT);
 
-    bind(sensor_recv_fd, (struct sockaddr *)&serv_addr, sizeof(serv_addr));
-    connect(sensor_recv_fd, (struct sockaddr *)&cli_addr, sizeof(cli_addr));
+    // see udp.c
+    int reuse = 1;
+    setsockopt(in->sensor_recv_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    bind(in->sensor_recv_fd, (struct sockaddr *)&serv_addr, sizeof(serv_addr));
+    connect(in->sensor_recv_fd, (struct sockaddr *)&cli_addr, sizeof(cli_addr));
 
     //event, message, and poll setup
-    sensor_iov.iov_len = sizeof(struct SensorData);
-    sensor_iov.iov_base = &sensor_data;
-    sensor_msg.msg_iov = &sensor_iov;
-    sensor_msg.msg_iovlen = 1;
-    sensor_poll.fd = sensor_recv_fd;
-    sensor_poll.events = POLLIN;
+    in->sensor_iov.iov_len = sizeof(struct SensorData);
+    in->sensor_iov.iov_base = &in->sensor_data;
+    in->sensor_msg.msg_iov = &in->sensor_iov;
+    in->sensor_msg.msg_iovlen = 1;
+    in->sensor_poll.fd = in->sensor_recv_fd;
+    in->sensor_poll.events = POLLIN;
 }
 
-static void create_virtual_input()
+static void create_virtual_input(input_recv_context *in)
 {
-	input_fd = open("/dev/uinput", O_WRONLY | O_NONBLOCK);
+	int input_fd = open("/dev/uinput", O_WRONLY | O_NONBLOCK);
 	if (input_fd < 0)
 	{
 		PRINT_ERR("Failed at opening uinput\n");
 	}
+	in->input_fd = input_fd;
 	
 	// Create Virtual Mouse
 	// ioctl(input_fd, UI_SET_EVBIT, EV_KEY);
@@ -185,29 +198,65 @@ static void create_virtual_input()
 
 static void *receive_input_loop(void *arg)
 {
-    arg = (void *)arg;
+    input_recv_context *in = arg;
 
-    setup_file_descriptors();
-    create_virtual_input();
-    
     sleep(1);   
 
-    do
+    while (!in->should_exit)
     {
-        recvmsg(sensor_recv_fd, &sensor_msg, 0);
+        // wakes up now and then to see whether the context is being closed
+        if (poll(&in->sensor_poll, 1, 100) <= 0)
+        {
+            continue;
+        }
+        if (recvmsg(in->sensor_recv_fd, &in->sensor_msg, 0) != sizeof(struct SensorData))
+        {
+            continue;
+        }
 
 	// Hard-coded factors (because direct manipulation of game control mechanism would make the project less adaptable to other scenarios)
-	input_control(input_fd, EV_REL, REL_X, sensor_data.gyro_y*0.075);
-	input_control(input_fd, EV_REL, REL_Y, sensor_data.gyro_x*-0.075);
+	input_control(in->input_fd, EV_REL, REL_X, in->sensor_data.gyro_y*0.075);
+	input_control(in->input_fd, EV_REL, REL_Y, in->sensor_data.gyro_x*-0.075);
 
-	input_control(input_fd, EV_SYN, SYN_REPORT, 0);
-    } while (1);
+	input_control(in->input_fd, EV_SYN, SYN_REPORT, 0);
+    }
     return 0;
 }
 
-int receive_input_loop_start()
+int input_recv_start(struct ouvr_ctx *ctx)
 {
-    pthread_t recv_input_thread;
-    pthread_create(&recv_input_thread, NULL, receive_input_loop, NULL);
+    input_recv_context *in = calloc(1, sizeof(input_recv_context));
+    setup_file_descriptors(ctx, in);
+    create_virtual_input(in);
+    if (pthread_create(&in->thread, NULL, receive_input_loop, in) != 0)
+    {
+        PRINT_ERR("Couldn't start the input thread\n");
+        close(in->sensor_recv_fd);
+        close(in->input_fd);
+        free(in);
+        return -1;
+    }
+    ouvr_threads_add(ctx->threads, in->thread, OPENUVR_THREAD_INPUT, "input");
+    ctx->input_priv = in;
     return 0;
 }
+
+void input_recv_stop(struct ouvr_ctx *ctx)
+{
+    input_recv_context *in = ctx->input_priv;
+    if (in == NULL)
+    {
+        return;
+    }
+    in->should_exit = 1;
+    ouvr_threads_remove(ctx->threads, in->thread);
+    pthread_join(in->thread, NULL);
+    if (in->input_fd >= 0)
+    {
+        ioctl(in->input_fd, UI_DEV_DESTROY);
+        close(in->input_fd);
+    }
+    close(in->sensor_recv_fd);
+    free(in);
+    ctx->input_priv = NULL;
+}
@@ -32,6 +32,10 @@
 #ifndef INPUT_RECEIVE_H
 #define INPUT_RECEIVE_H
 
-int receive_input_loop_start();
+#include "ouvr_packet.h"
+
+// turns the sensor data sent by ctx's receiver into events of a virtual input device, on a thread of its own
+int input_recv_start(struct ouvr_ctx *ctx);
+void input_recv_stop(struct ouvr_ctx *ctx);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,52 @@
+/*
+    The MIT License (MIT)
+
+    Copyright (c) 2020 OpenUVR
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+
+    Authors:
+    Alec Rohloff
+    Zackary Allen
+    Kung-Min Lin
+    Chengyi Nie
+    Hung-Wei Tseng
+*/
+
+#ifndef OUVR_LZ4_CHUNK_H
+#define OUVR_LZ4_CHUNK_H
+
+#include <stdint.h>
+
+#define LZ4_CHUNK_MAGIC 0x4b4e4843
+
+// start of every packet produced by lz4_encode. It is followed by compressed_size bytes of LZ4 block data which
+// decompress to rows [first_row, first_row + num_rows) of an RGB24 frame_width x frame_height picture.
+// Every chunk is compressed independently of the others, so it can be decompressed on its own.
+typedef struct lz4_chunk_header
+{
+    uint32_t magic;
+    uint16_t frame_width;
+    uint16_t frame_height;
+    uint16_t first_row;
+    uint16_t num_rows;
+    uint32_t compressed_size;
+} lz4_chunk_header;
+
+#endif
@@ -0,0 +1,296 @@
+/*
+    The MIT License (MIT)
+
+    Copyright (c) 2020 OpenUVR
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+
+    Authors:
+    Alec Rohloff
+    Zackary Allen
+    Kung-Min Lin
+    Chengyi Nie
+    Hung-Wei Tseng
+*/
+/**
+ * Lossless mode: the frame is converted to RGB24 and compressed with LZ4 in NUM_CHUNKS horizontal bands.
+ * The bands are compressed in parallel by a small pool of worker threads and each one is sent as its own packet
+ * as soon as it is ready, so the receiver can decompress them in parallel too, and a lost packet only damages
+ * its own band of the picture.
+ * Every frame is complete on its own, so there is nothing to do when the receiver asks for an i-frame.
+ */
+#include <lz4.h>
+#include <pthread.h>
+#include <stdlib.h>
+
+#include "lz4_encode.h"
+#include "lz4_chunk.h"
+#include "ouvr_packet.h"
+#include "thread_sched.h"
+
+#define NUM_CHUNKS 8
+// the thread calling process_frame compresses chunks as well
+#define NUM_WORKERS 3
+
+typedef struct lz4_encode_context
+{
+    struct ouvr_ctx *ctx;
+    pthread_t workers[NUM_WORKERS];
+    int num_workers;
+
+    // protects everything used to hand out the chunks of a frame to the workers
+    pthread_mutex_t lock;
+    pthread_cond_t start_cond;
+    pthread_cond_t done_cond;
+    unsigned int generation;
+    int next_chunk;
+    int chunks_done;
+    int should_exit;
+
+    // chunks are sent from whichever thread compressed them, under ctx->send_lock
+    int chunks_sent;
+    int send_failed;
+
+    int rows_per_chunk;
+    uint8_t *rgb[NUM_CHUNKS];
+    uint8_t *out[NUM_CHUNKS];
+    int out_capacity;
+} lz4_encode_context;
+
+static void compress_chunk(lz4_encode_context *e, int chunk)
+{
+    struct ouvr_ctx *ctx = e->ctx;
+    int first_row = chunk * e->rows_per_chunk;
+    int num_rows = ctx->enc_height - first_row < e->rows_per_chunk ? ctx->enc_height - first_row : e->rows_per_chunk;
+    // very short frames leave the last chunks empty
+    if (num_rows < 0)
+    {
+        num_rows = 0;
+    }
+
+    // same RGBA -> RGB trick as rgb_encode, the buffer has a spare byte for the last store
+    const uint8_t *src = ctx->pix_buf + first_row * ctx->enc_width * 4;
+    uint8_t *dst = e->rgb[chunk];
+    for (int i = 0; i < num_rows * ctx->enc_width; i++)
+    {
+        *(int *)dst = *(int *)src;
+        src += 4;
+        dst += 3;
+    }
+
+    lz4_chunk_header *hdr = (lz4_chunk_header *)e->out[chunk];
+    int compressed_size = LZ4_compress_default((const char *)e->rgb[chunk], (char *)(hdr + 1), num_rows * ctx->enc_width * 3, e->out_capacity - sizeof(lz4_chunk_header));
+    hdr->magic = LZ4_CHUNK_MAGIC;
+    hdr->frame_width = ctx->enc_width;
+    hdr->frame_height = ctx->enc_height;
+    hdr->first_row = first_row;
+    hdr->num_rows = num_rows;
+    hdr->compressed_size = compressed_size;
+
+    struct ouvr_packet chunk_pkt = {
+        .data = e->out[chunk],
+        .size = sizeof(lz4_chunk_header) + compressed_size,
+        .frame_id = ctx->frame_id,
+        // every frame is compressed on its own
+        .flags = OUVR_PACKET_FLAG_KEYFRAME,
+        .info = ctx->frame_info,
+    };
+
+    pthread_mutex_lock(&ctx->send_lock);
+    if (compressed_size <= 0)
+    {
+        PRINT_ERR("LZ4_compress_default failed\n");
+        e->send_failed = 1;
+        // the receiver still has to see the end of the frame
+        chunk_pkt.size = 0;
+    }
+    // chunks finish in any order, the last one to be sent ends the frame
+    if (++e->chunks_sent == NUM_CHUNKS)
+    {
+        chunk_pkt.flags |= OUVR_PACKET_FLAG_END_OF_FRAME;
+    }
+    if (ctx->net->send_packet(ctx, &chunk_pkt) != 0)
+    {
+        e->send_failed = 1;
+    }
+    pthread_mutex_unlock(&ctx->send_lock);
+}
+
+static void compress_chunks(lz4_encode_context *e)
+{
+    while (1)
+    {
+        pthread_mutex_lock(&e->lock);
+        int chunk = e->next_chunk++;
+        pthread_mutex_unlock(&e->lock);
+        if (chunk >= NUM_CHUNKS)
+        {
+            return;
+        }
+
+        compress_chunk(e, chunk);
+
+        pthread_mutex_lock(&e->lock);
+        if (++e->chunks_done == NUM_CHUNKS)
+        {
+            pthread_cond_signal(&e->done_cond);
+        }
+        pthread_mutex_unlock(&e->lock);
+    }
+}
+
+static void *lz4_worker(void *arg)
+{
+    lz4_encode_context *e = arg;
+
+    pthread_mutex_lock(&e->lock);
+    unsigned int seen = e->generation;
+    while (1)
+    {
+        while (e->generation == seen && !e->should_exit)
+        {
+            pthread_cond_wait(&e->start_cond, &e->lock);
+        }
+        if (e->should_exit)
+        {
+            break;
+        }
+        seen = e->generation;
+        pthread_mutex_unlock(&e->lock);
+        compress_chunks(e);
+        pthread_mutex_lock(&e->lock);
+    }
+    pthread_mutex_unlock(&e->lock);
+    return NULL;
+}
+
+static int lz4_initialize(struct ouvr_ctx *ctx)
+{
+    if (ctx->enc_priv != NULL)
+    {
+        free(ctx->enc_priv);
+    }
+    lz4_encode_context *e = calloc(1, sizeof(lz4_encode_context));
+    ctx->enc_priv = e;
+    e->ctx = ctx;
+
+    e->rows_per_chunk = (ctx->enc_height + NUM_CHUNKS - 1) / NUM_CHUNKS;
+    e->out_capacity = sizeof(lz4_chunk_header) + LZ4_compressBound(e->rows_per_chunk * ctx->enc_width * 3);
+    for (int i = 0; i < NUM_CHUNKS; i++)
+    {
+        e->rgb[i] = malloc(e->rows_per_chunk * ctx->enc_width * 3 + 1);
+        e->out[i] = malloc(e->out_capacity);
+        if (e->rgb[i] == NULL || e->out[i] == NULL)
+        {
+            PRINT_ERR("could not allocate lz4 chunk buffers\n");
+            return -1;
+        }
+    }
+
+    pthread_mutex_init(&e->lock, NULL);
+    pthread_cond_init(&e->start_cond, NULL);
+    pthread_cond_init(&e->done_cond, NULL);
+    for (int i = 0; i < NUM_WORKERS; i++)
+    {
+        if (pthread_create(&e->workers[i], NULL, lz4_worker, e) != 0)
+        {
+            PRINT_ERR("could not start lz4 worker thread\n");
+            break;
+        }
+        char name[16];
+        snprintf(name, sizeof(name), "lz4-%d", i);
+        ouvr_threads_add(ctx->threads, e->workers[i], OPENUVR_THREAD_WORKERS, name);
+        e->num_workers++;
+    }
+
+    return 0;
+}
+
+static int lz4_process_frame(struct ouvr_ctx *ctx, struct ouvr_packet *pkt)
+{
+    lz4_encode_context *e = ctx->enc_priv;
+    (void)pkt;
+
+    if (ctx->flag_send_iframe > 0)
+    {
+        ctx->flag_send_iframe = ~ctx->flag_send_iframe;
+    }
+    else if (ctx->flag_send_iframe < 0)
+    {
+        ctx->flag_send_iframe++;
+    }
+
+    e->chunks_sent = 0;
+    e->send_failed = 0;
+
+    pthread_mutex_lock(&e->lock);
+    e->next_chunk = 0;
+    e->chunks_done = 0;
+    e->generation++;
+    pthread_cond_broadcast(&e->start_cond);
+    pthread_mutex_unlock(&e->lock);
+
+    compress_chunks(e);
+
+    pthread_mutex_lock(&e->lock);
+    while (e->chunks_done < NUM_CHUNKS)
+    {
+        pthread_cond_wait(&e->done_cond, &e->lock);
+    }
+    pthread_mutex_unlock(&e->lock);
+
+    if (e->send_failed)
+    {
+        return -1;
+    }
+    return OUVR_FRAME_STREAMED;
+}
+
+static void lz4_deinitialize(struct ouvr_ctx *ctx)
+{
+    lz4_encode_context *e = ctx->enc_priv;
+
+    pthread_mutex_lock(&e->lock);
+    e->should_exit = 1;
+    pthread_cond_broadcast(&e->start_cond);
+    pthread_mutex_unlock(&e->lock);
+    for (int i = 0; i < e->num_workers; i++)
+    {
+        ouvr_threads_remove(ctx->threads, e->workers[i]);
+        pthread_join(e->workers[i], NULL);
+    }
+
+    pthread_mutex_destroy(&e->lock);
+    pthread_cond_destroy(&e->start_cond);
+    pthread_cond_destroy(&e->done_cond);
+    for (int i = 0; i < NUM_CHUNKS; i++)
+    {
+        free(e->rgb[i]);
+        free(e->out[i]);
+    }
+    free(e);
+    ctx->enc_priv = NULL;
+}
+
+struct ouvr_encoder lz4_encode = {
+    .init = lz4_initialize,
+    .process_frame = lz4_process_frame,
+    .deinit = lz4_deinitialize,
+    .unpacks_foveated = 1,
+};
@@ -30,20 +30,51 @@
 */
 
 #include "openuvr.h"
+#include "synthetic_frames.h"
 
+#include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 #include <unistd.h>
 
 #include <sys/time.h>
 #include <time.h>
-#include <sys/shm.h>
 
 #include <dlfcn.h>
 
 void usage()
 {
-    printf("Usage: sudo ./openuvr [h264 | rgb] [tcp | udp | udp-compat | raw | webrtc]\n");
+    printf("Usage: sudo ./openuvr [h264 | x264 | stereo | rgb | rgb-tile | lz4] [tcp | udp | udp-compat | raw | webrtc | udp-fanout] [width height fps] [shm name | synthetic scenario]\n");
+    printf("With shm, frames are read from the region /dev/shm/<name> written through ouvr_shm_producer.h, which also sets their size\n");
+    printf("With synthetic, frames are generated from a scenario such as seed=1,motion=4,detail=5,objects=4,cut=600,static=300:60\n");
+    printf("OPENUVR_THREADS places the threads, e.g. OPENUVR_THREADS=\"encode=2,fifo,50;send=3,fifo,50;mlock\" (see openuvr_configure_threads())\n");
+}
+
+// renders the scenario's frames at fps and hands them to a triggered session, until the process is killed
+static void send_synthetic(void *handle, struct openuvr_context *context, struct ouvr_synthetic *gen, int fps)
+{
+    uint8_t *(*get_frame_buffer)(struct openuvr_context *) = dlsym(handle, "openuvr_get_frame_buffer");
+    int (*publish_frame)(struct openuvr_context *, const uint8_t *) = dlsym(handle, "openuvr_publish_frame");
+    long interval_ns = 1000000000L / fps;
+    struct timespec next;
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    for (uint64_t frame_number = 0;; frame_number++)
+    {
+        // the encoder still holding every buffer drops the frame, the content moves on regardless
+        uint8_t *buf = get_frame_buffer(context);
+        if (buf != NULL)
+        {
+            ouvr_synthetic_render(gen, frame_number, buf);
+            publish_frame(context, buf);
+        }
+        next.tv_nsec += interval_ns;
+        if (next.tv_nsec >= 1000000000L)
+        {
+            next.tv_sec++;
+            next.tv_nsec -= 1000000000L;
+        }
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+    }
 }
 
 int main(int argc, char **argv)
@@ -51,6 +82,9 @@ int main(int argc, char **argv)
     struct openuvr_context *context;
     enum OPENUVR_NETWORK_TYPE net_choice = -1;
     enum OPENUVR_ENCODER_TYPE enc_choice = -1;
+    int width = 1920, height = 1080, fps = 60;
+    const char *shm_name = NULL;
+    const char *scenario = NULL;
 
     // __uid_t uid = getuid();
     // if (uid != 0)
@@ -60,32 +94,57 @@ int main(int argc, char **argv)
     //     return 1;
     // }
 
-    if (argc != 3)
+    if (argc < 3)
+    {
+        usage();
+        return 1;
+    }
+    int arg = 3;
+    if (argc >= 6 && strcmp("shm", argv[3]) && strcmp("synthetic", argv[3]))
+    {
+        width = atoi(argv[3]);
+        height = atoi(argv[4]);
+        fps = atoi(argv[5]);
+        arg = 6;
+    }
+    if (argc == arg + 2 && !strcmp("shm", argv[arg]))
+    {
+        shm_name = argv[arg + 1];
+    }
+    else if (argc == arg + 2 && !strcmp("synthetic", argv[arg]))
+    {
+        scenario = argv[arg + 1];
+    }
+    else if (argc != arg)
     {
         usage();
         return 1;
     }
-
-    // key_t shm_key = 5678;
-    // int shm_id = shmget(shm_key, 1920 * 1080 * 4, 0666);
-    // uint8_t *src = shmat(shm_id, NULL, 0);
-    // if (src == NULL)
-    // {
-    //     printf("couldn't get shared memory\n");
-    //     return -1;
-    // }
-
-    uint8_t *src = malloc(1920 * 1080 * 4);
-    memset(src, 100, 1920 * 1080 * 4);
 
     if (!strcmp("h264", argv[1]))
     {
         enc_choice = OPENUVR_ENCODER_H264;
     }
+    else if (!strcmp("x264", argv[1]))
+    {
+        enc_choice = OPENUVR_ENCODER_H264_X264;
+    }
+    else if (!strcmp("stereo", argv[1]))
+    {
+        enc_choice = OPENUVR_ENCODER_H264_STEREO;
+    }
     else if (!strcmp("rgb", argv[1]))
     {
         enc_choice = OPENUVR_ENCODER_RGB;
     }
+    else if (!strcmp("rgb-tile", argv[1]))
+    {
+        enc_choice = OPENUVR_ENCODER_RGB_TILE;
+    }
+    else if (!strcmp("lz4", argv[1]))
+    {
+        enc_choice = OPENUVR_ENCODER_LZ4;
+    }
 
     if (!strcmp("tcp", argv[2]))
     {
@@ -107,6 +166,10 @@ int main(int argc, char **argv)
     {
         net_choice = OPENUVR_NETWORK_WEBRTC;
     }
+    else if (!strcmp("udp-fanout", argv[2]))
+    {
+        net_choice = OPENUVR_NETWORK_UDP_FANOUT;
+    }
 
     if (net_choice == -1 || enc_choice == -1)
     {
@@ -120,17 +183,54 @@ int main(int argc, char **argv)
         printf("null, error: %s\n", dlerror());
         exit(1);
     }
-    struct openuvr_context *(*openuvr_alloc)(enum OPENUVR_ENCODER_TYPE, enum OPENUVR_NETWORK_TYPE, uint8_t *, unsigned int);
-    openuvr_alloc = dlsym(handle, "openuvr_alloc_context");
+    struct openuvr_context *(*openuvr_alloc)(enum OPENUVR_ENCODER_TYPE, enum OPENUVR_NETWORK_TYPE, uint8_t *, unsigned int, int, int, int);
+    openuvr_alloc = dlsym(handle, "openuvr_alloc_context_with_geometry");
     int (*openuvr_init)(struct openuvr_context *);
     openuvr_init = dlsym(handle, "openuvr_init_thread_continuous");
 
-    context = openuvr_alloc(enc_choice, net_choice, src, 0);
+    if (shm_name != NULL)
+    {
+        struct openuvr_context *(*openuvr_alloc_shm)(enum OPENUVR_ENCODER_TYPE, enum OPENUVR_NETWORK_TYPE, const char *, int);
+        openuvr_alloc_shm = dlsym(handle, "openuvr_alloc_context_shm");
+        context = openuvr_alloc_shm(enc_choice, net_choice, shm_name, fps);
+    }
+    else
+    {
+        // without a producer or a scenario there is just a grey frame to send
+        uint8_t *src = malloc((size_t)width * height * 4);
+        memset(src, 100, (size_t)width * height * 4);
+        context = openuvr_alloc(enc_choice, net_choice, src, 0, width, height, fps);
+    }
     if (context == NULL)
     {
         usage();
         return 1;
     }
+    const char *threads = getenv("OPENUVR_THREADS");
+    if (threads != NULL)
+    {
+        int (*openuvr_configure_threads)(struct openuvr_context *, const char *) = dlsym(handle, "openuvr_configure_threads");
+        openuvr_configure_threads(context, threads);
+    }
+
+    if (scenario != NULL)
+    {
+        ouvr_synthetic_scenario sc;
+        if (ouvr_synthetic_parse(scenario, &sc) != 0)
+        {
+            usage();
+            return 1;
+        }
+        struct ouvr_synthetic *gen = ouvr_synthetic_alloc(&sc, width, height, 0);
+        int (*openuvr_init_triggered)(struct openuvr_context *) = dlsym(handle, "openuvr_init_thread_triggered");
+        if (gen == NULL || openuvr_init_triggered(context) != 0)
+        {
+            printf("couldn't start the synthetic frame source\n");
+            return 1;
+        }
+        // doesn't return
+        send_synthetic(handle, context, gen, fps);
+    }
 
     openuvr_init(context);
 
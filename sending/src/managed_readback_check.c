@@ -0,0 +1,246 @@
+/*
+    The MIT License (MIT)
+
+    Copyright (c) 2020 OpenUVR
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+
+    Authors:
+    Alec Rohloff
+    Zackary Allen
+    Kung-Min Lin
+    Chengyi Nie
+    Hung-Wei Tseng
+*/
+
+/**
+ * Checks the managed framebuffer readback without a window or a receiver. An EGL pbuffer stands in for the game's
+ * framebuffer, each frame is cleared to colours that give its number away, and a dummy network takes the place of
+ * the one the context was opened with to check that every frame the rgb encoder sends is one frame, whole, and
+ * newer than the last. It runs once with the plain glReadPixels() and once with the pbo readback and prints
+ * game_copy_usec for both.
+ *
+ * Build with "make LOOPBACK=1 managed_readback_check", the udp and feedback sockets are opened before the dummy
+ * network replaces them. Runs on Mesa's software renderer with
+ *   LIBGL_ALWAYS_SOFTWARE=1 EGL_PLATFORM=surfaceless LD_LIBRARY_PATH=. ./managed_readback_check < /dev/null
+ * where stdin answers the feedback port prompts with the defaults.
+ */
+#include "openuvr.h"
+#include "ouvr_packet.h"
+
+#include <EGL/egl.h>
+#include <GLES3/gl3.h>
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+
+// frames are numbered by one byte, so at most 256 of them
+#ifndef CHECK_WIDTH
+#define CHECK_WIDTH 1280
+#endif
+#ifndef CHECK_HEIGHT
+#define CHECK_HEIGHT 720
+#endif
+#define CHECK_FRAMES 240
+
+struct check_net_context
+{
+    int last_frame;
+    int frames_received;
+    int frames_bad;
+};
+
+// frame n has the bottom half in one colour and the top half in another, both different for every frame below 256
+static void frame_colours(int n, uint8_t bottom[3], uint8_t top[3])
+{
+    bottom[0] = n;
+    bottom[1] = 255 - n;
+    bottom[2] = 0x20;
+    top[0] = n;
+    top[1] = 0x60;
+    top[2] = 255 - n;
+}
+
+static void render_frame(int n)
+{
+    uint8_t bottom[3], top[3];
+    frame_colours(n, bottom, top);
+    glEnable(GL_SCISSOR_TEST);
+    glScissor(0, 0, CHECK_WIDTH, CHECK_HEIGHT / 2);
+    glClearColor(bottom[0] / 255.0f, bottom[1] / 255.0f, bottom[2] / 255.0f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT);
+    glScissor(0, CHECK_HEIGHT / 2, CHECK_WIDTH, CHECK_HEIGHT / 2);
+    glClearColor(top[0] / 255.0f, top[1] / 255.0f, top[2] / 255.0f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT);
+    glDisable(GL_SCISSOR_TEST);
+}
+
+static int check_net_initialize(struct ouvr_ctx *ctx)
+{
+    struct check_net_context *c = calloc(1, sizeof(struct check_net_context));
+    ctx->net_priv = c;
+    return c == NULL ? -1 : 0;
+}
+
+// the rgb encoder sends the frame as 3 bytes per pixel, bottom row first like glReadPixels() returns it
+static int check_net_send_packet(struct ouvr_ctx *ctx, struct ouvr_packet *pkt)
+{
+    struct check_net_context *c = ctx->net_priv;
+    if (pkt->size == 0)
+    {
+        return 0;
+    }
+    if (ctx->enc_width != CHECK_WIDTH || ctx->enc_height != CHECK_HEIGHT || pkt->size != CHECK_WIDTH * CHECK_HEIGHT * 3)
+    {
+        PRINT_ERR("frame of %d bytes at %dx%d, expected %dx%d\n", pkt->size, ctx->enc_width, ctx->enc_height, CHECK_WIDTH, CHECK_HEIGHT);
+        c->frames_bad++;
+        return 0;
+    }
+    int n = pkt->data[0];
+    uint8_t bottom[3], top[3];
+    frame_colours(n, bottom, top);
+    for (int y = 0; y < CHECK_HEIGHT; y++)
+    {
+        const uint8_t *want = y < CHECK_HEIGHT / 2 ? bottom : top;
+        const uint8_t *row = pkt->data + y * CHECK_WIDTH * 3;
+        for (int x = 0; x < CHECK_WIDTH; x++)
+        {
+            if (row[x * 3] != want[0] || row[x * 3 + 1] != want[1] || row[x * 3 + 2] != want[2])
+            {
+                PRINT_ERR("frame %d: pixel %d,%d is %d %d %d, expected %d %d %d\n", n, x, y, row[x * 3], row[x * 3 + 1], row[x * 3 + 2], want[0], want[1], want[2]);
+                c->frames_bad++;
+                return 0;
+            }
+        }
+    }
+    if (n <= c->last_frame)
+    {
+        PRINT_ERR("frame %d sent after frame %d\n", n, c->last_frame);
+        c->frames_bad++;
+    }
+    c->last_frame = n;
+    c->frames_received++;
+    return 0;
+}
+
+static void check_net_deinitialize(struct ouvr_ctx *ctx)
+{
+    free(ctx->net_priv);
+    ctx->net_priv = NULL;
+}
+
+static struct ouvr_network check_net = {
+    .init = check_net_initialize,
+    .send_packet = check_net_send_packet,
+    .deinit = check_net_deinitialize,
+};
+
+static int run_check(int async_readback)
+{
+    // frame 0 is what openuvr_managed_alloc() reads back to set itself up, it's never sent
+    render_frame(0);
+    struct openuvr_managed *m = openuvr_managed_alloc(OPENUVR_ENCODER_RGB, OPENUVR_NETWORK_UDP, 60, async_readback);
+    if (m == NULL)
+    {
+        return -1;
+    }
+    struct ouvr_ctx *ctx = openuvr_managed_get_context(m)->priv;
+    // the encoder thread waits for the first frame, nothing is sent before the network is swapped
+    pthread_mutex_lock(&ctx->send_lock);
+    if (ctx->net->deinit != NULL)
+    {
+        ctx->net->deinit(ctx);
+    }
+    ctx->net_priv = NULL;
+    ctx->net = &check_net;
+    int ret = ctx->net->init(ctx);
+    pthread_mutex_unlock(&ctx->send_lock);
+    if (ret != 0)
+    {
+        openuvr_managed_free(m);
+        return -1;
+    }
+    struct check_net_context *c = ctx->net_priv;
+
+    for (int n = 1; n < CHECK_FRAMES; n++)
+    {
+        render_frame(n);
+        openuvr_managed_copy(m);
+    }
+    struct openuvr_stats stats;
+    openuvr_managed_stats(m, &stats);
+    // the last frames are still being read back or encoded, copying the unchanged framebuffer again hands them on
+    for (int i = 0; i < 1000 && c->last_frame != CHECK_FRAMES - 1; i++)
+    {
+        openuvr_managed_copy(m);
+        usleep(1000);
+    }
+
+    int received = c->frames_received;
+    int bad = c->frames_bad;
+    int last = c->last_frame;
+    printf("%s readback: game_copy_usec %ld, %d of %d frames sent, %d bad, %llu readbacks skipped\n", async_readback ? "async" : "sync",
+           stats.game_copy_usec, received, CHECK_FRAMES - 1, bad, (unsigned long long)stats.readbacks_skipped);
+    openuvr_managed_free(m);
+    return bad == 0 && received > 0 && last == CHECK_FRAMES - 1 ? 0 : -1;
+}
+
+int main()
+{
+    EGLDisplay dpy = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    if (dpy == EGL_NO_DISPLAY || !eglInitialize(dpy, NULL, NULL))
+    {
+        fprintf(stderr, "Couldn't initialize EGL\n");
+        return 1;
+    }
+    const EGLint config_attribs[] = {EGL_SURFACE_TYPE, EGL_PBUFFER_BIT, EGL_RENDERABLE_TYPE, EGL_OPENGL_ES3_BIT,
+                                     EGL_RED_SIZE, 8, EGL_GREEN_SIZE, 8, EGL_BLUE_SIZE, 8, EGL_ALPHA_SIZE, 8, EGL_NONE};
+    EGLConfig config;
+    EGLint num_configs = 0;
+    if (!eglChooseConfig(dpy, config_attribs, &config, 1, &num_configs) || num_configs < 1)
+    {
+        fprintf(stderr, "No EGL config for an RGBA8 pbuffer\n");
+        return 1;
+    }
+    const EGLint pbuffer_attribs[] = {EGL_WIDTH, CHECK_WIDTH, EGL_HEIGHT, CHECK_HEIGHT, EGL_NONE};
+    EGLSurface surface = eglCreatePbufferSurface(dpy, config, pbuffer_attribs);
+    eglBindAPI(EGL_OPENGL_ES_API);
+    const EGLint context_attribs[] = {EGL_CONTEXT_CLIENT_VERSION, 3, EGL_NONE};
+    EGLContext context = eglCreateContext(dpy, config, EGL_NO_CONTEXT, context_attribs);
+    if (surface == EGL_NO_SURFACE || context == EGL_NO_CONTEXT || !eglMakeCurrent(dpy, surface, surface, context))
+    {
+        fprintf(stderr, "Couldn't make a %dx%d GLES 3 pbuffer current\n", CHECK_WIDTH, CHECK_HEIGHT);
+        return 1;
+    }
+    glViewport(0, 0, CHECK_WIDTH, CHECK_HEIGHT);
+
+    int ret = run_check(0);
+    if (run_check(1) != 0)
+    {
+        ret = -1;
+    }
+
+    eglMakeCurrent(dpy, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    eglDestroyContext(dpy, context);
+    eglDestroySurface(dpy, surface);
+    eglTerminate(dpy);
+    printf(ret == 0 ? "managed readback check passed\n" : "managed readback check FAILED\n");
+    return ret == 0 ? 0 : 1;
+}
@@ -39,32 +39,165 @@
 #include "raw_ring.h"
 #include "udp_compat.h"
 #include "webrtc.h"
+#include "fanout.h"
 #include "inject.h"
 #include "ffmpeg_encode.h"
 #include "gst_encode.h"
 #include "rgb_encode.h"
+#include "x264_encode.h"
+#include "rgb_tile_encode.h"
+#include "lz4_encode.h"
+#include "stereo_encode.h"
 #include "pulse_audio.h"
 #include "feedback_net.h"
 #include "input_recv.h"
 #include "ssim_dummy_net.h"
+#include "frame_hash.h"
+#include "foveation.h"
+#include "foveated_pack.h"
+#include "resolution_ladder.h"
+#include "encode_budget.h"
+#include "spsc_queue.h"
+#include "frame_pacer.h"
+#include "ouvr_shm_source.h"
+#include "thread_sched.h"
+#include "packet_pool.h"
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <pthread.h>
+#include <semaphore.h>
+#include <stdatomic.h>
 
 #include <sys/time.h>
 #include <time.h>
+#include <arpa/inet.h>
+
+// used by openuvr_alloc_context(), which predates the geometry being configurable
+#define DEFAULT_WIDTH 1920
+#define DEFAULT_HEIGHT 1080
+#define DEFAULT_FPS 60
+// the largest geometry the packet header can describe, and a sanity limit on the frame rate
+#define MAX_DIMENSION 65535
+#define MAX_FPS 1000
+
+// a frame is encoded at least this often even when nothing changes, in case the receiver lost the last one
+#define STATIC_FRAME_KEEPALIVE 60
+
+// one frame being captured, one waiting for the encoder and one being encoded
+#define PIPELINE_FRAMES 3
+// encoded packets waiting for the send stage, the encoder blocks when they are all in use
+#define PIPELINE_PACKETS 4
+// what the packets' buffers may take, enough for all of the pipeline's packets to hold an uncompressed 1080p frame
+#define PACKET_POOL_CAP (64 << 20)
+
+typedef struct ouvr_frame_slot
+{
+    uint8_t *data;
+    // set instead of copying into data by openuvr_publish_borrowed_frame(), until the frame is reclaimed
+    const uint8_t *borrowed;
+    int borrowed_tag;
+    // when the frame was captured or published, to measure how long it waits for the encoder
+    struct timespec captured;
+} ouvr_frame_slot;
+
+/**
+ * State of openuvr_init_thread_pipelined() and openuvr_init_thread_triggered(). The capture stage (a thread copying
+ * pix_buf on every tick, or the game publishing its frames) fills a free frame slot and hands it over latest-wins: a
+ * frame the encoder hasn't picked up yet is replaced, and counted as dropped.
+ * The encode stage takes the newest frame and passes the packet on to the send stage through send_queue.
+ * Encoded packets are never dropped, since the frames after them may depend on them, so the encoder waits for a
+ * free packet instead. Each queue has exactly one producer and one consumer thread.
+ */
+typedef struct ouvr_send_pipeline
+{
+    // no capture thread, openuvr_publish_frame() hands the frames over from the game's thread
+    int triggered;
+    pthread_t capture_thread;
+    pthread_t send_thread;
+    uint8_t *src;
+    struct ouvr_packet *own_packet;
+
+    ouvr_frame_slot frames[PIPELINE_FRAMES];
+    // the slot the capture stage writes into next, taken back straight away when the encoder missed it
+    ouvr_frame_slot *capture_slot;
+    // slots back from the encoder, the ones with a borrowed frame stay here until it is reclaimed
+    ouvr_frame_slot *returned[PIPELINE_FRAMES];
+    int num_returned;
+    _Atomic(ouvr_frame_slot *) latest_frame;
+    sem_t frame_ready;
+    // encode -> capture
+    ouvr_spsc_queue free_frames;
+
+    struct ouvr_packet *packets[PIPELINE_PACKETS];
+    // encode -> send
+    ouvr_spsc_queue send_queue;
+    sem_t packets_ready;
+    // send -> encode
+    ouvr_spsc_queue free_packets;
+    sem_t packets_free;
+    // set once the encoder streamed a frame itself, its packets are then sent from the encode stage to keep them in order
+    int encoder_streams;
+
+    atomic_ullong frames_dropped;
+    atomic_long capture_usec;
+    atomic_long send_usec;
+    atomic_long capture_to_encode_usec;
+} ouvr_send_pipeline;
 
 typedef struct pthread_context
 {
-    int should_exit;
+    volatile int should_exit;
     pthread_t send_thread;
+    // only for openuvr_init_thread_pipelined(), send_thread then runs the encode stage
+    ouvr_send_pipeline *pipeline;
 } ouvr_pthread_context;
 
 struct openuvr_context *openuvr_alloc_context(enum OPENUVR_ENCODER_TYPE enc_type, enum OPENUVR_NETWORK_TYPE net_type, uint8_t *pix_buf, unsigned int pbo)
 {
+    return openuvr_alloc_context_with_geometry(enc_type, net_type, pix_buf, pbo, DEFAULT_WIDTH, DEFAULT_HEIGHT, DEFAULT_FPS);
+}
+
+struct openuvr_context *openuvr_alloc_context_with_geometry(enum OPENUVR_ENCODER_TYPE enc_type, enum OPENUVR_NETWORK_TYPE net_type, uint8_t *pix_buf, unsigned int pbo, int width, int height, int fps)
+{
+    return openuvr_alloc_context_for_receiver(enc_type, net_type, pix_buf, pbo, width, height, fps, CLIENT_IP);
+}
+
+struct openuvr_context *openuvr_alloc_context_for_receiver(enum OPENUVR_ENCODER_TYPE enc_type, enum OPENUVR_NETWORK_TYPE net_type, uint8_t *pix_buf, unsigned int pbo, int width, int height, int fps, const char *client_ip)
+{
+    struct in_addr client_addr;
+    if (client_ip == NULL || inet_pton(AF_INET, client_ip, &client_addr) != 1)
+    {
+        PRINT_ERR("Invalid receiver address %s\n", client_ip == NULL ? "(null)" : client_ip);
+        return NULL;
+    }
+    // H.264 works on 4:2:0 pictures, so both dimensions have to be even
+    if (width <= 0 || height <= 0 || width > MAX_DIMENSION || height > MAX_DIMENSION || width % 2 || height % 2)
+    {
+        PRINT_ERR("Invalid frame size %dx%d, both dimensions must be even and at most %d\n", width, height, MAX_DIMENSION);
+        return NULL;
+    }
+    if (fps <= 0 || fps > MAX_FPS)
+    {
+        PRINT_ERR("Invalid frame rate %d\n", fps);
+        return NULL;
+    }
+
     struct openuvr_context *ret = calloc(1, sizeof(struct openuvr_context));
     struct ouvr_ctx *ctx = calloc(1, sizeof(struct ouvr_ctx));
+    ctx->width = width;
+    ctx->height = height;
+    ctx->requested_fps = fps;
+    ctx->fps = fps;
+    ctx->view_width = width;
+    ctx->view_height = height;
+    ctx->enc_width = width;
+    ctx->enc_height = height;
+    ctx->frame_info.width = width;
+    ctx->frame_info.height = height;
+    ctx->frame_info.fps = fps;
+    snprintf(ctx->client_ip, sizeof(ctx->client_ip), "%s", client_ip);
 
     switch (net_type)
     {
@@ -86,6 +219,9 @@ struct openuvr_context *openuvr_alloc_context(enum OPENUVR_ENCODER_TYPE enc_type
     case OPENUVR_NETWORK_WEBRTC:
         ctx->net = &webrtc_handler;
         break;
+    case OPENUVR_NETWORK_UDP_FANOUT:
+        ctx->net = &udp_fanout_handler;
+        break;
     case OPENUVR_NETWORK_UDP:
     default:
         ctx->net = &udp_handler;
@@ -100,12 +236,32 @@ struct openuvr_context *openuvr_alloc_context(enum OPENUVR_ENCODER_TYPE enc_type
 
     ctx->pix_buf = pix_buf;
     ctx->pbo_handle = pbo;
+    ctx->fov = ouvr_foveation_alloc();
+    ctx->ladder = ouvr_ladder_alloc(width, height);
+    ctx->budget = ouvr_budget_alloc();
+    ctx->pacer = ouvr_pacer_alloc();
+    ctx->threads = ouvr_threads_alloc();
+    ctx->pool = ouvr_packet_pool_alloc(PACKET_POOL_CAP);
+    pthread_mutex_init(&ctx->params_lock, NULL);
+    pthread_mutex_init(&ctx->send_lock, NULL);
 
     switch (enc_type)
     {
     case OPENUVR_ENCODER_RGB:
         ctx->enc = &rgb_encode;
         break;
+    case OPENUVR_ENCODER_H264_X264:
+        ctx->enc = &x264_encode;
+        break;
+    case OPENUVR_ENCODER_RGB_TILE:
+        ctx->enc = &rgb_tile_encode;
+        break;
+    case OPENUVR_ENCODER_LZ4:
+        ctx->enc = &lz4_encode;
+        break;
+    case OPENUVR_ENCODER_H264_STEREO:
+        ctx->enc = &stereo_encode;
+        break;
     case OPENUVR_ENCODER_H264:
     default:
         ctx->enc = &gst_encode;
@@ -123,22 +279,59 @@ struct openuvr_context *openuvr_alloc_context(enum OPENUVR_ENCODER_TYPE enc_type
     //     goto err;
     // }
 
-    ctx->packet = ouvr_packet_alloc();
+    ctx->packet = ouvr_packet_alloc(ctx->pool);
+    if (ctx->packet == NULL)
+    {
+        goto err;
+    }
 
-    receive_input_loop_start();
+    input_recv_start(ctx);
     ctx->flag_send_iframe = 0;
-    feedback_initialize(ctx);
+    if (ctx->net->receive_feedback == NULL)
+    {
+        feedback_initialize(ctx);
+    }
+
+    ctx->detect_static_frames = 1;
 
     ret->priv = ctx;
 
     return ret;
 
 err:
+    pthread_mutex_destroy(&ctx->params_lock);
+    pthread_mutex_destroy(&ctx->send_lock);
+    ouvr_foveation_free(ctx->fov);
+    ouvr_ladder_free(ctx->ladder);
+    ouvr_budget_free(ctx->budget);
+    ouvr_pacer_free(ctx->pacer);
+    ouvr_threads_free(ctx->threads);
+    ouvr_packet_pool_free(ctx->pool);
     free(ctx);
     free(ret);
     return NULL;
 }
 
+struct openuvr_context *openuvr_alloc_context_shm(enum OPENUVR_ENCODER_TYPE enc_type, enum OPENUVR_NETWORK_TYPE net_type, const char *shm_name, int fps)
+{
+    struct ouvr_shm_source *shm = ouvr_shm_source_open(shm_name);
+    if (shm == NULL)
+    {
+        return NULL;
+    }
+    // pix_buf is pointed at each frame as it is acquired, the first buffer stands in until then
+    uint8_t *first = (uint8_t *)shm->hdr + shm->hdr->buffer_offset[0];
+    struct openuvr_context *ret = openuvr_alloc_context_with_geometry(enc_type, net_type, first, 0, shm->width, shm->height, fps);
+    if (ret == NULL)
+    {
+        ouvr_shm_source_close(shm);
+        return NULL;
+    }
+    struct ouvr_ctx *ctx = ret->priv;
+    ctx->shm = shm;
+    return ret;
+}
+
 #ifdef TIME_ENCODING
 float avg_enc_time = 0;
 #endif
@@ -146,14 +339,178 @@ float avg_enc_time = 0;
 float avg_send_time = 0;
 #endif
 
-int openuvr_send_frame(struct openuvr_context *context)
+// returns 1 when the frame in pix_buf is the same as the last one and does not need to be encoded
+static int frame_is_repeat(struct ouvr_ctx *ctx)
+{
+    // encoders with a cuda_copy take the frame from the pbo, pix_buf is not kept up to date for them
+    if (!ctx->detect_static_frames || ctx->pix_buf == NULL || ctx->enc->cuda_copy != NULL)
+    {
+        return 0;
+    }
+
+    uint32_t hash = ouvr_hash_block(ctx->pix_buf, ctx->width * 4, ctx->width * 4, ctx->height);
+    int changed = hash != ctx->last_frame_hash;
+    ctx->last_frame_hash = hash;
+    if (changed || ctx->flag_send_iframe > 0 || ctx->frames_since_keepalive >= STATIC_FRAME_KEEPALIVE)
+    {
+        ctx->frames_since_keepalive = 0;
+        return 0;
+    }
+    ctx->frames_since_keepalive++;
+    return 1;
+}
+
+// sets the encoder up again for frames of width x height, the network and everything else stay as they are
+static int resize_encoder(struct ouvr_ctx *ctx, int width, int height)
+{
+    ctx->enc->deinit(ctx);
+    ctx->enc_priv = NULL;
+    ctx->view_width = width;
+    ctx->view_height = height;
+    // packed frames are encoded as they are, at half the width
+    ctx->enc_packed = ctx->foveated_packing;
+    ctx->enc_width = ctx->enc_packed ? OUVR_FOVEATED_PACKED_WIDTH(width) : width;
+    ctx->enc_height = height;
+    ctx->resolution_changes++;
+    if (ctx->enc->init(ctx) != 0)
+    {
+        PRINT_ERR("Couldn't set the encoder up for %dx%d frames\n", width, height);
+        return -1;
+    }
+    return 0;
+}
+
+// hands the encoder whatever the openuvr_set_*() controls changed since the last frame
+static void apply_encoder_params(struct ouvr_ctx *ctx)
+{
+    unsigned int changed;
+    int keyframe;
+
+    pthread_mutex_lock(&ctx->params_lock);
+    changed = ctx->pending_params;
+    keyframe = ctx->keyframe_requested;
+    ctx->pending_params = 0;
+    ctx->keyframe_requested = 0;
+    if (changed)
+    {
+        ctx->enc_params = ctx->requested_params;
+    }
+    pthread_mutex_unlock(&ctx->params_lock);
+
+    // same path as a keyframe asked for by the receiver after a loss
+    if (keyframe && ctx->flag_send_iframe <= 0)
+    {
+        ctx->flag_send_iframe = 1;
+    }
+    if (!changed)
+    {
+        return;
+    }
+    // a failure isn't fatal, the encoder goes on with its old settings
+    if (ctx->enc->reconfigure == NULL || ctx->enc->reconfigure(ctx, changed) != 0)
+    {
+        PRINT_ERR("This encoder couldn't apply all of the new settings\n");
+    }
+}
+
+// moves along the resolution ladder according to how long the last frame took
+static int update_resolution(struct ouvr_ctx *ctx)
 {
+    int width, height;
+    // encoders with a cuda_copy read from the pbo, which can't be scaled on the way
+    if (!ctx->dynamic_resolution || ctx->pix_buf == NULL || ctx->enc->cuda_copy != NULL)
+    {
+        return ouvr_ladder_reset(ctx->ladder, &width, &height) ? resize_encoder(ctx, width, height) : 0;
+    }
+    long budget_usec = ctx->budget->deadline_usec > 0 ? ctx->budget->deadline_usec : 1000000 / ctx->fps;
+    // a faster preset costs less quality than a smaller frame, so encode time only counts here once the budget
+    // controller has run out of faster settings
+    long encode_usec = ouvr_budget_can_speed_up(ctx->budget) ? 0 : ctx->last_encode_usec;
+    if (!ouvr_ladder_update(ctx->ladder, encode_usec, budget_usec, ctx->overloaded, &width, &height))
+    {
+        return 0;
+    }
+    printf("OpenUVR: encoding at %d%% (%dx%d), the last frame took %ld us out of %ld%s\n", ouvr_ladder_percent(ctx->ladder), width, height,
+           ctx->last_encode_usec, budget_usec, ctx->overloaded ? ", overload reported" : "");
+    return resize_encoder(ctx, width, height);
+}
+
+// steps the encoder's speed settings when the last frame went over the deadline, or had room to spare for a while.
+// The change goes through the same path as openuvr_set_encoder_preset() and applies from the next frame
+static void update_encode_budget(struct ouvr_ctx *ctx)
+{
+    pthread_mutex_lock(&ctx->params_lock);
+    if (ouvr_budget_update(ctx->budget, ctx->last_encode_usec, &ctx->requested_params))
+    {
+        ctx->pending_params |= OUVR_PARAM_PRESET | OUVR_PARAM_ANALYSIS;
+        printf("OpenUVR: x264 preset %s, subme %d, refs %d, the last frame took %ld us out of %ld\n", ctx->requested_params.preset,
+               ctx->requested_params.subme, ctx->requested_params.refs, ctx->last_encode_usec, ctx->budget->deadline_usec);
+    }
+    pthread_mutex_unlock(&ctx->params_lock);
+}
+
+// what the frame about to be encoded is sent as, every packet of it carries a copy
+static void take_frame_info(struct ouvr_ctx *ctx)
+{
+    ctx->frame_info.width = ctx->view_width;
+    ctx->frame_info.height = ctx->view_height;
+    ctx->frame_info.fps = ctx->fps;
+    ctx->frame_info.foveated = ctx->foveated_packing;
+    if (ctx->foveated_packing)
+    {
+        ctx->frame_info.fovea = ctx->fovea;
+    }
+    else
+    {
+        memset(&ctx->frame_info.fovea, 0, sizeof(ctx->frame_info.fovea));
+    }
+    ctx->packet->info = ctx->frame_info;
+}
+
+static void pack_frame(struct ouvr_ctx *ctx)
+{
+    struct openuvr_foveation_profile p;
+    float center_x[2], center_y[2];
+    ouvr_foveation_snapshot(ctx->fov, &p, center_x, center_y);
+    ouvr_foveated_pack(ctx->pix_buf, ctx->packed_buf, ctx->view_width, ctx->view_height, p.stereo ? 2 : 1, center_x, center_y, &ctx->fovea);
+}
+
+// sends one packet, under the same lock as the encoders that stream their slices from their own threads
+static int send_packet(struct ouvr_ctx *ctx, struct ouvr_packet *pkt)
+{
+#ifdef TIME_NETWORK
+    struct timeval start, end;
+    gettimeofday(&start, NULL);
+#endif
 #ifdef UE4DEBUG
-    // PRINT_ERR("openuvr_send_frame entered\n");
+    // PRINT_ERR("before send_packet\n");
+#endif
+    pthread_mutex_lock(&ctx->send_lock);
+    int ret = ctx->net->send_packet(ctx, pkt);
+    pthread_mutex_unlock(&ctx->send_lock);
+    if (ret < 0)
+    {
+#ifdef UE4DEBUG
+    PRINT_ERR("send_packet return %d\n",ret);
 #endif
+        return -1;
+    }
+    // PRINT_ERR("print network stack time\n");
+#ifdef TIME_NETWORK
+    gettimeofday(&end, NULL);
+    int elapsed = end.tv_usec - start.tv_usec + (end.tv_sec - start.tv_sec) * 1000000 ;
+    avg_send_time = 0.998 * avg_send_time + 0.002 * elapsed;
+    fprintf(stderr, "send avg: %f, actual: %d\n", avg_send_time, elapsed);
+#endif
+    return 0;
+}
+
+// encodes the frame in pix_buf into ctx->packet. Returns 1 when the packet has to be sent, 0 when the encoder already
+// streamed the frame itself and -1 on error
+static int encode_frame(struct ouvr_ctx *ctx)
+{
     int ret;
-    struct ouvr_ctx *ctx = context->priv;
-#if defined(TIME_ENCODING) || defined(TIME_NETWORK)
+#ifdef TIME_ENCODING
     struct timeval start, end;
 #endif
 
@@ -165,18 +522,72 @@ int openuvr_send_frame(struct openuvr_context *context)
     // }
     // else if (ret > 0)
     // {
-    //     ret = ctx->net->send_packet(ctx, ctx->packet);
+    //     ret = send_packet(ctx, ctx->packet);
     //     if (ret < 0)
     //     {
     //         return -1;
     //     }
     // }
 
-    feedback_receive(ctx);
+    if (ctx->net->receive_feedback != NULL)
+    {
+        ctx->net->receive_feedback(ctx);
+    }
+    else
+    {
+        feedback_receive(ctx);
+    }
+    apply_encoder_params(ctx);
 
 #ifdef TIME_ENCODING
     gettimeofday(&start, NULL);
 #endif
+    ctx->frame_id++;
+    ctx->foveated_packing = ctx->request_foveated_packing && ctx->pix_buf != NULL && ctx->enc->unpacks_foveated;
+    if (ctx->foveated_packing && ctx->packed_buf == NULL)
+    {
+        ctx->packed_buf = calloc(1, (size_t)OUVR_FOVEATED_PACKED_WIDTH(ctx->width) * ctx->height * 4);
+        ctx->foveated_packing = ctx->packed_buf != NULL;
+    }
+    if (frame_is_repeat(ctx))
+    {
+        ctx->frames_suppressed++;
+        ctx->packet->size = 0;
+        ctx->packet->flags = OUVR_PACKET_FLAG_END_OF_FRAME | OUVR_PACKET_FLAG_REPEAT;
+        ctx->packet->frame_id = ctx->frame_id;
+        // the frame repeated is the last one encoded, whatever has changed since
+        ctx->packet->info = ctx->frame_info;
+        return 1;
+    }
+    ctx->frames_encoded++;
+    if (update_resolution(ctx) != 0)
+    {
+        return -1;
+    }
+    // the encoder is opened at the size of what it is given, which halves when packing starts
+    if (ctx->foveated_packing != ctx->enc_packed && resize_encoder(ctx, ctx->view_width, ctx->view_height) != 0)
+    {
+        return -1;
+    }
+    struct timespec enc_start, enc_end;
+    clock_gettime(CLOCK_MONOTONIC, &enc_start);
+    uint8_t *pix_buf = ctx->pix_buf;
+    if (ctx->view_width != ctx->width || ctx->view_height != ctx->height)
+    {
+        const uint8_t *scaled = ouvr_ladder_scale(ctx->ladder, pix_buf);
+        if (scaled == NULL)
+        {
+            PRINT_ERR("Couldn't scale the frame to %dx%d\n", ctx->view_width, ctx->view_height);
+            return -1;
+        }
+        ctx->pix_buf = (uint8_t *)scaled;
+    }
+    if (ctx->foveated_packing)
+    {
+        pack_frame(ctx);
+        ctx->pix_buf = ctx->packed_buf;
+    }
+    take_frame_info(ctx);
     do
     {
 #ifdef UE4DEBUG
@@ -184,6 +595,10 @@ int openuvr_send_frame(struct openuvr_context *context)
 #endif
         ret = ctx->enc->process_frame(ctx, ctx->packet);
     } while (ret == 0);
+    ctx->pix_buf = pix_buf;
+    clock_gettime(CLOCK_MONOTONIC, &enc_end);
+    ctx->last_encode_usec = (enc_end.tv_sec - enc_start.tv_sec) * 1000000 + (enc_end.tv_nsec - enc_start.tv_nsec) / 1000;
+    update_encode_budget(ctx);
 #ifdef UE4DEBUG
     // PRINT_ERR("process_frame break while\n");
 #endif
@@ -196,6 +611,7 @@ int openuvr_send_frame(struct openuvr_context *context)
     }
     // PRINT_ERR("print encoding time\n");
 #ifdef TIME_ENCODING
+    // for encoders that stream slices this also includes the time spent sending them
     gettimeofday(&end, NULL);
     int elapsed = end.tv_usec - start.tv_usec + (end.tv_sec > start.tv_sec ? 1000000 : 0);
     avg_enc_time = 0.998 * avg_enc_time + 0.002 * elapsed;
@@ -203,30 +619,29 @@ int openuvr_send_frame(struct openuvr_context *context)
     // fprintf(stderr, "enc avg: %f, actual: %d\n", avg_enc_time, elapsed);
     fflush(stdout);
 #endif
+    if (ret == OUVR_FRAME_STREAMED)
+    {
+        return 0;
+    }
 
-#ifdef TIME_NETWORK
-    gettimeofday(&start, NULL);
-#endif
+    // the encoder only sets the keyframe flag
+    ctx->packet->flags = (ctx->packet->flags & OUVR_PACKET_FLAG_KEYFRAME) | OUVR_PACKET_FLAG_END_OF_FRAME;
+    ctx->packet->frame_id = ctx->frame_id;
+    return 1;
+}
+
+int openuvr_send_frame(struct openuvr_context *context)
+{
 #ifdef UE4DEBUG
-    // PRINT_ERR("before send_packet\n");
+    // PRINT_ERR("openuvr_send_frame entered\n");
 #endif
-    ret = ctx->net->send_packet(ctx, ctx->packet);
-    if (ret < 0)
+    struct ouvr_ctx *ctx = context->priv;
+    int ret = encode_frame(ctx);
+    if (ret <= 0)
     {
-#ifdef UE4DEBUG
-    PRINT_ERR("send_packet return %d\n",ret);
-#endif
-        return -1;
+        return ret;
     }
-    // PRINT_ERR("print network stack time\n");
-#ifdef TIME_NETWORK
-    gettimeofday(&end, NULL);
-    elapsed = end.tv_usec - start.tv_usec + (end.tv_sec - start.tv_sec) * 1000000 ;
-    avg_send_time = 0.998 * avg_send_time + 0.002 * elapsed;
-    fprintf(stderr, "send avg: %f, actual: %d\n", avg_send_time, elapsed);
-#endif
-
-    return 0;
+    return send_packet(ctx, ctx->packet);
 }
 
 int openuvr_cuda_copy(struct openuvr_context *context)
@@ -237,7 +652,19 @@ int openuvr_cuda_copy(struct openuvr_context *context)
     return 0;
 }
 
-long prev_quot = 0;
+static long usec_since(const struct timespec *start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1000000 + (now.tv_nsec - start->tv_nsec) / 1000;
+}
+
+// returns at the start of the next frame interval. fps is re-read every frame, the receiver may lower the rate after
+// the session started
+static void wait_frame_interval(struct ouvr_ctx *ctx)
+{
+    ouvr_pacer_wait(ctx->pacer, ctx->fps);
+}
 
 void *send_loop_continuous(void *arg)
 {
@@ -245,21 +672,9 @@ void *send_loop_continuous(void *arg)
     struct ouvr_ctx *ctx = context->priv;
     ouvr_pthread_context *pth_ctx = ctx->main_priv;
 
-    struct timespec cur_time;
-    struct timespec wait_time = {.tv_sec = 0, .tv_nsec = 500000};
-
-    long div = 1e9 / 60;
-    long quot = 0;
-
     while (!pth_ctx->should_exit)
     {
-        do
-        {
-            clock_gettime(CLOCK_MONOTONIC, &cur_time);
-            quot = cur_time.tv_nsec / div;
-            nanosleep(&wait_time, NULL);
-        } while (quot == prev_quot);
-        prev_quot = quot;
+        wait_frame_interval(ctx);
 
 #ifdef UE4DEBUG
         // PRINT_ERR("before openuvr_send_frame(context)\n");
@@ -268,8 +683,50 @@ void *send_loop_continuous(void *arg)
         {
             pth_ctx->should_exit = 1;
         }
+    }
 
-        nanosleep(&wait_time, NULL);
+    return NULL;
+}
+
+// sends the producer's frames as they come instead of on a clock, at most fps of them a second. Each one is encoded
+// straight out of the shared buffer
+static void *send_loop_shm(void *arg)
+{
+    struct openuvr_context *context = arg;
+    struct ouvr_ctx *ctx = context->priv;
+    ouvr_pthread_context *pth_ctx = ctx->main_priv;
+    struct timespec next = {0, 0};
+
+    while (!pth_ctx->should_exit)
+    {
+        // a producer faster than fps has its frames in between skipped, the newest one is sent
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+        // wakes up now and then to see should_exit while the producer is idle
+        if (!ouvr_shm_source_wait(ctx->shm, 100))
+        {
+            continue;
+        }
+        const uint8_t *frame = ouvr_shm_source_acquire(ctx->shm);
+        if (frame == NULL)
+        {
+            continue;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &next);
+        long interval_ns = 1000000000L / ctx->fps;
+        next.tv_nsec += interval_ns;
+        if (next.tv_nsec >= 1000000000L)
+        {
+            next.tv_sec++;
+            next.tv_nsec -= 1000000000L;
+        }
+        ctx->pix_buf = (uint8_t *)frame;
+        int ret = openuvr_send_frame(context);
+        // the frame was already sent, a torn one is made up for by the next
+        ouvr_shm_source_release(ctx->shm);
+        if (ret != 0)
+        {
+            pth_ctx->should_exit = 1;
+        }
     }
 
     return NULL;
@@ -277,15 +734,404 @@ void *send_loop_continuous(void *arg)
 
 int openuvr_init_thread_continuous(struct openuvr_context *context)
 {
-    ouvr_pthread_context *pth_ctx = malloc(sizeof(ouvr_pthread_context));
-    pth_ctx->should_exit = 0;
-    pthread_create(&pth_ctx->send_thread, NULL, send_loop_continuous, context);
-
+    ouvr_pthread_context *pth_ctx = calloc(1, sizeof(ouvr_pthread_context));
     struct ouvr_ctx *ctx = context->priv;
+    // the thread reads it straight away
+    ctx->main_priv = pth_ctx;
+    pthread_create(&pth_ctx->send_thread, NULL, ctx->shm != NULL ? send_loop_shm : send_loop_continuous, context);
+    ouvr_threads_add(ctx->threads, pth_ctx->send_thread, OPENUVR_THREAD_ENCODE, "encode");
+    return 0;
+}
+
+// the slot to capture the next frame into, NULL if there is none free
+static void collect_returned_slots(ouvr_send_pipeline *p)
+{
+    ouvr_frame_slot *slot;
+    while (p->num_returned < PIPELINE_FRAMES && (slot = ouvr_spsc_pop(&p->free_frames)) != NULL)
+    {
+        p->returned[p->num_returned++] = slot;
+    }
+}
+
+static ouvr_frame_slot *get_capture_slot(ouvr_send_pipeline *p)
+{
+    if (p->capture_slot != NULL)
+    {
+        return p->capture_slot;
+    }
+    collect_returned_slots(p);
+    for (int i = 0; i < p->num_returned; i++)
+    {
+        if (p->returned[i]->borrowed == NULL)
+        {
+            p->capture_slot = p->returned[i];
+            p->returned[i] = p->returned[--p->num_returned];
+            break;
+        }
+    }
+    return p->capture_slot;
+}
+
+// hands the captured frame to the encoder, replacing the one still waiting there if it didn't get to it
+static void hand_over_frame(ouvr_send_pipeline *p)
+{
+    ouvr_frame_slot *missed = atomic_exchange(&p->latest_frame, p->capture_slot);
+    p->capture_slot = NULL;
+    if (missed == NULL)
+    {
+        sem_post(&p->frame_ready);
+        return;
+    }
+    atomic_fetch_add(&p->frames_dropped, 1);
+    if (missed->borrowed != NULL)
+    {
+        p->returned[p->num_returned++] = missed;
+    }
+    else
+    {
+        p->capture_slot = missed;
+    }
+}
+
+// fills the capture slot from frame, unless the frame was written into the slot in the first place
+static int capture_frame(struct ouvr_ctx *ctx, ouvr_send_pipeline *p, const uint8_t *frame)
+{
+    ouvr_frame_slot *slot = get_capture_slot(p);
+    if (slot == NULL)
+    {
+        // can't happen with PIPELINE_FRAMES slots, but a frame missed is better than one torn
+        atomic_fetch_add(&p->frames_dropped, 1);
+        return -1;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &slot->captured);
+    if (frame != slot->data)
+    {
+        memcpy(slot->data, frame, (size_t)ctx->width * ctx->height * 4);
+    }
+    atomic_store(&p->capture_usec, usec_since(&slot->captured));
+    hand_over_frame(p);
+    return 0;
+}
+
+static void *capture_loop(void *arg)
+{
+    struct ouvr_ctx *ctx = arg;
+    ouvr_pthread_context *pth_ctx = ctx->main_priv;
+    ouvr_send_pipeline *p = pth_ctx->pipeline;
+
+    while (!pth_ctx->should_exit)
+    {
+        wait_frame_interval(ctx);
+        capture_frame(ctx, p, p->src);
+    }
+    return NULL;
+}
+
+static void *encode_loop(void *arg)
+{
+    struct ouvr_ctx *ctx = arg;
+    ouvr_pthread_context *pth_ctx = ctx->main_priv;
+    ouvr_send_pipeline *p = pth_ctx->pipeline;
+    // the packet this stage encodes into next, kept when nothing had to be queued
+    struct ouvr_packet *pkt = NULL;
+
+    while (1)
+    {
+        sem_wait(&p->frame_ready);
+        if (pth_ctx->should_exit)
+        {
+            break;
+        }
+        ouvr_frame_slot *frame = atomic_exchange(&p->latest_frame, NULL);
+        if (frame == NULL)
+        {
+            continue;
+        }
+        if (pkt == NULL)
+        {
+            sem_wait(&p->packets_free);
+            if (pth_ctx->should_exit)
+            {
+                break;
+            }
+            pkt = ouvr_spsc_pop(&p->free_packets);
+        }
+        atomic_store(&p->capture_to_encode_usec, usec_since(&frame->captured));
+
+        ctx->pix_buf = frame->borrowed != NULL ? (uint8_t *)frame->borrowed : frame->data;
+        ctx->packet = pkt;
+        int ret = encode_frame(ctx);
+        ctx->pix_buf = p->src;
+        ouvr_spsc_push(&p->free_frames, frame);
+
+        if (ret == 0)
+        {
+            p->encoder_streams = 1;
+        }
+        else if (ret == 1 && p->encoder_streams)
+        {
+            ret = send_packet(ctx, pkt);
+        }
+        else if (ret == 1)
+        {
+            ouvr_spsc_push(&p->send_queue, pkt);
+            sem_post(&p->packets_ready);
+            pkt = NULL;
+        }
+        if (ret < 0)
+        {
+            pth_ctx->should_exit = 1;
+            // wakes the other stages up so that they see it
+            sem_post(&p->packets_ready);
+            break;
+        }
+    }
+    return NULL;
+}
+
+static void *send_loop(void *arg)
+{
+    struct ouvr_ctx *ctx = arg;
+    ouvr_pthread_context *pth_ctx = ctx->main_priv;
+    ouvr_send_pipeline *p = pth_ctx->pipeline;
+
+    while (1)
+    {
+        sem_wait(&p->packets_ready);
+        struct ouvr_packet *pkt = ouvr_spsc_pop(&p->send_queue);
+        if (pkt == NULL)
+        {
+            // only posted without a packet when the pipeline stops
+            if (pth_ctx->should_exit)
+            {
+                break;
+            }
+            continue;
+        }
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        int ret = send_packet(ctx, pkt);
+        atomic_store(&p->send_usec, usec_since(&start));
+        ouvr_spsc_push(&p->free_packets, pkt);
+        sem_post(&p->packets_free);
+        if (ret != 0)
+        {
+            pth_ctx->should_exit = 1;
+            sem_post(&p->frame_ready);
+            break;
+        }
+    }
+    return NULL;
+}
+
+static void free_pipeline(ouvr_send_pipeline *p)
+{
+    for (int i = 0; i < PIPELINE_FRAMES; i++)
+    {
+        free(p->frames[i].data);
+    }
+    for (int i = 0; i < PIPELINE_PACKETS; i++)
+    {
+        if (p->packets[i] != NULL)
+        {
+            ouvr_packet_free(p->packets[i]);
+        }
+    }
+    ouvr_spsc_destroy(&p->free_frames);
+    ouvr_spsc_destroy(&p->send_queue);
+    ouvr_spsc_destroy(&p->free_packets);
+    sem_destroy(&p->frame_ready);
+    sem_destroy(&p->packets_ready);
+    sem_destroy(&p->packets_free);
+    free(p);
+}
+
+static ouvr_send_pipeline *alloc_pipeline(struct ouvr_ctx *ctx)
+{
+    ouvr_send_pipeline *p = calloc(1, sizeof(ouvr_send_pipeline));
+    if (p == NULL)
+    {
+        return NULL;
+    }
+    p->src = ctx->pix_buf;
+    p->own_packet = ctx->packet;
+    atomic_init(&p->latest_frame, NULL);
+    atomic_init(&p->frames_dropped, 0);
+    atomic_init(&p->capture_usec, 0);
+    atomic_init(&p->send_usec, 0);
+    atomic_init(&p->capture_to_encode_usec, 0);
+    sem_init(&p->frame_ready, 0, 0);
+    sem_init(&p->packets_ready, 0, 0);
+    sem_init(&p->packets_free, 0, PIPELINE_PACKETS);
+    if (ouvr_spsc_init(&p->free_frames, PIPELINE_FRAMES) != 0 || ouvr_spsc_init(&p->send_queue, PIPELINE_PACKETS) != 0 ||
+        ouvr_spsc_init(&p->free_packets, PIPELINE_PACKETS) != 0)
+    {
+        free_pipeline(p);
+        return NULL;
+    }
+    for (int i = 0; i < PIPELINE_FRAMES; i++)
+    {
+        p->frames[i].data = malloc((size_t)ctx->width * ctx->height * 4);
+        if (p->frames[i].data == NULL)
+        {
+            free_pipeline(p);
+            return NULL;
+        }
+        ouvr_spsc_push(&p->free_frames, &p->frames[i]);
+    }
+    for (int i = 0; i < PIPELINE_PACKETS; i++)
+    {
+        p->packets[i] = ouvr_packet_alloc(ctx->pool);
+        if (p->packets[i] == NULL)
+        {
+            free_pipeline(p);
+            return NULL;
+        }
+        ouvr_spsc_push(&p->free_packets, p->packets[i]);
+    }
+    return p;
+}
+
+static int start_pipeline(struct ouvr_ctx *ctx, int triggered)
+{
+    // encoders with a cuda_copy take the frame from the pbo, there is nothing to capture from pix_buf. Shared memory
+    // frames are already multi-buffered by the producer and go through openuvr_init_thread_continuous()
+    if (ctx->pix_buf == NULL || ctx->enc->cuda_copy != NULL || ctx->shm != NULL)
+    {
+        PRINT_ERR("The pipelined sender needs frames in pix_buf\n");
+        return -1;
+    }
+    ouvr_pthread_context *pth_ctx = calloc(1, sizeof(ouvr_pthread_context));
+    pth_ctx->pipeline = alloc_pipeline(ctx);
+    if (pth_ctx->pipeline == NULL)
+    {
+        PRINT_ERR("Couldn't allocate the frames and packets of the pipelined sender\n");
+        free(pth_ctx);
+        return -1;
+    }
+    pth_ctx->pipeline->triggered = triggered;
     ctx->main_priv = pth_ctx;
+    pthread_create(&pth_ctx->pipeline->send_thread, NULL, send_loop, ctx);
+    ouvr_threads_add(ctx->threads, pth_ctx->pipeline->send_thread, OPENUVR_THREAD_SEND, "send");
+    pthread_create(&pth_ctx->send_thread, NULL, encode_loop, ctx);
+    ouvr_threads_add(ctx->threads, pth_ctx->send_thread, OPENUVR_THREAD_ENCODE, "encode");
+    if (!triggered)
+    {
+        pthread_create(&pth_ctx->pipeline->capture_thread, NULL, capture_loop, ctx);
+        ouvr_threads_add(ctx->threads, pth_ctx->pipeline->capture_thread, OPENUVR_THREAD_CAPTURE, "capture");
+    }
     return 0;
 }
 
+int openuvr_init_thread_pipelined(struct openuvr_context *context)
+{
+    return start_pipeline(context->priv, 0);
+}
+
+int openuvr_init_thread_triggered(struct openuvr_context *context)
+{
+    return start_pipeline(context->priv, 1);
+}
+
+// the pipeline started by openuvr_init_thread_triggered(), NULL in the other modes
+static ouvr_send_pipeline *triggered_pipeline(struct ouvr_ctx *ctx)
+{
+    ouvr_pthread_context *pth_ctx = ctx->main_priv;
+    if (pth_ctx == NULL || pth_ctx->pipeline == NULL || !pth_ctx->pipeline->triggered)
+    {
+        return NULL;
+    }
+    return pth_ctx->pipeline;
+}
+
+uint8_t *openuvr_get_frame_buffer(struct openuvr_context *context)
+{
+    struct ouvr_ctx *ctx = context->priv;
+    ouvr_send_pipeline *p = triggered_pipeline(ctx);
+    if (p == NULL)
+    {
+        return ctx->pix_buf;
+    }
+    ouvr_frame_slot *slot = get_capture_slot(p);
+    return slot != NULL ? slot->data : NULL;
+}
+
+int openuvr_publish_frame(struct openuvr_context *context, const uint8_t *frame)
+{
+    struct ouvr_ctx *ctx = context->priv;
+    ouvr_send_pipeline *p = triggered_pipeline(ctx);
+    if (p == NULL || frame == NULL)
+    {
+        return -1;
+    }
+    return capture_frame(ctx, p, frame);
+}
+
+int openuvr_publish_borrowed_frame(struct openuvr_context *context, const uint8_t *frame, int tag)
+{
+    struct ouvr_ctx *ctx = context->priv;
+    ouvr_send_pipeline *p = triggered_pipeline(ctx);
+    if (p == NULL || frame == NULL || tag < 0)
+    {
+        return -1;
+    }
+    ouvr_frame_slot *slot = get_capture_slot(p);
+    if (slot == NULL)
+    {
+        atomic_fetch_add(&p->frames_dropped, 1);
+        return -1;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &slot->captured);
+    slot->borrowed = frame;
+    slot->borrowed_tag = tag;
+    atomic_store(&p->capture_usec, 0);
+    hand_over_frame(p);
+    return 0;
+}
+
+int openuvr_reclaim_frame(struct openuvr_context *context)
+{
+    struct ouvr_ctx *ctx = context->priv;
+    ouvr_send_pipeline *p = triggered_pipeline(ctx);
+    if (p == NULL)
+    {
+        return -1;
+    }
+    collect_returned_slots(p);
+    for (int i = 0; i < p->num_returned; i++)
+    {
+        if (p->returned[i]->borrowed != NULL)
+        {
+            p->returned[i]->borrowed = NULL;
+            return p->returned[i]->borrowed_tag;
+        }
+    }
+    return -1;
+}
+
+static void stop_pipeline(struct ouvr_ctx *ctx, ouvr_pthread_context *pth_ctx)
+{
+    ouvr_send_pipeline *p = pth_ctx->pipeline;
+    pth_ctx->should_exit = 1;
+    if (!p->triggered)
+    {
+        ouvr_threads_remove(ctx->threads, p->capture_thread);
+        pthread_join(p->capture_thread, NULL);
+    }
+    sem_post(&p->frame_ready);
+    sem_post(&p->packets_free);
+    ouvr_threads_remove(ctx->threads, pth_ctx->send_thread);
+    pthread_join(pth_ctx->send_thread, NULL);
+    // the packets already encoded still go out
+    sem_post(&p->packets_ready);
+    ouvr_threads_remove(ctx->threads, p->send_thread);
+    pthread_join(p->send_thread, NULL);
+    ctx->pix_buf = p->src;
+    ctx->packet = p->own_packet;
+    free_pipeline(p);
+    pth_ctx->pipeline = NULL;
+}
+
 void openuvr_close(struct openuvr_context *context)
 {
     if (context == NULL || context->priv == NULL)
@@ -294,12 +1140,240 @@ void openuvr_close(struct openuvr_context *context)
     }
     struct ouvr_ctx *ctx = context->priv;
     ouvr_pthread_context *pth_ctx = ctx->main_priv;
-    pth_ctx->should_exit = 1;
-    pthread_join(pth_ctx->send_thread, NULL);
+    if (pth_ctx != NULL && pth_ctx->pipeline != NULL)
+    {
+        stop_pipeline(ctx, pth_ctx);
+    }
+    else if (pth_ctx != NULL)
+    {
+        pth_ctx->should_exit = 1;
+        ouvr_threads_remove(ctx->threads, pth_ctx->send_thread);
+        pthread_join(pth_ctx->send_thread, NULL);
+    }
+    printf("OpenUVR: %llu frames encoded, %llu identical frames suppressed\n", (unsigned long long)ctx->frames_encoded, (unsigned long long)ctx->frames_suppressed);
+    input_recv_stop(ctx);
     ctx->enc->deinit(ctx);
-    ctx->aud->deinit(ctx);
+    if (ctx->aud != NULL)
+    {
+        ctx->aud->deinit(ctx);
+    }
+    feedback_deinitialize(ctx);
+    if (ctx->net->deinit != NULL)
+    {
+        ctx->net->deinit(ctx);
+    }
 
+    ouvr_foveation_free(ctx->fov);
+    ouvr_ladder_free(ctx->ladder);
+    ouvr_budget_free(ctx->budget);
+    ouvr_pacer_free(ctx->pacer);
+    ouvr_threads_free(ctx->threads);
+    ouvr_shm_source_close(ctx->shm);
+    ouvr_packet_free(ctx->packet);
+    ouvr_packet_pool_free(ctx->pool);
+    free(ctx->packed_buf);
+    pthread_mutex_destroy(&ctx->params_lock);
+    pthread_mutex_destroy(&ctx->send_lock);
     free(ctx->main_priv);
     free(ctx);
     free(context);
 }
+
+void openuvr_set_static_frame_detection(struct openuvr_context *context, int enable)
+{
+    struct ouvr_ctx *ctx = context->priv;
+    ctx->detect_static_frames = enable;
+    ctx->frames_since_keepalive = 0;
+}
+
+int openuvr_get_stats(struct openuvr_context *context, struct openuvr_stats *stats)
+{
+    if (context == NULL || context->priv == NULL)
+    {
+        return -1;
+    }
+    struct ouvr_ctx *ctx = context->priv;
+    stats->frames_encoded = ctx->frames_encoded;
+    stats->frames_suppressed = ctx->frames_suppressed;
+    stats->encode_width = ctx->enc_width;
+    stats->encode_height = ctx->enc_height;
+    stats->resolution_changes = ctx->resolution_changes;
+    stats->encode_usec = ctx->last_encode_usec;
+    stats->game_copy_usec = 0;
+    stats->readbacks_skipped = 0;
+    stats->ticks_skipped = ctx->pacer->skipped_ticks;
+    for (int i = 0; i < OPENUVR_JITTER_BUCKETS; i++)
+    {
+        stats->send_jitter[i] = ctx->pacer->jitter_hist[i];
+    }
+    ouvr_pthread_context *pth_ctx = ctx->main_priv;
+    if (pth_ctx != NULL && pth_ctx->pipeline != NULL)
+    {
+        ouvr_send_pipeline *p = pth_ctx->pipeline;
+        stats->frames_dropped = atomic_load(&p->frames_dropped);
+        stats->frame_queue_depth = atomic_load(&p->latest_frame) != NULL;
+        stats->send_queue_depth = ouvr_spsc_depth(&p->send_queue);
+        stats->capture_usec = atomic_load(&p->capture_usec);
+        stats->send_usec = atomic_load(&p->send_usec);
+        stats->capture_to_encode_usec = atomic_load(&p->capture_to_encode_usec);
+    }
+    else
+    {
+        stats->frames_dropped = 0;
+        stats->frame_queue_depth = 0;
+        stats->send_queue_depth = 0;
+        stats->capture_usec = 0;
+        stats->send_usec = 0;
+        stats->capture_to_encode_usec = 0;
+    }
+    stats->frames_torn = 0;
+    stats->receivers = 0;
+    stats->shared_keyframes = 0;
+    stats->replayed_recoveries = 0;
+    if (ctx->net == &udp_fanout_handler)
+    {
+        fanout_get_counts(ctx, &stats->receivers, &stats->shared_keyframes, &stats->replayed_recoveries);
+    }
+    if (ctx->shm != NULL)
+    {
+        stats->frames_dropped = atomic_load(&ctx->shm->frames_skipped);
+        stats->capture_to_encode_usec = atomic_load(&ctx->shm->present_to_acquire_usec);
+        stats->frames_torn = atomic_load(&ctx->shm->frames_torn);
+    }
+    ouvr_packet_pool_stats(ctx->pool, &stats->packet_pool);
+    return 0;
+}
+
+void openuvr_set_foveation(struct openuvr_context *context, const struct openuvr_foveation_profile *profile)
+{
+    struct ouvr_ctx *ctx = context->priv;
+    ouvr_foveation_set_profile(ctx->fov, profile);
+}
+
+void openuvr_set_fovea_center(struct openuvr_context *context, int eye, float x, float y)
+{
+    struct ouvr_ctx *ctx = context->priv;
+    ouvr_foveation_set_center(ctx->fov, eye, x, y);
+}
+
+int openuvr_set_foveated_packing(struct openuvr_context *context, int enable)
+{
+    struct ouvr_ctx *ctx = context->priv;
+    // the H.264 receivers hand the picture to the display as it was decoded
+    if (enable && !ctx->enc->unpacks_foveated)
+    {
+        PRINT_ERR("Foveated packing needs an encoder whose receivers unpack it (rgb, rgb-tile or lz4)\n");
+        return -1;
+    }
+    ctx->request_foveated_packing = enable;
+    return 0;
+}
+
+void openuvr_set_dynamic_resolution(struct openuvr_context *context, int enable)
+{
+    struct ouvr_ctx *ctx = context->priv;
+    ctx->dynamic_resolution = enable;
+}
+
+void openuvr_report_overload(struct openuvr_context *context, int overloaded)
+{
+    struct ouvr_ctx *ctx = context->priv;
+    ctx->overloaded = overloaded;
+}
+
+int openuvr_set_bitrate(struct openuvr_context *context, int kbps)
+{
+    if (kbps <= 0)
+    {
+        return -1;
+    }
+    struct ouvr_ctx *ctx = context->priv;
+    pthread_mutex_lock(&ctx->params_lock);
+    ctx->requested_params.bitrate_kbps = kbps;
+    ctx->pending_params |= OUVR_PARAM_BITRATE;
+    pthread_mutex_unlock(&ctx->params_lock);
+    return 0;
+}
+
+void openuvr_request_keyframe(struct openuvr_context *context)
+{
+    struct ouvr_ctx *ctx = context->priv;
+    pthread_mutex_lock(&ctx->params_lock);
+    ctx->keyframe_requested = 1;
+    pthread_mutex_unlock(&ctx->params_lock);
+}
+
+int openuvr_set_gop(struct openuvr_context *context, int frames)
+{
+    if (frames <= 0)
+    {
+        return -1;
+    }
+    struct ouvr_ctx *ctx = context->priv;
+    pthread_mutex_lock(&ctx->params_lock);
+    ctx->requested_params.gop = frames;
+    ctx->pending_params |= OUVR_PARAM_GOP;
+    pthread_mutex_unlock(&ctx->params_lock);
+    return 0;
+}
+
+int openuvr_set_encoder_preset(struct openuvr_context *context, const char *preset)
+{
+    struct ouvr_ctx *ctx = context->priv;
+    if (preset == NULL || preset[0] == '\0' || strlen(preset) >= sizeof(ctx->requested_params.preset))
+    {
+        return -1;
+    }
+    pthread_mutex_lock(&ctx->params_lock);
+    strcpy(ctx->requested_params.preset, preset);
+    ctx->pending_params |= OUVR_PARAM_PRESET;
+    pthread_mutex_unlock(&ctx->params_lock);
+    return 0;
+}
+
+int openuvr_set_encode_deadline(struct openuvr_context *context, int usec)
+{
+    struct ouvr_ctx *ctx = context->priv;
+    if (usec < 0 || (usec > 0 && ctx->enc != &x264_encode && ctx->enc != &stereo_encode))
+    {
+        return -1;
+    }
+    pthread_mutex_lock(&ctx->params_lock);
+    ouvr_budget_set_deadline(ctx->budget, usec);
+    pthread_mutex_unlock(&ctx->params_lock);
+    return 0;
+}
+
+void openuvr_report_present(struct openuvr_context *context)
+{
+    struct ouvr_ctx *ctx = context->priv;
+    ouvr_pacer_report_present(ctx->pacer);
+}
+
+void openuvr_set_present_phase(struct openuvr_context *context, int offset_usec)
+{
+    struct ouvr_ctx *ctx = context->priv;
+    ouvr_pacer_set_phase(ctx->pacer, offset_usec);
+}
+
+int openuvr_fanout_add_receiver(struct openuvr_context *context, const char *ip)
+{
+    return fanout_add_receiver(context->priv, ip);
+}
+
+int openuvr_set_thread_config(struct openuvr_context *context, enum OPENUVR_THREAD_STAGE stage, const struct openuvr_thread_config *config)
+{
+    struct ouvr_ctx *ctx = context->priv;
+    return ouvr_threads_configure(ctx->threads, stage, config);
+}
+
+int openuvr_configure_threads(struct openuvr_context *context, const char *desc)
+{
+    struct ouvr_ctx *ctx = context->priv;
+    return ouvr_threads_parse(ctx->threads, desc);
+}
+
+int openuvr_lock_memory(void)
+{
+    return ouvr_lock_memory();
+}
@@ -34,6 +34,9 @@
 
 #include <stdint.h>
 
+// see openuvr_stats.send_jitter
+#define OPENUVR_JITTER_BUCKETS 8
+
 enum OPENUVR_NETWORK_TYPE
 {
     OPENUVR_NETWORK_TCP,
@@ -43,6 +46,8 @@ enum OPENUVR_NETWORK_TYPE
     OPENUVR_NETWORK_INJECT,
     OPENUVR_NETWORK_UDP_COMPAT,
     OPENUVR_NETWORK_WEBRTC,
+    // udp to every receiver that announces itself, encoding once for all of them
+    OPENUVR_NETWORK_UDP_FANOUT,
 };
 
 enum OPENUVR_ENCODER_TYPE
@@ -50,6 +55,10 @@ enum OPENUVR_ENCODER_TYPE
     OPENUVR_ENCODER_H264,
     OPENUVR_ENCODER_H264_CUDA,
     OPENUVR_ENCODER_RGB,
+    OPENUVR_ENCODER_H264_X264,
+    OPENUVR_ENCODER_RGB_TILE,
+    OPENUVR_ENCODER_LZ4,
+    OPENUVR_ENCODER_H264_STEREO,
 };
 
 struct openuvr_context
@@ -57,15 +66,209 @@ struct openuvr_context
     void *priv;
 };
 
+// the threads of a session, each named ouvr-<stage> or after what it does. The continuous send loops encode and send
+// on the encode thread, workers are the threads encoders start of their own (gstreamer's main loop, the stereo
+// encoder's right eye, the lz4 workers) and input turns the receiver's sensor data into input events
+enum OPENUVR_THREAD_STAGE
+{
+    OPENUVR_THREAD_CAPTURE,
+    OPENUVR_THREAD_ENCODE,
+    OPENUVR_THREAD_SEND,
+    OPENUVR_THREAD_WORKERS,
+    OPENUVR_THREAD_INPUT,
+};
+#define OPENUVR_THREAD_STAGES 5
+
+enum OPENUVR_SCHED_POLICY
+{
+    OPENUVR_SCHED_OTHER,
+    OPENUVR_SCHED_FIFO,
+    OPENUVR_SCHED_RR,
+};
+
+struct openuvr_thread_config
+{
+    // bit n lets the threads run on cpu n, 0 lets them run on any
+    uint64_t cpus;
+    enum OPENUVR_SCHED_POLICY policy;
+    // 1 to 99 for fifo and rr, which need CAP_SYS_NICE or an rtprio limit
+    int priority;
+};
+
+// the data buffers of a session's packets, see openuvr_stats.packet_pool
+struct openuvr_pool_stats
+{
+    // the most the pool maps, and what it has mapped now and at most. huge_page_bytes is the part backed by reserved
+    // huge pages, the rest is left to transparent huge pages
+    uint64_t cap;
+    uint64_t bytes_mapped;
+    uint64_t bytes_mapped_high_water;
+    uint64_t huge_page_bytes;
+    // held by packets, now and at most
+    uint64_t bytes_in_use;
+    uint64_t bytes_in_use_high_water;
+    int buffers_in_use;
+    int buffers_high_water;
+    // slabs mapped so far, and buffers refused because the cap was reached, each one a frame that wasn't sent
+    uint64_t slabs_mapped;
+    uint64_t failures;
+};
+
+struct openuvr_stats
+{
+    // frames that went through the encoder
+    uint64_t frames_encoded;
+    // frames identical to the previous one, sent as a repeat marker instead of being encoded
+    uint64_t frames_suppressed;
+    // size the frames are currently encoded at, and how often dynamic resolution changed it
+    int encode_width;
+    int encode_height;
+    uint64_t resolution_changes;
+    // how long the last frame took to scale and encode (and send, for the encoders that stream slices)
+    long encode_usec;
+    // openuvr_init_thread_pipelined() only, 0 otherwise: frames the capture stage replaced before the encoder got to
+    // them, frames and packets waiting between the stages, and how long the last capture (copy of pix_buf) and send took
+    uint64_t frames_dropped;
+    int frame_queue_depth;
+    int send_queue_depth;
+    long capture_usec;
+    long send_usec;
+    // from the start of the capture (or openuvr_publish_frame()) to the encoder picking the frame up
+    long capture_to_encode_usec;
+    // openuvr_alloc_context_shm() only: frames_dropped counts the producer's frames never sent,
+    // capture_to_encode_usec runs from the game presenting the frame, and frames_torn counts frames the producer
+    // overwrote while they were encoded
+    uint64_t frames_torn;
+    // OPENUVR_NETWORK_UDP_FANOUT only: receivers being sent to, keyframes forced to let receivers in, and receivers
+    // caught up by replaying the packets since the last keyframe to them alone
+    int receivers;
+    uint64_t shared_keyframes;
+    uint64_t replayed_recoveries;
+    // frame ticks of the send loop dropped because it woke up more than half an interval late, and how late the
+    // others woke up: under 50, 100, 250, 500 us, 1, 2, 4 ms and beyond
+    uint64_t ticks_skipped;
+    uint64_t send_jitter[OPENUVR_JITTER_BUCKETS];
+    // openuvr_managed_get_stats() and openuvr_managed_stats() only: how long copying the framebuffer holds up the
+    // game's thread, averaged over the last frames, and frames it couldn't read back because every pbo was still in use
+    long game_copy_usec;
+    uint64_t readbacks_skipped;
+    struct openuvr_pool_stats packet_pool;
+};
+
+struct openuvr_foveation_profile
+{
+    // 1 when the frame holds the two eye views side by side, each with its own fovea
+    int stereo;
+    // distances from the fovea centre as a fraction of the eye view's height. Quality is full up to inner_radius,
+    // then the quantizer offset grows until it reaches max_qp_offset at outer_radius and beyond
+    float inner_radius;
+    float outer_radius;
+    float max_qp_offset;
+};
+
+// frames are 1920x1080 RGBA sent at 60 fps
 struct openuvr_context *openuvr_alloc_context(enum OPENUVR_ENCODER_TYPE enc_type, enum OPENUVR_NETWORK_TYPE net_type, uint8_t *pix_buf, unsigned int pbo);
+// pix_buf (or the pbo) holds width x height RGBA pixels, both even. fps is lowered if the receiver reports a display
+// that can't keep up, and the geometry is sent with every frame so the receiver adapts to it
+struct openuvr_context *openuvr_alloc_context_with_geometry(enum OPENUVR_ENCODER_TYPE enc_type, enum OPENUVR_NETWORK_TYPE net_type, uint8_t *pix_buf, unsigned int pbo, int width, int height, int fps);
+// the same, sending to the receiver at client_ip instead of the one built in. Contexts share no state, so a process
+// can run one per receiver, each with its own threads. udp and udp-compat contexts share the local ports. The other
+// handlers ignore client_ip, and tcp, webrtc and udp-fanout listen on fixed ports, so one context per process each
+struct openuvr_context *openuvr_alloc_context_for_receiver(enum OPENUVR_ENCODER_TYPE enc_type, enum OPENUVR_NETWORK_TYPE net_type, uint8_t *pix_buf, unsigned int pbo, int width, int height, int fps, const char *client_ip);
+// frames come from another process through the shared region /dev/shm/<shm_name> (see ouvr_shm_producer.h), which
+// also gives the geometry. openuvr_init_thread_continuous() then sends each new frame as it is finished
+struct openuvr_context *openuvr_alloc_context_shm(enum OPENUVR_ENCODER_TYPE enc_type, enum OPENUVR_NETWORK_TYPE net_type, const char *shm_name, int fps);
 int openuvr_send_frame(struct openuvr_context *context);
 int openuvr_init_thread(struct openuvr_context *context);
 int openuvr_init_thread_continuous(struct openuvr_context *context);
+// like openuvr_init_thread_continuous(), but with a thread each to copy pix_buf, encode and send, so that the three
+// overlap for consecutive frames. A frame the encoder couldn't keep up with is dropped in favour of the newer one.
+// Needs frames in pix_buf, returns -1 for the cuda encoder
+int openuvr_init_thread_pipelined(struct openuvr_context *context);
+// no frame ticks at all: every frame the game hands over with openuvr_publish_frame() wakes the encoder straight
+// away, so frames are sent at the game's rate. Otherwise the same as openuvr_init_thread_pipelined()
+int openuvr_init_thread_triggered(struct openuvr_context *context);
+// the buffer to render or read the next frame into, so that openuvr_publish_frame() doesn't have to copy it.
+// pix_buf when the session isn't triggered, NULL if no buffer is free
+uint8_t *openuvr_get_frame_buffer(struct openuvr_context *context);
+// hands a width x height RGBA frame over to a triggered session, copying it unless it is the buffer from
+// openuvr_get_frame_buffer(). Returns -1 if the session isn't triggered or the frame had to be dropped
+int openuvr_publish_frame(struct openuvr_context *context, const uint8_t *frame);
+// like openuvr_publish_frame() without any copy, for buffers such as a mapped pbo that have to be released by the
+// caller's thread. frame must stay valid until openuvr_reclaim_frame() gives tag (>= 0) back
+int openuvr_publish_borrowed_frame(struct openuvr_context *context, const uint8_t *frame, int tag);
+// the tag of a borrowed frame the encoder is done with, or -1 if there is none (yet). Call it until it returns -1
+int openuvr_reclaim_frame(struct openuvr_context *context);
+// called by the game right after it presents a frame. The send loops then line their frame ticks up offset_usec
+// after the presents (0 by default), so that every frame is picked up as soon as it is finished
+void openuvr_report_present(struct openuvr_context *context);
+void openuvr_set_present_phase(struct openuvr_context *context, int offset_usec);
 int openuvr_cuda_copy(struct openuvr_context *context);
 void openuvr_close(struct openuvr_context *context);
+// static frame detection is on by default. It only applies to encoders that read pix_buf.
+void openuvr_set_static_frame_detection(struct openuvr_context *context, int enable);
+int openuvr_get_stats(struct openuvr_context *context, struct openuvr_stats *stats);
+// foveated encoding is used by the x264 and libavcodec encoders, passing NULL turns it off again
+void openuvr_set_foveation(struct openuvr_context *context, const struct openuvr_foveation_profile *profile);
+// x and y go from 0 to 1 across the eye's view, eye is 0 for the left (or only) view and 1 for the right one.
+// Can be called every frame from another thread with the tracked gaze or head pose
+void openuvr_set_fovea_center(struct openuvr_context *context, int eye, float x, float y);
+// packs the periphery of each eye at half resolution before encoding, around the centres set above, so the encoder
+// gets frames half as wide. Only the receiver's rgb renderer can unpack them, so it returns -1 for the encoders it
+// doesn't receive from
+int openuvr_set_foveated_packing(struct openuvr_context *context, int enable);
+// scales frames down to 85% then 70% of their size while encoding them takes longer than the frame interval or
+// overload is reported, and back up once there is room again. The receiver scales them up to its display.
+// Off by default, it only applies to encoders that read pix_buf
+void openuvr_set_dynamic_resolution(struct openuvr_context *context, int enable);
+// for a congestion controller outside the library to push the resolution down, stays in effect until called with 0
+void openuvr_report_overload(struct openuvr_context *context, int overloaded);
+
+// encoder controls, safe to call from any thread. They take effect before the next frame is encoded, without the
+// encoder being reopened, and stay in effect when dynamic resolution sets it up again.
+// Bitrate is in kbit/s for the whole frame, the H.264 encoders use it; rgb, rgb-tile and lz4 have no rate control
+int openuvr_set_bitrate(struct openuvr_context *context, int kbps);
+// the next frame is sent as an IDR (or in full, for rgb-tile)
+void openuvr_request_keyframe(struct openuvr_context *context);
+// frames from one keyframe to the next, for rgb-tile how often the whole frame is resent
+int openuvr_set_gop(struct openuvr_context *context, int frames);
+// an x264 preset name such as "ultrafast" or "veryfast", only the x264 and stereo encoders can change it
+int openuvr_set_encoder_preset(struct openuvr_context *context, const char *preset);
+// keeps encoding a frame under usec by stepping the x264 preset, subme and reference count between "faster" and
+// "superfast", and the resolution down only once that isn't enough. Overrides openuvr_set_encoder_preset() while on,
+// 0 turns it off. Only for the x264 and stereo encoders, returns -1 for the others
+int openuvr_set_encode_deadline(struct openuvr_context *context, int usec);
+// OPENUVR_NETWORK_UDP_FANOUT sessions take on receivers as they send their first feedback. This adds one by its
+// address up front instead, returns -1 for other sessions or when the receiver limit is reached
+int openuvr_fanout_add_receiver(struct openuvr_context *context, const char *ip);
+// places the stage's threads, those running already and those started later, and prints where each one ended up.
+// Stages never configured are left with what the threads inherit from the process, e.g. from taskset or chrt.
+// Returns -1 if the configuration is invalid or a thread couldn't be placed, which then keeps running as it was
+int openuvr_set_thread_config(struct openuvr_context *context, enum OPENUVR_THREAD_STAGE stage, const struct openuvr_thread_config *config);
+// the same from a description of "stage=cpus[,policy[,priority]]" entries separated by ';', e.g.
+// "encode=2-3,fifo,50;send=4,rr,40;input=0". Stages are capture, encode, send, workers and input, cpus a list like
+// 0+2-3 or "any", policy other, fifo or rr. An entry "mlock" calls openuvr_lock_memory()
+int openuvr_configure_threads(struct openuvr_context *context, const char *desc);
+// locks the process's memory, present and future, so that real-time threads don't stall on page faults
+int openuvr_lock_memory(void);
 
 //"managed" functions which declare and manage the opengl buffers
+// frames take the size of the viewport and are sent at 60 fps
 int openuvr_managed_init(enum OPENUVR_ENCODER_TYPE enc_type, enum OPENUVR_NETWORK_TYPE net_type);
+int openuvr_managed_init_with_rate(enum OPENUVR_ENCODER_TYPE enc_type, enum OPENUVR_NETWORK_TYPE net_type, int fps);
 void openuvr_managed_copy_framebuffer();
+// cpu encoders get the frames through a ring of pbos read back asynchronously, one frame later. Call before
+// openuvr_managed_init() with 0 to read them with a plain glReadPixels() instead, e.g. to compare game_copy_usec
+void openuvr_managed_set_async_readback(int enable);
+int openuvr_managed_get_stats(struct openuvr_stats *stats);
+// the same for several sessions in one process, each with its own OpenGL context, which has to be current whenever
+// one of its functions is called. The functions above work on a default one set up by openuvr_managed_init()
+struct openuvr_managed;
+struct openuvr_managed *openuvr_managed_alloc(enum OPENUVR_ENCODER_TYPE enc_type, enum OPENUVR_NETWORK_TYPE net_type, int fps, int async_readback);
+void openuvr_managed_copy(struct openuvr_managed *m);
+int openuvr_managed_stats(struct openuvr_managed *m, struct openuvr_stats *stats);
+// for the openuvr_set_*() controls
+struct openuvr_context *openuvr_managed_get_context(struct openuvr_managed *m);
+void openuvr_managed_free(struct openuvr_managed *m);
 
 #endif
\ No newline at end of file
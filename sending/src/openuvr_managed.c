@@ -41,6 +41,7 @@
 #include <GLES3/gl3.h>
 #include <dlfcn.h>
 #include <sys/time.h>
+#include <time.h>
 
 #include "ssim_plugin.h"
 
@@ -53,21 +54,109 @@
 #include "include/libswscale/swscale.h"
 
 #define NUM_SAVED_FRAMES 150
+#endif
+
+// for cpu encoders glReadPixels() goes into one of these pbos and returns straight away. A later frame maps it
+// once its fence has signalled and hands the mapping to the encoder, which reads the pixels from there. The pbo is
+// unmapped and read into again when the encoder gives it back
+#define NUM_READBACK_PBOS 3
+enum readback_state
+{
+    READBACK_FREE,
+    READBACK_PENDING,
+    READBACK_PUBLISHED,
+};
 
-static AVFrame *frame = NULL;
-static int const srcstride[1] = {1920 * 4};
-struct SwsContext *swsctx;
-static uint8_t *saved_frames[NUM_SAVED_FRAMES];
-static int cur_frame = 0;
-static int num_intermediary_frames = 3000;
-static uint8_t *y_buf;
+// everything one managed session keeps between frames. The openuvr_managed_*() functions without one use a default
+// instance, so each session needs its own OpenGL context to be current while its functions are called
+struct openuvr_managed
+{
+    struct openuvr_context *ctx;
+    GLuint pbo;
+    uint8_t *cpu_encoding_buf;
+    struct
+    {
+        GLuint pbo;
+        GLsync fence;
+        enum readback_state state;
+        // pending readbacks are published oldest first
+        uint64_t seq;
+    } readback[NUM_READBACK_PBOS];
+    int async_readback;
+    uint64_t readback_seq;
+    uint64_t readbacks_skipped;
+    // time spent on the game's thread per frame, as a moving average
+    float avg_game_copy_usec;
+    // taken from the viewport when the session is set up
+    GLint frame_width;
+    GLint frame_height;
+#ifdef MEASURE_SSIM
+    AVFrame *frame;
+    int srcstride[1];
+    struct SwsContext *swsctx;
+    uint8_t *saved_frames[NUM_SAVED_FRAMES];
+    int cur_frame;
+    int num_intermediary_frames;
+    uint8_t *y_buf;
 #endif
+};
 
-static GLuint pbo = 0;
-static uint8_t *cpu_encoding_buf = NULL;
-struct openuvr_context *ctx = NULL;
+static struct openuvr_managed *default_managed = NULL;
+// openuvr_managed_set_async_readback() is called before the default instance exists
+static int default_async_readback = 1;
+
+// deletes the buffers of m and m itself, with the OpenGL context that created them current. The encoder has to be
+// done with the readbacks it was given
+static void free_buffers(struct openuvr_managed *m)
+{
+    for (int i = 0; i < NUM_READBACK_PBOS; i++)
+    {
+        if (m->readback[i].fence != 0)
+        {
+            glDeleteSync(m->readback[i].fence);
+        }
+        if (m->readback[i].pbo != 0)
+        {
+            if (m->readback[i].state == READBACK_PUBLISHED)
+            {
+                glBindBuffer(GL_PIXEL_PACK_BUFFER, m->readback[i].pbo);
+                glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+            }
+            glDeleteBuffers(1, &m->readback[i].pbo);
+        }
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    if (m->pbo != 0)
+    {
+        glDeleteBuffers(1, &m->pbo);
+    }
+#ifdef MEASURE_SSIM
+    if (m->frame != NULL)
+    {
+        av_freep(&m->frame->data[0]);
+        av_frame_free(&m->frame);
+    }
+    sws_freeContext(m->swsctx);
+    for (int i = 0; i < NUM_SAVED_FRAMES; i++)
+        free(m->saved_frames[i]);
+    free(m->y_buf);
+#endif
+    free(m->cpu_encoding_buf);
+    free(m);
+}
 
 int openuvr_managed_init(enum OPENUVR_ENCODER_TYPE enc_type, enum OPENUVR_NETWORK_TYPE net_type)
+{
+    return openuvr_managed_init_with_rate(enc_type, net_type, 60);
+}
+
+int openuvr_managed_init_with_rate(enum OPENUVR_ENCODER_TYPE enc_type, enum OPENUVR_NETWORK_TYPE net_type, int fps)
+{
+    default_managed = openuvr_managed_alloc(enc_type, net_type, fps, default_async_readback);
+    return default_managed == NULL ? -1 : 0;
+}
+
+struct openuvr_managed *openuvr_managed_alloc(enum OPENUVR_ENCODER_TYPE enc_type, enum OPENUVR_NETWORK_TYPE net_type, int fps, int async_readback)
 {
 #ifdef UE4DEBUG
     PRINT_ERR("openuvr_managed_init entering\n");
@@ -76,24 +165,43 @@ int openuvr_managed_init(enum OPENUVR_ENCODER_TYPE enc_type, enum OPENUVR_NETWOR
     glGetIntegerv(GL_VIEWPORT, dims);
     GLint w = dims[2];
     GLint h = dims[3];
-    if (w != 1920 || h != 1080)
+    if (w <= 0 || h <= 0 || w % 2 || h % 2)
     {
-        PRINT_ERR("Viewport dimensions are %dx%d. You must set the dimensions to 1920x1080.\n", w, h);
-        return -1;
+        PRINT_ERR("Viewport dimensions are %dx%d. Both must be even.\n", w, h);
+        return NULL;
     }
+    struct openuvr_managed *m = calloc(1, sizeof(struct openuvr_managed));
+    m->frame_width = w;
+    m->frame_height = h;
+    m->async_readback = async_readback;
 
     if (enc_type == OPENUVR_ENCODER_H264_CUDA)
     {
 
-        glGenBuffers(1, &pbo);
-        glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo);
-        glBufferData(GL_PIXEL_PACK_BUFFER, 1920 * 1080 * 4, 0, GL_DYNAMIC_COPY);
+        glGenBuffers(1, &m->pbo);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, m->pbo);
+        glBufferData(GL_PIXEL_PACK_BUFFER, w * h * 4, 0, GL_DYNAMIC_COPY);
     }
     else
     {
 
-        cpu_encoding_buf = (uint8_t *)malloc(1920 * 1080 * 4);
-        glReadPixels(0, 0, w, h, GL_RGBA, GL_UNSIGNED_BYTE, cpu_encoding_buf);
+        m->cpu_encoding_buf = (uint8_t *)malloc(w * h * 4);
+        glReadPixels(0, 0, w, h, GL_RGBA, GL_UNSIGNED_BYTE, m->cpu_encoding_buf);
+#ifdef MEASURE_SSIM
+        // the measurement replays frames through cpu_encoding_buf
+        m->async_readback = 0;
+#endif
+        if (m->async_readback)
+        {
+            for (int i = 0; i < NUM_READBACK_PBOS; i++)
+            {
+                glGenBuffers(1, &m->readback[i].pbo);
+                glBindBuffer(GL_PIXEL_PACK_BUFFER, m->readback[i].pbo);
+                glBufferData(GL_PIXEL_PACK_BUFFER, w * h * 4, 0, GL_STREAM_READ);
+                m->readback[i].state = READBACK_FREE;
+            }
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        }
     }
 
     GLint size = 0;
@@ -101,15 +209,17 @@ int openuvr_managed_init(enum OPENUVR_ENCODER_TYPE enc_type, enum OPENUVR_NETWOR
 #ifdef UE4DEBUG
     // PRINT_ERR("openuvr_alloc_context entering\n");
 #endif
-    ctx = openuvr_alloc_context(enc_type, net_type, cpu_encoding_buf, pbo);
+    struct openuvr_context *ctx = openuvr_alloc_context_with_geometry(enc_type, net_type, m->cpu_encoding_buf, m->pbo, w, h, fps);
 #ifdef UE4DEBUG
     PRINT_ERR("openuvr_alloc_context finished\n");
 #endif
     if (ctx == NULL)
     {
         PRINT_ERR("Couldn't allocate openuvr context\n");
-        return -1;
+        free_buffers(m);
+        return NULL;
     }
+    m->ctx = ctx;
     openuvr_cuda_copy(ctx);
 #ifdef UE4DEBUG
     PRINT_ERR("openuvr_cuda_copy finished\n");
@@ -120,115 +230,275 @@ int openuvr_managed_init(enum OPENUVR_ENCODER_TYPE enc_type, enum OPENUVR_NETWOR
     // Required to run python later
     dlopen("libpython3.5m.so", RTLD_LAZY | RTLD_GLOBAL);
 
-    frame = av_frame_alloc();
-    frame->format = AV_PIX_FMT_YUV420P;
-    frame->width = 1920;
-    frame->height = 1080;
-    av_image_alloc(frame->data, frame->linesize, 1920, 1080, AV_PIX_FMT_YUV420P, 32);
-    swsctx = sws_getContext(1920, 1080, AV_PIX_FMT_RGB0, 1920, 1080, AV_PIX_FMT_YUV420P, SWS_BICUBIC, NULL, NULL, NULL);
+    m->frame = av_frame_alloc();
+    m->frame->format = AV_PIX_FMT_YUV420P;
+    m->frame->width = w;
+    m->frame->height = h;
+    m->srcstride[0] = w * 4;
+    av_image_alloc(m->frame->data, m->frame->linesize, w, h, AV_PIX_FMT_YUV420P, 32);
+    m->swsctx = sws_getContext(w, h, AV_PIX_FMT_RGB0, w, h, AV_PIX_FMT_YUV420P, SWS_BICUBIC, NULL, NULL, NULL);
     for (int i = 0; i < NUM_SAVED_FRAMES; i++)
-        saved_frames[i] = malloc(1920 * 1080 * 4);
-    y_buf = malloc(1920 * 1080);
+        m->saved_frames[i] = malloc(w * h * 4);
+    m->y_buf = malloc(w * h);
+    m->num_intermediary_frames = 3000;
 #else
-    openuvr_init_thread_continuous(ctx);
+    // the pixels only reach the cpu when the game calls openuvr_managed_copy_framebuffer(), which then wakes the
+    // encoder itself. The pbo is read by the encoder, so that one still goes by the clock
+    if (m->pbo == 0)
+    {
+        openuvr_init_thread_triggered(ctx);
+    }
+    else
+    {
+        openuvr_init_thread_continuous(ctx);
+    }
 #endif
 #ifdef UE4DEBUG
     PRINT_ERR("openuvr_managed_init finished\n");
 #endif
+    return m;
+}
+
+void openuvr_managed_set_async_readback(int enable)
+{
+    default_async_readback = enable;
+}
+
+int openuvr_managed_get_stats(struct openuvr_stats *stats)
+{
+    return openuvr_managed_stats(default_managed, stats);
+}
+
+int openuvr_managed_stats(struct openuvr_managed *m, struct openuvr_stats *stats)
+{
+    if (m == NULL || openuvr_get_stats(m->ctx, stats) != 0)
+    {
+        return -1;
+    }
+    stats->game_copy_usec = m->avg_game_copy_usec;
+    stats->readbacks_skipped = m->readbacks_skipped;
     return 0;
 }
 
+struct openuvr_context *openuvr_managed_get_context(struct openuvr_managed *m)
+{
+    return m->ctx;
+}
+
+void openuvr_managed_free(struct openuvr_managed *m)
+{
+    if (m == NULL)
+    {
+        return;
+    }
+    if (m == default_managed)
+    {
+        default_managed = NULL;
+    }
+    openuvr_close(m->ctx);
+    free_buffers(m);
+}
+
+// the pbo of each finished readback is mapped and given to the encoder, oldest first
+static void publish_readbacks(struct openuvr_managed *m)
+{
+    while (1)
+    {
+        int oldest = -1;
+        for (int i = 0; i < NUM_READBACK_PBOS; i++)
+        {
+            if (m->readback[i].state == READBACK_PENDING && (oldest < 0 || m->readback[i].seq < m->readback[oldest].seq))
+            {
+                oldest = i;
+            }
+        }
+        if (oldest < 0)
+        {
+            return;
+        }
+        // a zero timeout only polls the fence, the flush makes sure it gets signalled at all
+        GLenum r = glClientWaitSync(m->readback[oldest].fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+        if (r != GL_ALREADY_SIGNALED && r != GL_CONDITION_SATISFIED)
+        {
+            return;
+        }
+        glDeleteSync(m->readback[oldest].fence);
+        m->readback[oldest].fence = 0;
+
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, m->readback[oldest].pbo);
+        uint8_t *pix = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, m->frame_width * m->frame_height * 4, GL_MAP_READ_BIT);
+        if (pix != NULL && openuvr_publish_borrowed_frame(m->ctx, pix, oldest) == 0)
+        {
+            m->readback[oldest].state = READBACK_PUBLISHED;
+        }
+        else
+        {
+            if (pix != NULL)
+            {
+                glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+            }
+            m->readback[oldest].state = READBACK_FREE;
+        }
+    }
+}
+
+static void read_back_async(struct openuvr_managed *m)
+{
+    GLint bound_pbo;
+    glGetIntegerv(GL_PIXEL_PACK_BUFFER_BINDING, &bound_pbo);
+
+    int tag;
+    while ((tag = openuvr_reclaim_frame(m->ctx)) >= 0)
+    {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, m->readback[tag].pbo);
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        m->readback[tag].state = READBACK_FREE;
+    }
+    publish_readbacks(m);
+
+    int next = -1;
+    for (int i = 0; i < NUM_READBACK_PBOS && next < 0; i++)
+    {
+        if (m->readback[i].state == READBACK_FREE)
+        {
+            next = i;
+        }
+    }
+    if (next < 0)
+    {
+        m->readbacks_skipped++;
+    }
+    else
+    {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, m->readback[next].pbo);
+        glReadPixels(0, 0, m->frame_width, m->frame_height, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+        m->readback[next].fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        m->readback[next].seq = m->readback_seq++;
+        m->readback[next].state = READBACK_PENDING;
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, bound_pbo);
+}
+
 #ifdef TIME_COPY
 float avg_copy_time = 0;
 #endif
 void openuvr_managed_copy_framebuffer()
 {
+    if (default_managed != NULL)
+    {
+        openuvr_managed_copy(default_managed);
+    }
+}
+
+void openuvr_managed_copy(struct openuvr_managed *m)
+{
+    struct openuvr_context *ctx = m->ctx;
 #ifdef TIME_COPY
     struct timeval start, end;
     gettimeofday(&start, NULL);
 #endif
+    struct timespec copy_start, copy_end;
+    clock_gettime(CLOCK_MONOTONIC, &copy_start);
     GLuint bound_pbo;
     glGetIntegerv(GL_PIXEL_PACK_BUFFER_BINDING, (GLint *)&bound_pbo);
-    if (pbo != 0)
+    if (m->pbo != 0)
     {
-        if (bound_pbo != pbo)
+        if (bound_pbo != m->pbo)
         {
-            glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo);
-            glBufferData(GL_PIXEL_PACK_BUFFER, 1920 * 1080 * 4, 0, GL_DYNAMIC_COPY);
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, m->pbo);
+            glBufferData(GL_PIXEL_PACK_BUFFER, m->frame_width * m->frame_height * 4, 0, GL_DYNAMIC_COPY);
         }
 
         glReadBuffer(GL_BACK);
-        glReadPixels(0, 0, 1920, 1080, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+        glReadPixels(0, 0, m->frame_width, m->frame_height, GL_RGBA, GL_UNSIGNED_BYTE, 0);
 
 //To enable SSIM measurement, compile with "make MODE_MEASURE_SSIM=1"
 #ifdef MEASURE_SSIM
-        if (num_intermediary_frames > 0)
+        if (m->num_intermediary_frames > 0)
         {
-            num_intermediary_frames--;
+            m->num_intermediary_frames--;
             return;
         }
 
-        uint8_t *pix = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, 1920 * 1080 * 4, GL_MAP_READ_BIT);
-        memcpy(saved_frames[cur_frame], pix, 1920 * 1080 * 4);
+        uint8_t *pix = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, m->frame_width * m->frame_height * 4, GL_MAP_READ_BIT);
+        memcpy(m->saved_frames[m->cur_frame], pix, m->frame_width * m->frame_height * 4);
         glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
 
-        if (cur_frame == NUM_SAVED_FRAMES - 1)
+        if (m->cur_frame == NUM_SAVED_FRAMES - 1)
         {
             for (int i = 0; i < NUM_SAVED_FRAMES; i++)
             {
-                sws_scale(swsctx, &saved_frames[i], srcstride, 0, 1080, frame->data, frame->linesize);
-                py_ssim_set_ref_image_data(frame->data[0]);
+                sws_scale(m->swsctx, &m->saved_frames[i], m->srcstride, 0, m->frame_height, m->frame->data, m->frame->linesize);
+                py_ssim_set_ref_image_data(m->frame->data[0]);
 
-                uint8_t *pix = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, 1920 * 1080 * 4, GL_MAP_WRITE_BIT);
-                memcpy(pix, saved_frames[i], 1920 * 1080 * 4);
+                uint8_t *pix = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, m->frame_width * m->frame_height * 4, GL_MAP_WRITE_BIT);
+                memcpy(pix, m->saved_frames[i], m->frame_width * m->frame_height * 4);
                 glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
                 openuvr_cuda_copy(ctx);
 
                 openuvr_send_frame(ctx);
             }
-            cur_frame = 0;
-            num_intermediary_frames = NUM_SAVED_FRAMES * 6;
+            m->cur_frame = 0;
+            m->num_intermediary_frames = NUM_SAVED_FRAMES * 6;
         }
         else
         {
-            cur_frame++;
+            m->cur_frame++;
         }
 
 #endif
     }
-    else if (cpu_encoding_buf != 0)
+    else if (m->cpu_encoding_buf != 0)
     {
-        glReadPixels(0, 0, 1920, 1080, GL_RGBA, GL_UNSIGNED_BYTE, cpu_encoding_buf);
+#ifndef MEASURE_SSIM
+        if (m->async_readback)
+        {
+            read_back_async(m);
+        }
+        else
+        {
+            // read straight into the frame the encoder takes next and wake it up
+            uint8_t *dst = openuvr_get_frame_buffer(ctx);
+            if (dst != NULL)
+            {
+                glReadPixels(0, 0, m->frame_width, m->frame_height, GL_RGBA, GL_UNSIGNED_BYTE, dst);
+                openuvr_publish_frame(ctx, dst);
+            }
+        }
+#else
+        glReadPixels(0, 0, m->frame_width, m->frame_height, GL_RGBA, GL_UNSIGNED_BYTE, m->cpu_encoding_buf);
 
 //To enable SSIM measurement, compile with "make MODE_MEASURE_SSIM=1"
-#ifdef MEASURE_SSIM
-        if (num_intermediary_frames > 0)
+        if (m->num_intermediary_frames > 0)
         {
-            num_intermediary_frames--;
+            m->num_intermediary_frames--;
             return;
         }
 
-        memcpy(saved_frames[cur_frame], cpu_encoding_buf, 1920 * 1080 * 4);
+        memcpy(m->saved_frames[m->cur_frame], m->cpu_encoding_buf, m->frame_width * m->frame_height * 4);
 
-        if (cur_frame == NUM_SAVED_FRAMES - 1)
+        if (m->cur_frame == NUM_SAVED_FRAMES - 1)
         {
             for (int i = 0; i < NUM_SAVED_FRAMES; i++)
             {
-                sws_scale(swsctx, &saved_frames[i], srcstride, 0, 1080, frame->data, frame->linesize);
-                py_ssim_set_ref_image_data(frame->data[0]);
+                sws_scale(m->swsctx, &m->saved_frames[i], m->srcstride, 0, m->frame_height, m->frame->data, m->frame->linesize);
+                py_ssim_set_ref_image_data(m->frame->data[0]);
 
-                memcpy(cpu_encoding_buf, saved_frames[i], 1920 * 1080 * 4);
+                memcpy(m->cpu_encoding_buf, m->saved_frames[i], m->frame_width * m->frame_height * 4);
                 openuvr_send_frame(ctx);
             }
-            cur_frame = 0;
-            num_intermediary_frames = NUM_SAVED_FRAMES * 6;
+            m->cur_frame = 0;
+            m->num_intermediary_frames = NUM_SAVED_FRAMES * 6;
         }
         else
         {
-            cur_frame++;
+            m->cur_frame++;
         }
 #endif
     }
+    clock_gettime(CLOCK_MONOTONIC, &copy_end);
+    long copy_usec = (copy_end.tv_sec - copy_start.tv_sec) * 1000000 + (copy_end.tv_nsec - copy_start.tv_nsec) / 1000;
+    m->avg_game_copy_usec = 0.95 * m->avg_game_copy_usec + 0.05 * copy_usec;
 #ifdef TIME_COPY
     gettimeofday(&end, NULL);
     int elapsed = end.tv_usec - start.tv_usec + (end.tv_sec > start.tv_sec ? 1000000 : 0);
@@ -30,16 +30,83 @@
 */
 
 #include "ouvr_packet.h"
+#include "packet_pool.h"
 #include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
 
-struct ouvr_packet *ouvr_packet_alloc() {
+struct ouvr_packet *ouvr_packet_alloc(struct ouvr_packet_pool *pool) {
     struct ouvr_packet *pkt = malloc(sizeof(struct ouvr_packet));
-    pkt->data = malloc(10000000);
+    if (pkt == NULL)
+    {
+        return NULL;
+    }
+    pkt->data = ouvr_packet_pool_get(pool, 0, &pkt->capacity);
+    if (pkt->data == NULL)
+    {
+        PRINT_ERR("Packet pool exhausted\n");
+        free(pkt);
+        return NULL;
+    }
+    pkt->pool = pool;
+    atomic_init(&pkt->refs, 1);
     pkt->size = 0;
+    pkt->flags = OUVR_PACKET_FLAG_END_OF_FRAME;
+    pkt->frame_id = 0;
+    memset(&pkt->info, 0, sizeof(pkt->info));
+    return pkt;
+}
+
+struct ouvr_packet *ouvr_packet_ref(struct ouvr_packet *pkt) {
+    atomic_fetch_add_explicit(&pkt->refs, 1, memory_order_relaxed);
     return pkt;
 }
 
 void ouvr_packet_free(struct ouvr_packet *pkt) {
-    free(pkt->data);
+    if (pkt == NULL || atomic_fetch_sub_explicit(&pkt->refs, 1, memory_order_acq_rel) != 1)
+    {
+        return;
+    }
+    ouvr_packet_pool_put(pkt->pool, pkt->data);
     free(pkt);
+}
+
+int ouvr_packet_reserve(struct ouvr_packet *pkt, int size) {
+    if (size <= pkt->capacity)
+    {
+        return 0;
+    }
+    int capacity;
+    uint8_t *data = ouvr_packet_pool_get(pkt->pool, size, &capacity);
+    if (data == NULL)
+    {
+        PRINT_ERR("No buffer for a %d byte packet\n", size);
+        return -1;
+    }
+    memcpy(data, pkt->data, pkt->size);
+    ouvr_packet_pool_put(pkt->pool, pkt->data);
+    pkt->data = data;
+    pkt->capacity = capacity;
+    return 0;
+}
+
+void ouvr_packet_fill_header(struct ouvr_packet *pkt, ouvr_packet_header *hdr) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    // callers pass a header on the stack, padding and the fields of unpacked frames must not go out as it was
+    memset(hdr, 0, sizeof(*hdr));
+    hdr->size = pkt->size;
+    hdr->flags = pkt->flags;
+    hdr->frame_id = pkt->frame_id;
+    if (pkt->info.foveated)
+    {
+        hdr->flags |= OUVR_PACKET_FLAG_FOVEATED;
+        hdr->fovea = pkt->info.fovea;
+    }
+    // the receiver shows the view, whatever the encoder made of it
+    hdr->frame_width = pkt->info.width;
+    hdr->frame_height = pkt->info.height;
+    hdr->frame_rate = pkt->info.fps;
+    hdr->send_time.sec = tv.tv_sec;
+    hdr->send_time.usec = tv.tv_usec;
 }
\ No newline at end of file
@@ -36,18 +36,32 @@ struct ouvr_network;
 struct ouvr_encoder;
 struct ouvr_audio;
 struct ouvr_ctx;
+struct ouvr_foveation;
+struct ouvr_resolution_ladder;
+struct ouvr_encode_budget;
+struct ouvr_frame_pacer;
+struct ouvr_shm_source;
+struct ouvr_threads;
+struct ouvr_packet_pool;
 
 // #define SERVER_IP "172.16.38.214"
 // #define CLIENT_IP "172.16.44.23"
 
+// both can be given to make, LOOPBACK=1 runs the sender and the receiver on one machine
+#ifndef SERVER_IP
 #define SERVER_IP "10.0.0.247"
+#endif
+#ifndef CLIENT_IP
 // #define CLIENT_IP "10.0.0.250" // raspi eth0
 #define CLIENT_IP "10.0.1.32" //raspi wlan0
+#endif
 // #define SERVER_IP "192.168.1.2"
 //#define CLIENT_IP "192.168.1.3"
 
 #include <stdio.h>
 #include <stdint.h>
+#include <pthread.h>
+#include <stdatomic.h>
 
 #define PRINT_ERR(format, ...) fprintf(stderr, "\33[31;4mOpenUVR Error:%s:%d:\033[24m " format "\033[0m", __FILE__, __LINE__, ##__VA_ARGS__)
 
@@ -59,28 +73,135 @@ typedef struct timevalue
     int32_t usec;
 } timevalue;
 
+// set on the last packet of a frame; encoders that stream slices send several packets per frame
+#define OUVR_PACKET_FLAG_END_OF_FRAME 0x1
+// the frame is identical to the previous one, the packet carries no data and the receiver keeps showing what it has
+#define OUVR_PACKET_FLAG_REPEAT 0x2
+// the picture is packed by the sender's foveated_pack, with the foveae taken from the positions in the header.
+// It is OUVR_FOVEATED_PACKED_WIDTH() of the frame_width in the header wide
+#define OUVR_PACKET_FLAG_FOVEATED 0x4
+#define OUVR_FOVEATED_PACKED_WIDTH(width) ((width) / 2)
+// the packet belongs to the right eye's stream of a frame sent by the stereo encoder, which encodes each eye separately
+#define OUVR_PACKET_FLAG_RIGHT_EYE 0x8
+// the packet belongs to a frame the decoder can start from, set by the encoders that know it
+#define OUVR_PACKET_FLAG_KEYFRAME 0x10
+
+// top left corner of each eye's full resolution fovea, relative to the eye's view
+typedef struct ouvr_fovea_position
+{
+    uint16_t num_eyes;
+    uint16_t left[2];
+    uint16_t top[2];
+} ouvr_fovea_position;
+
+// what a frame is sent as, taken by openuvr_send_frame() once it knows. The header of each packet is filled in from
+// its own copy, the ctx fields it comes from are changed for the next frame while this one is still being sent
+typedef struct ouvr_frame_info
+{
+    uint16_t width;
+    uint16_t height;
+    uint16_t fps;
+    // packed by foveated_pack, with the foveae taken from fovea
+    int foveated;
+    ouvr_fovea_position fovea;
+} ouvr_frame_info;
+
+// sent in front of every datagram (udp, raw) or every packet (tcp)
+typedef struct ouvr_packet_header
+{
+    int32_t size;
+    uint32_t flags;
+    uint32_t frame_id;
+    timevalue send_time;
+    ouvr_fovea_position fovea;
+    // geometry and frame rate of the session, so the receiver can follow changes without being restarted
+    uint16_t frame_width;
+    uint16_t frame_height;
+    uint16_t frame_rate;
+} ouvr_packet_header;
+
+// sent by the receiver on the feedback socket. Besides asking for an i-frame, it tells the sender the largest
+// picture and the highest frame rate the receiver's display can show, 0 when it doesn't know
+typedef struct ouvr_feedback_msg
+{
+    int32_t send_iframe;
+    uint16_t max_width;
+    uint16_t max_height;
+    uint16_t max_fps;
+} ouvr_feedback_msg;
+
 struct ouvr_packet
 {
     uint8_t *data;
     int size;
+    uint32_t flags;
+    uint32_t frame_id;
+    // what data can hold, writers that may need more call ouvr_packet_reserve() first. Packets made up on the stack
+    // to point at an encoder's own buffer have no pool and must not be reserved or freed
+    int capacity;
+    struct ouvr_packet_pool *pool;
+    atomic_int refs;
+    ouvr_frame_info info;
 };
 
-struct ouvr_packet *ouvr_packet_alloc();
+// the largest packet there can be
+#define OUVR_PACKET_CAPACITY 10000000
+
+// a packet with a small buffer from pool, NULL if the pool is exhausted
+struct ouvr_packet *ouvr_packet_alloc(struct ouvr_packet_pool *pool);
+// another reference to pkt for a stage that holds on to it, each one is dropped by ouvr_packet_free()
+struct ouvr_packet *ouvr_packet_ref(struct ouvr_packet *pkt);
 void ouvr_packet_free(struct ouvr_packet *pkt);
+// makes room for size bytes of data, moving the first pkt->size bytes to a larger buffer if needed. Returns -1 when
+// size is above OUVR_PACKET_CAPACITY or the pool is at its cap, pkt keeps the buffer it had
+int ouvr_packet_reserve(struct ouvr_packet *pkt, int size);
+// fills hdr for pkt from what its frame was sent as
+void ouvr_packet_fill_header(struct ouvr_packet *pkt, ouvr_packet_header *hdr);
 
 struct ouvr_network
 {
     int (*init)(struct ouvr_ctx *ctx);
     int (*send_packet)(struct ouvr_ctx *ctx, struct ouvr_packet *pkt);
     void (*deinit)(struct ouvr_ctx *ctx);
+    // optional, replaces the feedback socket for handlers that talk to several receivers. Called before every frame
+    void (*receive_feedback)(struct ouvr_ctx *ctx);
+};
+
+// process_frame() returns 0 when it must be called again, 1 when pkt holds an encoded frame,
+// OUVR_FRAME_STREAMED when the encoder already passed the frame to ctx->net slice by slice, and < 0 on error
+#define OUVR_FRAME_STREAMED 2
+
+// encoder settings that can be changed while streaming. 0, or an empty preset, keeps the encoder's own default
+struct ouvr_encoder_params
+{
+    // for the whole frame, encoders made of several streams share it out
+    int bitrate_kbps;
+    // frames from one keyframe to the next
+    int gop;
+    char preset[16];
+    // override the preset's subpel refinement and reference count
+    int subme;
+    int refs;
 };
 
+// which members of ouvr_encoder_params reconfigure() has to look at
+#define OUVR_PARAM_BITRATE 0x1
+#define OUVR_PARAM_GOP 0x2
+#define OUVR_PARAM_PRESET 0x4
+#define OUVR_PARAM_ANALYSIS 0x8
+
 struct ouvr_encoder
 {
     int (*init)(struct ouvr_ctx *ctx);
     int (*process_frame)(struct ouvr_ctx *ctx, struct ouvr_packet *pkt);
     void (*cuda_copy)(struct ouvr_ctx *ctx);
     void (*deinit)(struct ouvr_ctx *ctx);
+    // applies the members of ctx->enc_params flagged in changed, between two frames and without reopening the codec.
+    // Optional for encoders that have none of them. Returns -1 if some could not be applied, the encoder carries on
+    // with what it had
+    int (*reconfigure)(struct ouvr_ctx *ctx, unsigned int changed);
+    // the receivers of this encoder's packets can undo foveated_pack, see openuvr_set_foveated_packing()
+    int unpacks_foveated;
 };
 
 struct ouvr_audio
@@ -98,12 +219,85 @@ struct ouvr_ctx
     void *enc_priv;
     //pointer to private data used by feedback_net
     void *fbn_priv;
+    //pointer to private data used by input_recv
+    void *input_priv;
+    // the receiver the handlers send to, CLIENT_IP unless the context was allocated for another one
+    char client_ip[16];
     uint8_t *pix_buf;
     unsigned int pbo_handle;
+    // geometry of the frames in pix_buf and the rate they are sent at, fixed when the context is allocated.
+    // requested_fps is what the caller asked for, fps is that clamped to what the receiver reported it can show
+    int width;
+    int height;
+    // size of the frames sent, smaller than width x height while the resolution ladder has scaled them down
+    int view_width;
+    int view_height;
+    // what the encoder is set up for and reads from pix_buf while process_frame runs. The view size, or the packed
+    // size when enc_packed is set
+    int enc_width;
+    int enc_height;
+    int enc_packed;
+    int requested_fps;
+    int fps;
+    // largest picture and highest rate the receiver reported, 0 until it does
+    int receiver_width;
+    int receiver_height;
+    int receiver_fps;
     struct ouvr_audio *aud;
     void *aud_priv;
     struct ouvr_packet *packet;
     int flag_send_iframe;
+    // id of the frame currently being encoded, carried in every packet header
+    uint32_t frame_id;
+
+    // static frame detection done by openuvr_send_frame()
+    int detect_static_frames;
+    uint32_t last_frame_hash;
+    int frames_since_keepalive;
+    uint64_t frames_encoded;
+    uint64_t frames_suppressed;
+
+    // fovea position and profile for the encoders that vary quality across the frame
+    struct ouvr_foveation *fov;
+    // frames are packed by foveated_pack into packed_buf before being encoded, fovea is where the foveae came from.
+    // foveated_packing is latched from request_foveated_packing at the start of each frame
+    int request_foveated_packing;
+    int foveated_packing;
+    uint8_t *packed_buf;
+    ouvr_fovea_position fovea;
+    // the frame being encoded, for the encoders that make up their own packets to send
+    ouvr_frame_info frame_info;
+
+    // held around every ctx->net->send_packet() call. Encoders that stream their slices send from their own threads,
+    // and the pipelined sender from its send stage
+    pthread_mutex_t send_lock;
+
+    // set by the openuvr_set_*() encoder controls from any thread and picked up by openuvr_send_frame() before the
+    // next frame, which copies them into enc_params. init() reads enc_params too, so they survive the encoder being
+    // set up again
+    pthread_mutex_t params_lock;
+    struct ouvr_encoder_params requested_params;
+    unsigned int pending_params;
+    int keyframe_requested;
+    struct ouvr_encoder_params enc_params;
+
+    // dynamic resolution, off unless the caller turns it on. overloaded is set by the caller on top of what
+    // openuvr_send_frame() measures itself, last_encode_usec is how long the previous frame took to scale and encode
+    int dynamic_resolution;
+    int overloaded;
+    struct ouvr_resolution_ladder *ladder;
+    long last_encode_usec;
+    uint64_t resolution_changes;
+    // steps the x264 speed settings to keep last_encode_usec under a deadline, off unless the caller sets one
+    struct ouvr_encode_budget *budget;
+    // schedules the ticks of the send loops
+    struct ouvr_frame_pacer *pacer;
+    // frames come from a producer process through shared memory, pix_buf then points into the region
+    struct ouvr_shm_source *shm;
+    // every thread of the session by stage, placed as configured through openuvr_set_thread_config()
+    struct ouvr_threads *threads;
+    // where every packet of the session gets its buffer
+    struct ouvr_packet_pool *pool;
 
     //contains variables for use in the main loops found in openuvr.c
     void *main_priv;
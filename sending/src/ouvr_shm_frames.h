@@ -0,0 +1,83 @@
+/*
+    The MIT License (MIT)
+
+    Copyright (c) 2020 OpenUVR
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+
+    Authors:
+    Alec Rohloff
+    Zackary Allen
+    Kung-Min Lin
+    Chengyi Nie
+    Hung-Wei Tseng
+*/
+
+#ifndef OUVR_SHM_FRAMES_H
+#define OUVR_SHM_FRAMES_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+
+// layout of the shared region between a frame producer (see ouvr_shm_producer.h) and the sender. The header sits
+// at the start of the region and is followed by OUVR_SHM_BUFFERS frames of height rows of stride bytes, each starting
+// on a page boundary. Frames are RGBA with stride == width * 4, the layout the encoders read pix_buf in.
+#define OUVR_SHM_MAGIC 0x5256554fu // "OUVR"
+#define OUVR_SHM_VERSION 1
+// one frame the sender is encoding, one holding the newest complete frame and one the producer is drawing into
+#define OUVR_SHM_BUFFERS 3
+// value of latest and reading when they name no buffer
+#define OUVR_SHM_NONE 0xffffffffu
+
+typedef struct ouvr_shm_frame_info
+{
+    // odd while the producer writes the buffer, bumped to even once it is complete. The sender compares it before
+    // and after encoding to tell if the frame was torn
+    _Atomic uint32_t seq;
+    uint32_t pad;
+    // CLOCK_MONOTONIC nanoseconds the game presented the frame at
+    int64_t present_ns;
+    // counts every frame the producer finished, the gaps are the frames the sender never picked up
+    uint64_t frame_number;
+} ouvr_shm_frame_info;
+
+typedef struct ouvr_shm_header
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t width;
+    uint32_t height;
+    uint32_t stride;
+    uint32_t pad;
+    uint64_t buffer_size;
+    uint64_t buffer_offset[OUVR_SHM_BUFFERS];
+
+    // the newest complete buffer, written by the producer only
+    _Atomic uint32_t latest;
+    // the buffer the sender is encoding from, written by the sender only. The producer never draws into latest or
+    // reading, so with three buffers there is always one left for it
+    _Atomic uint32_t reading;
+    // bumped after every frame, the sender sleeps on it as a futex
+    _Atomic uint32_t published;
+    uint32_t pad2;
+
+    ouvr_shm_frame_info frames[OUVR_SHM_BUFFERS];
+} ouvr_shm_header;
+
+#endif
@@ -0,0 +1,186 @@
+/*
+    The MIT License (MIT)
+
+    Copyright (c) 2020 OpenUVR
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+
+    Authors:
+    Alec Rohloff
+    Zackary Allen
+    Kung-Min Lin
+    Chengyi Nie
+    Hung-Wei Tseng
+*/
+/**
+ * Producer side of the shared-memory frame source. The producer always draws into the one buffer that is neither the
+ * newest complete frame nor the one the sender is reading, so it never waits for the sender and the sender never
+ * sees a half-written frame. Each buffer also carries a sequence count that is odd while it is written, which lets
+ * the sender detect a frame torn anyway, e.g. by a producer restarted under it.
+ */
+#include "ouvr_shm_producer.h"
+#include "ouvr_shm_frames.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+struct ouvr_shm_producer
+{
+    char name[NAME_MAX];
+    ouvr_shm_header *hdr;
+    size_t size;
+    // the buffer between begin_frame and end_frame, OUVR_SHM_NONE otherwise
+    uint32_t writing;
+    uint64_t frame_number;
+};
+
+static size_t page_align(size_t size)
+{
+    size_t page = sysconf(_SC_PAGESIZE);
+    return (size + page - 1) / page * page;
+}
+
+struct ouvr_shm_producer *ouvr_shm_producer_create(const char *name, int width, int height)
+{
+    if (width <= 0 || height <= 0 || width % 2 || height % 2)
+    {
+        fprintf(stderr, "ouvr_shm_producer: invalid frame size %dx%d, both dimensions must be even\n", width, height);
+        return NULL;
+    }
+    struct ouvr_shm_producer *p = calloc(1, sizeof(struct ouvr_shm_producer));
+    snprintf(p->name, sizeof(p->name), "/%s", name);
+    // a sender still mapping the old region keeps it alive, but won't see this one
+    shm_unlink(p->name);
+    int fd = shm_open(p->name, O_CREAT | O_EXCL | O_RDWR, 0666);
+    if (fd < 0)
+    {
+        perror("ouvr_shm_producer: shm_open");
+        free(p);
+        return NULL;
+    }
+
+    size_t stride = (size_t)width * 4;
+    size_t header_size = page_align(sizeof(ouvr_shm_header));
+    size_t buffer_size = page_align(stride * height);
+    p->size = header_size + OUVR_SHM_BUFFERS * buffer_size;
+    if (ftruncate(fd, p->size) != 0)
+    {
+        perror("ouvr_shm_producer: ftruncate");
+        goto err;
+    }
+    p->hdr = mmap(NULL, p->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (p->hdr == MAP_FAILED)
+    {
+        perror("ouvr_shm_producer: mmap");
+        goto err;
+    }
+    close(fd);
+
+    ouvr_shm_header *hdr = p->hdr;
+    hdr->version = OUVR_SHM_VERSION;
+    hdr->width = width;
+    hdr->height = height;
+    hdr->stride = stride;
+    hdr->buffer_size = buffer_size;
+    for (int i = 0; i < OUVR_SHM_BUFFERS; i++)
+    {
+        hdr->buffer_offset[i] = header_size + i * buffer_size;
+        atomic_init(&hdr->frames[i].seq, 0);
+    }
+    atomic_init(&hdr->latest, OUVR_SHM_NONE);
+    atomic_init(&hdr->reading, OUVR_SHM_NONE);
+    atomic_init(&hdr->published, 0);
+    p->writing = OUVR_SHM_NONE;
+    // last, a sender that opens the region before this only sees a bad magic
+    atomic_thread_fence(memory_order_release);
+    hdr->magic = OUVR_SHM_MAGIC;
+    return p;
+
+err:
+    close(fd);
+    shm_unlink(p->name);
+    free(p);
+    return NULL;
+}
+
+uint8_t *ouvr_shm_producer_begin_frame(struct ouvr_shm_producer *p)
+{
+    if (p->writing != OUVR_SHM_NONE)
+    {
+        return NULL;
+    }
+    ouvr_shm_header *hdr = p->hdr;
+    uint32_t latest = atomic_load(&hdr->latest);
+    uint32_t reading = atomic_load(&hdr->reading);
+    uint32_t b = 0;
+    while (b == latest || b == reading)
+    {
+        b++;
+    }
+    p->writing = b;
+    // odd, the frame is being written
+    atomic_fetch_add(&hdr->frames[b].seq, 1);
+    return (uint8_t *)hdr + hdr->buffer_offset[b];
+}
+
+int ouvr_shm_producer_end_frame(struct ouvr_shm_producer *p, int64_t present_ns)
+{
+    uint32_t b = p->writing;
+    if (b == OUVR_SHM_NONE)
+    {
+        return -1;
+    }
+    if (present_ns == 0)
+    {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        present_ns = now.tv_sec * 1000000000LL + now.tv_nsec;
+    }
+    ouvr_shm_header *hdr = p->hdr;
+    hdr->frames[b].present_ns = present_ns;
+    hdr->frames[b].frame_number = ++p->frame_number;
+    // even again, the pixel writes before it are visible to a sender that sees it
+    atomic_fetch_add(&hdr->frames[b].seq, 1);
+    atomic_store(&hdr->latest, b);
+    atomic_fetch_add(&hdr->published, 1);
+    // not FUTEX_PRIVATE_FLAG, the sender waits from another process
+    syscall(SYS_futex, &hdr->published, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+    p->writing = OUVR_SHM_NONE;
+    return 0;
+}
+
+void ouvr_shm_producer_destroy(struct ouvr_shm_producer *p)
+{
+    if (p == NULL)
+    {
+        return;
+    }
+    munmap(p->hdr, p->size);
+    shm_unlink(p->name);
+    free(p);
+}
@@ -0,0 +1,61 @@
+/*
+    The MIT License (MIT)
+
+    Copyright (c) 2020 OpenUVR
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+
+    Authors:
+    Alec Rohloff
+    Zackary Allen
+    Kung-Min Lin
+    Chengyi Nie
+    Hung-Wei Tseng
+*/
+
+#ifndef OUVR_SHM_PRODUCER_H
+#define OUVR_SHM_PRODUCER_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// writes frames into a shared region the sender picks them up from (openuvr_alloc_context_shm()), for engines and
+// tools that can't link libopenuvr.so. Link against libouvr_shm_producer.a, it only depends on librt.
+struct ouvr_shm_producer;
+
+// creates the region /dev/shm/<name> for width x height RGBA frames, replacing any left over from a previous run.
+// Returns NULL on failure
+struct ouvr_shm_producer *ouvr_shm_producer_create(const char *name, int width, int height);
+// a buffer of height rows of width * 4 bytes to draw the next frame into. Nothing of the previous frames is left in
+// it, so the whole frame has to be written. Returns NULL if the frame before wasn't ended
+uint8_t *ouvr_shm_producer_begin_frame(struct ouvr_shm_producer *p);
+// publishes the frame from ouvr_shm_producer_begin_frame() as the newest one and wakes the sender. present_ns is
+// when the game presented it on CLOCK_MONOTONIC, 0 for now
+int ouvr_shm_producer_end_frame(struct ouvr_shm_producer *p, int64_t present_ns);
+// unlinks the region, a sender still mapping it keeps encoding the last frame until it is closed
+void ouvr_shm_producer_destroy(struct ouvr_shm_producer *p);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,181 @@
+/*
+    The MIT License (MIT)
+
+    Copyright (c) 2020 OpenUVR
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+
+    Authors:
+    Alec Rohloff
+    Zackary Allen
+    Kung-Min Lin
+    Chengyi Nie
+    Hung-Wei Tseng
+*/
+/**
+ * Sender side of the shared-memory frame source. Acquiring a frame marks its buffer as being read before checking
+ * that it is still the newest one, so the producer either hasn't moved on yet and will keep away from it, or has and
+ * the acquire retries on the new frame. Nothing is copied, the encoder reads the shared buffer as pix_buf.
+ */
+#include "ouvr_shm_source.h"
+#include "ouvr_packet.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+struct ouvr_shm_source *ouvr_shm_source_open(const char *name)
+{
+    char path[256];
+    snprintf(path, sizeof(path), "/%s", name);
+    int fd = shm_open(path, O_RDWR, 0);
+    if (fd < 0)
+    {
+        PRINT_ERR("Couldn't open shared frames %s: %s\n", path, strerror(errno));
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(ouvr_shm_header))
+    {
+        PRINT_ERR("Shared frames %s are too small\n", path);
+        close(fd);
+        return NULL;
+    }
+    ouvr_shm_header *hdr = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (hdr == MAP_FAILED)
+    {
+        PRINT_ERR("Couldn't map shared frames %s: %s\n", path, strerror(errno));
+        return NULL;
+    }
+    uint64_t frame_size = (uint64_t)hdr->stride * hdr->height;
+    if (hdr->magic != OUVR_SHM_MAGIC || hdr->version != OUVR_SHM_VERSION || hdr->stride != hdr->width * 4 || hdr->buffer_size < frame_size ||
+        hdr->buffer_offset[OUVR_SHM_BUFFERS - 1] + frame_size > (uint64_t)st.st_size)
+    {
+        PRINT_ERR("Shared frames %s aren't in a format this sender understands\n", path);
+        munmap(hdr, st.st_size);
+        return NULL;
+    }
+
+    ouvr_shm_source *s = calloc(1, sizeof(ouvr_shm_source));
+    s->hdr = hdr;
+    s->size = st.st_size;
+    s->width = hdr->width;
+    s->height = hdr->height;
+    s->seen_published = atomic_load(&hdr->published) - 1;
+    s->acquired = OUVR_SHM_NONE;
+    // a sender that crashed mid-frame may have left it set
+    atomic_store(&hdr->reading, OUVR_SHM_NONE);
+    return s;
+}
+
+void ouvr_shm_source_close(struct ouvr_shm_source *s)
+{
+    if (s == NULL)
+    {
+        return;
+    }
+    if (s->acquired != OUVR_SHM_NONE)
+    {
+        ouvr_shm_source_release(s);
+    }
+    munmap(s->hdr, s->size);
+    free(s);
+}
+
+int ouvr_shm_source_wait(struct ouvr_shm_source *s, int timeout_ms)
+{
+    uint32_t published = atomic_load(&s->hdr->published);
+    if (published != s->seen_published)
+    {
+        return 1;
+    }
+    struct timespec timeout = {timeout_ms / 1000, (timeout_ms % 1000) * 1000000L};
+    // returns straight away if the producer published in between, the futex only sleeps while published is unchanged
+    syscall(SYS_futex, &s->hdr->published, FUTEX_WAIT, published, &timeout, NULL, 0);
+    return atomic_load(&s->hdr->published) != s->seen_published;
+}
+
+const uint8_t *ouvr_shm_source_acquire(struct ouvr_shm_source *s)
+{
+    ouvr_shm_header *hdr = s->hdr;
+    uint32_t published, latest, seq;
+    do
+    {
+        published = atomic_load(&hdr->published);
+        latest = atomic_load(&hdr->latest);
+        if (latest >= OUVR_SHM_BUFFERS)
+        {
+            return NULL;
+        }
+        atomic_store(&hdr->reading, latest);
+        seq = atomic_load(&hdr->frames[latest].seq);
+        // if latest moved on before reading was set the producer may already be drawing into the buffer
+    } while (atomic_load(&hdr->latest) != latest || seq % 2);
+
+    uint64_t frame_number = hdr->frames[latest].frame_number;
+    if (frame_number <= s->last_frame_number)
+    {
+        atomic_store(&hdr->reading, OUVR_SHM_NONE);
+        s->seen_published = published;
+        return NULL;
+    }
+    if (s->last_frame_number != 0)
+    {
+        atomic_fetch_add(&s->frames_skipped, frame_number - s->last_frame_number - 1);
+    }
+    s->last_frame_number = frame_number;
+    s->seen_published = published;
+    s->acquired = latest;
+    s->acquired_seq = seq;
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    int64_t now_ns = now.tv_sec * 1000000000LL + now.tv_nsec;
+    atomic_store(&s->present_to_acquire_usec, (long)((now_ns - hdr->frames[latest].present_ns) / 1000));
+    return (const uint8_t *)hdr + hdr->buffer_offset[latest];
+}
+
+int ouvr_shm_source_release(struct ouvr_shm_source *s)
+{
+    ouvr_shm_header *hdr = s->hdr;
+    if (s->acquired == OUVR_SHM_NONE)
+    {
+        return 0;
+    }
+    // the encoder's reads of the frame come before the check
+    atomic_thread_fence(memory_order_acquire);
+    int torn = atomic_load(&hdr->frames[s->acquired].seq) != s->acquired_seq;
+    atomic_store(&hdr->reading, OUVR_SHM_NONE);
+    s->acquired = OUVR_SHM_NONE;
+    if (torn)
+    {
+        atomic_fetch_add(&s->frames_torn, 1);
+        return -1;
+    }
+    return 0;
+}
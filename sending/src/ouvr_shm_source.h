@@ -0,0 +1,74 @@
+/*
+    The MIT License (MIT)
+
+    Copyright (c) 2020 OpenUVR
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+
+    Authors:
+    Alec Rohloff
+    Zackary Allen
+    Kung-Min Lin
+    Chengyi Nie
+    Hung-Wei Tseng
+*/
+
+#ifndef OUVR_SHM_SOURCE_H
+#define OUVR_SHM_SOURCE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+#include "ouvr_shm_frames.h"
+
+// the sender's end of a region written by ouvr_shm_producer. Frames are encoded straight from the shared buffers
+typedef struct ouvr_shm_source
+{
+    ouvr_shm_header *hdr;
+    size_t size;
+    int width;
+    int height;
+    // value of hdr->published when the last frame was acquired
+    uint32_t seen_published;
+    uint64_t last_frame_number;
+    // the buffer between acquire and release and its seq at acquire time, OUVR_SHM_NONE otherwise
+    uint32_t acquired;
+    uint32_t acquired_seq;
+
+    // frames finished by the producer that were never encoded, and frames found torn after encoding them
+    atomic_ullong frames_skipped;
+    atomic_ullong frames_torn;
+    // from the game presenting the last frame to it being acquired
+    atomic_long present_to_acquire_usec;
+} ouvr_shm_source;
+
+// maps the region /dev/shm/<name>, created by the producer beforehand. Returns NULL on failure
+struct ouvr_shm_source *ouvr_shm_source_open(const char *name);
+void ouvr_shm_source_close(struct ouvr_shm_source *s);
+// sleeps until the producer finishes a frame newer than the last one acquired, or timeout_ms passes. Returns 1 if
+// there is a new frame, 0 otherwise
+int ouvr_shm_source_wait(struct ouvr_shm_source *s, int timeout_ms);
+// the newest complete frame, which the producer leaves alone until ouvr_shm_source_release(). NULL if there is none
+// newer than the last one
+const uint8_t *ouvr_shm_source_acquire(struct ouvr_shm_source *s);
+// returns 0 if the frame stayed intact while it was acquired, -1 if it was torn
+int ouvr_shm_source_release(struct ouvr_shm_source *s);
+
+#endif
@@ -30,6 +30,7 @@
 */
 
 #include <stdio.h>
+#include <stdlib.h>
 
 #include <pulse/pulseaudio.h>
 #include <pulse/simple.h>
@@ -43,13 +44,17 @@ typedef struct pulse_audio_context
     pa_sample_spec ss;
 } pulse_audio_context;
 
-static pulse_audio_context pac;
-
 static int pulse_initialize(struct ouvr_ctx *ctx)
 {
-    pac.ss.format = PA_SAMPLE_S16LE;
-    pac.ss.channels = 2;
-    pac.ss.rate = 44100;
+    if (ctx->aud_priv != NULL)
+    {
+        free(ctx->aud_priv);
+    }
+    pulse_audio_context *pac = calloc(1, sizeof(pulse_audio_context));
+    ctx->aud_priv = pac;
+    pac->ss.format = PA_SAMPLE_S16LE;
+    pac->ss.channels = 2;
+    pac->ss.rate = 44100;
 
     
     return 0;
@@ -57,12 +62,13 @@ static int pulse_initialize(struct ouvr_ctx *ctx)
 
 static int pulse_process_frame(struct ouvr_ctx *ctx, struct ouvr_packet *pkt)
 {
-    pac.s = pa_simple_new(NULL,    // Use the default server.
+    pulse_audio_context *pac = ctx->aud_priv;
+    pac->s = pa_simple_new(NULL,    // Use the default server.
                           "thing", // Our application's name.
                           PA_STREAM_RECORD,
                           NULL,        // Use the default device.
                           "has stuff", // Description of our stream.
-                          &pac.ss,     // Our sample format.
+                          &pac->ss,    // Our sample format.
                           NULL,        // Use default channel map
                           NULL,        // Use default buffering attributes.
                           NULL         // Ignore error code.
@@ -70,7 +76,7 @@ static int pulse_process_frame(struct ouvr_ctx *ctx, struct ouvr_packet *pkt)
     
     int err = 17;
     printf("asdf\n");
-    int ret = pa_simple_read(pac.s, pkt->data, 1024, &err);
+    int ret = pa_simple_read(pac->s, pkt->data, 1024, &err);
     if (ret < 0)
     {
         PRINT_ERR("err: %d\n", err);
@@ -79,14 +85,15 @@ static int pulse_process_frame(struct ouvr_ctx *ctx, struct ouvr_packet *pkt)
     pkt->size = 4096;
     printf("fdsa\n");
 
-    pa_simple_free(pac.s);
+    pa_simple_free(pac->s);
 
     return 1;
 }
 
 static void pulse_deinitialize(struct ouvr_ctx *ctx)
 {
-    printf("TODO: implement pulse_deinitialize\n");
+    free(ctx->aud_priv);
+    ctx->aud_priv = NULL;
 }
 
 struct ouvr_audio pulse_audio = {
@@ -58,7 +58,7 @@ typedef struct raw_net_context
     int fd;
     struct sockaddr_ll raw_addr;
     struct msghdr msg;
-    struct iovec iov[4];
+    struct iovec iov[3];
 } raw_net_context;
 
 // MUD MAC + host MAC + 2 unchanged
@@ -106,7 +106,7 @@ static int raw_initialize(struct ouvr_ctx *ctx)
     c->msg.msg_control = 0;
     c->msg.msg_controllen = 0;
     c->msg.msg_iov = c->iov;
-    c->msg.msg_iovlen = 4;
+    c->msg.msg_iovlen = 3;
     return 0;
 }
 
@@ -116,19 +116,14 @@ static int raw_send_packet(struct ouvr_ctx *ctx, struct ouvr_packet *pkt)
     register ssize_t r;
     uint8_t *start_pos = pkt->data;
     int offset = 0;
-    struct timeval tv;
-    struct timevalue sending_tv;
-    gettimeofday(&tv, NULL);
-    sending_tv.sec = tv.tv_sec;
-    sending_tv.usec = tv.tv_usec;
-    c->iov[1].iov_len = sizeof(pkt->size);
-    c->iov[1].iov_base = &(pkt->size);
-    c->iov[2].iov_len = sizeof(sending_tv);
-    c->iov[2].iov_base = &(sending_tv);
-    c->iov[3].iov_len = SEND_SIZE;
-    while (offset < pkt->size)
+    ouvr_packet_header hdr;
+    ouvr_packet_fill_header(pkt, &hdr);
+    c->iov[1].iov_len = sizeof(hdr);
+    c->iov[1].iov_base = &hdr;
+    c->iov[2].iov_len = pkt->size < SEND_SIZE ? pkt->size : SEND_SIZE;
+    do
     {
-        c->iov[3].iov_base = start_pos + offset;
+        c->iov[2].iov_base = start_pos + offset;
         r = sendmsg(c->fd, &c->msg, 0);
         if (r < -1)
         {
@@ -140,10 +135,10 @@ static int raw_send_packet(struct ouvr_ctx *ctx, struct ouvr_packet *pkt)
             offset += c->iov[2].iov_len;
             if (offset + SEND_SIZE > pkt->size)
             {
-                c->iov[3].iov_len = pkt->size - offset;
+                c->iov[2].iov_len = pkt->size - offset;
             }
         }
-    }
+    } while (offset < pkt->size);
     return 0;
 }
 
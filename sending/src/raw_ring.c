@@ -62,6 +62,8 @@ typedef struct raw_ring_net_context
     int fd;
     struct sockaddr_ll raw_addr;
     uint8_t *ring_buf;
+    // next frame of the tx ring to fill
+    int ring_idx;
 } raw_ring_net_context;
 
 static uint8_t const global_eth_header[14] = {0xb8, 0x27, 0xeb, 0x6c, 0xa7, 0xdd, 0x00, 0x0e, 0x8e, 0x5c, 0x2e, 0x53, 0x88, 0xb5};
@@ -136,16 +138,16 @@ static int raw_ring_initialize(struct ouvr_ctx *ctx)
     return 0;
 }
 
-static int ring_idx = 0;
-
 static int raw_ring_send_packet(struct ouvr_ctx *ctx, struct ouvr_packet *pkt)
 {
     raw_ring_net_context *c = ctx->net_priv;
     uint8_t *cur = pkt->data;
     uint8_t *end = pkt->data + pkt->size;
-    while (cur < end)
+    ouvr_packet_header hdr;
+    ouvr_packet_fill_header(pkt, &hdr);
+    do
     {
-        uint8_t *frame_offset = c->ring_buf + (ring_idx * FRAME_SIZE);
+        uint8_t *frame_offset = c->ring_buf + (c->ring_idx * FRAME_SIZE);
         struct tpacket_hdr *header = (struct tpacket_hdr *)frame_offset;
         // if (header->tp_status != TP_STATUS_AVAILABLE)
         // {
@@ -163,13 +165,14 @@ static int raw_ring_send_packet(struct ouvr_ctx *ctx, struct ouvr_packet *pkt)
         //     // }
         // }
         uint8_t *data = frame_offset + 32 + 14;
-        *(int *)data = pkt->size;
-        memcpy(data + sizeof(pkt->size), cur, SEND_SIZE);
-        header->tp_len = SEND_SIZE + 14;
+        int len = end - cur < SEND_SIZE ? end - cur : SEND_SIZE;
+        memcpy(data, &hdr, sizeof(hdr));
+        memcpy(data + sizeof(hdr), cur, len);
+        header->tp_len = 14 + sizeof(hdr) + len;
         header->tp_status = 1;
-        ring_idx = (ring_idx + 1) % NUM_FRAMES;
-        cur += SEND_SIZE;
-    }
+        c->ring_idx = (c->ring_idx + 1) % NUM_FRAMES;
+        cur += len;
+    } while (cur < end);
 
     ssize_t r = send(c->fd, 0, 0, MSG_DONTWAIT);
     if (r < 0)
@@ -0,0 +1,168 @@
+/*
+    The MIT License (MIT)
+
+    Copyright (c) 2020 OpenUVR
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+
+    Authors:
+    Alec Rohloff
+    Zackary Allen
+    Kung-Min Lin
+    Chengyi Nie
+    Hung-Wei Tseng
+*/
+/**
+ * Dynamic resolution: the sender drops to a lower rung of the ladder when encoding (or the network, as reported by
+ * the caller) can't keep up, and climbs back once it has been comfortable for a while. Frames are scaled down before
+ * they reach the encoder, which is set up again for the new size, so the session itself carries on.
+ */
+#include <stdlib.h>
+
+#include "include/libavutil/avutil.h"
+#include "include/libswscale/swscale.h"
+
+#include "resolution_ladder.h"
+
+static const int ladder_percent[] = {100, 85, 70};
+#define NUM_LEVELS (int)(sizeof(ladder_percent) / sizeof(ladder_percent[0]))
+
+#define DOWN_FRAMES 8
+#define UP_FRAMES 180
+#define HOLD_FRAMES 60
+// a frame is overloaded past this share of the budget, and there is headroom for the next rung up when a frame
+// scaled by the extra area would still fit under the other
+#define OVERLOAD_PERCENT 90
+#define HEADROOM_PERCENT 75
+
+struct ouvr_resolution_ladder *ouvr_ladder_alloc(int width, int height)
+{
+    ouvr_resolution_ladder *l = calloc(1, sizeof(ouvr_resolution_ladder));
+    if (l == NULL)
+    {
+        return NULL;
+    }
+    l->width = width;
+    l->height = height;
+    return l;
+}
+
+void ouvr_ladder_free(struct ouvr_resolution_ladder *l)
+{
+    if (l == NULL)
+    {
+        return;
+    }
+    sws_freeContext(l->sws);
+    free(l->buf);
+    free(l);
+}
+
+// the encoders work on 4:2:0 pictures, so the scaled size stays even
+static void level_size(struct ouvr_resolution_ladder *l, int level, int *width, int *height)
+{
+    *width = (l->width * ladder_percent[level] / 100) & ~1;
+    *height = (l->height * ladder_percent[level] / 100) & ~1;
+}
+
+static int change_level(struct ouvr_resolution_ladder *l, int level, int *width, int *height)
+{
+    l->level = level;
+    l->overloaded_frames = 0;
+    l->relaxed_frames = 0;
+    l->hold_frames = HOLD_FRAMES;
+    sws_freeContext(l->sws);
+    l->sws = NULL;
+    free(l->buf);
+    l->buf = NULL;
+    level_size(l, level, width, height);
+    return 1;
+}
+
+int ouvr_ladder_update(struct ouvr_resolution_ladder *l, long encode_usec, long budget_usec, int overloaded, int *width, int *height)
+{
+    if (l->hold_frames > 0)
+    {
+        l->hold_frames--;
+        return 0;
+    }
+    overloaded = overloaded || encode_usec * 100 > budget_usec * OVERLOAD_PERCENT;
+    int has_headroom = 0;
+    if (l->level > 0)
+    {
+        // encode time goes with the number of pixels
+        long up = ladder_percent[l->level - 1], cur = ladder_percent[l->level];
+        has_headroom = encode_usec * up * up * 100 < budget_usec * HEADROOM_PERCENT * cur * cur;
+    }
+    l->overloaded_frames = overloaded ? l->overloaded_frames + 1 : 0;
+    l->relaxed_frames = has_headroom && !overloaded ? l->relaxed_frames + 1 : 0;
+
+    if (l->overloaded_frames >= DOWN_FRAMES && l->level < NUM_LEVELS - 1)
+    {
+        return change_level(l, l->level + 1, width, height);
+    }
+    if (l->relaxed_frames >= UP_FRAMES)
+    {
+        return change_level(l, l->level - 1, width, height);
+    }
+    return 0;
+}
+
+int ouvr_ladder_reset(struct ouvr_resolution_ladder *l, int *width, int *height)
+{
+    if (l->level == 0)
+    {
+        return 0;
+    }
+    change_level(l, 0, width, height);
+    l->hold_frames = 0;
+    return 1;
+}
+
+int ouvr_ladder_percent(struct ouvr_resolution_ladder *l)
+{
+    return ladder_percent[l->level];
+}
+
+const uint8_t *ouvr_ladder_scale(struct ouvr_resolution_ladder *l, const uint8_t *src)
+{
+    if (l->level == 0)
+    {
+        return src;
+    }
+    int width, height;
+    level_size(l, l->level, &width, &height);
+    if (l->sws == NULL)
+    {
+        l->sws = sws_getContext(l->width, l->height, AV_PIX_FMT_RGB0, width, height, AV_PIX_FMT_RGB0, SWS_FAST_BILINEAR, NULL, NULL, NULL);
+        l->buf = malloc((size_t)width * height * 4);
+        if (l->sws == NULL || l->buf == NULL)
+        {
+            sws_freeContext(l->sws);
+            l->sws = NULL;
+            free(l->buf);
+            l->buf = NULL;
+            return NULL;
+        }
+    }
+    const int srcstride[1] = {l->width * 4};
+    const int dststride[1] = {width * 4};
+    sws_scale(l->sws, &src, srcstride, 0, l->height, &l->buf, dststride);
+    return l->buf;
+}
@@ -0,0 +1,69 @@
+/*
+    The MIT License (MIT)
+
+    Copyright (c) 2020 OpenUVR
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+
+    Authors:
+    Alec Rohloff
+    Zackary Allen
+    Kung-Min Lin
+    Chengyi Nie
+    Hung-Wei Tseng
+*/
+
+#ifndef OUVR_RESOLUTION_LADDER_H
+#define OUVR_RESOLUTION_LADDER_H
+
+#include <stdint.h>
+
+struct SwsContext;
+
+// scales the frames down in steps of a fixed ladder when the sender can't keep up, and back up once it can again.
+// A step down needs DOWN_FRAMES overloaded frames in a row and a step up UP_FRAMES frames that would still have had
+// headroom at the bigger size, after a change the level stays put for HOLD_FRAMES whatever happens
+typedef struct ouvr_resolution_ladder
+{
+    int width;
+    int height;
+    int level;
+    int overloaded_frames;
+    int relaxed_frames;
+    int hold_frames;
+
+    // frames are scaled into buf with sws, which is set up again whenever the level changes
+    struct SwsContext *sws;
+    uint8_t *buf;
+} ouvr_resolution_ladder;
+
+// width x height is the size of the frames before scaling
+struct ouvr_resolution_ladder *ouvr_ladder_alloc(int width, int height);
+void ouvr_ladder_free(struct ouvr_resolution_ladder *l);
+// feeds how long the last frame took against the time there is for one, and whether the caller reported being
+// overloaded anyway. Returns 1 and the new size when the level changes, 0 otherwise
+int ouvr_ladder_update(struct ouvr_resolution_ladder *l, long encode_usec, long budget_usec, int overloaded, int *width, int *height);
+// goes straight back to full size, returns 1 and the size if that is a change
+int ouvr_ladder_reset(struct ouvr_resolution_ladder *l, int *width, int *height);
+// percentage of the full size the current level encodes at
+int ouvr_ladder_percent(struct ouvr_resolution_ladder *l);
+// returns src scaled down to the current level's size, or src itself at full size. NULL on failure
+const uint8_t *ouvr_ladder_scale(struct ouvr_resolution_ladder *l, const uint8_t *src);
+
+#endif
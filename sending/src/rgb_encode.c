@@ -43,14 +43,17 @@ typedef struct rgb_encode_context
     int unused;
 } rgb_encode_context;
 
-static int const srcstride[1] = {-1920 * 3};
-
 static int rgb_initialize(struct ouvr_ctx *ctx)
 {
     if (ctx->enc_priv != NULL)
     {
         free(ctx->enc_priv);
     }
+    if (ctx->enc_width * ctx->enc_height * 3 > OUVR_PACKET_CAPACITY)
+    {
+        PRINT_ERR("%dx%d frames don't fit in a packet uncompressed\n", ctx->enc_width, ctx->enc_height);
+        return -1;
+    }
     rgb_encode_context *e = calloc(1, sizeof(rgb_encode_context));
     ctx->enc_priv = e;
 
@@ -61,9 +64,15 @@ static int rgb_process_frame(struct ouvr_ctx *ctx, struct ouvr_packet *pkt)
 {
     int offset_src = 0;
     int offset_dst = 0;
-    for (int y = 0; y < 1080; y++)
+    // one byte more for the last 4 byte store
+    pkt->size = 0;
+    if (ouvr_packet_reserve(pkt, ctx->enc_width * ctx->enc_height * 3 + 1) != 0)
+    {
+        return -1;
+    }
+    for (int y = 0; y < ctx->enc_height; y++)
     {
-        for (int x = 0; x < 1920; x++)
+        for (int x = 0; x < ctx->enc_width; x++)
         {
             *(int *)(pkt->data + offset_dst) = *(int *)(ctx->pix_buf + offset_src);
             offset_src += 4;
@@ -71,8 +80,9 @@ static int rgb_process_frame(struct ouvr_ctx *ctx, struct ouvr_packet *pkt)
         }
     }
 
-    // memcpy(pkt->data, ctx->pix_buf, 1920 * 1080 * 3);
-    pkt->size = 1920 * 1080 * 3;
+    pkt->size = ctx->enc_width * ctx->enc_height * 3;
+    // every frame stands on its own, receivers can start from any of them
+    pkt->flags = OUVR_PACKET_FLAG_KEYFRAME;
 
     return 1;
 }
@@ -85,4 +95,5 @@ struct ouvr_encoder rgb_encode = {
     .init = rgb_initialize,
     .process_frame = rgb_process_frame,
     .deinit = rgb_deinitialize,
+    .unpacks_foveated = 1,
 };
@@ -0,0 +1,201 @@
+/*
+    The MIT License (MIT)
+
+    Copyright (c) 2020 OpenUVR
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+
+    Authors:
+    Alec Rohloff
+    Zackary Allen
+    Kung-Min Lin
+    Chengyi Nie
+    Hung-Wei Tseng
+*/
+/**
+ * Like rgb_encode, but only sends the tiles of the frame that changed since they were last sent, so that a frame in
+ * which only a small region changed costs a small fraction of a full RGB frame.
+ * Lost packets are recovered by the receiver asking for an I-frame through feedback_send(), which makes this
+ * encoder send every tile again. Every REFRESH_INTERVAL frames (or GOP, if one was set) all tiles are sent regardless.
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "rgb_tile_encode.h"
+#include "rgb_tile.h"
+#include "frame_hash.h"
+#include "ouvr_packet.h"
+
+#define TILE_SIZE 64
+
+// used until openuvr_set_gop() says otherwise
+#define REFRESH_INTERVAL 120
+
+typedef struct rgb_tile_encode_context
+{
+    int tiles_x;
+    int num_tiles;
+    uint32_t *hashes;
+    uint16_t *changed;
+    int refresh_interval;
+    int frames_since_refresh;
+} rgb_tile_encode_context;
+
+static int rgb_tile_initialize(struct ouvr_ctx *ctx)
+{
+    if (ctx->enc_priv != NULL)
+    {
+        free(ctx->enc_priv);
+    }
+    int tiles_x = (ctx->enc_width + TILE_SIZE - 1) / TILE_SIZE;
+    int tiles_y = (ctx->enc_height + TILE_SIZE - 1) / TILE_SIZE;
+    int num_tiles = tiles_x * tiles_y;
+    // a full refresh carries every tile
+    if (num_tiles > UINT16_MAX || sizeof(rgb_tile_header) + num_tiles * sizeof(uint16_t) + ctx->enc_width * ctx->enc_height * 3 > OUVR_PACKET_CAPACITY)
+    {
+        PRINT_ERR("%dx%d frames don't fit in a packet uncompressed\n", ctx->enc_width, ctx->enc_height);
+        return -1;
+    }
+    rgb_tile_encode_context *e = calloc(1, sizeof(rgb_tile_encode_context));
+    ctx->enc_priv = e;
+    e->tiles_x = tiles_x;
+    e->num_tiles = num_tiles;
+    e->hashes = calloc(num_tiles, sizeof(uint32_t));
+    e->changed = malloc(num_tiles * sizeof(uint16_t));
+    e->refresh_interval = ctx->enc_params.gop > 0 ? ctx->enc_params.gop : REFRESH_INTERVAL;
+    // makes the first frame a full one
+    e->frames_since_refresh = e->refresh_interval;
+
+    return 0;
+}
+
+static int rgb_tile_process_frame(struct ouvr_ctx *ctx, struct ouvr_packet *pkt)
+{
+    rgb_tile_encode_context *e = ctx->enc_priv;
+    int refresh = 0;
+
+    if (ctx->flag_send_iframe > 0)
+    {
+        refresh = 1;
+        ctx->flag_send_iframe = ~ctx->flag_send_iframe;
+    }
+    else if (ctx->flag_send_iframe < 0)
+    {
+        ctx->flag_send_iframe++;
+    }
+    if (++e->frames_since_refresh >= e->refresh_interval)
+    {
+        refresh = 1;
+    }
+    if (refresh)
+    {
+        e->frames_since_refresh = 0;
+    }
+
+    int num_changed = 0;
+    int size = sizeof(rgb_tile_header);
+    for (int t = 0; t < e->num_tiles; t++)
+    {
+        int x = (t % e->tiles_x) * TILE_SIZE;
+        int y = (t / e->tiles_x) * TILE_SIZE;
+        int w = ctx->enc_width - x < TILE_SIZE ? ctx->enc_width - x : TILE_SIZE;
+        int h = ctx->enc_height - y < TILE_SIZE ? ctx->enc_height - y : TILE_SIZE;
+        uint32_t hash = ouvr_hash_block(ctx->pix_buf + (y * ctx->enc_width + x) * 4, ctx->enc_width * 4, w * 4, h);
+        if (refresh || hash != e->hashes[t])
+        {
+            e->hashes[t] = hash;
+            e->changed[num_changed++] = t;
+            size += sizeof(uint16_t) + w * h * 3;
+        }
+    }
+    // one byte more for the last 4 byte store
+    pkt->size = 0;
+    if (ouvr_packet_reserve(pkt, size + 1) != 0)
+    {
+        return -1;
+    }
+
+    rgb_tile_header *hdr = (rgb_tile_header *)pkt->data;
+    hdr->magic = RGB_TILE_MAGIC;
+    hdr->frame_width = ctx->enc_width;
+    hdr->frame_height = ctx->enc_height;
+    hdr->tile_size = TILE_SIZE;
+    hdr->num_tiles = num_changed;
+    uint8_t *dst = pkt->data + sizeof(rgb_tile_header);
+    memcpy(dst, e->changed, num_changed * sizeof(uint16_t));
+    dst += num_changed * sizeof(uint16_t);
+
+    for (int i = 0; i < num_changed; i++)
+    {
+        int t = e->changed[i];
+        int x = (t % e->tiles_x) * TILE_SIZE;
+        int y = (t / e->tiles_x) * TILE_SIZE;
+        int w = ctx->enc_width - x < TILE_SIZE ? ctx->enc_width - x : TILE_SIZE;
+        int h = ctx->enc_height - y < TILE_SIZE ? ctx->enc_height - y : TILE_SIZE;
+        for (int row = 0; row < h; row++)
+        {
+            const uint8_t *src = ctx->pix_buf + ((y + row) * ctx->enc_width + x) * 4;
+            // same RGBA -> RGB trick as rgb_encode: each 4 byte store is overwritten by the next one except for the last
+            for (int col = 0; col < w - 1; col++)
+            {
+                *(int *)dst = *(int *)src;
+                src += 4;
+                dst += 3;
+            }
+            dst[0] = src[0];
+            dst[1] = src[1];
+            dst[2] = src[2];
+            dst += 3;
+        }
+    }
+
+    pkt->size = dst - pkt->data;
+    // only a full refresh can be decoded without the frames before it
+    pkt->flags = refresh ? OUVR_PACKET_FLAG_KEYFRAME : 0;
+
+    return 1;
+}
+
+// tiles are sent raw, so the GOP is the only setting that means anything here
+static int rgb_tile_reconfigure(struct ouvr_ctx *ctx, unsigned int changed)
+{
+    rgb_tile_encode_context *e = ctx->enc_priv;
+    if (changed & OUVR_PARAM_GOP)
+    {
+        e->refresh_interval = ctx->enc_params.gop > 0 ? ctx->enc_params.gop : REFRESH_INTERVAL;
+    }
+    return changed & ~OUVR_PARAM_GOP ? -1 : 0;
+}
+
+static void rgb_tile_deinitialize(struct ouvr_ctx *ctx)
+{
+    rgb_tile_encode_context *e = ctx->enc_priv;
+    free(e->hashes);
+    free(e->changed);
+    free(e);
+    ctx->enc_priv = NULL;
+}
+
+struct ouvr_encoder rgb_tile_encode = {
+    .init = rgb_tile_initialize,
+    .process_frame = rgb_tile_process_frame,
+    .deinit = rgb_tile_deinitialize,
+    .reconfigure = rgb_tile_reconfigure,
+    .unpacks_foveated = 1,
+};
@@ -0,0 +1,90 @@
+/*
+    The MIT License (MIT)
+
+    Copyright (c) 2020 OpenUVR
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+
+    Authors:
+    Alec Rohloff
+    Zackary Allen
+    Kung-Min Lin
+    Chengyi Nie
+    Hung-Wei Tseng
+*/
+#include <stdlib.h>
+
+#include "spsc_queue.h"
+
+int ouvr_spsc_init(ouvr_spsc_queue *q, unsigned int capacity)
+{
+    unsigned int size = 1;
+    while (size < capacity)
+    {
+        size <<= 1;
+    }
+    q->items = calloc(size, sizeof(void *));
+    if (q->items == NULL)
+    {
+        return -1;
+    }
+    q->capacity = size;
+    atomic_init(&q->head, 0);
+    atomic_init(&q->tail, 0);
+    return 0;
+}
+
+void ouvr_spsc_destroy(ouvr_spsc_queue *q)
+{
+    free(q->items);
+    q->items = NULL;
+}
+
+int ouvr_spsc_push(ouvr_spsc_queue *q, void *item)
+{
+    unsigned int tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+    unsigned int head = atomic_load_explicit(&q->head, memory_order_acquire);
+    if (tail - head == q->capacity)
+    {
+        return -1;
+    }
+    q->items[tail & (q->capacity - 1)] = item;
+    // publishes the item before the consumer can see the new tail
+    atomic_store_explicit(&q->tail, tail + 1, memory_order_release);
+    return 0;
+}
+
+void *ouvr_spsc_pop(ouvr_spsc_queue *q)
+{
+    unsigned int head = atomic_load_explicit(&q->head, memory_order_relaxed);
+    unsigned int tail = atomic_load_explicit(&q->tail, memory_order_acquire);
+    if (head == tail)
+    {
+        return NULL;
+    }
+    void *item = q->items[head & (q->capacity - 1)];
+    // the slot may be reused by the producer from here on
+    atomic_store_explicit(&q->head, head + 1, memory_order_release);
+    return item;
+}
+
+unsigned int ouvr_spsc_depth(ouvr_spsc_queue *q)
+{
+    return atomic_load_explicit(&q->tail, memory_order_acquire) - atomic_load_explicit(&q->head, memory_order_acquire);
+}
@@ -0,0 +1,59 @@
+/*
+    The MIT License (MIT)
+
+    Copyright (c) 2020 OpenUVR
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+
+    Authors:
+    Alec Rohloff
+    Zackary Allen
+    Kung-Min Lin
+    Chengyi Nie
+    Hung-Wei Tseng
+*/
+
+#ifndef OUVR_SPSC_QUEUE_H
+#define OUVR_SPSC_QUEUE_H
+
+#include <stdatomic.h>
+
+// a bounded lock-free queue of pointers between exactly one producer thread and one consumer thread. It never blocks,
+// callers that need to wait pair it with a semaphore
+typedef struct ouvr_spsc_queue
+{
+    void **items;
+    // a power of two, so that the indices can run freely and wrap around
+    unsigned int capacity;
+    // only the consumer moves head and only the producer moves tail
+    atomic_uint head;
+    atomic_uint tail;
+} ouvr_spsc_queue;
+
+// capacity is rounded up to a power of two. Returns 0, or -1 if the ring couldn't be allocated
+int ouvr_spsc_init(ouvr_spsc_queue *q, unsigned int capacity);
+void ouvr_spsc_destroy(ouvr_spsc_queue *q);
+// producer side, returns 0 or -1 if the queue is full
+int ouvr_spsc_push(ouvr_spsc_queue *q, void *item);
+// consumer side, returns NULL if the queue is empty
+void *ouvr_spsc_pop(ouvr_spsc_queue *q);
+// number of items waiting, may be stale by the time the caller looks at it
+unsigned int ouvr_spsc_depth(ouvr_spsc_queue *q);
+
+#endif
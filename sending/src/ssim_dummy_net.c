@@ -74,7 +74,7 @@ static int ssim_dummy_net_initialize(struct ouvr_ctx *ctx)
         return -1;
     }
 
-    d->grayscale_buf = malloc(1920 * 1080);
+    d->grayscale_buf = malloc(ctx->width * ctx->height);
 
     return 0;
 }
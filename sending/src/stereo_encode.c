@@ -0,0 +1,204 @@
+/*
+    The MIT License (MIT)
+
+    Copyright (c) 2020 OpenUVR
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+
+    Authors:
+    Alec Rohloff
+    Zackary Allen
+    Kung-Min Lin
+    Chengyi Nie
+    Hung-Wei Tseng
+*/
+/**
+ * Treats the frame as the two eye views side by side and encodes each half with its own x264 stream, the left
+ * one on the calling thread and the right one on a thread of its own, so both are encoded at the same time.
+ * Both streams send their slices as soon as they are done under the same frame id, the right eye's packets
+ * carrying OUVR_PACKET_FLAG_RIGHT_EYE, and each stream ends its half of the frame with its own end of frame packet.
+ */
+#include <pthread.h>
+#include <stdlib.h>
+
+#include "stereo_encode.h"
+#include "x264_encode.h"
+#include "ouvr_packet.h"
+#include "thread_sched.h"
+
+#define SLICES_PER_EYE 4
+
+typedef struct stereo_encode_context
+{
+    x264_stream *eyes[2];
+
+    pthread_t right_thread;
+    int right_thread_started;
+    // hands the right eye of each frame to right_thread
+    pthread_mutex_t lock;
+    pthread_cond_t start_cond;
+    pthread_cond_t done_cond;
+    unsigned int generation;
+    int force_idr;
+    int right_done;
+    int right_result;
+    int should_exit;
+} stereo_encode_context;
+
+static void *right_eye_loop(void *arg)
+{
+    stereo_encode_context *e = arg;
+
+    pthread_mutex_lock(&e->lock);
+    unsigned int seen = e->generation;
+    while (1)
+    {
+        while (e->generation == seen && !e->should_exit)
+        {
+            pthread_cond_wait(&e->start_cond, &e->lock);
+        }
+        if (e->should_exit)
+        {
+            break;
+        }
+        seen = e->generation;
+        int force_idr = e->force_idr;
+        pthread_mutex_unlock(&e->lock);
+
+        int ret = x264_stream_encode(e->eyes[1], force_idr);
+
+        pthread_mutex_lock(&e->lock);
+        e->right_result = ret;
+        e->right_done = 1;
+        pthread_cond_signal(&e->done_cond);
+    }
+    pthread_mutex_unlock(&e->lock);
+    return NULL;
+}
+
+static int stereo_initialize(struct ouvr_ctx *ctx)
+{
+    if (ctx->enc_priv != NULL)
+    {
+        free(ctx->enc_priv);
+    }
+    stereo_encode_context *e = calloc(1, sizeof(stereo_encode_context));
+    ctx->enc_priv = e;
+
+    pthread_mutex_init(&e->lock, NULL);
+    pthread_cond_init(&e->start_cond, NULL);
+    pthread_cond_init(&e->done_cond, NULL);
+
+    // each eye's view has to stay even for 4:2:0
+    int eye_width = ctx->enc_width / 2 & ~1;
+    e->eyes[0] = x264_stream_open(ctx, 0, eye_width, ctx->enc_height, SLICES_PER_EYE, 0, &ctx->send_lock);
+    e->eyes[1] = x264_stream_open(ctx, ctx->enc_width / 2, eye_width, ctx->enc_height, SLICES_PER_EYE, OUVR_PACKET_FLAG_RIGHT_EYE, &ctx->send_lock);
+    if (e->eyes[0] == NULL || e->eyes[1] == NULL)
+    {
+        return -1;
+    }
+
+    if (pthread_create(&e->right_thread, NULL, right_eye_loop, e) != 0)
+    {
+        PRINT_ERR("could not start the right eye's encoding thread\n");
+        return -1;
+    }
+    e->right_thread_started = 1;
+    ouvr_threads_add(ctx->threads, e->right_thread, OPENUVR_THREAD_WORKERS, "right-eye");
+    return 0;
+}
+
+static int stereo_process_frame(struct ouvr_ctx *ctx, struct ouvr_packet *pkt)
+{
+    stereo_encode_context *e = ctx->enc_priv;
+    int force_idr = 0;
+    (void)pkt;
+
+    // both eyes refresh together, the receiver asks for i-frames without knowing which stream lost data
+    if (ctx->flag_send_iframe > 0)
+    {
+        force_idr = 1;
+        ctx->flag_send_iframe = ~ctx->flag_send_iframe;
+    }
+    else if (ctx->flag_send_iframe < 0)
+    {
+        ctx->flag_send_iframe++;
+    }
+
+    pthread_mutex_lock(&e->lock);
+    e->force_idr = force_idr;
+    e->right_done = 0;
+    e->generation++;
+    pthread_cond_signal(&e->start_cond);
+    pthread_mutex_unlock(&e->lock);
+
+    int left_result = x264_stream_encode(e->eyes[0], force_idr);
+
+    pthread_mutex_lock(&e->lock);
+    while (!e->right_done)
+    {
+        pthread_cond_wait(&e->done_cond, &e->lock);
+    }
+    int right_result = e->right_result;
+    pthread_mutex_unlock(&e->lock);
+
+    if (left_result != 0 || right_result != 0)
+    {
+        return -1;
+    }
+    return OUVR_FRAME_STREAMED;
+}
+
+// called between frames, while the right eye's thread is waiting for the next one
+static int stereo_reconfigure(struct ouvr_ctx *ctx, unsigned int changed)
+{
+    stereo_encode_context *e = ctx->enc_priv;
+    int left_result = x264_stream_reconfigure(e->eyes[0], changed);
+    int right_result = x264_stream_reconfigure(e->eyes[1], changed);
+    return left_result != 0 || right_result != 0 ? -1 : 0;
+}
+
+static void stereo_deinitialize(struct ouvr_ctx *ctx)
+{
+    stereo_encode_context *e = ctx->enc_priv;
+
+    if (e->right_thread_started)
+    {
+        pthread_mutex_lock(&e->lock);
+        e->should_exit = 1;
+        pthread_cond_signal(&e->start_cond);
+        pthread_mutex_unlock(&e->lock);
+        ouvr_threads_remove(ctx->threads, e->right_thread);
+        pthread_join(e->right_thread, NULL);
+    }
+    x264_stream_close(e->eyes[0]);
+    x264_stream_close(e->eyes[1]);
+    pthread_mutex_destroy(&e->lock);
+    pthread_cond_destroy(&e->start_cond);
+    pthread_cond_destroy(&e->done_cond);
+    free(e);
+    ctx->enc_priv = NULL;
+}
+
+struct ouvr_encoder stereo_encode = {
+    .init = stereo_initialize,
+    .process_frame = stereo_process_frame,
+    .deinit = stereo_deinitialize,
+    .reconfigure = stereo_reconfigure,
+};
@@ -0,0 +1,431 @@
+/*
+    The MIT License (MIT)
+
+    Copyright (c) 2020 OpenUVR
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+
+    Authors:
+    Alec Rohloff
+    Zackary Allen
+    Kung-Min Lin
+    Chengyi Nie
+    Hung-Wei Tseng
+*/
+/**
+ * Synthetic frames for load testing: a tiling value-noise texture, generated from the seed for every scene, is
+ * panned across the frame while colour-inverted squares of it move on their own bouncing paths. Each frame is a pure
+ * function of the scenario and its number. Per frame it is only row copies and a loop over the objects that the
+ * compiler vectorises, split across a pool of threads, so high resolutions at 120 Hz are bound by memory bandwidth.
+ * The next scene's texture costs far more than a frame, so it is built into a second buffer a few rows with every
+ * frame of the scene before, and swapped in at the cut.
+ */
+#include "synthetic_frames.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#define DEFAULT_SEED 1
+#define DEFAULT_MOTION 4
+#define DEFAULT_DETAIL 5
+#define DEFAULT_OBJECTS 4
+#define DEFAULT_CUT_INTERVAL 600
+// the coarsest octave has 256 pixel cells, each further one halves them down to 2 pixels
+#define COARSEST_CELL_SHIFT 8
+#define MAX_DETAIL 8
+#define MAX_OBJECTS 64
+#define MAX_THREADS 16
+
+static uint32_t hash32(uint32_t x)
+{
+    x ^= x >> 16;
+    x *= 0x7feb352dU;
+    x ^= x >> 15;
+    x *= 0x846ca68bU;
+    x ^= x >> 16;
+    return x;
+}
+
+static uint32_t hash3(uint32_t a, uint32_t b, uint32_t c)
+{
+    return hash32(a ^ hash32(b ^ hash32(c)));
+}
+
+// the texture is a whole number of the coarsest cells, which every finer octave divides too, so it tiles
+static int round_to_cells(int v)
+{
+    int cell = 1 << COARSEST_CELL_SHIFT;
+    return (v + cell - 1) / cell * cell;
+}
+
+static int64_t wrap(int64_t v, int64_t range)
+{
+    v %= range;
+    return v < 0 ? v + range : v;
+}
+
+// moves back and forth over [0, range]
+static int bounce(int64_t v, int range)
+{
+    if (range <= 0)
+    {
+        return 0;
+    }
+    v = wrap(v, 2 * (int64_t)range);
+    return v <= range ? v : 2 * range - v;
+}
+
+static uint32_t scene_seed(const ouvr_synthetic *g, int64_t scene)
+{
+    return hash3(g->sc.seed, (uint32_t)scene, 0x5ce7e);
+}
+
+int ouvr_synthetic_parse(const char *desc, ouvr_synthetic_scenario *sc)
+{
+    sc->seed = DEFAULT_SEED;
+    sc->motion = DEFAULT_MOTION;
+    sc->detail = DEFAULT_DETAIL;
+    sc->objects = DEFAULT_OBJECTS;
+    sc->cut_interval = DEFAULT_CUT_INTERVAL;
+    sc->static_interval = 0;
+    sc->static_length = 0;
+    if (desc == NULL)
+    {
+        return 0;
+    }
+
+    char *copy = strdup(desc);
+    char *save = NULL;
+    int ret = 0;
+    for (char *item = strtok_r(copy, ",", &save); item != NULL; item = strtok_r(NULL, ",", &save))
+    {
+        unsigned int seed;
+        if (sscanf(item, "seed=%u", &seed) == 1)
+        {
+            sc->seed = seed;
+        }
+        else if (sscanf(item, "motion=%d", &sc->motion) == 1 || sscanf(item, "detail=%d", &sc->detail) == 1 ||
+                 sscanf(item, "objects=%d", &sc->objects) == 1 || sscanf(item, "cut=%d", &sc->cut_interval) == 1 ||
+                 sscanf(item, "static=%d:%d", &sc->static_interval, &sc->static_length) == 2)
+        {
+        }
+        else
+        {
+            fprintf(stderr, "Unknown synthetic scenario setting \"%s\"\n", item);
+            ret = -1;
+        }
+    }
+    free(copy);
+
+    if (sc->motion < 0 || sc->detail < 0 || sc->detail > MAX_DETAIL || sc->objects < 0 || sc->objects > MAX_OBJECTS ||
+        sc->cut_interval < 0 || sc->static_interval < 0 || sc->static_length < 0 || sc->static_length > sc->static_interval)
+    {
+        fprintf(stderr, "Synthetic scenario \"%s\" is out of range\n", desc);
+        ret = -1;
+    }
+    return ret;
+}
+
+// texture rows [y0, y1) of build_scene into build_texture: detail octaves of value noise averaged into a brightness,
+// which blends between two colours of the scene
+static void render_texture_rows(ouvr_synthetic *g, int y0, int y1)
+{
+    int tw = g->tex_width;
+    uint32_t seed = scene_seed(g, g->build_scene);
+    uint32_t c0 = hash32(seed ^ 1), c1 = hash32(seed ^ 2);
+    int32_t *acc = malloc(tw * sizeof(int32_t));
+    int32_t *lattice = malloc((tw + 1) * sizeof(int32_t));
+
+    for (int y = y0; y < y1; y++)
+    {
+        memset(acc, 0, tw * sizeof(int32_t));
+        for (int k = 0; k < g->sc.detail; k++)
+        {
+            int shift = COARSEST_CELL_SHIFT - k;
+            int cell = 1 << shift;
+            int cells_x = tw >> shift;
+            int cells_y = g->tex_height >> shift;
+            int iy = y >> shift;
+            int fy = (y & (cell - 1)) << (8 - shift);
+            // the two lattice rows around y blended once per row, leaving one lerp per pixel
+            uint32_t octave_seed = hash32(seed + k);
+            uint32_t row_a = (uint32_t)(iy % cells_y) * cells_x, row_b = (uint32_t)((iy + 1) % cells_y) * cells_x;
+            for (int j = 0; j < cells_x; j++)
+            {
+                int a = hash32(octave_seed ^ (row_a + j)) & 0xff;
+                int b = hash32(octave_seed ^ (row_b + j)) & 0xff;
+                lattice[j] = a + (((b - a) * fy) >> 8);
+            }
+            lattice[cells_x] = lattice[0];
+            for (int x = 0; x < tw; x++)
+            {
+                int j = x >> shift;
+                int fx = (x & (cell - 1)) << (8 - shift);
+                acc[x] += lattice[j] + (((lattice[j + 1] - lattice[j]) * fx) >> 8);
+            }
+        }
+
+        uint32_t *row = g->build_texture + (size_t)y * tw;
+        int octaves = g->sc.detail > 0 ? g->sc.detail : 1;
+        for (int x = 0; x < tw; x++)
+        {
+            int l = acc[x] / octaves;
+            uint32_t px = 0xff000000u;
+            for (int c = 0; c < 24; c += 8)
+            {
+                int from = (c0 >> c) & 0xff, to = (c1 >> c) & 0xff;
+                px |= (uint32_t)(from + (((to - from) * l) >> 8)) << c;
+            }
+            row[x] = px;
+        }
+    }
+    free(lattice);
+    free(acc);
+}
+
+// frame rows [y0, y1): the background rows with the pan's wrap-around, then the part of each object in the band
+static void render_frame_rows(ouvr_synthetic *g, int y0, int y1)
+{
+    static const int dir_x[8] = {1, 1, 0, -1, -1, -1, 0, 1};
+    static const int dir_y[8] = {0, 1, 1, 1, 0, -1, -1, -1};
+    int tw = g->tex_width, th = g->tex_height, w = g->width;
+    int64_t t = g->scene_frame;
+    uint32_t seed = scene_seed(g, g->scene);
+    int dir = hash32(seed ^ 3) & 7;
+    int ox = wrap((int64_t)dir_x[dir] * g->sc.motion * t, tw);
+    int oy = wrap((int64_t)dir_y[dir] * g->sc.motion * t, th);
+
+    int first = tw - ox < w ? tw - ox : w;
+    for (int y = y0; y < y1; y++)
+    {
+        const uint32_t *src = g->texture + (size_t)((y + oy) % th) * tw;
+        uint32_t *dst = g->dst + (size_t)y * w;
+        memcpy(dst, src + ox, first * sizeof(uint32_t));
+        memcpy(dst + first, src, (w - first) * sizeof(uint32_t));
+    }
+
+    int size = g->height / 6;
+    if (size > w)
+    {
+        size = w;
+    }
+    int max_speed = 2 * g->sc.motion;
+    for (int i = 0; i < g->sc.objects; i++)
+    {
+        uint32_t h[6];
+        for (int k = 0; k < 6; k++)
+        {
+            h[k] = hash3(seed, i, k + 4);
+        }
+        int sx = h[0] % (tw - size + 1), sy = h[1] % (th - size + 1);
+        int vx = (int)(h[2] % (2 * max_speed + 1)) - max_speed;
+        int vy = (int)(h[3] % (2 * max_speed + 1)) - max_speed;
+        int x = bounce(h[4] + (int64_t)vx * t, w - size);
+        int y = bounce(h[5] + (int64_t)vy * t, g->height - size);
+        int from = y > y0 ? y : y0, to = y + size < y1 ? y + size : y1;
+        for (int r = from; r < to; r++)
+        {
+            const uint32_t *src = g->texture + (size_t)(sy + r - y) * tw + sx;
+            uint32_t *dst = g->dst + (size_t)r * w + x;
+            for (int k = 0; k < size; k++)
+            {
+                dst[k] = src[k] ^ 0x00ffffffu;
+            }
+        }
+    }
+}
+
+static void run_band(ouvr_synthetic *g, int band)
+{
+    int y0 = g->job_first_row + (int64_t)g->job_rows * band / g->num_threads;
+    int y1 = g->job_first_row + (int64_t)g->job_rows * (band + 1) / g->num_threads;
+    g->job(g, y0, y1);
+}
+
+static void *worker_loop(void *arg)
+{
+    ouvr_synthetic *g = arg;
+    uint64_t seen = 0;
+    pthread_mutex_lock(&g->lock);
+    while (1)
+    {
+        while (g->job_generation == seen && !g->should_exit)
+        {
+            pthread_cond_wait(&g->job_cond, &g->lock);
+        }
+        if (g->should_exit)
+        {
+            break;
+        }
+        seen = g->job_generation;
+        int band = g->next_band++;
+        pthread_mutex_unlock(&g->lock);
+        run_band(g, band);
+        pthread_mutex_lock(&g->lock);
+        if (--g->jobs_pending == 0)
+        {
+            pthread_cond_signal(&g->done_cond);
+        }
+    }
+    pthread_mutex_unlock(&g->lock);
+    return NULL;
+}
+
+// runs job over rows [first_row, first_row + rows) on every thread and waits for all of them
+static void run_job(ouvr_synthetic *g, void (*job)(ouvr_synthetic *, int, int), int first_row, int rows)
+{
+    pthread_mutex_lock(&g->lock);
+    g->job = job;
+    g->job_first_row = first_row;
+    g->job_rows = rows;
+    g->next_band = 1;
+    g->jobs_pending = g->num_threads - 1;
+    g->job_generation++;
+    pthread_cond_broadcast(&g->job_cond);
+    pthread_mutex_unlock(&g->lock);
+
+    run_band(g, 0);
+
+    pthread_mutex_lock(&g->lock);
+    while (g->jobs_pending > 0)
+    {
+        pthread_cond_wait(&g->done_cond, &g->lock);
+    }
+    pthread_mutex_unlock(&g->lock);
+}
+
+struct ouvr_synthetic *ouvr_synthetic_alloc(const ouvr_synthetic_scenario *sc, int width, int height, int threads)
+{
+    if (width <= 0 || height <= 0)
+    {
+        return NULL;
+    }
+    ouvr_synthetic *g = calloc(1, sizeof(ouvr_synthetic));
+    g->sc = *sc;
+    g->width = width;
+    g->height = height;
+    g->tex_width = round_to_cells(width);
+    g->tex_height = round_to_cells(height);
+    g->texture = malloc((size_t)g->tex_width * g->tex_height * sizeof(uint32_t));
+    g->next_texture = malloc((size_t)g->tex_width * g->tex_height * sizeof(uint32_t));
+    if (g->texture == NULL || g->next_texture == NULL)
+    {
+        free(g->texture);
+        free(g->next_texture);
+        free(g);
+        return NULL;
+    }
+    g->scene = -1;
+    g->next_scene = -1;
+
+    if (threads <= 0)
+    {
+        threads = sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    g->num_threads = threads < 1 ? 1 : threads > MAX_THREADS ? MAX_THREADS : threads;
+    pthread_mutex_init(&g->lock, NULL);
+    pthread_cond_init(&g->job_cond, NULL);
+    pthread_cond_init(&g->done_cond, NULL);
+    g->threads = calloc(g->num_threads, sizeof(pthread_t));
+    for (int i = 1; i < g->num_threads; i++)
+    {
+        pthread_create(&g->threads[i], NULL, worker_loop, g);
+    }
+    return g;
+}
+
+void ouvr_synthetic_free(struct ouvr_synthetic *g)
+{
+    if (g == NULL)
+    {
+        return;
+    }
+    pthread_mutex_lock(&g->lock);
+    g->should_exit = 1;
+    pthread_cond_broadcast(&g->job_cond);
+    pthread_mutex_unlock(&g->lock);
+    for (int i = 1; i < g->num_threads; i++)
+    {
+        pthread_join(g->threads[i], NULL);
+    }
+    pthread_mutex_destroy(&g->lock);
+    pthread_cond_destroy(&g->job_cond);
+    pthread_cond_destroy(&g->done_cond);
+    free(g->threads);
+    free(g->texture);
+    free(g->next_texture);
+    free(g);
+}
+
+void ouvr_synthetic_render(struct ouvr_synthetic *g, uint64_t frame_number, uint8_t *dst)
+{
+    int64_t n = frame_number;
+    // a static period shows its first frame throughout
+    if (g->sc.static_length > 0)
+    {
+        int64_t into = n % g->sc.static_interval, frozen_from = g->sc.static_interval - g->sc.static_length;
+        if (into > frozen_from)
+        {
+            n -= into - frozen_from;
+        }
+    }
+    int64_t scene = g->sc.cut_interval > 0 ? n / g->sc.cut_interval : 0;
+    if (scene != g->scene)
+    {
+        if (scene == g->next_scene && g->next_rows == g->tex_height)
+        {
+            uint32_t *texture = g->texture;
+            g->texture = g->next_texture;
+            g->next_texture = texture;
+        }
+        else
+        {
+            // the first frame, or a jump
+            g->build_scene = scene;
+            g->build_texture = g->texture;
+            run_job(g, render_texture_rows, 0, g->tex_height);
+        }
+        g->scene = scene;
+        g->next_scene = -1;
+    }
+    g->scene_frame = g->sc.cut_interval > 0 ? n % g->sc.cut_interval : n;
+    g->dst = (uint32_t *)dst;
+    run_job(g, render_frame_rows, 0, g->height);
+
+    // an equal share of what is left of the next texture for each frame up to the cut
+    if (g->sc.cut_interval > 0)
+    {
+        if (g->next_scene != scene + 1)
+        {
+            g->next_scene = scene + 1;
+            g->next_rows = 0;
+        }
+        int64_t frames_left = g->sc.cut_interval - g->scene_frame;
+        int rows = (g->tex_height - g->next_rows + frames_left - 1) / frames_left;
+        if (rows > 0)
+        {
+            g->build_scene = g->next_scene;
+            g->build_texture = g->next_texture;
+            run_job(g, render_texture_rows, g->next_rows, rows);
+            g->next_rows += rows;
+        }
+    }
+}
@@ -0,0 +1,105 @@
+/*
+    The MIT License (MIT)
+
+    Copyright (c) 2020 OpenUVR
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+
+    Authors:
+    Alec Rohloff
+    Zackary Allen
+    Kung-Min Lin
+    Chengyi Nie
+    Hung-Wei Tseng
+*/
+
+#ifndef OUVR_SYNTHETIC_FRAMES_H
+#define OUVR_SYNTHETIC_FRAMES_H
+
+#include <stdint.h>
+#include <pthread.h>
+
+// what the generated content does. Everything is derived from seed, so the same scenario gives the same frames
+typedef struct ouvr_synthetic_scenario
+{
+    uint32_t seed;
+    // pixels per frame the background pans by, the objects move at up to twice that
+    int motion;
+    // octaves of texture from coarse to 2 pixel fine, 0 gives flat colour
+    int detail;
+    // textured squares moving across the background on their own paths
+    int objects;
+    // a new scene every cut_interval frames, 0 for none
+    int cut_interval;
+    // the last static_length frames of every static_interval are frozen, 0 for none
+    int static_interval;
+    int static_length;
+} ouvr_synthetic_scenario;
+
+// renders frames as a tiling texture panned across the frame with objects moving over it, on a pool of threads
+typedef struct ouvr_synthetic
+{
+    ouvr_synthetic_scenario sc;
+    int width;
+    int height;
+    // at least the frame size and tiling, so that panning just wraps around
+    uint32_t *texture;
+    int tex_width;
+    int tex_height;
+    // the scene texture holds, -1 before the first frame
+    int64_t scene;
+    // the next scene's texture, built a share of its rows per frame so that it is ready at the cut without any one
+    // frame paying for all of it. next_rows of it are done, for next_scene
+    uint32_t *next_texture;
+    int64_t next_scene;
+    int next_rows;
+    // where render_texture_rows() puts the rows of which scene
+    uint32_t *build_texture;
+    int64_t build_scene;
+
+    // the job the workers are running: rows [job_first_row, job_first_row + job_rows) split into num_threads bands
+    pthread_t *threads;
+    int num_threads;
+    pthread_mutex_t lock;
+    pthread_cond_t job_cond;
+    pthread_cond_t done_cond;
+    uint64_t job_generation;
+    void (*job)(struct ouvr_synthetic *g, int y0, int y1);
+    int job_first_row;
+    int job_rows;
+    int jobs_pending;
+    // the next band a worker takes, the calling thread renders band 0 itself
+    int next_band;
+    int should_exit;
+    // of the frame being rendered
+    uint32_t *dst;
+    int64_t scene_frame;
+} ouvr_synthetic;
+
+// parses "key=value,..." with the keys seed, motion, detail, objects, cut and static=interval:length on top of the
+// defaults. Returns -1 on an unknown key or bad value
+int ouvr_synthetic_parse(const char *desc, ouvr_synthetic_scenario *sc);
+// threads <= 0 uses one per online cpu
+struct ouvr_synthetic *ouvr_synthetic_alloc(const ouvr_synthetic_scenario *sc, int width, int height, int threads);
+void ouvr_synthetic_free(struct ouvr_synthetic *g);
+// writes frame frame_number as width x height RGBA to dst. Frames can be rendered in any order, although jumping to
+// another scene than the next one generates its whole texture in that frame
+void ouvr_synthetic_render(struct ouvr_synthetic *g, uint64_t frame_number, uint8_t *dst);
+
+#endif
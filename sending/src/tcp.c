@@ -94,9 +94,6 @@ static int tcp_send_packet(struct ouvr_ctx *ctx, struct ouvr_packet *pkt)
     PRINT_ERR("tcp_send_packet enter\n");
     tcp_net_context *c = ctx->net_priv;
 
-    struct timeval tv;
-    gettimeofday(&tv, NULL);
-
     register int r;
 
     if (c->send_fd == -1)
@@ -107,23 +104,13 @@ static int tcp_send_packet(struct ouvr_ctx *ctx, struct ouvr_packet *pkt)
     }
 
     int nleft = pkt->size;
-    r = write(c->send_fd, &nleft, sizeof(nleft));
+    ouvr_packet_header hdr;
+    ouvr_packet_fill_header(pkt, &hdr);
+    r = write(c->send_fd, &hdr, sizeof(hdr));
     PRINT_ERR("pkt len = %d\n", nleft);
-    if (r != sizeof(nleft))
-    {
-        PRINT_ERR("Error on writing num left: returned %d\n", r);
-        close(c->send_fd);
-        c->send_fd = -1;
-        return 0;
-    }
-
-    struct timevalue sending_tv;
-    sending_tv.sec = tv.tv_sec;
-    sending_tv.usec = tv.tv_usec;
-    r = write(c->send_fd, &sending_tv, sizeof(sending_tv));
-    if (r != sizeof(sending_tv))
+    if (r != sizeof(hdr))
     {
-        PRINT_ERR("Error on writing sending time: returned %d\n", r);
+        PRINT_ERR("Error on writing packet header: returned %d\n", r);
         close(c->send_fd);
         c->send_fd = -1;
         return 0;
@@ -27,7 +27,7 @@ typedef struct udp_net_context
     int fd;
     struct sockaddr_in serv_addr, cli_addr;
     struct msghdr msg;
-    struct iovec iov[3];
+    struct iovec iov[2];
 } udp_net_context;
 
 
@@ -51,9 +51,12 @@ static int udp_initialize(struct ouvr_ctx *ctx)
     c->serv_addr.sin_port = htons(SERVER_PORT_BUFFER);
 
     c->cli_addr.sin_family = AF_INET;
-    inet_pton(AF_INET, CLIENT_IP, &c->cli_addr.sin_addr.s_addr); //c->cli_addr.sin_addr.s_addr = htonl(CLIENT_IP);
+    inet_pton(AF_INET, ctx->client_ip, &c->cli_addr.sin_addr.s_addr); //c->cli_addr.sin_addr.s_addr = htonl(CLIENT_IP);
     c->cli_addr.sin_port = htons(CLIENT_PORT_BUFFER);
 
+    // contexts sending to different receivers share the local port, each socket only gets its own receiver's datagrams
+    int reuse = 1;
+    setsockopt(c->fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
     if (bind(c->fd, (struct sockaddr *)&c->serv_addr, sizeof(c->serv_addr)) < 0)
     {
         PRINT_ERR("Couldn't bind udp\n");
@@ -68,7 +71,7 @@ static int udp_initialize(struct ouvr_ctx *ctx)
     fcntl(c->fd, F_SETFL, flags | (int)O_NONBLOCK);
 
     c->msg.msg_iov = c->iov;
-    c->msg.msg_iovlen = 3;
+    c->msg.msg_iovlen = 2;
     return 0;
 }
 
@@ -78,20 +81,16 @@ static int udp_send_packet(struct ouvr_ctx *ctx, struct ouvr_packet *pkt)
     register ssize_t r;
     uint8_t *start_pos = pkt->data;
     int offset = 0;
-    struct timeval tv;
-    struct timevalue sending_tv;
-    gettimeofday(&tv, NULL);
-    sending_tv.sec = tv.tv_sec;
-    sending_tv.usec = tv.tv_usec;
-    
-    c->iov[0].iov_len = sizeof(pkt->size);
-    c->iov[0].iov_base = &(pkt->size);
-    c->iov[1].iov_len = sizeof(sending_tv);
-    c->iov[1].iov_base = &sending_tv;
-    c->iov[2].iov_len = SEND_SIZE;
-    while (offset < pkt->size)
+    ouvr_packet_header hdr;
+    ouvr_packet_fill_header(pkt, &hdr);
+
+    c->iov[0].iov_len = sizeof(hdr);
+    c->iov[0].iov_base = &hdr;
+    c->iov[1].iov_len = pkt->size < SEND_SIZE ? pkt->size : SEND_SIZE;
+    // packets without a payload (e.g. an end-of-frame marker) still go out as a single datagram
+    do
     {
-        c->iov[2].iov_base = start_pos + offset;
+        c->iov[1].iov_base = start_pos + offset;
         r = sendmsg(c->fd, &c->msg, 0);
         if (r < -1)
         {
@@ -100,19 +99,28 @@ static int udp_send_packet(struct ouvr_ctx *ctx, struct ouvr_packet *pkt)
         }
         else if (r > 0)
         {
-            offset += c->iov[2].iov_len;
+            offset += c->iov[1].iov_len;
             if (offset + SEND_SIZE > pkt->size)
             {
-                c->iov[2].iov_len = pkt->size - offset;
-                // PRINT_ERR("%d\n", r-sizeof(pkt->size)-sizeof(tv));
+                c->iov[1].iov_len = pkt->size - offset;
+                // PRINT_ERR("%d\n", r-sizeof(hdr));
             }
         }
-    }
+    } while (offset < pkt->size);
     // PRINT_ERR("%d\n",pkt->size);
     return 0;
 }
 
+static void udp_deinitialize(struct ouvr_ctx *ctx)
+{
+    udp_net_context *c = ctx->net_priv;
+    close(c->fd);
+    free(c);
+    ctx->net_priv = NULL;
+}
+
 struct ouvr_network udp_handler = {
     .init = udp_initialize,
     .send_packet = udp_send_packet,
+    .deinit = udp_deinitialize,
 };
@@ -77,9 +77,12 @@ static int udp_initialize(struct ouvr_ctx *ctx)
     c->serv_addr.sin_port = htons(SERVER_PORT_BUFFER);
 
     c->cli_addr.sin_family = AF_INET;
-    inet_pton(AF_INET, CLIENT_IP, &c->cli_addr.sin_addr.s_addr);
+    inet_pton(AF_INET, ctx->client_ip, &c->cli_addr.sin_addr.s_addr);
     c->cli_addr.sin_port = htons(CLIENT_PORT_BUFFER);
 
+    // see udp.c
+    int reuse = 1;
+    setsockopt(c->fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
     if (bind(c->fd, (struct sockaddr *)&c->serv_addr, sizeof(c->serv_addr)) < 0)
     {
         PRINT_ERR("Couldn't bind\n");
@@ -126,7 +129,16 @@ static int udp_send_packet(struct ouvr_ctx *ctx, struct ouvr_packet *pkt)
     return 0;
 }
 
+static void udp_deinitialize(struct ouvr_ctx *ctx)
+{
+    udp_compat_net_context *c = ctx->net_priv;
+    close(c->fd);
+    free(c);
+    ctx->net_priv = NULL;
+}
+
 struct ouvr_network udp_compat_handler = {
     .init = udp_initialize,
     .send_packet = udp_send_packet,
+    .deinit = udp_deinitialize,
 };
\ No newline at end of file
@@ -1,6 +1,7 @@
 #include "webrtc.h"
 #include "ouvr_packet.h"
 #include "rtc/rtc.h"
+#include <stdlib.h>
 
 static int websocket_port = 30888;
 
@@ -68,9 +69,9 @@ typedef struct {
 	int pc;
 	int tr;
 	int ws;
+	int wss;
 } Peer;
 
-static Peer peer;
 
 
 static void RTC_API descriptionCallback(int pc, const char *sdp, const char *type, void *ptr) {
@@ -103,7 +104,13 @@ static int webrtc_initialize(struct ouvr_ctx *ctx)
 {
     rtcInitLogger(RTC_LOG_DEBUG, NULL);
 
-	memset(&peer, 0, sizeof(Peer));
+	if (ctx->net_priv != NULL)
+	{
+		free(ctx->net_priv);
+	}
+	// the context's one peer, filled in once a browser connects to the websocket server
+	Peer *peer = calloc(1, sizeof(Peer));
+	ctx->net_priv = peer;
 	rtcWsServerConfiguration wsConfig = {
 		websocket_port,
 		false,
@@ -117,20 +124,36 @@ static int webrtc_initialize(struct ouvr_ctx *ctx)
 		fprintf(stderr, "Error creating websocket server: errorcode: %d\n", wssId);
 		return -1;
 	}
+	peer->wss = wssId;
+	rtcSetUserPointer(wssId, peer);
     return 0;
 };
 
 static int webrtc_send_packet(struct ouvr_ctx * ctx, struct ouvr_packet *pkt)
 {
-	if(peer.pc && peer.state == RTC_CONNECTED){
-		rtcSendMessage(peer.tr, pkt->data, pkt->size);
+	Peer *peer = ctx->net_priv;
+	if(peer->pc && peer->state == RTC_CONNECTED){
+		rtcSendMessage(peer->tr, pkt->data, pkt->size);
 	}
     return 0;
 }
 
+static void webrtc_deinitialize(struct ouvr_ctx *ctx)
+{
+	Peer *peer = ctx->net_priv;
+	rtcDeleteWebSocketServer(peer->wss);
+	if (peer->pc)
+	{
+		rtcDeletePeerConnection(peer->pc);
+	}
+	free(peer);
+	ctx->net_priv = NULL;
+}
+
 struct ouvr_network webrtc_handler = {
     .init = webrtc_initialize,
     .send_packet = webrtc_send_packet,
+    .deinit = webrtc_deinitialize,
 };
 
 static void RTC_API wbOpenCallback(int id, void *ptr)
@@ -168,6 +191,13 @@ static void RTC_API wbMessageCallback(int id, const char *message, int size, voi
 
 static void RTC_API wbServerClientCallbackFunc(int wsserver, int ws, void *ptr)
 {
+	Peer *peer = (Peer *)ptr;
+	if (peer == NULL)
+	{
+		// connected before webrtc_initialize() got to hand the peer over
+		rtcClose(ws);
+		return;
+	}
 	char address[256];
 	if (rtcGetWebSocketRemoteAddress(ws, address, 256) < 0) {
 		fprintf(stderr, "rtcGetWebSocketRemoteAddress failed\n");
@@ -178,22 +208,22 @@ static void RTC_API wbServerClientCallbackFunc(int wsserver, int ws, void *ptr)
 	rtcConfiguration config;
 	memset(&config, 0, sizeof(config));
 
-	if (peer.pc == 0)
+	if (peer->pc == 0)
 	{
-		peer.pc = rtcCreatePeerConnection(&config);
-		fprintf(stderr, "Peer %d created\n", peer.pc);
+		peer->pc = rtcCreatePeerConnection(&config);
+		fprintf(stderr, "Peer %d created\n", peer->pc);
 	} else 
 	{
 		rtcClose(ws);
 		return;
 	}
 
-	rtcSetUserPointer(peer.pc, &peer);
-	rtcSetLocalDescriptionCallback(peer.pc, descriptionCallback);
-	rtcSetLocalCandidateCallback(peer.pc, candidateCallback);
-	rtcSetStateChangeCallback(peer.pc, stateChangeCallback);
-	rtcSetGatheringStateChangeCallback(peer.pc, gatheringStateCallback);
-	rtcSetClosedCallback(peer.pc, pcClosedCallback);
+	rtcSetUserPointer(peer->pc, peer);
+	rtcSetLocalDescriptionCallback(peer->pc, descriptionCallback);
+	rtcSetLocalCandidateCallback(peer->pc, candidateCallback);
+	rtcSetStateChangeCallback(peer->pc, stateChangeCallback);
+	rtcSetGatheringStateChangeCallback(peer->pc, gatheringStateCallback);
+	rtcSetClosedCallback(peer->pc, pcClosedCallback);
 
 	rtcTrackInit trackInit = {
 		RTC_DIRECTION_SENDONLY,
@@ -205,14 +235,14 @@ static void RTC_API wbServerClientCallbackFunc(int wsserver, int ws, void *ptr)
 		NULL,
 		NULL,
 	};
-	peer.tr = rtcAddTrackEx(peer.pc, &trackInit);
-	rtcSetUserPointer(peer.tr, &peer);
-	rtcSetClosedCallback(peer.tr, trClosedCallback);
+	peer->tr = rtcAddTrackEx(peer->pc, &trackInit);
+	rtcSetUserPointer(peer->tr, peer);
+	rtcSetClosedCallback(peer->tr, trClosedCallback);
 
-	rtcSetLocalDescription(peer.pc, "offer");
+	rtcSetLocalDescription(peer->pc, "offer");
 
-	peer.ws = ws;
-	rtcSetUserPointer(peer.ws, &peer);
+	peer->ws = ws;
+	rtcSetUserPointer(peer->ws, peer);
 	rtcSetOpenCallback(ws, wbOpenCallback);
 	rtcSetClosedCallback(ws, wbClosedCallback);
 	rtcSetErrorCallback(ws, wbErrorCallback);
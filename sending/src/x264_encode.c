@@ -0,0 +1,510 @@
+/*
+    The MIT License (MIT)
+
+    Copyright (c) 2020 OpenUVR
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+
+    Authors:
+    Alec Rohloff
+    Zackary Allen
+    Kung-Min Lin
+    Chengyi Nie
+    Hung-Wei Tseng
+*/
+/**
+ * Encodes with libx264 directly instead of through libavcodec, so that its nalu_process callback can be used.
+ * Every frame is split into NUM_SLICES slices which are encoded in parallel by x264's sliced threads, and each
+ * slice is handed to the network as soon as it is finished, while the rest of the frame is still being encoded.
+ * The receiver can then start decoding the first slices before the last ones have arrived.
+ * x264's threads finish their slices in any order, but the high profile needs them in macroblock order, so a slice
+ * that is done before the one above it is held back until the gap is filled.
+ */
+
+#include <x264.h>
+#include <pthread.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "include/libavutil/pixfmt.h"
+#include "include/libswscale/swscale.h"
+
+#include "x264_encode.h"
+#include "ouvr_packet.h"
+#include "foveation.h"
+
+// the bitrate was tuned for 1080p at 60 fps, other geometries get the same number of bits per pixel
+#define REFERENCE_BITRATE 15000
+#define REFERENCE_PIXEL_RATE (1920 * 1080 * 60)
+
+#define NUM_SLICES 8
+// used until openuvr_set_gop() or openuvr_set_encoder_preset() say otherwise
+#define DEFAULT_GOP 140
+#define DEFAULT_PRESET "veryfast"
+
+struct x264_stream
+{
+    x264_t *enc;
+    x264_picture_t pic_in;
+    x264_picture_t pic_out;
+    struct SwsContext *rgb_to_yuv_ctx;
+    struct ouvr_ctx *ctx;
+    int x_offset;
+    int width;
+    int height;
+    int num_slices;
+    uint32_t packet_flags;
+    // OUVR_PACKET_FLAG_KEYFRAME once the frame being encoded turned out to start with an SPS or an IDR slice
+    uint32_t keyframe_flag;
+    // x264 can't change its keyint once open, so IDRs are placed here instead
+    int gop;
+    int frames_since_idr;
+    // this stream's part of the foveation map
+    float *quant_offsets;
+    int num_mbs;
+
+    // nalu_process is called from x264's slice threads, so everything below is protected by send_lock
+    pthread_mutex_t *send_lock;
+    struct ouvr_packet slice_pkt;
+    uint8_t *nal_buf;
+    // the first macroblock of the slice that is sent next
+    int next_mb;
+    // slices that finished before the one in front of them, num_slices of them at most
+    struct held_slice *held;
+    int num_held;
+    int sent_end_of_frame;
+    int send_failed;
+};
+
+struct held_slice
+{
+    uint8_t *data;
+    int size;
+    int capacity;
+    int first_mb;
+    int last_mb;
+};
+
+typedef struct x264_encode_context
+{
+    x264_stream *stream;
+} x264_encode_context;
+
+// streams that only cover part of the frame get their share of the bitrate in proportion to their area
+static int stream_bitrate(x264_stream *s)
+{
+    struct ouvr_ctx *ctx = s->ctx;
+    if (ctx->enc_params.bitrate_kbps > 0)
+    {
+        return (int64_t)ctx->enc_params.bitrate_kbps * s->width * s->height / ((int64_t)ctx->enc_width * ctx->enc_height);
+    }
+    return (int64_t)REFERENCE_BITRATE * s->width * s->height * ctx->fps / REFERENCE_PIXEL_RATE;
+}
+
+static void set_rate_control(x264_stream *s, x264_param_t *param)
+{
+    param->rc.i_bitrate = stream_bitrate(s);
+    param->rc.i_vbv_max_bitrate = param->rc.i_bitrate;
+    param->rc.i_vbv_buffer_size = param->rc.i_bitrate / s->ctx->fps;
+}
+
+// subme and refs given on top of the preset
+static void apply_analysis(struct ouvr_ctx *ctx, x264_param_t *param)
+{
+    if (ctx->enc_params.subme > 0)
+    {
+        param->analyse.i_subpel_refine = ctx->enc_params.subme;
+    }
+    if (ctx->enc_params.refs > 0)
+    {
+        param->i_frame_reference = ctx->enc_params.refs;
+    }
+}
+
+// last_mb is the last macroblock of the slice in data, or -1 for the nals that aren't slices. Called with send_lock held
+static void send_nal(x264_stream *s, uint8_t *data, int size, int last_mb)
+{
+    s->slice_pkt.data = data;
+    s->slice_pkt.size = size;
+    s->slice_pkt.frame_id = s->ctx->frame_id;
+    s->slice_pkt.flags = s->packet_flags | s->keyframe_flag;
+    s->slice_pkt.info = s->ctx->frame_info;
+    if (last_mb >= 0)
+    {
+        s->next_mb = last_mb + 1;
+        // the frame ends with the slice that reaches its last macroblock
+        if (s->next_mb >= s->num_mbs)
+        {
+            s->slice_pkt.flags |= OUVR_PACKET_FLAG_END_OF_FRAME;
+            s->sent_end_of_frame = 1;
+        }
+    }
+    if (s->ctx->net->send_packet(s->ctx, &s->slice_pkt) != 0)
+    {
+        s->send_failed = 1;
+    }
+}
+
+// sends the held slice at i and forgets it, keeping its buffer for the next one held
+static void send_held(x264_stream *s, int i)
+{
+    struct held_slice h = s->held[i];
+    send_nal(s, h.data, h.size, h.last_mb);
+    s->held[i] = s->held[--s->num_held];
+    s->held[s->num_held] = h;
+}
+
+// sends the held slices that the last one sent made contiguous
+static void release_held(x264_stream *s)
+{
+    int i = 0;
+    while (i < s->num_held)
+    {
+        if (s->held[i].first_mb == s->next_mb)
+        {
+            send_held(s, i);
+            i = 0;
+        }
+        else
+        {
+            i++;
+        }
+    }
+}
+
+static int hold_slice(x264_stream *s, x264_nal_t *nal)
+{
+    struct held_slice *h = &s->held[s->num_held];
+    if (h->capacity < nal->i_payload)
+    {
+        uint8_t *data = realloc(h->data, nal->i_payload);
+        if (data == NULL)
+        {
+            return -1;
+        }
+        h->data = data;
+        h->capacity = nal->i_payload;
+    }
+    memcpy(h->data, nal->p_payload, nal->i_payload);
+    h->size = nal->i_payload;
+    h->first_mb = nal->i_first_mb;
+    h->last_mb = nal->i_last_mb;
+    s->num_held++;
+    return 0;
+}
+
+static void x264_nalu_process(x264_t *h, x264_nal_t *nal, void *opaque)
+{
+    x264_stream *s = opaque;
+
+    pthread_mutex_lock(s->send_lock);
+    // the nal has to be escaped into a buffer of at least i_payload * 3/2 + 5 + 64 bytes before it can be used
+    x264_nal_encode(h, s->nal_buf, nal);
+
+    if (nal->i_type == NAL_SPS || nal->i_type == NAL_SLICE_IDR)
+    {
+        s->keyframe_flag = OUVR_PACKET_FLAG_KEYFRAME;
+    }
+    if (nal->i_type != NAL_SLICE && nal->i_type != NAL_SLICE_IDR)
+    {
+        // SPS/PPS/SEI nals are sent as they come, they are written before any slice
+        send_nal(s, nal->p_payload, nal->i_payload, -1);
+    }
+    // a slice waits for the ones above it, unless it can't be kept
+    else if (nal->i_first_mb == s->next_mb || s->num_held == s->num_slices || hold_slice(s, nal) != 0)
+    {
+        send_nal(s, nal->p_payload, nal->i_payload, nal->i_last_mb);
+        release_held(s);
+    }
+    pthread_mutex_unlock(s->send_lock);
+}
+
+x264_stream *x264_stream_open(struct ouvr_ctx *ctx, int x_offset, int width, int height, int num_slices, uint32_t packet_flags, pthread_mutex_t *send_lock)
+{
+    x264_stream *s = calloc(1, sizeof(x264_stream));
+    s->ctx = ctx;
+    s->x_offset = x_offset;
+    s->width = width;
+    s->height = height;
+    s->num_slices = num_slices;
+    s->packet_flags = packet_flags;
+    s->send_lock = send_lock;
+    s->num_mbs = ((width + 15) / 16) * ((height + 15) / 16);
+    s->held = calloc(num_slices, sizeof(struct held_slice));
+    s->gop = ctx->enc_params.gop > 0 ? ctx->enc_params.gop : DEFAULT_GOP;
+
+    x264_param_t param;
+    if (x264_param_default_preset(&param, ctx->enc_params.preset[0] ? ctx->enc_params.preset : DEFAULT_PRESET, "zerolatency") < 0)
+    {
+        PRINT_ERR("x264_param_default_preset failed\n");
+        goto err;
+    }
+    apply_analysis(ctx, &param);
+    param.i_width = width;
+    param.i_height = height;
+    param.i_csp = X264_CSP_I420;
+    param.i_fps_num = ctx->fps;
+    param.i_fps_den = 1;
+    param.i_keyint_max = X264_KEYINT_MAX_INFINITE;
+    param.i_bframe = 0;
+    param.b_annexb = 1;
+    param.b_repeat_headers = 1;
+    param.rc.i_rc_method = X264_RC_ABR;
+    set_rate_control(s, &param);
+    // nalu_process only works with sliced threads (zerolatency already turns them on), and the slice count has
+    // to be fixed so that we know which slice ends the frame
+    param.b_sliced_threads = 1;
+    param.i_threads = num_slices;
+    param.i_slice_count = num_slices;
+    param.nalu_process = x264_nalu_process;
+    if (x264_param_apply_profile(&param, "high") < 0)
+    {
+        PRINT_ERR("x264_param_apply_profile failed\n");
+        goto err;
+    }
+
+    s->enc = x264_encoder_open(&param);
+    if (s->enc == NULL)
+    {
+        PRINT_ERR("x264_encoder_open failed\n");
+        goto err;
+    }
+    if (x264_picture_alloc(&s->pic_in, X264_CSP_I420, width, height) < 0)
+    {
+        PRINT_ERR("x264_picture_alloc failed\n");
+        goto err;
+    }
+    s->pic_in.opaque = s;
+
+    s->quant_offsets = malloc(((width + 15) / 16) * ((height + 15) / 16) * sizeof(float));
+    s->nal_buf = malloc(width * height * 3);
+    s->rgb_to_yuv_ctx = sws_getContext(width, height, AV_PIX_FMT_RGB0, width, height, AV_PIX_FMT_YUV420P, SWS_FAST_BILINEAR, NULL, NULL, NULL);
+    return s;
+
+err:
+    x264_stream_close(s);
+    return NULL;
+}
+
+int x264_stream_encode(x264_stream *s, int force_idr)
+{
+    struct ouvr_ctx *ctx = s->ctx;
+    x264_nal_t *nals;
+    int num_nals;
+
+    const uint8_t *const src = ctx->pix_buf + s->x_offset * 4;
+    const int srcstride[1] = {ctx->enc_width * 4};
+    sws_scale(s->rgb_to_yuv_ctx, &src, srcstride, 0, s->height, s->pic_in.img.plane, s->pic_in.img.i_stride);
+
+    s->pic_in.i_pts++;
+    if (++s->frames_since_idr >= s->gop)
+    {
+        force_idr = 1;
+    }
+    s->pic_in.i_type = force_idr ? X264_TYPE_IDR : X264_TYPE_AUTO;
+    // x264 is done with the map when x264_encoder_encode returns since zerolatency leaves no lookahead
+    s->pic_in.prop.quant_offsets = ouvr_foveation_qp_offsets(ctx->fov, ctx->enc_width, s->x_offset, s->width, s->height, 16, s->quant_offsets) ? s->quant_offsets : NULL;
+
+    s->next_mb = 0;
+    s->num_held = 0;
+    s->keyframe_flag = 0;
+    s->sent_end_of_frame = 0;
+    s->send_failed = 0;
+    // the slices are sent from x264_nalu_process while this call runs
+    if (x264_encoder_encode(s->enc, &nals, &num_nals, &s->pic_in, &s->pic_out) < 0)
+    {
+        PRINT_ERR("x264_encoder_encode failed\n");
+        return -1;
+    }
+    if (s->pic_out.b_keyframe)
+    {
+        s->frames_since_idr = 0;
+    }
+    // x264 delivered every slice by now, so anything still held comes after a gap that will never be filled.
+    // It goes out in order all the same
+    pthread_mutex_lock(s->send_lock);
+    while (s->num_held > 0)
+    {
+        int first = 0;
+        for (int i = 1; i < s->num_held; i++)
+        {
+            if (s->held[i].first_mb < s->held[first].first_mb)
+            {
+                first = i;
+            }
+        }
+        send_held(s, first);
+    }
+    pthread_mutex_unlock(s->send_lock);
+    if (s->send_failed)
+    {
+        return -1;
+    }
+    // should only happen if a slice went missing, the receiver still needs to know the frame is done
+    if (!s->sent_end_of_frame)
+    {
+        struct ouvr_packet end_pkt = {
+            .data = s->nal_buf,
+            .size = 0,
+            .flags = s->packet_flags | s->keyframe_flag | OUVR_PACKET_FLAG_END_OF_FRAME,
+            .frame_id = ctx->frame_id,
+            .info = ctx->frame_info,
+        };
+        pthread_mutex_lock(s->send_lock);
+        int ret = ctx->net->send_packet(ctx, &end_pkt);
+        pthread_mutex_unlock(s->send_lock);
+        if (ret != 0)
+        {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int x264_stream_reconfigure(x264_stream *s, unsigned int changed)
+{
+    struct ouvr_ctx *ctx = s->ctx;
+    x264_param_t param;
+
+    if (changed & OUVR_PARAM_GOP)
+    {
+        s->gop = ctx->enc_params.gop > 0 ? ctx->enc_params.gop : DEFAULT_GOP;
+    }
+    if (!(changed & (OUVR_PARAM_BITRATE | OUVR_PARAM_PRESET | OUVR_PARAM_ANALYSIS)))
+    {
+        return 0;
+    }
+
+    x264_encoder_parameters(s->enc, &param);
+    if (changed & OUVR_PARAM_BITRATE)
+    {
+        set_rate_control(s, &param);
+    }
+    if (changed & (OUVR_PARAM_PRESET | OUVR_PARAM_ANALYSIS))
+    {
+        // only the analysis settings of the preset can change in an open encoder, x264_encoder_reconfig() leaves
+        // the rest alone. It also won't go back up from subme 0 once "ultrafast" turned it on
+        x264_param_t preset;
+        if (x264_param_default_preset(&preset, ctx->enc_params.preset[0] ? ctx->enc_params.preset : DEFAULT_PRESET, "zerolatency") < 0)
+        {
+            PRINT_ERR("Unknown x264 preset %s\n", ctx->enc_params.preset);
+            return -1;
+        }
+        param.analyse = preset.analyse;
+        param.i_frame_reference = preset.i_frame_reference;
+        param.b_deblocking_filter = preset.b_deblocking_filter;
+        apply_analysis(ctx, &param);
+        if (x264_param_apply_profile(&param, "high") < 0)
+        {
+            return -1;
+        }
+    }
+    if (x264_encoder_reconfig(s->enc, &param) < 0)
+    {
+        PRINT_ERR("x264_encoder_reconfig failed\n");
+        return -1;
+    }
+    return 0;
+}
+
+void x264_stream_close(x264_stream *s)
+{
+    if (s == NULL)
+    {
+        return;
+    }
+    if (s->enc != NULL)
+    {
+        x264_encoder_close(s->enc);
+        x264_picture_clean(&s->pic_in);
+    }
+    sws_freeContext(s->rgb_to_yuv_ctx);
+    if (s->held != NULL)
+    {
+        for (int i = 0; i < s->num_slices; i++)
+        {
+            free(s->held[i].data);
+        }
+        free(s->held);
+    }
+    free(s->quant_offsets);
+    free(s->nal_buf);
+    free(s);
+}
+
+static int x264_initialize(struct ouvr_ctx *ctx)
+{
+    if (ctx->enc_priv != NULL)
+    {
+        free(ctx->enc_priv);
+    }
+    x264_encode_context *e = calloc(1, sizeof(x264_encode_context));
+    ctx->enc_priv = e;
+
+    e->stream = x264_stream_open(ctx, 0, ctx->enc_width, ctx->enc_height, NUM_SLICES, 0, &ctx->send_lock);
+    if (e->stream == NULL)
+    {
+        return -1;
+    }
+    return 0;
+}
+
+static int x264_process_frame(struct ouvr_ctx *ctx, struct ouvr_packet *pkt)
+{
+    x264_encode_context *e = ctx->enc_priv;
+    int force_idr = 0;
+    (void)pkt;
+
+    if (ctx->flag_send_iframe > 0)
+    {
+        force_idr = 1;
+        ctx->flag_send_iframe = ~ctx->flag_send_iframe;
+    }
+    else if (ctx->flag_send_iframe < 0)
+    {
+        ctx->flag_send_iframe++;
+    }
+
+    if (x264_stream_encode(e->stream, force_idr) != 0)
+    {
+        return -1;
+    }
+    return OUVR_FRAME_STREAMED;
+}
+
+static int x264_reconfigure(struct ouvr_ctx *ctx, unsigned int changed)
+{
+    x264_encode_context *e = ctx->enc_priv;
+    return x264_stream_reconfigure(e->stream, changed);
+}
+
+static void x264_deinitialize(struct ouvr_ctx *ctx)
+{
+    x264_encode_context *e = ctx->enc_priv;
+    x264_stream_close(e->stream);
+    free(e);
+    ctx->enc_priv = NULL;
+}
+
+struct ouvr_encoder x264_encode = {
+    .init = x264_initialize,
+    .process_frame = x264_process_frame,
+    .deinit = x264_deinitialize,
+    .reconfigure = x264_reconfigure,
+};
@@ -0,0 +1,55 @@
+/*
+    The MIT License (MIT)
+
+    Copyright (c) 2020 OpenUVR
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+
+    Authors:
+    Alec Rohloff
+    Zackary Allen
+    Kung-Min Lin
+    Chengyi Nie
+    Hung-Wei Tseng
+*/
+
+#ifndef X264_ENCODE_H
+#define X264_ENCODE_H
+
+#include <pthread.h>
+
+#include "ouvr_packet.h"
+
+struct ouvr_encoder x264_encode;
+
+/**
+ * One libx264 encoder streaming its slices to ctx->net. x264_encode uses one for the whole frame,
+ * stereo_encode one per eye. The stream encodes the width x height area of ctx->pix_buf starting at column
+ * x_offset, and every packet it sends carries packet_flags.
+ * Streams of the same ctx send under the same send_lock.
+ */
+typedef struct x264_stream x264_stream;
+x264_stream *x264_stream_open(struct ouvr_ctx *ctx, int x_offset, int width, int height, int num_slices, uint32_t packet_flags, pthread_mutex_t *send_lock);
+// returns 0, or -1 if encoding or sending failed
+int x264_stream_encode(x264_stream *s, int force_idr);
+// applies the members of ctx->enc_params flagged in changed (OUVR_PARAM_*), between two frames
+int x264_stream_reconfigure(x264_stream *s, unsigned int changed);
+void x264_stream_close(x264_stream *s);
+
+#endif